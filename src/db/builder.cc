@@ -56,6 +56,13 @@ void AddFilterString(FileLevelFilterBuilder* file_level_filter_builder, int n,
 #endif
 }
 
+// Flushed tables are no larger than the memtable they are built from
+static FileOptions TableFileOptions(const Options& options) {
+  FileOptions file_options(options);
+  file_options.preallocation_size = options.write_buffer_size;
+  return file_options;
+}
+
 Status BuildLevel0Tables(const std::string& dbname,
                   Env* env,
                   const Options& options,
@@ -77,10 +84,12 @@ Status BuildLevel0Tables(const std::string& dbname,
 	  int tot_parsed = 0;
 
 	  FileMetaData meta;
+	  InternalKeyStats stats;
 	  WritableFile* file;
 	  TableBuilder* builder;
 	  const FilterPolicy* filter_policy = options.filter_policy;
 	  int index = 0;
+	  const FileOptions file_options = TableFileOptions(options);
 
 	  iter->SeekToFirst();
 	  if (iter->Valid()) {
@@ -105,14 +114,16 @@ Status BuildLevel0Tables(const std::string& dbname,
 								mutex_->Unlock();
 						  	}
 							const std::string fname = TableFileName(dbname, meta.number);
-							s = env->NewWritableFile(fname, &file);
+							s = env->NewWritableFile(fname, file_options, &file);
 							if (!s.ok()) {
 								return s;
 							}
 							builder = new TableBuilder(options, file);
 							meta.smallest.DecodeFrom(iter->key());
+							stats.Clear();
 					  }
 					  builder->Add(iter->key(), iter->value());
+					  stats.Add(key);
 #ifdef FILE_LEVEL_FILTER
 					  file_level_filter_builder->AddKey(key);
 #endif
@@ -121,9 +132,12 @@ Status BuildLevel0Tables(const std::string& dbname,
 					  tot_parsed++;
 				  } else {
 					  if (count > 0) {
+						  stats.SaveTo(builder);
+						  meta.num_deletions = stats.num_deletions();
 						  s = builder->Finish();
 						  if (s.ok()) {
 							  meta.file_size = builder->FileSize();
+							  meta.num_entries = builder->NumEntries();
 							  assert(meta.file_size > 0);
 							  meta_list->push_back(meta);
 
@@ -142,9 +156,12 @@ Status BuildLevel0Tables(const std::string& dbname,
 			  }
 		  }
 		  if (count > 0) {
+			  stats.SaveTo(builder);
+			  meta.num_deletions = stats.num_deletions();
 			  s = builder->Finish();
 			  if (s.ok()) {
 				  meta.file_size = builder->FileSize();
+				  meta.num_entries = builder->NumEntries();
 				  assert(meta.file_size > 0);
 				  meta_list->push_back(meta);
 
@@ -172,14 +189,16 @@ Status BuildLevel0Tables(const std::string& dbname,
 				  	}
 
 				  	const std::string fname = TableFileName(dbname, meta.number);
-					s = env->NewWritableFile(fname, &file);
+					s = env->NewWritableFile(fname, file_options, &file);
 					if (!s.ok()) {
 						return s;
 					}
 					builder = new TableBuilder(options, file);
 					meta.smallest.DecodeFrom(iter->key());
+					stats.Clear();
 			  }
 			  builder->Add(iter->key(), iter->value());
+			  stats.Add(iter->key());
 
 #ifdef FILE_LEVEL_FILTER
 			  file_level_filter_builder->AddKey(iter->key());
@@ -189,9 +208,12 @@ Status BuildLevel0Tables(const std::string& dbname,
 			  tot_parsed++;
 		  }
 		  if (count > 0) {
+			  stats.SaveTo(builder);
+			  meta.num_deletions = stats.num_deletions();
 			  s = builder->Finish();
 			  if (s.ok()) {
 				  meta.file_size = builder->FileSize();
+				  meta.num_entries = builder->NumEntries();
 				  assert(meta.file_size > 0);
 				  meta_list->push_back(meta);
 
@@ -225,25 +247,31 @@ Status BuildTable(const std::string& dbname,
 
   std::string fname = TableFileName(dbname, meta->number);
   if (iter->Valid()) {
+    const FileOptions file_options = TableFileOptions(options);
     WritableFile* file;
-    s = env->NewWritableFile(fname, &file);
+    s = env->NewWritableFile(fname, file_options, &file);
     if (!s.ok()) {
       return s;
     }
 
     TableBuilder* builder = new TableBuilder(options, file);
     meta->smallest.DecodeFrom(iter->key());
+    InternalKeyStats stats;
     for (; iter->Valid(); iter->Next()) {
       Slice key = iter->key();
       meta->largest.DecodeFrom(key);
       builder->Add(key, iter->value());
+      stats.Add(key);
     }
 
     // Finish and check for builder errors
     if (s.ok()) {
+      stats.SaveTo(builder);
+      meta->num_deletions = stats.num_deletions();
       s = builder->Finish();
       if (s.ok()) {
         meta->file_size = builder->FileSize();
+        meta->num_entries = builder->NumEntries();
         assert(meta->file_size > 0);
       }
     } else {
@@ -2,12 +2,15 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
 #include <cassert>
 #include <iostream>
 #include <string>
 #include <cstring>
 #include <sstream>
 #include <cstdlib>
+#include <cmath>
+#include <map>
 #include <sys/mman.h>
 #include <sys/time.h>
 #include <sys/time.h>
@@ -15,15 +18,18 @@
 #include <fstream>
 
 #include <sys/types.h>
+#include <errno.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include "db/db_impl.h"
+#include "db/trace.h"
 #include "db/version_set.h"
 #include "pebblesdb/cache.h"
 #include "pebblesdb/db.h"
 #include "pebblesdb/env.h"
 #include "pebblesdb/write_batch.h"
 #include "port/port.h"
+#include "util/atomic.h"
 #include "util/crc32c.h"
 #include "util/histogram.h"
 #include "util/mutexlock.h"
@@ -55,10 +61,25 @@
 //      deleterandom  -- delete N keys in random order
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
+//      parallelscan  -- scan the whole DB with --threads disjoint iterators
 //      readrandom    -- read N times in random order
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
+//      replay        -- re-issue the operations of --trace_file, spread over
+//                       --threads threads, at --replay_speed
+//      ycsbload      -- insert N YCSB records of --field_count fields of
+//                       --field_size bytes
+//      ycsba         -- YCSB A: 50% reads, 50% updates, zipfian keys
+//      ycsbb         -- YCSB B: 95% reads, 5% updates, zipfian keys
+//      ycsbc         -- YCSB C: reads only, zipfian keys
+//      ycsbd         -- YCSB D: 95% reads, 5% inserts, latest keys
+//      ycsbe         -- YCSB E: 95% scans, 5% inserts, zipfian keys
+//      ycsbf         -- YCSB F: 50% reads, 50% read-modify-writes, zipfian
+//                       keys
+//                       (ycsba..ycsbf run --reads operations per thread
+//                       against a database loaded by ycsbload with the
+//                       same --num)
 //      crc32c        -- repeated crc32c of 4K of data
 //      acquireload   -- load N*1000 times
 //   Meta operations:
@@ -116,22 +137,54 @@ static bool FLAGS_histogram = false;
 // (initialized to default value by "main")
 static int FLAGS_write_buffer_size = 0;
 
+// Fraction of the write buffer spent on a memtable bloom filter
+static double FLAGS_memtable_bloom_size_ratio = 0;
+
 // Number of bytes to use as a cache of uncompressed data.
 // Negative means use default settings.
 static int FLAGS_cache_size = -1;
 
+// Number of bytes to use as a row cache of table entries (0 for none)
+static int FLAGS_row_cache_size = 0;
+
+// If set, keep blocks evicted from the block cache in a file-backed
+// secondary cache of --secondary_cache_size bytes in this directory
+static const char* FLAGS_secondary_cache_path = NULL;
+static int FLAGS_secondary_cache_size = 256 << 20;
+
 // Maximum number of files to keep open at the same time (use default if == 0)
 static int FLAGS_open_files = 0;
 
 // Amount of data per block (initialized to default value by "main")
 static int FLAGS_block_size = 0;
 
+// If true, store the KeyNum of each restart point in data and index blocks
+static bool FLAGS_block_key_nums = false;
+
 // Number of next operations to do in a ScanRandom workload
 static int FLAGS_num_next = 1;
 
 // Base key which gets added to the randodm key generated
 static int FLAGS_base_key = 0;
 
+// Bytes per second of input allowed to read-triggered compactions
+// (negative means use default settings)
+static int FLAGS_read_compaction_bytes_per_sec = -1;
+
+// Start writeback of table files and of log files every this many bytes
+// (0 means only when the file is synced)
+static int FLAGS_bytes_per_sync = 0;
+static int FLAGS_wal_bytes_per_sync = 0;
+
+// Number of obsolete log files to keep for reuse
+static int FLAGS_recycle_log_file_num = 0;
+
+// If true, create the next log file in the background before it is needed
+static bool FLAGS_preallocate_next_log = false;
+
+// If true, compress the records written to the log files with snappy
+static bool FLAGS_wal_compression = false;
+
 // Bloom filter bits per key.
 // Negative means use default settings.
 static int FLAGS_bloom_bits = 10;
@@ -144,6 +197,44 @@ static bool FLAGS_use_existing_db = false;
 // Use the db with the following name.
 static const char* FLAGS_db = NULL;
 
+// Trace (see DB::StartTrace) re-issued by the "replay" benchmark
+static const char* FLAGS_trace_file = NULL;
+
+// If set, every benchmark traces its operations to "<trace_out>.<name>"
+static const char* FLAGS_trace_out = NULL;
+
+// Record keys in the traces written for --trace_out
+static bool FLAGS_trace_keys = true;
+
+// Speed of "replay" relative to the trace: 2 issues operations twice as
+// fast as they were recorded, 0 as fast as possible.
+static double FLAGS_replay_speed = 1.0;
+
+// Key distribution of the YCSB workloads, "zipfian", "latest" or
+// "uniform".  If NULL, each workload uses its own.
+static const char* FLAGS_ycsb_distribution = NULL;
+
+// Skew of the zipfian and latest distributions
+static double FLAGS_zipfian_theta = 0.99;
+
+// A YCSB record is --field_count fields of --field_size bytes each
+static int FLAGS_field_count = 10;
+static int FLAGS_field_size = 100;
+
+// YCSB E scans a uniformly chosen 1..--max_scan_length records
+static int FLAGS_max_scan_length = 100;
+
+// If > 0, print a row of time-series statistics (throughput, p99 latency,
+// level sizes, pending compaction, write amplification and stall time)
+// every --stats_interval seconds while a benchmark runs.
+static int FLAGS_stats_interval = 0;
+
+// Format of the --stats_interval rows, "csv" or "json"
+static const char* FLAGS_stats_format = "csv";
+
+// Write the --stats_interval rows to this file instead of stdout
+static const char* FLAGS_stats_file = NULL;
+
 namespace leveldb {
 
 namespace {
@@ -192,6 +283,104 @@ static Slice TrimSpace(Slice s) {
   return Slice(s.data() + start, limit - start);
 }
 
+// The 64-bit FNV-1 hash YCSB uses to scatter record numbers
+static uint64_t FNVHash64(uint64_t v) {
+  uint64_t hash = 0xCBF29CE484222325ull;
+  for (int i = 0; i < 8; i++) {
+    hash ^= v & 0xff;
+    hash *= 1099511628211ull;
+    v >>= 8;
+  }
+  return hash;
+}
+
+// Draws ranks in [0, n) where rank i has probability proportional to
+// 1/(i+1)^theta, using the method of Gray et al., "Quickly Generating
+// Billion-Record Synthetic Databases", as YCSB does.
+class ZipfianGenerator {
+ public:
+  ZipfianGenerator(uint64_t n, double theta)
+      : n_(n),
+        theta_(theta),
+        alpha_(1.0 / (1.0 - theta)),
+        zetan_(Zeta(n, theta)),
+        eta_((1.0 - pow(2.0 / n, 1.0 - theta)) /
+             (1.0 - Zeta(2, theta) / zetan_)) {
+  }
+
+  uint64_t n() const { return n_; }
+
+  uint64_t Next(Random* rand) const {
+    const double u = rand->Next() / 2147483647.0;
+    const double uz = u * zetan_;
+    if (n_ < 2 || uz < 1.0) {
+      return 0;
+    }
+    if (uz < 1.0 + pow(0.5, theta_)) {
+      return 1;
+    }
+    uint64_t r = static_cast<uint64_t>(n_ * pow(eta_ * u - eta_ + 1.0, alpha_));
+    return std::min(r, n_ - 1);
+  }
+
+ private:
+  static double Zeta(uint64_t n, double theta) {
+    double sum = 0;
+    for (uint64_t i = 0; i < n; i++) {
+      sum += 1.0 / pow(static_cast<double>(i + 1), theta);
+    }
+    return sum;
+  }
+
+  const uint64_t n_;
+  const double theta_;
+  const double alpha_;
+  const double zetan_;
+  const double eta_;
+};
+
+// Operation mix of a YCSB core workload; the fractions add up to 1.
+struct YCSBWorkload {
+  const char* name;
+  double read;
+  double update;
+  double insert;
+  double scan;
+  double read_modify_write;
+  const char* distribution;
+};
+
+static const YCSBWorkload kYCSBWorkloads[] = {
+  {"ycsba", 0.50, 0.50, 0.00, 0.00, 0.00, "zipfian"},
+  {"ycsbb", 0.95, 0.05, 0.00, 0.00, 0.00, "zipfian"},
+  {"ycsbc", 1.00, 0.00, 0.00, 0.00, 0.00, "zipfian"},
+  {"ycsbd", 0.95, 0.00, 0.05, 0.00, 0.00, "latest"},
+  {"ycsbe", 0.00, 0.00, 0.05, 0.95, 0.00, "zipfian"},
+  {"ycsbf", 0.50, 0.00, 0.00, 0.00, 0.50, "zipfian"},
+};
+
+static const YCSBWorkload* FindYCSBWorkload(const Slice& name) {
+  for (size_t i = 0; i < sizeof(kYCSBWorkloads) / sizeof(kYCSBWorkloads[0]);
+       i++) {
+    if (name == Slice(kYCSBWorkloads[i].name)) {
+      return &kYCSBWorkloads[i];
+    }
+  }
+  return NULL;
+}
+
+// Latencies of one benchmark thread, by operation type
+typedef std::map<std::string, Histogram> OpLatencies;
+
+static Histogram* OpHistogram(OpLatencies* latencies, const char* op) {
+  OpLatencies::iterator it = latencies->find(op);
+  if (it == latencies->end()) {
+    it = latencies->insert(std::make_pair(std::string(op), Histogram())).first;
+    it->second.Clear();
+  }
+  return &it->second;
+}
+
 static void AppendWithSpace(std::string* str, Slice msg) {
   if (msg.empty()) return;
   if (!str->empty()) {
@@ -212,6 +401,12 @@ class Stats {
   Histogram hist_;
   std::string message_;
 
+  // Ops and latencies since the last TakeInterval() for --stats_interval.
+  // Unlike the fields above, these are also read by the reporting thread.
+  port::Mutex interval_mu_;
+  int64_t interval_done_;
+  Histogram interval_hist_;
+
  public:
   Stats() 
     : start_(),
@@ -222,20 +417,26 @@ class Stats {
       bytes_(),
       last_op_finish_(),
       hist_(),
-      message_() {
+      message_(),
+      interval_mu_(),
+      interval_done_(),
+      interval_hist_() {
     Start();
   }
 
   void Start() {
     next_report_ = 100;
-    last_op_finish_ = start_;
     hist_.Clear();
     done_ = 0;
     bytes_ = 0;
     seconds_ = 0;
     start_ = Env::Default()->NowMicros();
     finish_ = start_;
+    last_op_finish_ = start_;
     message_.clear();
+    MutexLock l(&interval_mu_);
+    interval_done_ = 0;
+    interval_hist_.Clear();
   }
 
   void Merge(const Stats& other) {
@@ -260,13 +461,20 @@ class Stats {
   }
 
   void FinishedSingleOp() {
-    if (FLAGS_histogram) {
+    if (FLAGS_histogram || FLAGS_stats_interval > 0) {
       double now = Env::Default()->NowMicros();
       double micros = now - last_op_finish_;
-      hist_.Add(micros);
-      if (micros > 20000) {
-        fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
-        fflush(stderr);
+      if (FLAGS_histogram) {
+        hist_.Add(micros);
+        if (micros > 20000) {
+          fprintf(stderr, "long op: %.1f micros%30s\r", micros, "");
+          fflush(stderr);
+        }
+      }
+      if (FLAGS_stats_interval > 0) {
+        MutexLock l(&interval_mu_);
+        interval_done_++;
+        interval_hist_.Add(micros);
       }
       last_op_finish_ = now;
     }
@@ -289,6 +497,16 @@ class Stats {
     bytes_ += n;
   }
 
+  // Add the ops and latencies recorded since the previous call to *done
+  // and *hist.
+  void TakeInterval(Histogram* hist, int64_t* done) {
+    MutexLock l(&interval_mu_);
+    hist->Merge(interval_hist_);
+    *done += interval_done_;
+    interval_hist_.Clear();
+    interval_done_ = 0;
+  }
+
   void Report(const Slice& name) {
     // Pretend at least one op was done in case we are running a benchmark
     // that does not call FinishedSingleOp().
@@ -370,6 +588,7 @@ class Benchmark {
   Benchmark(const Benchmark&);
   Benchmark& operator = (const Benchmark&);
   Cache* cache_;
+  SecondaryCache* secondary_cache_;
   const FilterPolicy* filter_policy_;
   DB* db_;
   int num_;
@@ -378,6 +597,21 @@ class Benchmark {
   WriteOptions write_options_;
   int reads_;
   int heap_counter_;
+  std::vector<Iterator*> parallel_iters_;
+
+  // Per operation type latencies of the running benchmark, merged from
+  // all threads
+  port::Mutex op_mu_;
+  OpLatencies op_latencies_;
+
+  // State of the YCSB benchmarks
+  const YCSBWorkload* ycsb_workload_;
+  ZipfianGenerator* zipfian_;
+  volatile uint64_t ycsb_records_;
+
+  // Destination of the --stats_interval rows
+  FILE* stats_out_;
+  bool stats_header_printed_;
 
   DBImpl* dbfull() {
     return reinterpret_cast<DBImpl*>(db_);
@@ -460,6 +694,7 @@ class Benchmark {
  public:
   Benchmark()
   : cache_(FLAGS_cache_size >= 0 ? NewLRUCache(FLAGS_cache_size) : NULL),
+    secondary_cache_(NULL),
     filter_policy_(FLAGS_bloom_bits >= 0
                    ? NewBloomFilterPolicy(FLAGS_bloom_bits)
                    : NULL),
@@ -469,7 +704,33 @@ class Benchmark {
     entries_per_batch_(1),
     write_options_(),
     reads_(FLAGS_reads < 0 ? FLAGS_num : FLAGS_reads),
-    heap_counter_(0) {
+    heap_counter_(0),
+    parallel_iters_(),
+    op_mu_(),
+    op_latencies_(),
+    ycsb_workload_(NULL),
+    zipfian_(NULL),
+    ycsb_records_(0),
+    stats_out_(stdout),
+    stats_header_printed_(false) {
+    if (FLAGS_stats_file != NULL) {
+      stats_out_ = fopen(FLAGS_stats_file, "w");
+      if (stats_out_ == NULL) {
+        fprintf(stderr, "Cannot open %s: %s\n", FLAGS_stats_file,
+                strerror(errno));
+        exit(1);
+      }
+    }
+    if (FLAGS_secondary_cache_path != NULL) {
+      Status s = NewFileSecondaryCache(Env::Default(),
+                                       FLAGS_secondary_cache_path,
+                                       FLAGS_secondary_cache_size,
+                                       &secondary_cache_);
+      if (!s.ok()) {
+        fprintf(stderr, "secondary cache error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+    }
     std::vector<std::string> files;
     Env::Default()->GetChildren(FLAGS_db, &files);
     for (size_t i = 0; i < files.size(); i++) {
@@ -483,8 +744,13 @@ class Benchmark {
   }
 
   ~Benchmark() {
+    if (stats_out_ != stdout) {
+      fclose(stats_out_);
+    }
+    delete zipfian_;
     delete db_;
     delete cache_;
+    delete secondary_cache_;
     delete filter_policy_;
   }
 
@@ -890,6 +1156,35 @@ class Benchmark {
         method = &Benchmark::ReadSequential;
       } else if (name == Slice("readreverse")) {
         method = &Benchmark::ReadReverse;
+      } else if (name == Slice("parallelscan")) {
+        Status s = db_->NewParallelIterators(ReadOptions(), num_threads,
+                                             &parallel_iters_);
+        if (!s.ok()) {
+          fprintf(stderr, "parallelscan error: %s\n", s.ToString().c_str());
+          exit(1);
+        }
+        num_threads = parallel_iters_.size();
+        method = &Benchmark::ParallelScan;
+      } else if (name == Slice("ycsbload")) {
+        fresh_db = true;
+        ycsb_records_ = num_;
+        method = &Benchmark::YCSBLoad;
+      } else if (FindYCSBWorkload(name) != NULL) {
+        ycsb_workload_ = FindYCSBWorkload(name);
+        if (ycsb_records_ < static_cast<uint64_t>(num_)) {
+          ycsb_records_ = num_;  // Loaded by an earlier run
+        }
+        if (zipfian_ == NULL || zipfian_->n() != ycsb_records_) {
+          delete zipfian_;
+          zipfian_ = new ZipfianGenerator(ycsb_records_, FLAGS_zipfian_theta);
+        }
+        method = &Benchmark::YCSBRun;
+      } else if (name == Slice("replay")) {
+        if (FLAGS_trace_file == NULL) {
+          fprintf(stderr, "replay needs --trace_file\n");
+          exit(1);
+        }
+        method = &Benchmark::Replay;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
       } else if (name == Slice("readmissing")) {
@@ -971,8 +1266,26 @@ class Benchmark {
       }
 
       if (method != NULL) {
+        if (FLAGS_trace_out != NULL) {
+          std::string fname = std::string(FLAGS_trace_out) + "." +
+                              name.ToString();
+          Status s = db_->StartTrace(fname, FLAGS_trace_keys);
+          if (!s.ok()) {
+            fprintf(stderr, "trace error: %s\n", s.ToString().c_str());
+            exit(1);
+          }
+        }
+        const uint64_t start = Env::Default()->NowMicros();
         RunBenchmark(num_threads, name, method);
+        PrintOpLatencies((Env::Default()->NowMicros() - start) * 1e-6);
+        if (FLAGS_trace_out != NULL) {
+          db_->EndTrace();
+        }
+      }
+      for (size_t i = 0; i < parallel_iters_.size(); i++) {
+        delete parallel_iters_[i];
       }
+      parallel_iters_.clear();
     }
     db_->PrintTimerAudit();
   }
@@ -1076,6 +1389,13 @@ class Benchmark {
     shared.num_done = 0;
     shared.start = false;
 
+    const uint64_t secondary_hits =
+        secondary_cache_ != NULL ? secondary_cache_->Hits() : 0;
+    const uint64_t secondary_misses =
+        secondary_cache_ != NULL ? secondary_cache_->Misses() : 0;
+    const int64_t user_bytes = IntProperty("user-bytes-written");
+    const int64_t wal_bytes = IntProperty("wal-bytes-written");
+
     ThreadArg* arg = new ThreadArg[n];
     for (int i = 0; i < n; i++) {
       arg[i].bm = this;
@@ -1093,6 +1413,11 @@ class Benchmark {
 
     shared.start = true;
     shared.cv.SignalAll();
+    if (FLAGS_stats_interval > 0) {
+      shared.mu.Unlock();
+      ReportIntervals(name, arg, n, &shared);
+      shared.mu.Lock();
+    }
     while (shared.num_done < n) {
       shared.cv.Wait();
     }
@@ -1101,6 +1426,26 @@ class Benchmark {
     for (int i = 1; i < n; i++) {
       arg[0].thread->stats.Merge(arg[i].thread->stats);
     }
+    if (secondary_cache_ != NULL) {
+      const uint64_t hits = secondary_cache_->Hits() - secondary_hits;
+      const uint64_t misses = secondary_cache_->Misses() - secondary_misses;
+      char msg[100];
+      snprintf(msg, sizeof(msg), "(secondary cache %.1f%% of %llu)",
+               hits + misses > 0 ? 100.0 * hits / (hits + misses) : 0.0,
+               static_cast<unsigned long long>(hits + misses));
+      arg[0].thread->stats.AddMessage(msg);
+    }
+    const int64_t wal_written = IntProperty("wal-bytes-written") - wal_bytes;
+    if (wal_written > 0) {
+      const int64_t user_written =
+          IntProperty("user-bytes-written") - user_bytes;
+      char msg[100];
+      snprintf(msg, sizeof(msg), "(wal %.1f MB, %.2fx of batches)",
+               wal_written / 1048576.0,
+               user_written > 0 ?
+                   static_cast<double>(wal_written) / user_written : 0.0);
+      arg[0].thread->stats.AddMessage(msg);
+    }
     arg[0].thread->stats.Report(name);
 
     for (int i = 0; i < n; i++) {
@@ -1109,6 +1454,138 @@ class Benchmark {
     delete[] arg;
   }
 
+  // Emit a --stats_interval row every interval until all n threads of
+  // "shared" are done, and a final row for the remainder.
+  void ReportIntervals(const Slice& name, ThreadArg* arg, int n,
+                       SharedState* shared) {
+    Env* env = Env::Default();
+    const uint64_t interval = FLAGS_stats_interval * 1000000ull;
+    const uint64_t start = env->NowMicros();
+    uint64_t last = start;
+    bool done = false;
+    while (!done) {
+      uint64_t now = env->NowMicros();
+      if (now < last + interval) {
+        // Sleep in short steps so that the final row is not delayed
+        env->SleepForMicroseconds(std::min<uint64_t>(last + interval - now,
+                                                     100000));
+      }
+      {
+        MutexLock l(&shared->mu);
+        done = shared->num_done >= n;
+      }
+      now = env->NowMicros();
+      if (done || now >= last + interval) {
+        EmitIntervalRow(name, arg, n, (now - start) * 1e-6,
+                        (now - last) * 1e-6);
+        last = now;
+      }
+    }
+  }
+
+  int64_t IntProperty(const std::string& property) {
+    std::string value;
+    if (db_ == NULL || !db_->GetProperty("leveldb." + property, &value)) {
+      return 0;
+    }
+    return strtoll(value.c_str(), NULL, 10);
+  }
+
+  // Print the throughput and latency of the last "seconds" of the n
+  // threads, together with the current shape of the DB.  The write
+  // amplification is the bytes written by flushes and compactions (not
+  // counting the log) over the bytes written by the user since the DB was
+  // opened.
+  void EmitIntervalRow(const Slice& name, ThreadArg* arg, int n,
+                       double elapsed, double seconds) {
+    Histogram hist;
+    hist.Clear();
+    int64_t done = 0;
+    for (int i = 0; i < n; i++) {
+      arg[i].thread->stats.TakeInterval(&hist, &done);
+    }
+    const double ops_per_sec = seconds > 0 ? done / seconds : 0;
+    const double p99 = hist.Count() > 0 ? hist.Percentile(99) : 0;
+    int64_t level_bytes[config::kNumLevels];
+    int64_t level_guards[config::kNumLevels];
+    char buf[100];
+    for (unsigned level = 0; level < config::kNumLevels; level++) {
+      snprintf(buf, sizeof(buf), "num-bytes-at-level%u", level);
+      level_bytes[level] = IntProperty(buf);
+      snprintf(buf, sizeof(buf), "num-guards-at-level%u", level);
+      level_guards[level] = IntProperty(buf);
+    }
+    const int64_t l0_files = IntProperty("num-files-at-level0");
+    const int64_t pending = IntProperty("pending-compaction-bytes");
+    const int64_t user_bytes = IntProperty("user-bytes-written");
+    const double write_amp = user_bytes > 0 ?
+        static_cast<double>(IntProperty("compaction-bytes-written")) /
+        user_bytes : 0;
+    const double stall_seconds = IntProperty("write-stall-micros") * 1e-6;
+
+    std::string row;
+    if (strcmp(FLAGS_stats_format, "json") == 0) {
+      snprintf(buf, sizeof(buf), "{\"benchmark\":\"%s\",\"seconds\":%.3f,",
+               name.ToString().c_str(), elapsed);
+      row = buf;
+      snprintf(buf, sizeof(buf),
+               "\"ops_per_sec\":%.1f,\"p99_micros\":%.1f,\"l0_files\":%lld,",
+               ops_per_sec, p99, static_cast<long long>(l0_files));
+      row += buf;
+      row += "\"level_bytes\":[";
+      for (unsigned level = 0; level < config::kNumLevels; level++) {
+        snprintf(buf, sizeof(buf), "%s%lld", level > 0 ? "," : "",
+                 static_cast<long long>(level_bytes[level]));
+        row += buf;
+      }
+      row += "],\"level_guards\":[";
+      for (unsigned level = 0; level < config::kNumLevels; level++) {
+        snprintf(buf, sizeof(buf), "%s%lld", level > 0 ? "," : "",
+                 static_cast<long long>(level_guards[level]));
+        row += buf;
+      }
+      snprintf(buf, sizeof(buf),
+               "],\"pending_compaction_bytes\":%lld,\"write_amp\":%.3f,"
+               "\"stall_seconds\":%.3f}",
+               static_cast<long long>(pending), write_amp, stall_seconds);
+      row += buf;
+    } else {
+      if (!stats_header_printed_) {
+        std::string header = "benchmark,seconds,ops_per_sec,p99_micros,l0_files";
+        for (unsigned level = 0; level < config::kNumLevels; level++) {
+          snprintf(buf, sizeof(buf), ",l%u_bytes", level);
+          header += buf;
+        }
+        for (unsigned level = 0; level < config::kNumLevels; level++) {
+          snprintf(buf, sizeof(buf), ",l%u_guards", level);
+          header += buf;
+        }
+        header += ",pending_compaction_bytes,write_amp,stall_seconds";
+        fprintf(stats_out_, "%s\n", header.c_str());
+        stats_header_printed_ = true;
+      }
+      snprintf(buf, sizeof(buf), "%s,%.3f,%.1f,%.1f,%lld",
+               name.ToString().c_str(), elapsed, ops_per_sec, p99,
+               static_cast<long long>(l0_files));
+      row = buf;
+      for (unsigned level = 0; level < config::kNumLevels; level++) {
+        snprintf(buf, sizeof(buf), ",%lld",
+                 static_cast<long long>(level_bytes[level]));
+        row += buf;
+      }
+      for (unsigned level = 0; level < config::kNumLevels; level++) {
+        snprintf(buf, sizeof(buf), ",%lld",
+                 static_cast<long long>(level_guards[level]));
+        row += buf;
+      }
+      snprintf(buf, sizeof(buf), ",%lld,%.3f,%.3f",
+               static_cast<long long>(pending), write_amp, stall_seconds);
+      row += buf;
+    }
+    fprintf(stats_out_, "%s\n", row.c_str());
+    fflush(stats_out_);
+  }
+
   void Crc32c(ThreadState* thread) {
     // Checksum about 500MB of data total
     const int size = 4096;
@@ -1196,10 +1673,24 @@ class Benchmark {
     Options options;
     options.create_if_missing = !FLAGS_use_existing_db;
     options.block_cache = cache_;
+    options.secondary_cache = secondary_cache_;
+    options.row_cache_size = FLAGS_row_cache_size;
     options.write_buffer_size = FLAGS_write_buffer_size;
+    options.memtable_bloom_size_ratio = FLAGS_memtable_bloom_size_ratio;
     options.max_open_files = FLAGS_open_files;
     options.block_size = FLAGS_block_size;
+    options.block_key_nums = FLAGS_block_key_nums;
     options.filter_policy = filter_policy_;
+    if (FLAGS_read_compaction_bytes_per_sec >= 0) {
+      options.read_compaction_bytes_per_sec =
+          FLAGS_read_compaction_bytes_per_sec;
+    }
+    options.bytes_per_sync = FLAGS_bytes_per_sync;
+    options.wal_bytes_per_sync = FLAGS_wal_bytes_per_sync;
+    options.recycle_log_file_num = FLAGS_recycle_log_file_num;
+    options.preallocate_next_log = FLAGS_preallocate_next_log;
+    options.wal_compression =
+        FLAGS_wal_compression ? kSnappyCompression : kNoCompression;
     Status s = DB::Open(options, FLAGS_db, &db_);
     if (!s.ok()) {
       fprintf(stderr, "open error: %s\n", s.ToString().c_str());
@@ -1325,6 +1816,269 @@ class Benchmark {
     thread->stats.AddBytes(bytes);
   }
 
+  // Each thread scans the partition handed out for its tid.
+  void ParallelScan(ThreadState* thread) {
+    Iterator* iter = parallel_iters_[thread->tid];
+    int64_t bytes = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      bytes += iter->key().size() + iter->value().size();
+      thread->stats.FinishedSingleOp();
+    }
+    if (!iter->status().ok()) {
+      fprintf(stderr, "parallelscan error: %s\n",
+              iter->status().ToString().c_str());
+    }
+    thread->stats.AddBytes(bytes);
+    char msg[100];
+    snprintf(msg, sizeof(msg), "(%d partitions)",
+             static_cast<int>(parallel_iters_.size()));
+    thread->stats.AddMessage(msg);
+  }
+
+  // The key to re-issue for "op": the traced key if the trace has keys,
+  // otherwise a random key of the traced size.
+  std::string ReplayKey(const TraceReader* reader, const TraceOp& op,
+                        Random* rand) {
+    if (reader->has_keys()) {
+      return op.key;
+    }
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%016d", rand->Next() % FLAGS_num);
+    std::string key(buf);
+    if (key.size() < op.key_size) {
+      key.insert(0, op.key_size - key.size(), '0');
+    } else {
+      key.erase(0, key.size() - op.key_size);
+    }
+    return key;
+  }
+
+  void Replay(ThreadState* thread) {
+    Env* env = Env::Default();
+    TraceReader* reader = NULL;
+    Status s = TraceReader::Open(env, FLAGS_trace_file, &reader);
+    if (!s.ok()) {
+      fprintf(stderr, "replay error: %s\n", s.ToString().c_str());
+      exit(1);
+    }
+    static const char* op_names[] = {NULL, "get", "write", "seek"};
+    RandomGenerator gen;
+    OpLatencies latencies;
+    ReadOptions options;
+    std::string value;
+    std::string large_value;
+    int64_t bytes = 0;
+    TraceRecord r;
+    const uint64_t start = env->NowMicros();
+    // Every thread reads the whole trace and issues its share of records,
+    // each at its traced time.
+    for (uint64_t i = 0; reader->Read(&r); i++) {
+      if (i % thread->shared->total != static_cast<uint64_t>(thread->tid)) {
+        continue;
+      }
+      if (FLAGS_replay_speed > 0) {
+        uint64_t due = start + static_cast<uint64_t>(r.micros /
+                                                     FLAGS_replay_speed);
+        uint64_t now = env->NowMicros();
+        if (due > now) {
+          env->SleepForMicroseconds(static_cast<int>(due - now));
+        }
+      }
+      const uint64_t op_start = env->NowMicros();
+      if (r.type == kTraceWrite) {
+        WriteBatch batch;
+        for (size_t j = 0; j < r.ops.size(); j++) {
+          std::string key = ReplayKey(reader, r.ops[j], &thread->rand);
+          if (r.ops[j].type == kTypeDeletion) {
+            batch.Delete(key);
+          } else if (r.ops[j].value_size < 1048576) {
+            batch.Put(key, gen.Generate(r.ops[j].value_size));
+          } else {
+            large_value.assign(r.ops[j].value_size, 'v');
+            batch.Put(key, large_value);
+          }
+          bytes += key.size() + r.ops[j].value_size;
+        }
+        s = db_->Write(write_options_, &batch);
+      } else if (r.type == kTraceGet) {
+        std::string key = ReplayKey(reader, r.ops[0], &thread->rand);
+        s = db_->Get(options, key, &value);
+        if (s.IsNotFound()) {
+          s = Status::OK();
+        } else {
+          bytes += key.size() + value.size();
+        }
+      } else {
+        std::string key = ReplayKey(reader, r.ops[0], &thread->rand);
+        Iterator* iter = db_->NewIterator(options);
+        iter->Seek(key);
+        if (iter->Valid()) {
+          bytes += iter->key().size() + iter->value().size();
+        }
+        s = iter->status();
+        delete iter;
+      }
+      if (!s.ok()) {
+        fprintf(stderr, "replay error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      OpHistogram(&latencies, op_names[r.type])->Add(env->NowMicros() -
+                                                    op_start);
+      thread->stats.FinishedSingleOp();
+    }
+    if (!reader->status().ok()) {
+      fprintf(stderr, "replay error: %s\n",
+              reader->status().ToString().c_str());
+      exit(1);
+    }
+    delete reader;
+    thread->stats.AddBytes(bytes);
+    MergeOpLatencies(latencies);
+  }
+
+  void MergeOpLatencies(const OpLatencies& latencies) {
+    MutexLock l(&op_mu_);
+    for (OpLatencies::const_iterator it = latencies.begin();
+         it != latencies.end(); ++it) {
+      OpHistogram(&op_latencies_, it->first.c_str())->Merge(it->second);
+    }
+  }
+
+  // Report, and then forget, the latencies merged by MergeOpLatencies
+  // during a benchmark that ran for "seconds".
+  void PrintOpLatencies(double seconds) {
+    MutexLock l(&op_mu_);
+    for (OpLatencies::const_iterator it = op_latencies_.begin();
+         it != op_latencies_.end(); ++it) {
+      const Histogram& h = it->second;
+      fprintf(stdout, "%-12s : %11.1f ops/sec; p50 %9.1f p99 %9.1f "
+              "p99.9 %9.1f micros (%.0f ops)\n",
+              it->first.c_str(), h.Count() / seconds, h.Percentile(50),
+              h.Percentile(99), h.Percentile(99.9), h.Count());
+      if (FLAGS_histogram) {
+        fprintf(stdout, "Microseconds per %s:\n%s\n", it->first.c_str(),
+                h.ToString().c_str());
+      }
+    }
+    op_latencies_.clear();
+    fflush(stdout);
+  }
+
+  static std::string YCSBKey(uint64_t record) {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "user%020llu",
+             static_cast<unsigned long long>(FNVHash64(record)));
+    return buf;
+  }
+
+  // A record number in [0, records) drawn from "distribution".
+  uint64_t NextYCSBRecord(const char* distribution, uint64_t records,
+                          Random* rand) {
+    if (strcmp(distribution, "uniform") == 0) {
+      return rand->Next() % records;
+    }
+    uint64_t rank = zipfian_->Next(rand);
+    if (strcmp(distribution, "latest") == 0) {
+      // The most recent inserts are the most popular
+      return records - 1 - std::min(rank, records - 1);
+    }
+    // Scatter the popular records over the key space
+    return FNVHash64(rank) % records;
+  }
+
+  void YCSBLoad(ThreadState* thread) {
+    Env* env = Env::Default();
+    RandomGenerator gen;
+    OpLatencies latencies;
+    const int record_size = FLAGS_field_count * FLAGS_field_size;
+    int64_t bytes = 0;
+    for (int i = thread->tid; i < num_; i += thread->shared->total) {
+      const std::string key = YCSBKey(i);
+      const uint64_t start = env->NowMicros();
+      Status s = db_->Put(write_options_, key, gen.Generate(record_size));
+      if (!s.ok()) {
+        fprintf(stderr, "put error: %s\n", s.ToString().c_str());
+        exit(1);
+      }
+      OpHistogram(&latencies, "insert")->Add(env->NowMicros() - start);
+      bytes += key.size() + record_size;
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    MergeOpLatencies(latencies);
+  }
+
+  void YCSBRun(ThreadState* thread) {
+    const YCSBWorkload& w = *ycsb_workload_;
+    const char* distribution = FLAGS_ycsb_distribution != NULL ?
+                               FLAGS_ycsb_distribution : w.distribution;
+    Env* env = Env::Default();
+    RandomGenerator gen;
+    OpLatencies latencies;
+    ReadOptions options;
+    std::string value;
+    const int record_size = FLAGS_field_count * FLAGS_field_size;
+    int64_t bytes = 0;
+    for (int i = 0; i < reads_; i++) {
+      double p = thread->rand.Next() / 2147483647.0;
+      const uint64_t records = atomic::load_64_acquire(&ycsb_records_);
+      const uint64_t start = env->NowMicros();
+      const char* op;
+      Status s;
+      if ((p -= w.read) < 0) {
+        op = "read";
+        std::string key = YCSBKey(NextYCSBRecord(distribution, records,
+                                                 &thread->rand));
+        s = db_->Get(options, key, &value);
+        bytes += key.size() + value.size();
+      } else if ((p -= w.update) < 0) {
+        // There are no partial updates, so the whole record is rewritten
+        op = "update";
+        std::string key = YCSBKey(NextYCSBRecord(distribution, records,
+                                                 &thread->rand));
+        s = db_->Put(write_options_, key, gen.Generate(record_size));
+        bytes += key.size() + record_size;
+      } else if ((p -= w.insert) < 0) {
+        op = "insert";
+        uint64_t record = atomic::increment_64_fullbarrier(&ycsb_records_, 1) - 1;
+        std::string key = YCSBKey(record);
+        s = db_->Put(write_options_, key, gen.Generate(record_size));
+        bytes += key.size() + record_size;
+      } else if ((p -= w.scan) < 0) {
+        op = "scan";
+        std::string key = YCSBKey(NextYCSBRecord(distribution, records,
+                                                 &thread->rand));
+        int length = 1 + thread->rand.Next() % FLAGS_max_scan_length;
+        Iterator* iter = db_->NewIterator(options);
+        iter->Seek(key);
+        for (int j = 0; j < length && iter->Valid(); j++) {
+          bytes += iter->key().size() + iter->value().size();
+          iter->Next();
+        }
+        s = iter->status();
+        delete iter;
+      } else {
+        op = "readmodifywrite";
+        std::string key = YCSBKey(NextYCSBRecord(distribution, records,
+                                                 &thread->rand));
+        s = db_->Get(options, key, &value);
+        if (s.ok() || s.IsNotFound()) {
+          s = db_->Put(write_options_, key, gen.Generate(record_size));
+        }
+        bytes += key.size() + value.size() + record_size;
+      }
+      // Records inserted by other threads may not be written yet
+      if (!s.ok() && !s.IsNotFound()) {
+        fprintf(stderr, "%s error: %s\n", op, s.ToString().c_str());
+        exit(1);
+      }
+      OpHistogram(&latencies, op)->Add(env->NowMicros() - start);
+      thread->stats.FinishedSingleOp();
+    }
+    thread->stats.AddBytes(bytes);
+    MergeOpLatencies(latencies);
+  }
+
   void ReadRandom(ThreadState* thread) {
 	uint64_t a, b, start, end;
     ReadOptions options;
@@ -1621,10 +2375,35 @@ int main(int argc, char** argv) {
       FLAGS_value_size = n;
     } else if (sscanf(argv[i], "--write_buffer_size=%d%c", &n, &junk) == 1) {
       FLAGS_write_buffer_size = n;
+    } else if (sscanf(argv[i], "--memtable_bloom_size_ratio=%lf%c",
+                      &d, &junk) == 1) {
+      FLAGS_memtable_bloom_size_ratio = d;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
       FLAGS_cache_size = n;
+    } else if (sscanf(argv[i], "--row_cache_size=%d%c", &n, &junk) == 1) {
+      FLAGS_row_cache_size = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
+    } else if (sscanf(argv[i], "--block_key_nums=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_block_key_nums = n;
+    } else if (sscanf(argv[i], "--read_compaction_bytes_per_sec=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_read_compaction_bytes_per_sec = n;
+    } else if (sscanf(argv[i], "--bytes_per_sync=%d%c", &n, &junk) == 1) {
+      FLAGS_bytes_per_sync = n;
+    } else if (sscanf(argv[i], "--wal_bytes_per_sync=%d%c", &n, &junk) == 1) {
+      FLAGS_wal_bytes_per_sync = n;
+    } else if (sscanf(argv[i], "--recycle_log_file_num=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_recycle_log_file_num = n;
+    } else if (sscanf(argv[i], "--preallocate_next_log=%d%c",
+                      &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_preallocate_next_log = n;
+    } else if (sscanf(argv[i], "--wal_compression=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_wal_compression = n;
     } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
       FLAGS_bloom_bits = n;
     } else if (sscanf(argv[i], "--open_files=%d%c", &n, &junk) == 1) {
@@ -1633,8 +2412,54 @@ int main(int argc, char** argv) {
       FLAGS_num_next = n;
     } else if (sscanf(argv[i], "--base_key=%d%c", &n, &junk) == 1) {
       FLAGS_base_key = n;
+    } else if (strncmp(argv[i], "--secondary_cache_path=", 23) == 0) {
+      FLAGS_secondary_cache_path = argv[i] + 23;
+    } else if (sscanf(argv[i], "--secondary_cache_size=%d%c",
+                      &n, &junk) == 1) {
+      FLAGS_secondary_cache_size = n;
     } else if (strncmp(argv[i], "--db=", 5) == 0) {
       FLAGS_db = argv[i] + 5;
+    } else if (strncmp(argv[i], "--trace_file=", 13) == 0) {
+      FLAGS_trace_file = argv[i] + 13;
+    } else if (strncmp(argv[i], "--trace_out=", 12) == 0) {
+      FLAGS_trace_out = argv[i] + 12;
+    } else if (sscanf(argv[i], "--trace_keys=%d%c", &n, &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_trace_keys = n;
+    } else if (sscanf(argv[i], "--replay_speed=%lf%c", &d, &junk) == 1) {
+      FLAGS_replay_speed = d;
+    } else if (strncmp(argv[i], "--ycsb_distribution=", 20) == 0) {
+      FLAGS_ycsb_distribution = argv[i] + 20;
+      if (strcmp(FLAGS_ycsb_distribution, "zipfian") != 0 &&
+          strcmp(FLAGS_ycsb_distribution, "latest") != 0 &&
+          strcmp(FLAGS_ycsb_distribution, "uniform") != 0) {
+        fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+        exit(1);
+      }
+    } else if (sscanf(argv[i], "--zipfian_theta=%lf%c", &d, &junk) == 1 &&
+               d > 0 && d < 1) {
+      FLAGS_zipfian_theta = d;
+    } else if (sscanf(argv[i], "--field_count=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_field_count = n;
+    } else if (sscanf(argv[i], "--field_size=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_field_size = n;
+    } else if (sscanf(argv[i], "--max_scan_length=%d%c", &n, &junk) == 1 &&
+               n > 0) {
+      FLAGS_max_scan_length = n;
+    } else if (sscanf(argv[i], "--stats_interval=%d%c", &n, &junk) == 1 &&
+               n >= 0) {
+      FLAGS_stats_interval = n;
+    } else if (strncmp(argv[i], "--stats_format=", 15) == 0) {
+      FLAGS_stats_format = argv[i] + 15;
+      if (strcmp(FLAGS_stats_format, "csv") != 0 &&
+          strcmp(FLAGS_stats_format, "json") != 0) {
+        fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+        exit(1);
+      }
+    } else if (strncmp(argv[i], "--stats_file=", 13) == 0) {
+      FLAGS_stats_file = argv[i] + 13;
     } else {
       fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
       exit(1);
@@ -21,6 +21,7 @@
 #include "db/memtable.h"
 #include "db/replay_iterator.h"
 #include "db/table_cache.h"
+#include "db/trace.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "pebblesdb/db.h"
@@ -33,6 +34,7 @@
 #include "table/block.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
+#include "util/atomic.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -120,12 +122,22 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Sequence numbers of all live snapshots, in increasing order.  Two
+  // versions of a key that no snapshot separates are visible to exactly
+  // the same readers, so only the newer of them needs to be kept.
+  std::vector<SequenceNumber> snapshots;
+
   // Files produced by compaction
   struct Output {
-    Output() : number(), file_size(), smallest(), largest() {}
+    Output() : number(), file_size(), smallest(), largest(), fully_compacted(true),
+               num_entries(), stats() {}
     uint64_t number;
     uint64_t file_size;
     InternalKey smallest, largest;
+    // No deletion markers and no second entry for any user key were written
+    bool fully_compacted;
+    uint64_t num_entries;
+    InternalKeyStats stats;
   };
   std::vector<Output> outputs;
 
@@ -140,6 +152,7 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(),
+        snapshots(),
         outputs(),
         outfile(NULL),
         builder(NULL),
@@ -166,6 +179,7 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.max_open_files,    64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64<<10,                      1<<30);
   ClipToRange(&result.block_size,        1<<10,                       4<<20);
+  ClipToRange(&result.memtable_bloom_size_ratio, 0.0,                 0.25);
   if (result.info_log == NULL) {
     // Open a log file in the same directory as the db
     src.env->CreateDir(dbname);  // In case it does not exist
@@ -182,9 +196,32 @@ Options SanitizeOptions(const std::string& dbname,
   return result;
 }
 
+// Size of the bloom filter of the memtables that take writes
+static size_t MemTableBloomBytes(const Options& options) {
+  return static_cast<size_t>(options.write_buffer_size *
+                             options.memtable_bloom_size_ratio);
+}
+
+// Log files start writeback as set by wal_bytes_per_sync
+static FileOptions LogFileOptions(const Options& options) {
+  FileOptions file_options(options);
+  file_options.bytes_per_sync = options.wal_bytes_per_sync;
+  return file_options;
+}
+
+// Logs that may be recycled are tagged with their number, so that what an
+// earlier log left in the file is not replayed
+static log::Writer* NewLogWriter(const Options& options,
+                                 ConcurrentWritableFile* file,
+                                 uint64_t log_number) {
+  return new log::Writer(file, log_number, options.recycle_log_file_num > 0,
+                         options.wal_compression);
+}
+
 DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
     : env_(raw_options.env),
-      internal_comparator_(raw_options.comparator),
+      internal_comparator_(raw_options.comparator,
+                           raw_options.key_num_extractor),
       internal_filter_policy_(raw_options.filter_policy),
       filter_policy_(raw_options.filter_policy),
       options_(SanitizeOptions(dbname, &internal_comparator_,
@@ -197,12 +234,17 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       db_lock_(NULL),
       mutex_(),
       shutting_down_(NULL),
-      mem_(new MemTable(internal_comparator_)),
+      mem_(new MemTable(internal_comparator_, MemTableBloomBytes(options_))),
       imm_(NULL),
       has_imm_(),
       logfile_(),
       logfile_number_(0),
       log_(),
+      prev_logfile_(),
+      prev_logfile_number_(0),
+      log_recycle_files_(),
+      next_logfile_(NULL),
+      next_logfile_number_(0),
       seed_(0),
       writers_mutex_(),
       writers_upper_(0),
@@ -222,17 +264,25 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       replay_iters_(),
       straight_reads_(0),
       versions_(),
+      num_bg_compaction_threads_(1),
       backup_cv_(&writers_mutex_),
       backup_in_progress_(),
       backup_waiters_(0),
       backup_waiter_has_it_(false),
       backup_deferred_delete_(),
+      checkpoints_in_progress_(0),
+      trace_mutex_(),
+      tracer_(NULL),
+      tracing_(),
       bg_error_(),
-      num_bg_compaction_threads_(1) {
+      stall_micros_(0),
+      user_bytes_written_(0),
+      wal_bytes_written_(0) {
   mutex_.Lock();
   mem_->Ref();
   has_imm_.Release_Store(NULL);
   backup_in_progress_.Release_Store(NULL);
+  tracing_.Release_Store(NULL);
   env_->StartThread(&DBImpl::CompactMemTableWrapper, this);
   for (int i = 1; i <= num_bg_compaction_threads_; i++) {
 	  env_->StartThread(&DBImpl::CompactLevelWrapper, this);
@@ -282,11 +332,14 @@ DBImpl::~DBImpl() {
     env_->UnlockFile(db_lock_);
   }
 
+  delete tracer_;
   delete versions_;
   if (mem_ != NULL) mem_->Unref();
   if (imm_ != NULL) imm_->Unref();
   log_.reset();
   logfile_.reset();
+  prev_logfile_.reset();
+  delete next_logfile_;
   delete table_cache_;
 
   if (owns_info_log_) {
@@ -358,7 +411,8 @@ void DBImpl::MaybeIgnoreError(Status* s) const {
 void DBImpl::DeleteObsoleteFiles() {
   // Defer if there's background activity
   mutex_.AssertHeld();
-  if (backup_in_progress_.Acquire_Load() != NULL) {
+  if (backup_in_progress_.Acquire_Load() != NULL ||
+      checkpoints_in_progress_ > 0) {
     backup_deferred_delete_ = true;
     return;
   }
@@ -386,7 +440,8 @@ void DBImpl::DeleteObsoleteFiles() {
       switch (type) {
         case kLogFile:
           keep = ((number >= versions_->LogNumber()) ||
-                  (number == versions_->PrevLogNumber()));
+                  (number == versions_->PrevLogNumber()) ||
+                  KeepLogFileForRecycling(number));
           break;
         case kDescriptorFile:
           // Keep my manifest file, and any newer incarnations'
@@ -427,6 +482,81 @@ void DBImpl::DeleteObsoleteFiles() {
   }
 }
 
+Status DBImpl::NewLogFile(uint64_t number, uint64_t recycled,
+                          const FileOptions& file_options,
+                          ConcurrentWritableFile** file) {
+  const std::string fname = LogFileName(dbname_, number);
+  if (recycled != 0) {
+    Status s = env_->ReuseConcurrentWritableFile(
+        fname, LogFileName(dbname_, recycled), file_options, file);
+    if (s.ok()) {
+      Log(options_.info_log, "Reusing log #%llu as #%llu",
+          static_cast<unsigned long long>(recycled),
+          static_cast<unsigned long long>(number));
+      return s;
+    }
+    Log(options_.info_log, "Reusing log #%llu failed: %s",
+        static_cast<unsigned long long>(recycled), s.ToString().c_str());
+  }
+  return env_->NewConcurrentWritableFile(fname, file_options, file);
+}
+
+uint64_t DBImpl::TakeRecycledLogFile() {
+  mutex_.AssertHeld();
+  // Like deletions, reuse waits for a backup or checkpoint that may be
+  // copying the file
+  if (log_recycle_files_.empty() ||
+      backup_in_progress_.Acquire_Load() != NULL ||
+      checkpoints_in_progress_ > 0) {
+    return 0;
+  }
+  const uint64_t number = log_recycle_files_.front();
+  log_recycle_files_.pop_front();
+  return number;
+}
+
+bool DBImpl::KeepLogFileForRecycling(uint64_t number) {
+  mutex_.AssertHeld();
+  if (std::find(log_recycle_files_.begin(), log_recycle_files_.end(),
+                number) != log_recycle_files_.end()) {
+    return true;
+  }
+  // Only logs this DB wrote in the recyclable format qualify, and only
+  // once no writer holds them open any more.  A writer closing the file
+  // later would truncate it underneath its next use.
+  if (number != prev_logfile_number_ || !prev_logfile_ ||
+      prev_logfile_.use_count() > 1 ||
+      log_recycle_files_.size() >= options_.recycle_log_file_num) {
+    return false;
+  }
+  prev_logfile_.reset();
+  log_recycle_files_.push_back(number);
+  return true;
+}
+
+void DBImpl::PrepareNextLogFile() {
+  mutex_.AssertHeld();
+  const uint64_t number = versions_->NewFileNumber();
+  const uint64_t recycled = TakeRecycledLogFile();
+  FileOptions file_options = LogFileOptions(options_);
+  file_options.preallocation_size = options_.write_buffer_size;
+  ConcurrentWritableFile* lfile = NULL;
+  mutex_.Unlock();
+  Status s = NewLogFile(number, recycled, file_options, &lfile);
+  mutex_.Lock();
+  if (!s.ok()) {
+    Log(options_.info_log, "Preparing log #%llu failed: %s",
+        static_cast<unsigned long long>(number), s.ToString().c_str());
+  } else if (number < logfile_number_) {
+    // A memtable switch did not wait for it and created a newer log
+    delete lfile;
+    env_->DeleteFile(LogFileName(dbname_, number));
+  } else {
+    next_logfile_ = lfile;
+    next_logfile_number_ = number;
+  }
+}
+
 Status DBImpl::Recover(VersionEdit* edit) {
   mutex_.AssertHeld();
 
@@ -564,7 +694,7 @@ Status DBImpl::RecoverLogFile(uint64_t log_number,
   // to be skipped instead of propagating bad information (like overly
   // large sequence numbers).
   log::Reader reader(file, &reporter, true/*checksum*/,
-                     0/*initial_offset*/);
+                     0/*initial_offset*/, log_number);
   Log(options_.info_log, "Recovering log #%llu",
       (unsigned long long) log_number);
 
@@ -707,8 +837,7 @@ Status DBImpl::WriteLevel0TableGuards(MemTable* mem, VersionEdit* edit,
 			const Slice min_user_key = meta.smallest.user_key();
 			const Slice max_user_key = meta.largest.user_key();
 			// Note: We are always putting the new files to level 0
-			edit->AddFile(level, meta.number, meta.file_size,
-						  meta.smallest, meta.largest);
+			edit->AddFile(level, meta);
 			numbers.push_back(meta.number);
 			total_file_size += meta.file_size;
 		}
@@ -738,6 +867,10 @@ void DBImpl::CompactMemTableThread() {
     bg_memtable_cv_.Wait();
   }
   while (!shutting_down_.Acquire_Load()) {
+    if (options_.preallocate_next_log && next_logfile_ == NULL &&
+        imm_ == NULL && bg_error_.ok()) {
+      PrepareNextLogFile();
+    }
     while (!shutting_down_.Acquire_Load() && imm_ == NULL) {
       bg_memtable_cv_.Wait();
     }
@@ -853,8 +986,8 @@ void DBImpl::TEST_CompactOnce() {
 
 void DBImpl::TEST_CompactAllLevels() {
 	while (!versions_->IsAllLevelsCompacted()) {
-		bool force_compact;
-		int level = versions_->PickCompactionLevel(levels_locked_, false, &force_compact);
+		bool force_compact, read_driven;
+		int level = versions_->PickCompactionLevel(levels_locked_, false, &force_compact, &read_driven);
 		printf("Level picked for compaction - %d\n", level);
 		printf("Signalling background compaction compactAllLevels. . \n");
 		bg_compaction_cv_.Signal();
@@ -1020,6 +1153,7 @@ Status DBImpl::BackgroundCompactionGuards(FileLevelFilterBuilder* file_level_fil
   int x, y, z;
   mutex_.AssertHeld();
   bool force_compact;
+  bool read_driven;
   Compaction* c = NULL;
   bool is_manual = (manual_compaction_ != NULL);
   InternalKey manual_end;
@@ -1042,12 +1176,17 @@ Status DBImpl::BackgroundCompactionGuards(FileLevelFilterBuilder* file_level_fil
   } else {
 
 	start_timer(BGC_PICK_COMPACTION_LEVEL);
-    unsigned level = versions_->PickCompactionLevel(levels_locked_, straight_reads_ > kStraightReads, &force_compact);
+    unsigned level = versions_->PickCompactionLevel(levels_locked_, straight_reads_ > kStraightReads, &force_compact, &read_driven);
     record_timer(BGC_PICK_COMPACTION_LEVEL);
 
     start_timer(BGC_PICK_COMPACTION);
     if (level != config::kNumLevels) {
-      c = versions_->PickCompactionForGuards(versions_->current(), level, &complete_guards_used_in_bg_compaction, force_compact);
+      c = versions_->PickCompactionForGuards(versions_->current(), level, &complete_guards_used_in_bg_compaction, force_compact, read_driven);
+    }
+    if (c != NULL && read_driven) {
+      Log(options_.info_log, "Read-triggered compaction of %lu@%d + %lu@%d files\n",
+          c->num_input_files(0), c->level(),
+          c->num_input_files(1), c->level() + 1);
     }
     record_timer(BGC_PICK_COMPACTION);
 
@@ -1165,7 +1304,9 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
 
   // Make the output file
   std::string fname = TableFileName(dbname_, file_number);
-  Status s = env_->NewWritableFile(fname, &compact->outfile);
+  FileOptions file_options(file_options_);
+  file_options.preallocation_size = compact->compaction->MaxOutputFileSize();
+  Status s = env_->NewWritableFile(fname, file_options, &compact->outfile);
   if (s.ok()) {
     compact->builder = new TableBuilder(options_, compact->outfile);
   }
@@ -1187,6 +1328,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   Status s = input->status();
   const uint64_t current_entries = compact->builder->NumEntries();
   if (s.ok()) {
+    compact->current_output()->stats.SaveTo(compact->builder);
     s = compact->builder->Finish();
   } else {
     compact->builder->Abandon();
@@ -1196,6 +1338,7 @@ Status DBImpl::FinishCompactionOutputFile(CompactionState* compact,
   InternalKey smallest = compact->current_output()->smallest;
   InternalKey largest = compact->current_output()->largest;
   compact->current_output()->file_size = current_bytes;
+  compact->current_output()->num_entries = current_entries;
   compact->total_bytes += current_bytes;
   delete compact->builder;
   compact->builder = NULL;
@@ -1255,13 +1398,27 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact, const int leve
   compact->compaction->AddInputDeletions(compact->compaction->edit());
   for (size_t i = 0; i < compact->outputs.size(); i++) {
     const CompactionState::Output& out = compact->outputs[i];
-    compact->compaction->edit()->AddFile(
-        level_to_add_new_files,
-        out.number, out.file_size, out.smallest, out.largest);
+    FileMetaData f;
+    f.number = out.number;
+    f.file_size = out.file_size;
+    f.smallest = out.smallest;
+    f.largest = out.largest;
+    f.fully_compacted = out.fully_compacted;
+    f.num_entries = out.num_entries;
+    f.num_deletions = out.stats.num_deletions();
+    compact->compaction->edit()->AddFile(level_to_add_new_files, f);
   }
   return versions_->LogAndApply(compact->compaction->edit(), &mutex_, &bg_log_cv_, &bg_log_occupied_, file_numbers, file_level_filters, 0);
 }
 
+// Return the index of the oldest snapshot in the sorted "snapshots" whose
+// sequence number is >= seq, or snapshots.size() if there is none.
+static size_t SnapshotStripe(const std::vector<SequenceNumber>& snapshots,
+                             SequenceNumber seq) {
+  return std::lower_bound(snapshots.begin(), snapshots.end(), seq) -
+         snapshots.begin();
+}
+
 Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
 		std::vector<GuardMetaData*> complete_guards_used_in_bg_compaction,
 		FileLevelFilterBuilder* file_level_filter_builder) {
@@ -1291,6 +1448,7 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
   } else {
     compact->smallest_snapshot = snapshots_.oldest()->number_;
   }
+  snapshots_.GetAll(&compact->snapshots);
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
   // In case some other level needs to be compacted and some thread is waiting.
@@ -1309,6 +1467,7 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
   std::string current_key_backing;
   bool has_current_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
+  size_t last_stripe_for_key = 0;
   size_t boundary_hint = 0;
   std::vector<GuardMetaData*> guards;
   int compaction_level = compact->compaction->level();
@@ -1327,7 +1486,8 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
 	cnt++;
     // Handle key/value, add to state, etc.
     bool drop = false;
-    if (!ParseInternalKey(key, &ikey)) {
+    bool valid_key = ParseInternalKey(key, &ikey);
+    if (!valid_key) {
       // Do not hide error keys
       current_key_backing.clear();
       has_current_key = false;
@@ -1359,8 +1519,14 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
       // Just remember that last_sequence_for_key is decreasing over time, and
       // all of this makes sense.
 
-      if (last_sequence_for_key <= compact->smallest_snapshot) {
-        // Hidden by an newer entry for same user key
+      // The stripe of an entry is the oldest snapshot that can see it
+      // (snapshots.size() if only the live view can).
+      const size_t stripe = SnapshotStripe(compact->snapshots, ikey.sequence);
+      if (last_sequence_for_key <= compact->smallest_snapshot ||
+          (last_sequence_for_key != kMaxSequenceNumber &&
+           last_stripe_for_key == stripe)) {
+        // Hidden by an newer entry for same user key that every snapshot
+        // able to see this one sees as well
         drop = true;    // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
@@ -1385,6 +1551,7 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
       }
 
       last_sequence_for_key = ikey.sequence;
+      last_stripe_for_key = stripe;
     }
 
     if (!drop) {
@@ -1429,10 +1596,21 @@ Status DBImpl::DoCompactionWorkGuards(CompactionState* compact,
           break;
         }
       }
+      CompactionState::Output* out = compact->current_output();
       if (compact->builder->NumEntries() == 0) {
-        compact->current_output()->smallest.DecodeFrom(key);
+        out->smallest.DecodeFrom(key);
+      } else if (out->fully_compacted && valid_key &&
+                 user_comparator()->Compare(ikey.user_key,
+                                            out->largest.user_key()) == 0) {
+        out->fully_compacted = false;
+      }
+      if (!valid_key || ikey.type == kTypeDeletion) {
+        out->fully_compacted = false;
       }
-      compact->current_output()->largest.DecodeFrom(key);
+      if (valid_key) {
+        out->stats.Add(key);
+      }
+      out->largest.DecodeFrom(key);
       compact->builder->Add(key, input->value());
 
 #ifdef FILE_LEVEL_FILTER
@@ -1540,6 +1718,29 @@ static void CleanupIteratorState(void* arg1, void* /*arg2*/) {
   state->mu->Unlock();
   delete state;
 }
+
+// Passes every Seek on to the running trace.
+class TracingIterator : public Iterator {
+ public:
+  TracingIterator(DBImpl* db, Iterator* iter) : db_(db), iter_(iter) { }
+  virtual ~TracingIterator() { delete iter_; }
+  virtual bool Valid() const { return iter_->Valid(); }
+  virtual void Seek(const Slice& k) { db_->TraceSeek(k); iter_->Seek(k); }
+  virtual void SeekToFirst() { iter_->SeekToFirst(); }
+  virtual void SeekToLast() { iter_->SeekToLast(); }
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual const Status& status() const { return iter_->status(); }
+
+ private:
+  TracingIterator(const TracingIterator&);
+  TracingIterator& operator = (const TracingIterator&);
+
+  DBImpl* const db_;
+  Iterator* const iter_;
+};
 }  // namespace
 
 Iterator* DBImpl::NewInternalIterator(const ReadOptions& options, uint64_t number,
@@ -1589,10 +1790,25 @@ int64_t DBImpl::TEST_MaxNextLevelOverlappingBytes() {
   return versions_->MaxNextLevelOverlappingBytes();
 }
 
+int DBImpl::TEST_QueuedWriters() {
+  MutexLock l(&writers_mutex_);
+  int count = 0;
+  for (Writer* w = writers_tail_; w != NULL; w = w->prev_) {
+    ++count;
+  }
+  return count;
+}
+
 Status DBImpl::Get(const ReadOptions& options,
                    const Slice& key,
                    std::string* value) {
   Status s;
+  if (tracing_.Acquire_Load() != NULL) {
+    MutexLock l(&trace_mutex_);
+    if (tracer_ != NULL) {
+      tracer_->Get(key);
+    }
+  }
   start_timer_simple(GET_OVERALL_TIME);
   start_timer(GET_OVERALL_TIME);
   start_timer(GET_TIME_TO_GET_MUTEX);
@@ -1676,12 +1892,56 @@ Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
   Iterator* iter = NewInternalIterator(options, 0, &latest_snapshot, &seed, false);
-  return NewDBIterator(
+  iter = NewDBIterator(
       this, user_comparator(), iter,
       (options.snapshot != NULL
        ? reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_
        : latest_snapshot),
       seed);
+  if (tracing_.Acquire_Load() != NULL) {
+    iter = new TracingIterator(this, iter);
+  }
+  return iter;
+}
+
+Status DBImpl::NewParallelIterators(const ReadOptions& options, int n,
+                                    std::vector<Iterator*>* iterators) {
+  if (n < 1) {
+    return Status::InvalidArgument("need at least one iterator");
+  }
+  iterators->clear();
+
+  // Build every partition under one hold of mutex_ so they all share the
+  // same memtables, version and sequence number.
+  std::vector<std::string> splits;
+  std::vector<Iterator*> internal_iters;
+  std::vector<uint32_t> seeds;
+  SequenceNumber sequence = 0;
+  {
+    MutexLock l(&mutex_);
+    versions_->current()->GetGuardSplitKeys(n, &splits);
+    for (size_t i = 0; i <= splits.size(); i++) {
+      SequenceNumber latest_snapshot;
+      uint32_t seed;
+      internal_iters.push_back(
+          NewInternalIterator(options, 0, &latest_snapshot, &seed, true));
+      seeds.push_back(seed);
+      sequence = latest_snapshot;
+    }
+  }
+  if (options.snapshot != NULL) {
+    sequence = reinterpret_cast<const SnapshotImpl*>(options.snapshot)->number_;
+  }
+
+  for (size_t i = 0; i < internal_iters.size(); i++) {
+    Iterator* iter = NewDBIterator(this, user_comparator(), internal_iters[i],
+                                   sequence, seeds[i]);
+    iterators->push_back(NewBoundedIterator(
+        user_comparator(), iter,
+        i > 0 ? &splits[i - 1] : NULL,
+        i < splits.size() ? &splits[i] : NULL));
+  }
+  return Status::OK();
 }
 
 void DBImpl::GetReplayTimestamp(std::string* timestamp) {
@@ -1868,6 +2128,12 @@ Status DBImpl::Delete(const WriteOptions& options, const Slice& key) {
 Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   Writer w(&writers_mutex_);
   Status s;
+  if (updates != NULL && tracing_.Acquire_Load() != NULL) {
+    MutexLock l(&trace_mutex_);
+    if (tracer_ != NULL) {
+      tracer_->Write(updates);
+    }
+  }
 
   start_timer_simple(WRITE_OVERALL_TIME);
   start_timer(WRITE_OVERALL_TIME);
@@ -1877,6 +2143,8 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
   WriteBatch* updates_with_guards = NULL;
   if (s.ok() && updates != NULL) { // NULL batch is for compactions
+    atomic::increment_64_nobarrier(&user_bytes_written_,
+                                   WriteBatchInternal::ByteSize(updates));
 
     start_timer(WRITE_SET_SEQUENCE_CREATE_NEW_BATCH);
     WriteBatchInternal::SetSequence(updates, w.start_sequence_);
@@ -1900,7 +2168,10 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
     // because both the log and the memtable are safe for concurrent access.
     // The synchronization with readers occurs with SequenceWriteEnd.
     start_timer(WRITE_LOG_ADDRECORD);
-    s = w.log_->AddRecord(WriteBatchInternal::Contents(updates_with_guards));
+    uint64_t log_bytes = 0;
+    s = w.log_->AddRecord(WriteBatchInternal::Contents(updates_with_guards),
+                          &log_bytes);
+    atomic::increment_64_nobarrier(&wal_bytes_written_, log_bytes);
     record_timer(WRITE_LOG_ADDRECORD);
 
     if (!s.ok()) {
@@ -1955,25 +2226,42 @@ Status DBImpl::SequenceWriteBegin(Writer* w, WriteBatch* updates) {
         // We have filled up the current memtable, but the previous
         // one is still being compacted, so we wait.
 
+        const uint64_t stall_start = env_->NowMicros();
         bg_memtable_cv_.Signal();
         bg_fg_cv_.Wait();
+        atomic::increment_64_fullbarrier(&stall_micros_,
+                                         env_->NowMicros() - stall_start);
       } else {
         // Attempt to switch to a new memtable and trigger compaction of old
         assert(versions_->PrevLogNumber() == 0);
-        uint64_t new_log_number = versions_->NewFileNumber();
+        uint64_t new_log_number = 0;
         ConcurrentWritableFile* lfile = NULL;
-        s = env_->NewConcurrentWritableFile(LogFileName(dbname_, new_log_number), &lfile);
-        if (!s.ok()) {
-          // Avoid chewing through file number space in a tight loop.
-          versions_->ReuseFileNumber(new_log_number);
-          break;
+        if (next_logfile_ != NULL) {
+          // Take the log prepared in the background
+          new_log_number = next_logfile_number_;
+          lfile = next_logfile_;
+          next_logfile_ = NULL;
+        } else {
+          new_log_number = versions_->NewFileNumber();
+          s = NewLogFile(new_log_number, TakeRecycledLogFile(),
+                         LogFileOptions(options_), &lfile);
+          if (!s.ok()) {
+            // Avoid chewing through file number space in a tight loop.
+            versions_->ReuseFileNumber(new_log_number);
+            break;
+          }
+        }
+        if (options_.recycle_log_file_num > 0) {
+          prev_logfile_ = logfile_;
+          prev_logfile_number_ = logfile_number_;
         }
         logfile_.reset(lfile);
         logfile_number_ = new_log_number;
-        log_.reset(new log::Writer(lfile));
+        log_.reset(NewLogWriter(options_, lfile, new_log_number));
         imm_ = mem_;
         w->has_imm_ = true;
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_,
+                            MemTableBloomBytes(options_));
         mem_->Ref();
         force = false;   // Do not force another compaction if have room
         enqueue_mem = true;
@@ -2084,8 +2372,9 @@ void DBImpl::SequenceWriteEnd(Writer* w, WriteBatch* updates_with_guards, Status
 
   start_timer(SWE_UNLOCK_WRITERS_MUTEX);
   if (writers_tail_ == w) {
+    // Writers still ahead of us stay in the queue for the next to link to
     assert(!w->next_);
-    writers_tail_ = NULL;
+    writers_tail_ = w->prev_;
   }
   writers_mutex_.Unlock();
   record_timer(SWE_UNLOCK_WRITERS_MUTEX);
@@ -2103,6 +2392,8 @@ void DBImpl::SequenceWriteEnd(Writer* w, WriteBatch* updates_with_guards, Status
   if (w->micros_ > config::kL0_SlowdownWritesTrigger) {
     start_timer(SWE_SLEEP);
 	env_->SleepForMicroseconds(w->micros_ - config::kL0_SlowdownWritesTrigger);
+    atomic::increment_64_fullbarrier(&stall_micros_,
+                                     w->micros_ - config::kL0_SlowdownWritesTrigger);
     record_timer(SWE_SLEEP);
   }
 }
@@ -2234,6 +2525,32 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
 	  std::string sentinel_details = versions_->SentinelDetailsAtLevel(level);
 	  *value = sentinel_details.c_str();
 	  return true;
+  } else if (in.starts_with("table-properties-at-level")) {
+    in.remove_prefix(strlen("table-properties-at-level"));
+    uint64_t level;
+    bool ok = ConsumeDecimalNumber(&in, &level) && in.empty();
+    if (!ok || level >= config::kNumLevels) {
+      return false;
+    }
+    // Tables may have to be opened, so read them without holding the lock
+    Version* current = versions_->current();
+    current->Ref();
+    const std::vector<FileMetaData*> files = current->GetFilesAtLevel(level);
+    mutex_.Unlock();
+    for (size_t i = 0; i < files.size(); i++) {
+      TableProperties props;
+      Status s = table_cache_->GetTableProperties(files[i]->number,
+                                                  files[i]->file_size, &props);
+      char buf[100];
+      snprintf(buf, sizeof(buf), "#%llu ",
+               static_cast<unsigned long long>(files[i]->number));
+      value->append(buf);
+      value->append(s.ok() ? props.ToString() : s.ToString());
+      value->append("\n");
+    }
+    mutex_.Lock();
+    current->Unref();
+    return true;
   } else if (in == "stats") {
     char buf[200];
     snprintf(buf, sizeof(buf),
@@ -2258,6 +2575,58 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
       }
     }
     return true;
+  } else if (in.starts_with("num-bytes-at-level")) {
+    in.remove_prefix(strlen("num-bytes-at-level"));
+    uint64_t level;
+    bool ok = ConsumeDecimalNumber(&in, &level) && in.empty();
+    if (!ok || level >= config::kNumLevels) {
+      return false;
+    }
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%lld",
+             static_cast<long long>(versions_->NumLevelBytes(level)));
+    *value = buf;
+    return true;
+  } else if (in == "pending-compaction-bytes") {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%lld",
+             static_cast<long long>(versions_->PendingCompactionBytes()));
+    *value = buf;
+    return true;
+  } else if (in == "compaction-bytes-written") {
+    int64_t bytes = 0;
+    for (unsigned level = 0; level < config::kNumLevels; level++) {
+      bytes += stats_[level].bytes_written;
+    }
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%lld", static_cast<long long>(bytes));
+    *value = buf;
+    return true;
+  } else if (in == "user-bytes-written") {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(
+             atomic::load_64_nobarrier(&user_bytes_written_)));
+    *value = buf;
+    return true;
+  } else if (in == "wal-bytes-written") {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(
+             atomic::load_64_nobarrier(&wal_bytes_written_)));
+    *value = buf;
+    return true;
+  } else if (in == "write-stall-micros") {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(
+             atomic::load_64_acquire(&stall_micros_)));
+    *value = buf;
+    return true;
+  } else if (in == "row-cache-hits" || in == "row-cache-misses") {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(
+             in == "row-cache-hits" ? table_cache_->RowCacheHits() :
+                                      table_cache_->RowCacheMisses()));
+    *value = buf;
+    return true;
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
@@ -2441,6 +2810,247 @@ Status DBImpl::LiveBackup(const Slice& _name) {
   return s;
 }
 
+// Copy the first "size" bytes of "src" to "target" and sync the copy
+static Status CopyFilePrefix(Env* env, const std::string& src,
+                             const std::string& target, uint64_t size) {
+  SequentialFile* in;
+  Status s = env->NewSequentialFile(src, FileOptions(), &in);
+  if (!s.ok()) {
+    return s;
+  }
+  WritableFile* out;
+  s = env->NewWritableFile(target, &out);
+  if (!s.ok()) {
+    delete in;
+    return s;
+  }
+  static const size_t kBufferSize = 65536;
+  char* space = new char[kBufferSize];
+  while (s.ok() && size > 0) {
+    Slice fragment;
+    s = in->Read(std::min<uint64_t>(size, kBufferSize), &fragment, space);
+    if (s.ok() && fragment.empty()) {
+      s = Status::IOError(src, "shorter than expected");
+    }
+    if (s.ok()) {
+      s = out->Append(fragment);
+      size -= fragment.size();
+    }
+  }
+  delete[] space;
+  if (s.ok()) {
+    s = out->Sync();
+  }
+  if (s.ok()) {
+    s = out->Close();
+  }
+  delete out;
+  delete in;
+  if (!s.ok()) {
+    env->DeleteFile(target);
+  }
+  return s;
+}
+
+Status DBImpl::Checkpoint(const Slice& _dir, bool incremental) {
+  const std::string dir = _dir.ToString();
+  env_->CreateDir(dir);  // Ignore error; the directory may already exist
+  if (!incremental && env_->FileExists(CurrentFileName(dir))) {
+    return Status::InvalidArgument(dir, "already holds a checkpoint");
+  }
+
+  // Files already present from an earlier checkpoint
+  std::vector<std::string> existing;
+  env_->GetChildren(dir, &existing);  // Ignoring errors on purpose
+
+  // Pin the current version and note how much of the MANIFEST and of the
+  // current log it takes.  No MANIFEST write is in progress while the
+  // descriptor log is free, so that prefix describes exactly this version.
+  // Obsolete files are neither deleted nor recycled until we are done.
+  Version* version = NULL;
+  uint64_t manifest_number = 0;
+  uint64_t manifest_size = 0;
+  uint64_t log_number = 0;
+  uint64_t prev_log_number = 0;
+  uint64_t active_log_number = 0;
+  uint64_t active_log_size = 0;
+  std::set<uint64_t> live;
+  {
+    MutexLock l(&mutex_);
+    while (bg_log_occupied_) {
+      bg_log_cv_.Wait();
+    }
+    ++checkpoints_in_progress_;
+    version = versions_->current();
+    version->Ref();
+    version->AddLiveFiles(&live);
+    manifest_number = versions_->ManifestFileNumber();
+    manifest_size = versions_->ManifestFileSize();
+    log_number = versions_->LogNumber();
+    prev_log_number = versions_->PrevLogNumber();
+    active_log_number = logfile_number_;
+    // Read before we queue below; writers claim log space only once queued
+    active_log_size = log_->Offset();
+  }
+
+  // The records before active_log_size belong to writers queued ahead of
+  // us.  Wait for them to be written; writers behind us carry on.
+  Writer w(&writers_mutex_);
+  w.block_if_backup_in_progress_ = false;
+  WriteBatch empty;
+  Status s = SequenceWriteBegin(&w, &empty);
+  if (s.ok()) {
+    MutexLock l(&writers_mutex_);
+    while (w.prev_) {
+      w.wake_me_when_head_ = true;
+      w.cv_.Wait();
+    }
+    w.wake_me_when_head_ = false;
+  }
+  SequenceWriteEnd(&w, NULL, s);
+
+  std::vector<std::string> filenames;
+  if (s.ok()) {
+    s = env_->GetChildren(dbname_, &filenames);
+  }
+  uint64_t number;
+  FileType type;
+  if (s.ok()) {
+    s = CopyFilePrefix(env_, DescriptorFileName(dbname_, manifest_number),
+                       DescriptorFileName(dir, manifest_number),
+                       manifest_size);
+  }
+  // Logs switched out before the current one were complete once the
+  // writers ahead of us finished; logs started since are not needed
+  std::set<std::string> copied_logs;
+  for (size_t i = 0; s.ok() && i < filenames.size(); i++) {
+    if (!ParseFileName(filenames[i], &number, &type) ||
+        type != kLogFile ||
+        number > active_log_number ||
+        (number < log_number && number != prev_log_number)) {
+      continue;
+    }
+    const std::string src = dbname_ + "/" + filenames[i];
+    uint64_t size = active_log_size;
+    if (number != active_log_number) {
+      s = env_->GetFileSize(src, &size);
+    }
+    if (s.ok()) {
+      s = CopyFilePrefix(env_, src, dir + "/" + filenames[i], size);
+    }
+    copied_logs.insert(filenames[i]);
+  }
+
+  // Table files are immutable; link the ones the pinned version needs
+  // and that an earlier checkpoint does not already have.  A same-named
+  // file of a different size was written by someone else and is replaced.
+  std::set<std::string> present(existing.begin(), existing.end());
+  for (size_t i = 0; s.ok() && i < filenames.size(); i++) {
+    if (!ParseFileName(filenames[i], &number, &type) ||
+        type != kTableFile ||
+        live.find(number) == live.end()) {
+      continue;
+    }
+    const std::string src = dbname_ + "/" + filenames[i];
+    const std::string target = dir + "/" + filenames[i];
+    if (present.find(filenames[i]) != present.end()) {
+      uint64_t src_size = 0;
+      uint64_t target_size = 0;
+      if (env_->GetFileSize(src, &src_size).ok() &&
+          env_->GetFileSize(target, &target_size).ok() &&
+          src_size == target_size) {
+        continue;
+      }
+      env_->DeleteFile(target);
+    }
+    s = env_->LinkFile(src, target);
+  }
+
+  // Make the copies and links durable before CURRENT names them, and
+  // CURRENT durable before reporting success
+  if (s.ok()) {
+    s = env_->SyncDir(dir);
+  }
+  if (s.ok()) {
+    s = SetCurrentFile(env_, dir, manifest_number);
+  }
+  if (s.ok()) {
+    s = env_->SyncDir(dir);
+  }
+
+  // Drop what the earlier checkpoint had and this one does not reference
+  for (size_t i = 0; s.ok() && i < existing.size(); i++) {
+    if (!ParseFileName(existing[i], &number, &type)) {
+      continue;
+    }
+    bool keep = true;
+    switch (type) {
+      case kLogFile:
+        keep = (copied_logs.find(existing[i]) != copied_logs.end());
+        break;
+      case kDescriptorFile:
+        keep = (number == manifest_number);
+        break;
+      case kTableFile:
+        keep = (live.find(number) != live.end());
+        break;
+      case kTempFile:
+        keep = false;
+        break;
+      default:
+        keep = true;
+        break;
+    }
+    if (!keep) {
+      env_->DeleteFile(dir + "/" + existing[i]);
+    }
+  }
+
+  {
+    MutexLock l(&mutex_);
+    version->Unref();
+    --checkpoints_in_progress_;
+    if (checkpoints_in_progress_ == 0 && backup_deferred_delete_) {
+      backup_deferred_delete_ = false;
+      DeleteObsoleteFiles();
+    }
+  }
+  return s;
+}
+
+Status DBImpl::StartTrace(const std::string& fname, bool record_keys) {
+  MutexLock l(&trace_mutex_);
+  if (tracer_ != NULL) {
+    return Status::InvalidArgument("a trace is already running");
+  }
+  Status s = TraceWriter::Open(env_, fname, record_keys, &tracer_);
+  if (s.ok()) {
+    tracing_.Release_Store(tracer_);
+  }
+  return s;
+}
+
+Status DBImpl::EndTrace() {
+  MutexLock l(&trace_mutex_);
+  if (tracer_ == NULL) {
+    return Status::InvalidArgument("no trace is running");
+  }
+  tracing_.Release_Store(NULL);
+  Status s = tracer_->Close();
+  delete tracer_;
+  tracer_ = NULL;
+  return s;
+}
+
+void DBImpl::TraceSeek(const Slice& key) {
+  if (tracing_.Acquire_Load() != NULL) {
+    MutexLock l(&trace_mutex_);
+    if (tracer_ != NULL) {
+      tracer_->Seek(key);
+    }
+  }
+}
+
 // Default implementations of convenience methods that subclasses of DB
 // can call if they wish
 Status DB::Put(const WriteOptions& opt, const Slice& key, const Slice& value) {
@@ -2470,12 +3080,13 @@ Status DB::Open(const Options& options, const std::string& dbname,
     uint64_t new_log_number = impl->versions_->NewFileNumber();
     ConcurrentWritableFile* lfile;
     s = options.env->NewConcurrentWritableFile(LogFileName(dbname, new_log_number),
+                                               LogFileOptions(impl->options_),
                                                &lfile);
     if (s.ok()) {
       edit.SetLogNumber(new_log_number);
       impl->logfile_.reset(lfile);
       impl->logfile_number_ = new_log_number;
-      impl->log_.reset(new log::Writer(lfile));
+      impl->log_.reset(NewLogWriter(impl->options_, lfile, new_log_number));
       s = impl->versions_->LogAndApply(&edit, &impl->mutex_, &impl->bg_log_cv_, &impl->bg_log_occupied_, std::vector<uint64_t>(), std::vector<std::string*>(), 1);
     }
     if (s.ok()) {
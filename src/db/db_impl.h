@@ -35,6 +35,7 @@ namespace leveldb {
 
 class MemTable;
 class TableCache;
+class TraceWriter;
 class Version;
 class VersionEdit;
 class VersionSet;
@@ -53,6 +54,8 @@ class DBImpl : public DB {
                      std::string* value);
   virtual Status GetCurrentVersionState(std::string* value);
   virtual Iterator* NewIterator(const ReadOptions&);
+  virtual Status NewParallelIterators(const ReadOptions& options, int n,
+                                      std::vector<Iterator*>* iterators);
   virtual void GetReplayTimestamp(std::string* timestamp);
   virtual void AllowGarbageCollectBeforeTimestamp(const std::string& timestamp);
   virtual bool ValidateTimestamp(const std::string& timestamp);
@@ -66,6 +69,9 @@ class DBImpl : public DB {
   virtual void GetApproximateSizes(const Range* range, int n, uint64_t* sizes);
   virtual void CompactRange(const Slice* begin, const Slice* end);
   virtual Status LiveBackup(const Slice& name);
+  virtual Status Checkpoint(const Slice& dir, bool incremental);
+  virtual Status StartTrace(const std::string& fname, bool record_keys);
+  virtual Status EndTrace();
   virtual void PrintTimerAudit();
   virtual void ClearTimer();
 
@@ -89,6 +95,9 @@ class DBImpl : public DB {
   // file at a level >= 1.
   int64_t TEST_MaxNextLevelOverlappingBytes();
 
+  // Return the number of writers in the write queue.
+  int TEST_QueuedWriters();
+
   // Hacky function to forcefully fit all files to a single level inorder to do a comparison for seek benchmark
   void TEST_ComapactFilesToSingleLevel();
 
@@ -100,6 +109,10 @@ class DBImpl : public DB {
   // bytes.
   void RecordReadSample(Slice key);
 
+  // Record a Seek in the running trace, if any.  Called by the iterators
+  // NewIterator returns while a trace runs.
+  void TraceSeek(const Slice& key);
+
   // Peek at the last sequence;
   // REQURES: mutex_ not held
   SequenceNumber LastSequence();
@@ -137,6 +150,20 @@ class DBImpl : public DB {
                         SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
+  // Create log file "number", reusing obsolete log file "recycled" for it
+  // unless that is 0 or fails.
+  Status NewLogFile(uint64_t number, uint64_t recycled,
+                    const FileOptions& file_options,
+                    ConcurrentWritableFile** file);
+  // Return the number of an obsolete log file to reuse, or 0 if none.
+  uint64_t TakeRecycledLogFile() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns true if obsolete log file "number" is kept for reuse.
+  bool KeepLogFileForRecycling(uint64_t number)
+      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Create the log that the next memtable switch will use.  Releases
+  // mutex_ while the file is created.
+  void PrepareNextLogFile() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base, uint64_t* number)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -203,6 +230,14 @@ class DBImpl : public DB {
   SHARED_PTR<WritableFile> logfile_;
   uint64_t logfile_number_;
   SHARED_PTR<log::Writer> log_;
+  // The log before logfile_, held until it can be recycled
+  SHARED_PTR<WritableFile> prev_logfile_;
+  uint64_t prev_logfile_number_;
+  // Obsolete log files kept for reuse as new logs, oldest first
+  std::deque<uint64_t> log_recycle_files_;
+  // Log prepared for the next memtable switch, or NULL
+  ConcurrentWritableFile* next_logfile_;
+  uint64_t next_logfile_number_;
   uint32_t seed_;                // For sampling.
 
   // Synchronize writers
@@ -271,10 +306,24 @@ class DBImpl : public DB {
   uint64_t backup_waiters_; // how many threads waiting to backup
   bool backup_waiter_has_it_;
   bool backup_deferred_delete_; // DeleteObsoleteFiles delayed by backup; protect with mutex_
+  int checkpoints_in_progress_; // Checkpoints copying files; protect with mutex_
+
+  // The running trace.  tracing_ is non-NULL iff tracer_ is, so the hot
+  // paths only take trace_mutex_ while a trace runs.
+  port::Mutex trace_mutex_;
+  TraceWriter* tracer_;
+  port::AtomicPointer tracing_;
 
   // Have we encountered a background error in paranoid mode?
   Status bg_error_;
 
+  // Cumulative time writers spent stalled on the memtable or level-0,
+  // bytes of user batches written, and bytes they took in the log files.
+  // Updated without holding any lock.
+  volatile uint64_t stall_micros_;
+  volatile uint64_t user_bytes_written_;
+  volatile uint64_t wal_bytes_written_;
+
   // Per level compaction stats.  stats_[level] stores the stats for
   // compactions that produced data for the specified "level".
   struct CompactionStats {
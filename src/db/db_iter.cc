@@ -319,6 +319,90 @@ void DBIter::SeekToLast() {
   FindPrevUserEntry();
 }
 
+// Restricts a user-key iterator to [start, limit).  Used to hand out
+// disjoint slices of one snapshot to concurrent scanners.
+class BoundedIter: public Iterator {
+ public:
+  BoundedIter(const Comparator* cmp, Iterator* iter,
+              const std::string* start, const std::string* limit)
+      : user_comparator_(cmp),
+        iter_(iter),
+        has_start_(start != NULL),
+        has_limit_(limit != NULL),
+        start_(start != NULL ? *start : std::string()),
+        limit_(limit != NULL ? *limit : std::string()),
+        valid_(false) {
+  }
+  virtual ~BoundedIter() {
+    delete iter_;
+  }
+  virtual bool Valid() const { return valid_; }
+  virtual Slice key() const { assert(valid_); return iter_->key(); }
+  virtual Slice value() const { assert(valid_); return iter_->value(); }
+  virtual const Status& status() const { return iter_->status(); }
+
+  virtual void Next() {
+    assert(valid_);
+    iter_->Next();
+    Update();
+  }
+  virtual void Prev() {
+    assert(valid_);
+    iter_->Prev();
+    Update();
+  }
+  virtual void Seek(const Slice& target) {
+    if (has_start_ && user_comparator_->Compare(target, start_) < 0) {
+      iter_->Seek(start_);
+    } else {
+      iter_->Seek(target);
+    }
+    Update();
+  }
+  virtual void SeekToFirst() {
+    if (has_start_) {
+      iter_->Seek(start_);
+    } else {
+      iter_->SeekToFirst();
+    }
+    Update();
+  }
+  virtual void SeekToLast() {
+    if (has_limit_) {
+      iter_->Seek(limit_);
+      if (iter_->Valid()) {
+        iter_->Prev();
+      } else {
+        iter_->SeekToLast();
+      }
+    } else {
+      iter_->SeekToLast();
+    }
+    Update();
+  }
+
+ private:
+  void Update() {
+    valid_ = iter_->Valid() &&
+             (!has_start_ ||
+              user_comparator_->Compare(iter_->key(), start_) >= 0) &&
+             (!has_limit_ ||
+              user_comparator_->Compare(iter_->key(), limit_) < 0);
+  }
+
+  const Comparator* const user_comparator_;
+  Iterator* const iter_;
+  const bool has_start_;
+  const bool has_limit_;
+  const std::string start_;
+  const std::string limit_;
+  bool valid_;
+
+  // No copying allowed
+  BoundedIter(const BoundedIter&);
+  void operator=(const BoundedIter&);
+};
+
 }  // anonymous namespace
 
 Iterator* NewDBIterator(
@@ -330,4 +414,12 @@ Iterator* NewDBIterator(
   return new DBIter(db, user_key_comparator, internal_iter, sequence, seed);
 }
 
+Iterator* NewBoundedIterator(
+    const Comparator* user_key_comparator,
+    Iterator* db_iter,
+    const std::string* start,
+    const std::string* limit) {
+  return new BoundedIter(user_key_comparator, db_iter, start, limit);
+}
+
 }  // namespace leveldb
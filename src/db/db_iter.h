@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_DB_ITER_H_
 
 #include <stdint.h>
+#include <string>
 #include "pebblesdb/db.h"
 #include "db/dbformat.h"
 
@@ -23,6 +24,15 @@ extern Iterator* NewDBIterator(
     SequenceNumber sequence,
     uint32_t seed);
 
+// Return a new iterator that yields only the entries of "*db_iter" whose
+// user keys fall in [*start, *limit).  A NULL bound leaves that side
+// open.  Takes ownership of "db_iter".
+extern Iterator* NewBoundedIterator(
+    const Comparator* user_key_comparator,
+    Iterator* db_iter,
+    const std::string* start,
+    const std::string* limit);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_DB_ITER_H_
@@ -8,6 +8,7 @@
 #include "pebblesdb/filter_policy.h"
 #include "db/db_impl.h"
 #include "db/filename.h"
+#include "db/trace.h"
 #include "db/version_set.h"
 #include "db/write_batch_internal.h"
 #include "pebblesdb/cache.h"
@@ -90,6 +91,12 @@ class SpecialEnv : public EnvWrapper {
   // Force write to manifest files to fail while this pointer is non-NULL
   port::AtomicPointer manifest_write_error_;
 
+  // While this pointer is non-NULL, the first log write to reach it waits
+  // for it to be cleared, with log_write_stalled_ set.
+  port::AtomicPointer stall_log_write_;
+  port::AtomicPointer log_write_stalled_;
+  port::Mutex stall_mutex_;
+
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
@@ -101,6 +108,19 @@ class SpecialEnv : public EnvWrapper {
     count_random_reads_ = false;
     manifest_sync_error_.Release_Store(NULL);
     manifest_write_error_.Release_Store(NULL);
+    stall_log_write_.Release_Store(NULL);
+    log_write_stalled_.Release_Store(NULL);
+  }
+
+  // Whether the caller is the log write that stalls
+  bool ClaimLogStall() {
+    MutexLock l(&stall_mutex_);
+    if (stall_log_write_.Acquire_Load() == NULL ||
+        log_write_stalled_.Acquire_Load() != NULL) {
+      return false;
+    }
+    log_write_stalled_.Release_Store(this);
+    return true;
   }
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
@@ -110,19 +130,37 @@ class SpecialEnv : public EnvWrapper {
     return s;
   }
 
+  // Every file goes through the wrappers below; their options are ignored
+  Status NewWritableFile(const std::string& f, const FileOptions& o,
+                         WritableFile** r) {
+    return NewWritableFile(f, r);
+  }
+
+  Status NewConcurrentWritableFile(const std::string& f, const FileOptions& o,
+                                   ConcurrentWritableFile** r) {
+    return NewConcurrentWritableFile(f, r);
+  }
+
   Status NewConcurrentWritableFile(const std::string& f, ConcurrentWritableFile** r) {
     class DataFile : public ConcurrentWritableFile {
      private:
       SpecialEnv* env_;
       ConcurrentWritableFile* base_;
+      bool is_log_;
 
      public:
-      DataFile(SpecialEnv* env, ConcurrentWritableFile* base)
+      DataFile(SpecialEnv* env, ConcurrentWritableFile* base, bool is_log)
           : env_(env),
-            base_(base) {
+            base_(base),
+            is_log_(is_log) {
       }
       ~DataFile() { delete base_; }
       Status WriteAt(uint64_t offset, const Slice& data) {
+        if (is_log_ && env_->ClaimLogStall()) {
+          while (env_->stall_log_write_.Acquire_Load() != NULL) {
+            DelayMilliseconds(10);
+          }
+        }
         if (env_->no_space_.Acquire_Load() != NULL) {
           // Drop writes on the floor
           return Status::OK();
@@ -190,7 +228,7 @@ class SpecialEnv : public EnvWrapper {
     if (s.ok()) {
       if (strstr(f.c_str(), ".ldb") != NULL ||
           strstr(f.c_str(), ".log") != NULL) {
-        *r = new DataFile(this, *r);
+        *r = new DataFile(this, *r, strstr(f.c_str(), ".log") != NULL);
       } else if (strstr(f.c_str(), "MANIFEST") != NULL) {
         *r = new ManifestFile(this, *r);
       }
@@ -1062,6 +1100,294 @@ TEST(DBTest, MinorCompactionsHappen) {
   }
 }
 
+TEST(DBTest, WriteStatsProperties) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 10000;
+  Reopen(&options);
+
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.user-bytes-written", &property));
+  ASSERT_EQ("0", property);
+  for (int i = 0; i < 500; i++) {
+    ASSERT_OK(Put(Key(i), Key(i) + std::string(1000, 'v')));
+  }
+  ASSERT_TRUE(db_->GetProperty("leveldb.user-bytes-written", &property));
+  ASSERT_GT(strtoull(property.c_str(), NULL, 10), 500 * 1000ULL);
+  ASSERT_TRUE(db_->GetProperty("leveldb.compaction-bytes-written", &property));
+  ASSERT_GT(strtoull(property.c_str(), NULL, 10), 0ULL);
+  ASSERT_TRUE(db_->GetProperty("leveldb.write-stall-micros", &property));
+  ASSERT_TRUE(db_->GetProperty("leveldb.pending-compaction-bytes", &property));
+
+  uint64_t total = 0;
+  for (unsigned level = 0; level < config::kNumLevels; level++) {
+    ASSERT_TRUE(db_->GetProperty(
+        "leveldb.num-bytes-at-level" + NumberToString(level), &property));
+    total += strtoull(property.c_str(), NULL, 10);
+  }
+  ASSERT_GT(total, 0u);
+  ASSERT_TRUE(!db_->GetProperty("leveldb.num-bytes-at-level7", &property));
+}
+
+TEST(DBTest, MemTableBloom) {
+  Options options = CurrentOptions();
+  options.memtable_bloom_size_ratio = 0.1;
+  Reopen(&options);
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Put("baz", "v1"));
+  dbfull()->TEST_CompactMemTable();
+
+  // The memtable filter must not hide deletions or keys in the tables
+  ASSERT_OK(Delete("foo"));
+  ASSERT_OK(Put("bar", "v2"));
+  ASSERT_EQ("NOT_FOUND", Get("foo"));
+  ASSERT_EQ("v2", Get("bar"));
+  ASSERT_EQ("v1", Get("baz"));
+  ASSERT_EQ("NOT_FOUND", Get("missing"));
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_OK(Put(Key(i), Key(i)));
+  }
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ(Key(i), Get(Key(i)));
+    ASSERT_EQ("NOT_FOUND", Get(Key(i) + "x"));
+  }
+}
+
+TEST(DBTest, RowCache) {
+  Options options = CurrentOptions();
+  options.row_cache_size = 1 << 20;
+  Reopen(&options);
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Put("bar", "v1"));
+  dbfull()->TEST_CompactMemTable();
+
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_EQ("v1", Get("foo"));
+  std::string hits, misses;
+  ASSERT_TRUE(db_->GetProperty("leveldb.row-cache-hits", &hits));
+  ASSERT_TRUE(db_->GetProperty("leveldb.row-cache-misses", &misses));
+  ASSERT_EQ("1", hits);
+  ASSERT_EQ("1", misses);
+
+  // Newer entries in other tables and snapshots of older ones
+  const Snapshot* snapshot = db_->GetSnapshot();
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_OK(Delete("bar"));
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 2; i++) {
+    ASSERT_EQ("v2", Get("foo"));
+    ASSERT_EQ("NOT_FOUND", Get("bar"));
+    ASSERT_EQ("v1", Get("foo", snapshot));
+    ASSERT_EQ("v1", Get("bar", snapshot));
+  }
+  db_->ReleaseSnapshot(snapshot);
+  ASSERT_TRUE(db_->GetProperty("leveldb.row-cache-hits", &hits));
+  ASSERT_GT(strtoull(hits.c_str(), NULL, 10), 3);
+}
+
+TEST(DBTest, ReadTriggeredCompaction) {
+  Options options = CurrentOptions();
+  options.filter_policy = NULL;
+  options.read_compaction_bytes_per_sec = 0;
+  Reopen(&options);
+
+  // Two overlapping tables at level 1, with the even keys in the older
+  // one; each pair of flushes is compacted into one table
+  for (int parity = 0; parity < 2; parity++) {
+    for (int i = parity; i < 400; i += 2) {
+      ASSERT_OK(Put(Key(i), "v"));
+      if (i % 200 == 198 + parity) {
+        dbfull()->TEST_CompactMemTable();
+      }
+    }
+    dbfull()->TEST_CompactRange(0, NULL, NULL);
+  }
+  ASSERT_EQ("0,2", FilesPerLevel());
+
+  // Reads of even keys search both tables.  Without a budget for read
+  // compactions the tables are left alone.
+  for (int n = 0; n < 4000; n++) {
+    ASSERT_EQ("v", Get(Key((n * 2) % 400)));
+  }
+  ASSERT_EQ("0,2", FilesPerLevel());
+
+  // With one they are merged, by a compaction that runs in the background
+  options.read_compaction_bytes_per_sec = 1 << 20;
+  Reopen(&options);
+  for (int n = 0; n < 4000 && NumTableFilesAtLevel(1) > 1; n++) {
+    ASSERT_EQ("v", Get(Key((n * 2) % 400)));
+  }
+  for (int i = 0; i < 1000 && NumTableFilesAtLevel(1) > 1; i++) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_EQ(1, NumTableFilesAtLevel(1) + NumTableFilesAtLevel(2));
+  for (int i = 0; i < 400; i++) {
+    ASSERT_EQ("v", Get(Key(i)));
+  }
+}
+
+// Return the comma separated numbers of the sentinel files at "level"
+static std::string SentinelFileList(const std::string& details) {
+  const size_t start = details.find("\"files\":[") + 9;
+  return details.substr(start, details.find(']', start) - start);
+}
+
+static bool ListContains(const std::string& list, const std::string& number) {
+  return ("," + list + ",").find("," + number + ",") != std::string::npos;
+}
+
+TEST(DBTest, CompactRangeSkipsCompactedFiles) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  for (int snapshot = 0; snapshot < 2; snapshot++) {
+    DestroyAndReopen(&options);
+    // Level-2 gets a single table, which holds two versions of key 0 if a
+    // snapshot was taken in between
+    const Snapshot* s = NULL;
+    for (int i = 0; i < 1000; i++) {
+      ASSERT_OK(Put(Key(i), "v1"));
+    }
+    if (snapshot) {
+      s = db_->GetSnapshot();
+    }
+    ASSERT_OK(Put(Key(0), "v2"));
+    db_->CompactRange(NULL, NULL);
+    dbfull()->TEST_CompactRange(1, NULL, NULL);
+    ASSERT_EQ("0,0,1", FilesPerLevel());
+    const std::string table = SentinelFileList(SentinelDetailsAtLevel(2));
+    if (s != NULL) {
+      db_->ReleaseSnapshot(s);
+    }
+
+    // A full compaction of data outside its range rewrites the table only
+    // if it still holds entries to drop
+    Reopen(&options);
+    ASSERT_OK(Put(Key(5000), "v1"));
+    db_->CompactRange(NULL, NULL);
+    ASSERT_EQ(0, NumTableFilesAtLevel(0) + NumTableFilesAtLevel(1));
+    const std::string tables = SentinelFileList(SentinelDetailsAtLevel(2));
+    ASSERT_EQ(!snapshot, ListContains(tables, table)) << tables;
+    ASSERT_EQ("v2", Get(Key(0)));
+    ASSERT_EQ("v1", Get(Key(999)));
+    ASSERT_EQ("v1", Get(Key(5000)));
+  }
+}
+
+TEST(DBTest, TombstoneTriggeredCompaction) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  for (int i = 0; i < 2000; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  db_->CompactRange(NULL, NULL);
+  dbfull()->TEST_CompactRange(1, NULL, NULL);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+
+  // A level-1 table made up of deletions is pushed down on its own, which
+  // drops the deletions along with the values they shadow
+  for (int i = 0; i < 1500; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  for (int i = 0; i < 500 && NumTableFilesAtLevel(1) > 0; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  ASSERT_EQ("NOT_FOUND", Get(Key(0)));
+  ASSERT_EQ("v", Get(Key(1500)));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  int count = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    count++;
+  }
+  delete iter;
+  ASSERT_EQ(500, count);
+}
+
+TEST(DBTest, TablePropertiesProperty) {
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  DestroyAndReopen(&options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), "v"));
+  }
+  for (int i = 0; i < 30; i++) {
+    ASSERT_OK(Delete(Key(i)));
+  }
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ(1, NumTableFilesAtLevel(0));
+
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.table-properties-at-level0",
+                               &property));
+  ASSERT_TRUE(property.find("entries=130 deletions=30 ") != std::string::npos)
+      << property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.table-properties-at-level1",
+                               &property));
+  ASSERT_EQ("", property);
+  ASSERT_TRUE(!db_->GetProperty("leveldb.table-properties-at-level99",
+                                &property));
+}
+
+TEST(DBTest, KeyNumExtractor) {
+  const KeyNumExtractor* extractor =
+      NewPrefixSkippingKeyNumExtractor("tenant:0042:");
+  const KeyNumExtractor* other = NewPrefixSkippingKeyNumExtractor("tenant:");
+  std::vector<std::string> keys;
+  keys.push_back("a");
+  keys.push_back("tenant:0041:obj:000000");
+  for (int i = 0; i < 1000; i++) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "tenant:0042:obj:%06d", i);
+    keys.push_back(buf);
+  }
+  keys.push_back("tenant:0043:obj:000000");
+  keys.push_back("z");
+  for (size_t i = 1; i < keys.size(); i++) {
+    ASSERT_LE(extractor->KeyNum(keys[i - 1]), extractor->KeyNum(keys[i]));
+  }
+
+  Options options = CurrentOptions();
+  options.create_if_missing = true;
+  options.key_num_extractor = extractor;
+  options.block_key_nums = true;
+  options.block_restart_interval = 1;
+  options.write_buffer_size = 10000;
+  DestroyAndReopen(&options);
+  for (size_t i = 0; i < keys.size(); i++) {
+    ASSERT_OK(Put(keys[i], "v" + keys[i]));
+  }
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->CompactRange(NULL, NULL);
+
+  // Blocks written with one extractor stay readable under another
+  for (int pass = 0; pass < 3; pass++) {
+    options.key_num_extractor = pass == 0 ? extractor :
+                                pass == 1 ? other : NULL;
+    Reopen(&options);
+    for (size_t i = 0; i < keys.size(); i++) {
+      ASSERT_EQ("v" + keys[i], Get(keys[i]));
+    }
+    ASSERT_EQ("NOT_FOUND", Get("tenant:0042:obj:000500x"));
+    Iterator* iter = db_->NewIterator(ReadOptions());
+    iter->Seek("tenant:0042:obj:000500x");
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ("tenant:0042:obj:000501", iter->key().ToString());
+    size_t count = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+      ASSERT_LT(count, keys.size());
+      ASSERT_EQ(keys[count], iter->key().ToString());
+      count++;
+    }
+    ASSERT_EQ(keys.size(), count);
+    delete iter;
+  }
+  Close();
+  delete extractor;
+  delete other;
+}
+
 TEST(DBTest, RecoverWithLargeLog) {
   {
     Options options = CurrentOptions();
@@ -1086,6 +1412,60 @@ TEST(DBTest, RecoverWithLargeLog) {
   ASSERT_GT(NumTableFilesAtLevel(0), 1);
 }
 
+TEST(DBTest, RecycleLogFiles) {
+  Options options = CurrentOptions();
+  options.write_buffer_size = 100000;
+  options.recycle_log_file_num = 2;
+  options.preallocate_next_log = true;
+  Reopen(&options);
+
+  for (int round = 0; round < 3; round++) {
+    for (int i = 0; i < 500; i++) {
+      ASSERT_OK(Put(Key(i), Key(i + round) + std::string(1000, 'v')));
+    }
+    Reopen(&options);
+    for (int i = 0; i < 500; i++) {
+      ASSERT_EQ(Key(i + round) + std::string(1000, 'v'), Get(Key(i)));
+    }
+  }
+
+  // The info log of the last round of writes was rotated by the reopen
+  std::string info_log;
+  ASSERT_OK(ReadFileToString(env_, OldInfoLogFileName(dbname_), &info_log));
+  ASSERT_TRUE(info_log.find("Reusing log") != std::string::npos);
+}
+
+static bool SnappyCompressionSupported() {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaa";
+  return port::Snappy_Compress(in.data(), in.size(), &out);
+}
+
+TEST(DBTest, WalCompression) {
+  Options options = CurrentOptions();
+  options.wal_compression = kSnappyCompression;
+  Reopen(&options);
+
+  for (int i = 0; i < 100; i++) {
+    ASSERT_OK(Put(Key(i), std::string(1000, 'a' + i % 26)));
+  }
+  std::string property;
+  ASSERT_TRUE(db_->GetProperty("leveldb.user-bytes-written", &property));
+  const uint64_t user_bytes = strtoull(property.c_str(), NULL, 10);
+  ASSERT_TRUE(db_->GetProperty("leveldb.wal-bytes-written", &property));
+  const uint64_t wal_bytes = strtoull(property.c_str(), NULL, 10);
+  ASSERT_GT(wal_bytes, 0);
+  if (SnappyCompressionSupported()) {
+    ASSERT_LT(wal_bytes, user_bytes / 2);
+  }
+
+  // Recover the records from the compressed log
+  Reopen(&options);
+  for (int i = 0; i < 100; i++) {
+    ASSERT_EQ(std::string(1000, 'a' + i % 26), Get(Key(i)));
+  }
+}
+
 TEST(DBTest, CompactionsGenerateMultipleFiles) {
   Options options = CurrentOptions();
   options.write_buffer_size = 100000000;        // Large write buffer
@@ -1269,6 +1649,55 @@ TEST(DBTest, ApproximateSizes_MixOfSmallAndLarge) {
   } while (ChangeOptions());
 }
 
+// Return a key just after "prefix" that is chosen as a guard at "level"
+// and all deeper levels (see GuardInserter in write_batch.cc)
+static std::string GuardKeyAfter(const std::string& prefix, unsigned level) {
+  const uint32_t mask = (1u << (27 - 2 * level)) - 1;
+  for (int i = 0; ; i++) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "%s.%d", prefix.c_str(), i);
+    uint32_t hash;
+    MurmurHash3_x86_32(buf, strlen(buf), 42, &hash);
+    if ((hash & mask) == mask) {
+      return buf;
+    }
+  }
+}
+
+TEST(DBTest, ApproximateSizesWithGuards) {
+  Options options = CurrentOptions();
+  options.compression = kNoCompression;
+  options.write_buffer_size = 1 << 20;
+  Reopen(&options);
+
+  const int N = 20000;
+  static const int S1 = 1000;
+  static const int S2 = 1100;  // Allow some expansion from metadata
+  // A few guards from level 2 down split the keys, each holding several
+  // files
+  Random rnd(301);
+  for (int i = 0; i < N; i++) {
+    ASSERT_OK(Put(Key(i), RandomString(&rnd, S1)));
+    if (i % 5000 == 2500) {
+      ASSERT_OK(Put(GuardKeyAfter(Key(i), 2), ""));
+    }
+  }
+  dbfull()->TEST_CompactMemTable();
+  for (int i = 0; i < 500 && NumTableFilesAtLevel(0) > 0; i++) {
+    env_->SleepForMicroseconds(10000);
+  }
+  ASSERT_GT(NumGuardFiles(), 0);
+
+  for (int run = 0; run < 2; run++) {
+    for (int i = 0; i < N; i += 1000) {
+      ASSERT_TRUE(Between(Size("", Key(i)), S1*i, S2*i));
+      ASSERT_TRUE(Between(Size(Key(i), Key(i+1000)), S1*1000, S2*1000));
+    }
+    ASSERT_TRUE(Between(Size("", Key(N)), S1*N, S2*N));
+    Reopen(&options);
+  }
+}
+
 TEST(DBTest, IteratorPinsRef) {
   Put("foo", "hello");
 
@@ -1351,6 +1780,32 @@ TEST(DBTest, HiddenValuesAreRemoved) {
   } while (ChangeOptions());
 }
 
+TEST(DBTest, CompactionKeepsOneVersionPerSnapshot) {
+  Put("a", "begin");
+  Put("z", "end");
+  Put("foo", "v1");
+  const Snapshot* s1 = db_->GetSnapshot();
+  Put("foo", "v2");
+  Put("foo", "v3");
+  Put("foo", "v4");
+  const Snapshot* s2 = db_->GetSnapshot();
+  Put("foo", "v5");
+  Put("foo", "v6");
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_EQ(AllEntriesFor("foo"), "[ v6, v5, v4, v3, v2, v1 ]");
+
+  dbfull()->TEST_CompactRange(0, NULL, NULL);
+  // Only the newest version visible to each snapshot and to the live
+  // view survives.
+  ASSERT_EQ(AllEntriesFor("foo"), "[ v6, v4, v1 ]");
+  ASSERT_EQ("v1", Get("foo", s1));
+  ASSERT_EQ("v4", Get("foo", s2));
+  ASSERT_EQ("v6", Get("foo"));
+
+  db_->ReleaseSnapshot(s1);
+  db_->ReleaseSnapshot(s2);
+}
+
 TEST(DBTest, DeletionMarkers1) {
   Put("foo", "v1");
   ASSERT_OK(dbfull()->TEST_CompactMemTable());
@@ -1552,6 +2007,298 @@ TEST(DBTest, CustomComparator) {
   ASSERT_EQ("0,0,1", FilesPerLevel());
 }*/
 
+TEST(DBTest, Checkpoint) {
+  const std::string dir = test::TmpDir() + "/db_test_checkpoint";
+  DestroyDB(dir, Options());
+
+  ASSERT_OK(Put("foo", "v1"));
+  ASSERT_OK(Put("bar", "b1"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("baz", "z1"));  // Only in the log
+  ASSERT_OK(db_->Checkpoint(dir, false));
+  ASSERT_TRUE(!db_->Checkpoint(dir, false).ok());
+
+  // Later writes do not show up in the checkpoint
+  ASSERT_OK(Put("foo", "v2"));
+  ASSERT_OK(dbfull()->TEST_CompactMemTable());
+  ASSERT_OK(Put("qux", "q1"));
+
+  Options options = CurrentOptions();
+  DB* copy = NULL;
+  ASSERT_OK(DB::Open(options, dir, &copy));
+  std::string value;
+  ASSERT_OK(copy->Get(ReadOptions(), "foo", &value));
+  ASSERT_EQ("v1", value);
+  ASSERT_OK(copy->Get(ReadOptions(), "bar", &value));
+  ASSERT_EQ("b1", value);
+  ASSERT_OK(copy->Get(ReadOptions(), "baz", &value));
+  ASSERT_EQ("z1", value);
+  ASSERT_TRUE(copy->Get(ReadOptions(), "qux", &value).IsNotFound());
+  delete copy;
+
+  // Refreshing the checkpoint brings it up to date
+  ASSERT_OK(db_->Checkpoint(dir, true));
+  ASSERT_OK(DB::Open(options, dir, &copy));
+  ASSERT_OK(copy->Get(ReadOptions(), "foo", &value));
+  ASSERT_EQ("v2", value);
+  ASSERT_OK(copy->Get(ReadOptions(), "qux", &value));
+  ASSERT_EQ("q1", value);
+  delete copy;
+
+  // The source is unaffected
+  ASSERT_EQ("v2", Get("foo"));
+  ASSERT_EQ("q1", Get("qux"));
+  DestroyDB(dir, Options());
+}
+
+namespace {
+
+struct StalledPutState {
+  DB* db;
+  port::AtomicPointer done;
+};
+
+static void StalledPutBody(void* arg) {
+  StalledPutState* t = reinterpret_cast<StalledPutState*>(arg);
+  ASSERT_OK(t->db->Put(WriteOptions(), "a", "va"));
+  t->done.Release_Store(t);
+}
+
+struct CheckpointThreadState {
+  DB* db;
+  std::string dir;
+  Status status;
+  port::AtomicPointer done;
+};
+
+static void CheckpointThreadBody(void* arg) {
+  CheckpointThreadState* t = reinterpret_cast<CheckpointThreadState*>(arg);
+  t->status = t->db->Checkpoint(t->dir, false);
+  t->done.Release_Store(t);
+}
+
+}  // namespace
+
+TEST(DBTest, WriterQueueKeepsEarlierWriters) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // "a" stalls in the middle of its log write
+  env_->stall_log_write_.Release_Store(env_);
+  StalledPutState state;
+  state.db = db_;
+  state.done.Release_Store(NULL);
+  env_->StartThread(StalledPutBody, &state);
+  while (env_->log_write_stalled_.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+
+  // "b" queues behind "a" and finishes first; "a" must stay queued
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_EQ(1, dbfull()->TEST_QueuedWriters());
+
+  env_->stall_log_write_.Release_Store(NULL);
+  while (state.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+  env_->log_write_stalled_.Release_Store(NULL);
+  ASSERT_EQ(0, dbfull()->TEST_QueuedWriters());
+  ASSERT_EQ("va", Get("a"));
+  ASSERT_EQ("vb", Get("b"));
+}
+
+TEST(DBTest, CheckpointDoesNotBlockWriters) {
+  const std::string dir = test::TmpDir() + "/db_test_checkpoint_writers";
+  DestroyDB(dir, Options());
+  Options options = CurrentOptions();
+  options.env = env_;
+  Reopen(&options);
+
+  // "a" has its place in the log but stalls before writing it
+  env_->stall_log_write_.Release_Store(env_);
+  StalledPutState put;
+  put.db = db_;
+  put.done.Release_Store(NULL);
+  env_->StartThread(StalledPutBody, &put);
+  while (env_->log_write_stalled_.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+
+  // The checkpoint waits for "a", but "b" does not wait for the checkpoint
+  CheckpointThreadState checkpoint;
+  checkpoint.db = db_;
+  checkpoint.dir = dir;
+  checkpoint.done.Release_Store(NULL);
+  env_->StartThread(CheckpointThreadBody, &checkpoint);
+  while (dbfull()->TEST_QueuedWriters() < 2) {
+    DelayMilliseconds(10);
+  }
+  ASSERT_OK(Put("b", "vb"));
+  ASSERT_TRUE(checkpoint.done.Acquire_Load() == NULL);
+
+  env_->stall_log_write_.Release_Store(NULL);
+  while (put.done.Acquire_Load() == NULL ||
+         checkpoint.done.Acquire_Load() == NULL) {
+    DelayMilliseconds(10);
+  }
+  env_->log_write_stalled_.Release_Store(NULL);
+  ASSERT_OK(checkpoint.status);
+
+  // "a" was under way when the checkpoint started and is in it; "b" was
+  // written after and is not
+  DB* copy = NULL;
+  ASSERT_OK(DB::Open(options, dir, &copy));
+  std::string value;
+  ASSERT_OK(copy->Get(ReadOptions(), "a", &value));
+  ASSERT_EQ("va", value);
+  ASSERT_TRUE(copy->Get(ReadOptions(), "b", &value).IsNotFound());
+  delete copy;
+  DestroyDB(dir, Options());
+}
+
+namespace {
+
+struct CheckpointWriterState {
+  DB* db;
+  int id;
+  port::AtomicPointer stop;
+  port::AtomicPointer acked;  // Number of Puts that have returned
+  port::AtomicPointer done;
+};
+
+static const uintptr_t kCheckpointMaxWrites = 50000;
+
+static void CheckpointWriterBody(void* arg) {
+  CheckpointWriterState* t = reinterpret_cast<CheckpointWriterState*>(arg);
+  for (uintptr_t n = 0; t->stop.Acquire_Load() == NULL &&
+                        n < kCheckpointMaxWrites; n++) {
+    char key[40];
+    snprintf(key, sizeof(key), "%d.%08d", t->id, static_cast<int>(n));
+    ASSERT_OK(t->db->Put(WriteOptions(), key, std::string(100, 'x')));
+    t->acked.Release_Store(reinterpret_cast<void*>(n + 1));
+  }
+  t->done.Release_Store(t);
+}
+
+}  // namespace
+
+TEST(DBTest, CheckpointDuringWrites) {
+  const int kWriters = 4;
+  const std::string dir = test::TmpDir() + "/db_test_checkpoint_writes";
+  // Keep every write in one memtable and one log
+  Options options = CurrentOptions();
+  options.write_buffer_size = 64 << 20;
+  Reopen(&options);
+
+  CheckpointWriterState state[kWriters];
+  for (int id = 0; id < kWriters; id++) {
+    state[id].db = db_;
+    state[id].id = id;
+    state[id].stop.Release_Store(NULL);
+    state[id].acked.Release_Store(NULL);
+    state[id].done.Release_Store(NULL);
+    env_->StartThread(CheckpointWriterBody, &state[id]);
+  }
+
+  for (int round = 0; round < 3; round++) {
+    DelayMilliseconds(20);
+    DestroyDB(dir, Options());
+    uintptr_t acked[kWriters];
+    for (int id = 0; id < kWriters; id++) {
+      acked[id] = reinterpret_cast<uintptr_t>(state[id].acked.Acquire_Load());
+    }
+    ASSERT_OK(db_->Checkpoint(dir, false));
+
+    // Every write acknowledged before the checkpoint started is in it
+    options.paranoid_checks = true;
+    DB* copy = NULL;
+    ASSERT_OK(DB::Open(options, dir, &copy));
+    std::string value;
+    for (int id = 0; id < kWriters; id++) {
+      for (uintptr_t n = 0; n < acked[id]; n++) {
+        char key[40];
+        snprintf(key, sizeof(key), "%d.%08d", id, static_cast<int>(n));
+        ASSERT_OK(copy->Get(ReadOptions(), key, &value)) << key;
+      }
+    }
+    delete copy;
+  }
+
+  for (int id = 0; id < kWriters; id++) {
+    state[id].stop.Release_Store(&state[id]);
+  }
+  for (int id = 0; id < kWriters; id++) {
+    while (state[id].done.Acquire_Load() == NULL) {
+      DelayMilliseconds(10);
+    }
+  }
+  DestroyDB(dir, Options());
+}
+
+TEST(DBTest, Trace) {
+  const std::string fname = test::TmpDir() + "/db_test_trace";
+  ASSERT_OK(db_->StartTrace(fname, true));
+  ASSERT_TRUE(!db_->StartTrace(fname, true).ok());
+  ASSERT_OK(Put("foo", "v1"));
+  WriteBatch batch;
+  batch.Put("bar", "b1");
+  batch.Delete("baz");
+  ASSERT_OK(db_->Write(WriteOptions(), &batch));
+  ASSERT_EQ("v1", Get("foo"));
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  iter->Seek("b");
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("bar", iter->key().ToString());
+  delete iter;
+  ASSERT_OK(db_->EndTrace());
+  ASSERT_TRUE(!db_->EndTrace().ok());
+  ASSERT_OK(Put("after", "v"));  // Not traced
+
+  TraceReader* reader = NULL;
+  ASSERT_OK(TraceReader::Open(env_, fname, &reader));
+  ASSERT_TRUE(reader->has_keys());
+  TraceRecord r;
+  ASSERT_TRUE(reader->Read(&r));
+  ASSERT_EQ(kTraceWrite, r.type);
+  ASSERT_EQ(1u, r.ops.size());
+  ASSERT_EQ("foo", r.ops[0].key);
+  ASSERT_EQ(2u, r.ops[0].value_size);
+  uint64_t micros = r.micros;
+  ASSERT_TRUE(reader->Read(&r));
+  ASSERT_EQ(kTraceWrite, r.type);
+  ASSERT_EQ(2u, r.ops.size());
+  ASSERT_EQ(kTypeValue, r.ops[0].type);
+  ASSERT_EQ("bar", r.ops[0].key);
+  ASSERT_EQ(kTypeDeletion, r.ops[1].type);
+  ASSERT_EQ("baz", r.ops[1].key);
+  ASSERT_GE(r.micros, micros);
+  ASSERT_TRUE(reader->Read(&r));
+  ASSERT_EQ(kTraceGet, r.type);
+  ASSERT_EQ("foo", r.ops[0].key);
+  ASSERT_TRUE(reader->Read(&r));
+  ASSERT_EQ(kTraceSeek, r.type);
+  ASSERT_EQ("b", r.ops[0].key);
+  ASSERT_TRUE(!reader->Read(&r));
+  ASSERT_OK(reader->status());
+  delete reader;
+
+  // Without keys only the sizes are kept
+  ASSERT_OK(db_->StartTrace(fname, false));
+  ASSERT_EQ("v1", Get("foo"));
+  ASSERT_OK(db_->EndTrace());
+  ASSERT_OK(TraceReader::Open(env_, fname, &reader));
+  ASSERT_TRUE(!reader->has_keys());
+  ASSERT_TRUE(reader->Read(&r));
+  ASSERT_EQ(kTraceGet, r.type);
+  ASSERT_EQ(3u, r.ops[0].key_size);
+  ASSERT_EQ("", r.ops[0].key);
+  ASSERT_TRUE(!reader->Read(&r));
+  ASSERT_OK(reader->status());
+  delete reader;
+  env_->DeleteFile(fname);
+}
+
 TEST(DBTest, DBOpen_Options) {
   std::string dbname = test::TmpDir() + "/db_options_test";
   DestroyDB(dbname, Options());
@@ -1944,6 +2691,12 @@ class ModelDB: public DB {
       return new ModelIter(snapshot_state, false);
     }
   }
+  virtual Status NewParallelIterators(const ReadOptions& options, int n,
+                                      std::vector<Iterator*>* iterators) {
+    iterators->clear();
+    iterators->push_back(NewIterator(options));
+    return Status::OK();
+  }
   virtual void GetReplayTimestamp(std::string* timestamp) {
   }
   virtual void AllowGarbageCollectBeforeTimestamp(const std::string& timestamp) {
@@ -2001,6 +2754,15 @@ class ModelDB: public DB {
   }
   virtual Status LiveBackup(const Slice& name) {
   }
+  virtual Status Checkpoint(const Slice& dir, bool incremental) {
+    return Status::NotSupported("checkpoint");
+  }
+  virtual Status StartTrace(const std::string& fname, bool record_keys) {
+    return Status::NotSupported("trace");
+  }
+  virtual Status EndTrace() {
+    return Status::NotSupported("trace");
+  }
 
  private:
   class ModelIter: public Iterator {
@@ -2879,6 +3641,56 @@ TEST(DBTest, FLSMGuardsE2EScanOneLevel)  {
 	  ASSERT_EQ(num_entries, 102);
 }
 
+// Verify that parallel iterators partition one snapshot of the database
+TEST(DBTest, FLSMGuardsParallelIterators) {
+  int num_values = 100000, value_size = 100;
+  Options options = CurrentOptions();
+  options.compression = kNoCompression;
+  Reopen(&options);
+
+  const std::string value(value_size, 'x');
+  for (int i = 0; i < num_values; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "B%010d", i);
+    Put(key, value);
+  }
+  Reopen();
+
+  std::vector<Iterator*> iters;
+  ASSERT_TRUE(!db_->NewParallelIterators(ReadOptions(), 0, &iters).ok());
+  ASSERT_OK(db_->NewParallelIterators(ReadOptions(), 4, &iters));
+  ASSERT_GT(iters.size(), 1u);
+  ASSERT_LE(iters.size(), 4u);
+
+  // Writes after the call are not visible to any partition.
+  Put("A", "va");
+  Put("C", "vc");
+
+  std::string last;
+  int count = 0;
+  for (size_t i = 0; i < iters.size(); i++) {
+    int in_partition = 0;
+    for (iters[i]->SeekToFirst(); iters[i]->Valid(); iters[i]->Next()) {
+      std::string key = iters[i]->key().ToString();
+      ASSERT_TRUE(count == 0 || last < key);
+      last = key;
+      count++;
+      in_partition++;
+    }
+    ASSERT_OK(iters[i]->status());
+    ASSERT_GT(in_partition, 0);
+
+    // Reverse iteration stays inside the partition too.
+    int reverse = 0;
+    for (iters[i]->SeekToLast(); iters[i]->Valid(); iters[i]->Prev()) {
+      reverse++;
+    }
+    ASSERT_EQ(in_partition, reverse);
+    delete iters[i];
+  }
+  ASSERT_EQ(num_values, count);
+}
+
 bool is_valid_key_for_random_seek(int n) {
 	if (n % 5 == 0 || n % 7 == 0 || n % 11 == 0 || n % 13 == 0 || n % 17 == 0 || n % 57 == 0) {
 		return true;
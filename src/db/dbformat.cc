@@ -98,6 +98,11 @@ void InternalKeyComparator::FindShortSuccessor(std::string* key) const {
   }
 }
 
+uint64_t InternalKeyComparator::KeyNum(const Slice& key) const {
+  // Internal keys order by user key first
+  return UserKeyNum(ExtractUserKey(key));
+}
+
 const char* InternalFilterPolicy::Name() const {
   return user_policy_->Name();
 }
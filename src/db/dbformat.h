@@ -49,6 +49,24 @@ static const unsigned kMaxMemCompactLevel = 2;
 // Approximate gap in bytes between samples of data read during iteration.
 static const unsigned kReadBytesPeriod = 1048576;
 
+// One in this many Gets that search more than one file of a guard is
+// charged to the guard's read samples.
+static const unsigned kGuardReadSamplePeriod = 16;
+
+// A guard with more than one file is compacted for the sake of reads
+// once it has this many read samples.
+static const unsigned kGuardReadCompactionTrigger = 64;
+
+// Read-triggered compactions may save up at most this many seconds of
+// their budget while there is nothing to compact.
+static const unsigned kReadCompactionBurstSeconds = 10;
+
+// A guard is compacted to drop deletion markers once at least this fraction
+// of the entries in its files are deletions, provided they hold at least
+// kTombstoneCompactionMinEntries entries.
+static const double kTombstoneCompactionRatio = 0.5;
+static const uint64_t kTombstoneCompactionMinEntries = 1000;
+
 }  // namespace config
 
 class InternalKey;
@@ -120,28 +138,86 @@ inline ValueType ExtractValueType(const Slice& internal_key) {
   return static_cast<ValueType>(c);
 }
 
+// Tallies the deletion markers and the range of sequence numbers among the
+// internal keys written to one table, for the table's properties.
+class InternalKeyStats {
+ public:
+  InternalKeyStats() { Clear(); }
+
+  void Clear() {
+    num_deletions_ = 0;
+    smallest_seqno_ = kMaxSequenceNumber;
+    largest_seqno_ = 0;
+  }
+
+  void Add(const Slice& internal_key) {
+    assert(internal_key.size() >= 8);
+    const uint64_t num =
+        DecodeFixed64(internal_key.data() + internal_key.size() - 8);
+    const SequenceNumber seq = num >> 8;
+    if (static_cast<ValueType>(num & 0xff) == kTypeDeletion) {
+      num_deletions_++;
+    }
+    if (seq < smallest_seqno_) smallest_seqno_ = seq;
+    if (seq > largest_seqno_) largest_seqno_ = seq;
+  }
+
+  uint64_t num_deletions() const { return num_deletions_; }
+
+  // Record the tallies in the properties of the table *builder writes
+  void SaveTo(TableBuilder* builder) const {
+    if (smallest_seqno_ <= largest_seqno_) {
+      builder->SetInternalKeyStats(num_deletions_, smallest_seqno_,
+                                   largest_seqno_);
+    }
+  }
+
+ private:
+  uint64_t num_deletions_;
+  SequenceNumber smallest_seqno_;
+  SequenceNumber largest_seqno_;
+};
+
 // A comparator for internal keys that uses a specified comparator for
 // the user key portion and breaks ties by decreasing sequence number.
 class InternalKeyComparator : public Comparator {
  private:
   const Comparator* user_comparator_;
+  const KeyNumExtractor* key_num_extractor_;
  public:
-  explicit InternalKeyComparator(const Comparator* c) : user_comparator_(c) { }
+  explicit InternalKeyComparator(const Comparator* c)
+    : user_comparator_(c), key_num_extractor_(NULL) { }
+  // KeyNums are taken from "e" instead of "c" unless "e" is NULL
+  InternalKeyComparator(const Comparator* c, const KeyNumExtractor* e)
+    : user_comparator_(c), key_num_extractor_(e) { }
   InternalKeyComparator(const InternalKeyComparator& other)
-    : user_comparator_(other.user_comparator_) {}
+    : user_comparator_(other.user_comparator_),
+      key_num_extractor_(other.key_num_extractor_) {}
   virtual const char* Name() const;
   virtual int Compare(const Slice& a, const Slice& b) const;
   virtual void FindShortestSeparator(
       std::string* start,
       const Slice& limit) const;
   virtual void FindShortSuccessor(std::string* key) const;
+  virtual uint64_t KeyNum(const Slice& key) const;
 
   const Comparator* user_comparator() const { return user_comparator_; }
 
+  // The KeyNum of a user key.  All KeyNums of a DB come from here, so
+  // that they agree wherever they are compared.
+  uint64_t UserKeyNum(const Slice& user_key) const {
+    return key_num_extractor_ != NULL ?
+        key_num_extractor_->KeyNum(user_key) :
+        user_comparator_->KeyNum(user_key);
+  }
+
   int Compare(const InternalKey& a, const InternalKey& b) const;
 
-  InternalKeyComparator& operator = (const InternalKeyComparator& rhs)
-  { user_comparator_ = rhs.user_comparator_; return *this; }
+  InternalKeyComparator& operator = (const InternalKeyComparator& rhs) {
+    user_comparator_ = rhs.user_comparator_;
+    key_num_extractor_ = rhs.key_num_extractor_;
+    return *this;
+  }
 };
 
 // Filter policy wrapper that converts from internal keys to user keys
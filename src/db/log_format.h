@@ -20,15 +20,32 @@ enum RecordType {
   // For fragments
   kFirstType = 2,
   kMiddleType = 3,
-  kLastType = 4
+  kLastType = 4,
+
+  // Like the above, but the header also carries the log number so that
+  // records left over from an earlier use of a recycled file can be told
+  // apart from the ones written since
+  kRecyclableFullType = 5,
+  kRecyclableFirstType = 6,
+  kRecyclableMiddleType = 7,
+  kRecyclableLastType = 8,
+
+  // Starts a log whose records are compressed; the payload is the
+  // CompressionType, and each following record is that type's framing
+  // byte followed by the record, compressed or as is
+  kSetCompressionType = 9,
+  kRecyclableSetCompressionType = 10
 };
-static const unsigned kMaxRecordType = kLastType;
+static const unsigned kMaxRecordType = kRecyclableSetCompressionType;
 
 static const unsigned kBlockSize = 32768;
 
 // Header is checksum (4 bytes), type (1 byte), length (2 bytes).
 static const unsigned kHeaderSize = 4 + 1 + 2;
 
+// Recyclable header is the above followed by the log number (4 bytes).
+static const unsigned kRecyclableHeaderSize = kHeaderSize + 4;
+
 }  // namespace log
 }  // namespace leveldb
 
@@ -6,6 +6,8 @@
 
 #include <stdio.h>
 #include "pebblesdb/env.h"
+#include "pebblesdb/options.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 
@@ -16,7 +18,7 @@ Reader::Reporter::~Reporter() {
 }
 
 Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-               uint64_t initial_offset)
+               uint64_t initial_offset, uint64_t log_number)
     : file_(file),
       reporter_(reporter),
       checksum_(checksum),
@@ -25,7 +27,12 @@ Reader::Reader(SequentialFile* file, Reporter* reporter, bool checksum,
       eof_(false),
       last_record_offset_(0),
       end_of_buffer_offset_(0),
-      initial_offset_(initial_offset) {
+      initial_offset_(initial_offset),
+      log_number_(log_number),
+      recycled_(false),
+      compressed_(false),
+      compression_lost_(false),
+      uncompressed_() {
 }
 
 Reader::~Reader() {
@@ -90,6 +97,9 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         prospective_record_offset = physical_record_offset;
         scratch->clear();
         *record = fragment;
+        if (!Unframe(record, fragment.size())) {
+          break;
+        }
         last_record_offset_ = prospective_record_offset;
         return true;
 
@@ -126,11 +136,25 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
         } else {
           scratch->append(fragment.data(), fragment.size());
           *record = Slice(*scratch);
+          in_fragmented_record = false;
+          if (!Unframe(record, scratch->size())) {
+            scratch->clear();
+            break;
+          }
           last_record_offset_ = prospective_record_offset;
           return true;
         }
         break;
 
+      case kSetCompressionType:
+        if (fragment.size() == 1 &&
+            fragment[0] == static_cast<char>(kSnappyCompression)) {
+          compressed_ = true;
+        } else {
+          ReportCorruption(fragment.size(), "unknown log compression");
+        }
+        break;
+
       case kEof:
         if (in_fragmented_record) {
           // This can be caused by the writer dying immediately after
@@ -163,6 +187,40 @@ bool Reader::ReadRecord(Slice* record, std::string* scratch) {
   return false;
 }
 
+bool Reader::Unframe(Slice* record, size_t bytes) {
+  if (compression_lost_) {
+    ReportCorruption(bytes, "log compression record lost");
+    return false;
+  }
+  if (!compressed_) {
+    return true;
+  }
+  if (record->empty()) {
+    ReportCorruption(bytes, "bad compressed record");
+    return false;
+  }
+  const char type = (*record)[0];
+  record->remove_prefix(1);
+  if (type == static_cast<char>(kNoCompression)) {
+    return true;
+  }
+  size_t ulength = 0;
+  if (type != static_cast<char>(kSnappyCompression) ||
+      !port::Snappy_GetUncompressedLength(record->data(), record->size(),
+                                          &ulength)) {
+    ReportCorruption(bytes, "bad compressed record");
+    return false;
+  }
+  uncompressed_.resize(ulength);
+  if (!port::Snappy_Uncompress(record->data(), record->size(),
+                               &uncompressed_[0])) {
+    ReportCorruption(bytes, "bad compressed record");
+    return false;
+  }
+  *record = Slice(uncompressed_);
+  return true;
+}
+
 uint64_t Reader::LastRecordOffset() {
   return last_record_offset_;
 }
@@ -211,11 +269,31 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     const uint32_t b = static_cast<uint32_t>(header[5]) & 0xff;
     const unsigned int type = header[6];
     const uint32_t length = a | (b << 8);
-    if (kHeaderSize + length > buffer_.size()) {
+    const bool recyclable = (type >= kRecyclableFullType &&
+                             type <= kRecyclableLastType) ||
+                            type == kRecyclableSetCompressionType;
+    // A damaged record at the start of the log that still claims to be the
+    // kSetCompressionType record takes the framing of the log with it
+    const bool names_compression =
+        end_of_buffer_offset_ == buffer_.size() &&
+        (type == kSetCompressionType || type == kRecyclableSetCompressionType);
+    size_t header_size = kHeaderSize;
+    if (recyclable) {
+      if (buffer_.size() < kRecyclableHeaderSize) {
+        // Too short for a recyclable header, so this is a trailer too
+        buffer_.clear();
+        continue;
+      }
+      header_size = kRecyclableHeaderSize;
+    }
+    if (header_size + length > buffer_.size()) {
       size_t drop_size = buffer_.size();
       buffer_.clear();
       if (!eof_) {
-        ReportCorruption(drop_size, "bad record length");
+        if (!recycled_) {
+          ReportCorruption(drop_size, "bad record length");
+        }
+        compression_lost_ = compression_lost_ || names_compression;
         return kBadRecord;
       }
       // If the end of the file has been reached without reading |length| bytes
@@ -235,7 +313,8 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
     // Check crc
     if (checksum_) {
       uint32_t expected_crc = crc32c::Unmask(DecodeFixed32(header));
-      uint32_t actual_crc = crc32c::Value(header + 6, 1 + length);
+      uint32_t actual_crc = crc32c::Value(header + 6,
+                                          header_size - 6 + length);
       if (actual_crc != expected_crc) {
         // Drop the rest of the buffer since "length" itself may have
         // been corrupted and if we trust it, we could find some
@@ -243,21 +322,46 @@ unsigned int Reader::ReadPhysicalRecord(Slice* result) {
         // like a valid log record.
         size_t drop_size = buffer_.size();
         buffer_.clear();
-        ReportCorruption(drop_size, "checksum mismatch");
+        if (!recycled_) {
+          ReportCorruption(drop_size, "checksum mismatch");
+        }
+        compression_lost_ = compression_lost_ || names_compression;
         return kBadRecord;
       }
     }
 
-    buffer_.remove_prefix(kHeaderSize + length);
+    if (recycled_ && !recyclable) {
+      // Recycled files are only ever written with recyclable records
+      buffer_.clear();
+      return kBadRecord;
+    }
+
+    buffer_.remove_prefix(header_size + length);
+
+    if (recyclable) {
+      recycled_ = true;
+      if (log_number_ != 0 &&
+          DecodeFixed32(header + kHeaderSize) !=
+              static_cast<uint32_t>(log_number_)) {
+        // Left over from an earlier log that used this file
+        result->clear();
+        return kBadRecord;
+      }
+    }
 
     // Skip physical record that started before initial_offset_
-    if (end_of_buffer_offset_ - buffer_.size() - kHeaderSize - length <
+    if (end_of_buffer_offset_ - buffer_.size() - header_size - length <
         initial_offset_) {
       result->clear();
       return kBadRecord;
     }
 
-    *result = Slice(header + kHeaderSize, length);
+    *result = Slice(header + header_size, length);
+    if (type == kRecyclableSetCompressionType) {
+      return kSetCompressionType;
+    } else if (recyclable) {
+      return type - kRecyclableFullType + kFullType;
+    }
     return type;
   }
 }
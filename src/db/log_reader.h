@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_DB_LOG_READER_H_
 
 #include <stdint.h>
+#include <string>
 
 #include "db/log_format.h"
 #include "pebblesdb/slice.h"
@@ -40,8 +41,15 @@ class Reader {
   //
   // The Reader will start reading at the first record located at physical
   // position >= initial_offset within the file.
+  //
+  // If "log_number" is non-zero, recyclable records are only returned if
+  // they carry that log number; the others were left behind by an earlier
+  // use of the file and are skipped without reporting a drop.
+  //
+  // Records of a log written with compression are returned uncompressed,
+  // provided the reader starts at the beginning of the log.
   Reader(SequentialFile* file, Reporter* reporter, bool checksum,
-         uint64_t initial_offset);
+         uint64_t initial_offset, uint64_t log_number = 0);
 
   ~Reader();
 
@@ -73,6 +81,20 @@ class Reader {
   // Offset at which to start looking for the first record to return
   uint64_t const initial_offset_;
 
+  uint64_t const log_number_;
+
+  // True once a valid recyclable record was read.  Past that point the
+  // file may end in what an earlier use of it left behind, so records that
+  // fail to parse are skipped rather than reported.
+  bool recycled_;
+
+  // Compression named by the log's kSetCompressionType record, if any.
+  // Records of such a log are framed with their own compression type.
+  bool compressed_;
+  // True if that record was damaged, so no record can be unframed
+  bool compression_lost_;
+  std::string uncompressed_;
+
   // Extend record types with the following special values
   enum {
     kEof = kMaxRecordType + 1,
@@ -81,6 +103,7 @@ class Reader {
     // * The record has an invalid CRC (ReadPhysicalRecord reports a drop)
     // * The record is a 0-length record (No drop is reported)
     // * The record is below constructor's initial_offset (No drop is reported)
+    // * The record is left over in a recycled file (No drop is reported)
     kBadRecord = kMaxRecordType + 2
   };
 
@@ -92,6 +115,11 @@ class Reader {
   // Return type, or one of the preceding special values
   unsigned int ReadPhysicalRecord(Slice* result);
 
+  // Strip the framing from a record of a compressed log, uncompressing it
+  // into uncompressed_ if needed.  Returns false, after reporting the
+  // "bytes" of the record as dropped, if it cannot be unframed.
+  bool Unframe(Slice* record, size_t bytes);
+
   // Reports dropped bytes to the reporter.
   // buffer_ must be updated to remove the dropped bytes prior to invocation.
   void ReportCorruption(size_t bytes, const char* reason);
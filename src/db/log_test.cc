@@ -5,10 +5,12 @@
 #include "db/log_reader.h"
 #include "db/log_writer.h"
 #include "pebblesdb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/random.h"
 #include "util/testharness.h"
+#include "util/testutil.h"
 
 namespace leveldb {
 namespace log {
@@ -115,6 +117,8 @@ class LogTest {
   bool reading_;
   Writer writer_;
   Reader reader_;
+  Writer* log_writer_;
+  Reader* log_reader_;
 
   // Record metadata for testing initial offset functionality
   static size_t initial_offset_record_sizes_[];
@@ -124,12 +128,40 @@ class LogTest {
   LogTest() : reading_(false),
               writer_(&dest_),
               reader_(&source_, &report_, true/*checksum*/,
-                      0/*initial_offset*/) {
+                      0/*initial_offset*/),
+              log_writer_(NULL),
+              log_reader_(NULL) {
+  }
+
+  ~LogTest() {
+    delete log_writer_;
+    delete log_reader_;
+  }
+
+  // Write later records as log "log_number", overwriting the file from
+  // its start, and read them expecting that log number.
+  void StartLog(uint64_t log_number, bool recycle,
+                CompressionType compression) {
+    ASSERT_TRUE(!reading_) << "StartLog() after starting to read";
+    delete log_writer_;
+    delete log_reader_;
+    log_writer_ = new Writer(&dest_, log_number, recycle, compression);
+    log_reader_ = new Reader(&source_, &report_, true/*checksum*/,
+                             0/*initial_offset*/, log_number);
+  }
+
+  // Reuse the file for log "log_number"
+  void RecycleAs(uint64_t log_number) {
+    StartLog(log_number, true, kNoCompression);
   }
 
   void Write(const std::string& msg) {
     ASSERT_TRUE(!reading_) << "Write() after starting to read";
-    writer_.AddRecord(Slice(msg));
+    if (log_writer_ != NULL) {
+      log_writer_->AddRecord(Slice(msg));
+    } else {
+      writer_.AddRecord(Slice(msg));
+    }
   }
 
   size_t WrittenBytes() const {
@@ -143,7 +175,8 @@ class LogTest {
     }
     std::string scratch;
     Slice record;
-    if (reader_.ReadRecord(&record, &scratch)) {
+    Reader* reader = log_reader_ != NULL ? log_reader_ : &reader_;
+    if (reader->ReadRecord(&record, &scratch)) {
       return record.ToString();
     } else {
       return "EOF";
@@ -327,6 +360,143 @@ TEST(LogTest, AlignedEof) {
   ASSERT_EQ("EOF", Read());
 }
 
+TEST(LogTest, RecordFillingBlocksExactly) {
+  // The second fragment ends exactly at the end of the second block
+  const int n = 2 * (kBlockSize - kHeaderSize);
+  Write(BigString("foo", n));
+  Write("bar");
+  ASSERT_EQ(2 * kBlockSize + kHeaderSize + 3, WrittenBytes());
+  ASSERT_EQ(BigString("foo", n), Read());
+  ASSERT_EQ("bar", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledReadWrite) {
+  RecycleAs(7);
+  Write("foo");
+  Write(BigString("bar", 3 * kBlockSize));
+  Write("");
+  Write("xxxx");
+  ASSERT_EQ(3 * kRecyclableHeaderSize + 3 + 4 +
+            4 * kRecyclableHeaderSize + 3 * kBlockSize, WrittenBytes());
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ(BigString("bar", 3 * kBlockSize), Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ("xxxx", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, RecycledLogIgnoresStaleTail) {
+  RecycleAs(1);
+  for (int i = 0; i < 1000; i++) {
+    Write(NumberString(i));
+  }
+  Write(BigString("old", 2 * kBlockSize));
+  const size_t old_size = WrittenBytes();
+
+  // The new log ends in the middle of a record of the old one
+  RecycleAs(2);
+  Write("a");
+  Write(BigString("new", 1000));
+  ASSERT_EQ(old_size, WrittenBytes());
+  ASSERT_EQ("a", Read());
+  ASSERT_EQ(BigString("new", 1000), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+  ASSERT_EQ("", ReportMessage());
+}
+
+TEST(LogTest, RecycledLogReportsCorruption) {
+  RecycleAs(3);
+  Write("foo");
+  Write("bar");
+  // Before any record checks out, damage is not mistaken for a leftover
+  IncrementByte(kRecyclableHeaderSize, 1);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(2 * (kRecyclableHeaderSize + 3), DroppedBytes());
+  ASSERT_EQ("OK", MatchError("checksum mismatch"));
+}
+
+static bool SnappyCompressionSupported() {
+  std::string out;
+  Slice in = "aaaaaaaaaaaaaaaaaaa";
+  return port::Snappy_Compress(in.data(), in.size(), &out);
+}
+
+TEST(LogTest, CompressedReadWrite) {
+  StartLog(5, false, kSnappyCompression);
+  Write("foo");
+  Write("");
+  Write(std::string(100000, 'b'));
+  Write("xxxx");
+  if (SnappyCompressionSupported()) {
+    ASSERT_LT(WrittenBytes(), 10000u);
+  }
+  ASSERT_EQ("foo", Read());
+  ASSERT_EQ("", Read());
+  ASSERT_EQ(std::string(100000, 'b'), Read());
+  ASSERT_EQ("xxxx", Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, CompressedRecycledReadWrite) {
+  StartLog(6, true, kSnappyCompression);
+  for (int i = 0; i < 100; i++) {
+    Write(BigString(NumberString(i), 1000));
+  }
+  const size_t old_size = WrittenBytes();
+  StartLog(7, true, kSnappyCompression);
+  Write(BigString("foo", 1000));
+  ASSERT_EQ(old_size, WrittenBytes());
+  ASSERT_EQ(BigString("foo", 1000), Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_EQ(0, DroppedBytes());
+}
+
+TEST(LogTest, CompressedLogSkipsDamagedRecord) {
+  // Random records do not compress and so span several blocks
+  Random rnd(301);
+  std::string records[3];
+  for (int i = 0; i < 3; i++) {
+    test::RandomString(&rnd, 100000, &records[i]);
+  }
+  StartLog(8, false, kSnappyCompression);
+  for (int i = 0; i < 3; i++) {
+    Write(records[i]);
+  }
+  // Damage a block that holds only the second record
+  const size_t second_block = WrittenBytes() / kBlockSize / 2;
+  IncrementByte(second_block * kBlockSize + kHeaderSize + 1, 1);
+  ASSERT_EQ(records[0], Read());
+  ASSERT_EQ(records[2], Read());
+  ASSERT_EQ("EOF", Read());
+  ASSERT_GT(DroppedBytes(), 0u);
+}
+
+TEST(LogTest, CompressedLogLosesCompressionRecord) {
+  // Build a compressed log by hand, with records stored as is, so that
+  // the test does not depend on snappy being available
+  Write(std::string(1, static_cast<char>(kSnappyCompression)));
+  SetByte(6, kSetCompressionType);
+  FixChecksum(0, 1);
+  Random rnd(301);
+  std::string record;
+  for (int i = 0; i < 3; i++) {
+    test::RandomString(&rnd, 100000, &record);
+    Write(std::string(1, static_cast<char>(kNoCompression)) + record);
+  }
+
+  // Damage the compression named by the first record.  The records that
+  // follow must not be read back as uncompressed ones.
+  IncrementByte(kHeaderSize, 1);
+  ASSERT_EQ("EOF", Read());
+  ASSERT_GT(DroppedBytes(), 2 * 100000u);
+  ASSERT_EQ("OK", MatchError("log compression record lost"));
+}
+
 TEST(LogTest, RandomRead) {
   const int N = 500;
   Random write_rnd(301);
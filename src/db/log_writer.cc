@@ -6,6 +6,7 @@
 
 #include <stdint.h>
 #include "pebblesdb/env.h"
+#include "port/port.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
 #include "util/mutexlock.h"
@@ -13,9 +14,48 @@
 namespace leveldb {
 namespace log {
 
+// Records are only compressed if the compression is available
+static CompressionType SupportedCompression(CompressionType type) {
+  std::string compressed;
+  if (type == kSnappyCompression &&
+      port::Snappy_Compress("", 0, &compressed)) {
+    return type;
+  }
+  return kNoCompression;
+}
+
 Writer::Writer(ConcurrentWritableFile* dest)
     : dest_(dest),
-      offset_(0) {
+      offset_(0),
+      recycle_(false),
+      log_number_(0),
+      header_size_(kHeaderSize),
+      compression_(kNoCompression),
+      status_() {
+  InitTypeCrc();
+}
+
+Writer::Writer(ConcurrentWritableFile* dest, uint64_t log_number,
+               bool recycle, CompressionType compression)
+    : dest_(dest),
+      offset_(0),
+      recycle_(recycle),
+      log_number_(recycle ? static_cast<uint32_t>(log_number) : 0),
+      header_size_(recycle ? kRecyclableHeaderSize : kHeaderSize),
+      compression_(SupportedCompression(compression)),
+      status_() {
+  InitTypeCrc();
+  if (compression_ != kNoCompression) {
+    // Nothing is written concurrently before the constructor returns
+    const char type = static_cast<char>(compression_);
+    status_ = EmitPhysicalRecordAt(
+        recycle_ ? kRecyclableSetCompressionType : kSetCompressionType,
+        &type, 0, 1);
+    offset_ = header_size_ + 1;
+  }
+}
+
+void Writer::InitTypeCrc() {
   for (unsigned i = 0; i <= kMaxRecordType; i++) {
     char t = static_cast<char>(i);
     type_crc_[i] = crc32c::Value(&t, 1);
@@ -25,31 +65,60 @@ Writer::Writer(ConcurrentWritableFile* dest)
 Writer::~Writer() {
 }
 
-Status Writer::AddRecord(const Slice& slice) {
+// Prefix the record with the compression type byte and compress it,
+// unless that does not save at least 12.5%.
+void Writer::FrameRecord(const Slice& slice, std::string* framed) {
+  std::string compressed;
+  if (compression_ == kSnappyCompression &&
+      port::Snappy_Compress(slice.data(), slice.size(), &compressed) &&
+      compressed.size() < slice.size() - (slice.size() / 8u)) {
+    framed->reserve(1 + compressed.size());
+    framed->push_back(static_cast<char>(kSnappyCompression));
+    framed->append(compressed);
+  } else {
+    framed->reserve(1 + slice.size());
+    framed->push_back(static_cast<char>(kNoCompression));
+    framed->append(slice.data(), slice.size());
+  }
+}
+
+Status Writer::AddRecord(const Slice& record, uint64_t* bytes_written) {
   // computation of block_offset requires a pow2
   assert(kBlockSize == 32768);
+  if (!status_.ok()) {
+    return status_;
+  }
+  std::string framed;
+  Slice slice(record);
+  if (compression_ != kNoCompression) {
+    FrameRecord(record, &framed);
+    slice = framed;
+  }
   uint64_t start_offset = 0;
   uint64_t end_offset = 0;
 
   while (true) {
     start_offset = __sync_add_and_fetch(&offset_, 0);
     uint64_t roundup_start = start_offset;
-    if (kBlockSize - (start_offset & (kBlockSize - 1)) < kHeaderSize) {
-      roundup_start += kHeaderSize;
+    if (kBlockSize - (start_offset & (kBlockSize - 1)) < header_size_) {
+      roundup_start += header_size_;
       roundup_start = roundup_start & ~(kBlockSize - 1);
     }
     const uint64_t left = kBlockSize - (roundup_start & (kBlockSize - 1));
-    assert(left >= kHeaderSize);
-    if (kHeaderSize + slice.size() <= left) {
-      end_offset = roundup_start + kHeaderSize + slice.size();
+    assert(left >= header_size_);
+    if (header_size_ + slice.size() <= left) {
+      end_offset = roundup_start + header_size_ + slice.size();
     } else {
       end_offset = ComputeRecordSize(roundup_start + left,
-                                     slice.size() + kHeaderSize - left);
+                                     slice.size() + header_size_ - left);
     }
     if (__sync_bool_compare_and_swap(&offset_, start_offset, end_offset)) {
       break;
     }
   }
+  if (bytes_written != NULL) {
+    *bytes_written = end_offset - start_offset;
+  }
 
   const char* ptr = slice.data();
   size_t left = slice.size();
@@ -64,35 +133,37 @@ Status Writer::AddRecord(const Slice& slice) {
     uint64_t block_offset = offset & (kBlockSize - 1);
     const uint64_t leftover = kBlockSize - block_offset;
     assert(leftover > 0);
-    if (leftover < kHeaderSize) {
+    if (leftover < header_size_) {
       // Switch to a new block
-      // Fill the trailer (literal below relies on kHeaderSize being 7)
-      assert(kHeaderSize == 7);
-      dest_->WriteAt(offset, Slice("\x00\x00\x00\x00\x00\x00", leftover));
+      // Fill the trailer (literal below relies on kRecyclableHeaderSize
+      // being 11)
+      assert(kRecyclableHeaderSize == 11);
+      dest_->WriteAt(offset, Slice("\x00\x00\x00\x00\x00\x00\x00\x00\x00\x00",
+                                   leftover));
       block_offset = 0;
       offset += leftover;
     }
-    // Invariant: we never leave < kHeaderSize bytes in a block.
+    // Invariant: we never leave < header_size_ bytes in a block.
     assert(kBlockSize >= block_offset);
-    assert(kBlockSize - block_offset >= kHeaderSize);
+    assert(kBlockSize - block_offset >= header_size_);
 
-    const size_t avail = kBlockSize - block_offset - kHeaderSize;
+    const size_t avail = kBlockSize - block_offset - header_size_;
     const size_t fragment_length = (left < avail) ? left : avail;
 
     RecordType type;
     const bool end = (left == fragment_length);
     if (begin && end) {
-      type = kFullType;
+      type = recycle_ ? kRecyclableFullType : kFullType;
     } else if (begin) {
-      type = kFirstType;
+      type = recycle_ ? kRecyclableFirstType : kFirstType;
     } else if (end) {
-      type = kLastType;
+      type = recycle_ ? kRecyclableLastType : kLastType;
     } else {
-      type = kMiddleType;
+      type = recycle_ ? kRecyclableMiddleType : kMiddleType;
     }
 
     s = EmitPhysicalRecordAt(type, ptr, offset, fragment_length);
-    offset += kHeaderSize + fragment_length;
+    offset += header_size_ + fragment_length;
     ptr += fragment_length;
     left -= fragment_length;
     begin = false;
@@ -100,32 +171,46 @@ Status Writer::AddRecord(const Slice& slice) {
   return s;
 }
 
+uint64_t Writer::Offset() {
+  return __sync_add_and_fetch(&offset_, 0);
+}
+
 uint64_t Writer::ComputeRecordSize(uint64_t start, uint64_t remain) {
   assert((start & ~(kBlockSize- 1)) == start);
-  const uint64_t per_block = kBlockSize - kHeaderSize;
+  const uint64_t per_block = kBlockSize - header_size_;
   const uint64_t whole_blocks = remain / per_block;
   const uint64_t leftover = remain % per_block;
-  return start + whole_blocks * kBlockSize + kHeaderSize + leftover;
+  if (leftover == 0) {
+    // The last fragment fills its block exactly; reserving a header past it
+    // would leave a hole at the start of the next block.
+    return start + whole_blocks * kBlockSize;
+  }
+  return start + whole_blocks * kBlockSize + header_size_ + leftover;
 }
 
 Status Writer::EmitPhysicalRecordAt(RecordType t, const char* ptr, uint64_t offset, size_t n) {
   assert(n <= 0xffff);  // Must fit in two bytes
 
   // Format the header
-  char buf[kHeaderSize];
+  char buf[kRecyclableHeaderSize];
   buf[4] = static_cast<char>(n & 0xff);
   buf[5] = static_cast<char>(n >> 8);
   buf[6] = static_cast<char>(t);
 
-  // Compute the crc of the record type and the payload.
-  uint32_t crc = crc32c::Extend(type_crc_[t], ptr, n);
+  // Compute the crc of the record type, the log number and the payload.
+  uint32_t crc = type_crc_[t];
+  if (recycle_) {
+    EncodeFixed32(buf + kHeaderSize, log_number_);
+    crc = crc32c::Extend(crc, buf + kHeaderSize, 4);
+  }
+  crc = crc32c::Extend(crc, ptr, n);
   crc = crc32c::Mask(crc);                 // Adjust for storage
   EncodeFixed32(buf, crc);
 
   // Write the header and the payload
-  Status s = dest_->WriteAt(offset, Slice(buf, kHeaderSize));
+  Status s = dest_->WriteAt(offset, Slice(buf, header_size_));
   if (s.ok()) {
-    s = dest_->WriteAt(offset + kHeaderSize, Slice(ptr, n));
+    s = dest_->WriteAt(offset + header_size_, Slice(ptr, n));
   }
   return s;
 }
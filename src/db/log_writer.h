@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include "db/log_format.h"
+#include "pebblesdb/options.h"
 #include "pebblesdb/slice.h"
 #include "pebblesdb/status.h"
 #include "port/port.h"
@@ -23,19 +24,43 @@ class Writer {
   // "*dest" must be initially empty.
   // "*dest" must remain live while this Writer is in use.
   explicit Writer(ConcurrentWritableFile* dest);
+
+  // Create a writer for log "log_number".
+  //
+  // If "recycle" is true, records are tagged with the log number.  "*dest"
+  // may then hold the contents of an earlier log; readers told the log
+  // number skip whatever is left of it.
+  //
+  // If "compression" is not kNoCompression and is supported, each record
+  // is compressed on its own, so a damaged record costs no other.
+  Writer(ConcurrentWritableFile* dest, uint64_t log_number, bool recycle,
+         CompressionType compression);
   ~Writer();
 
-  Status AddRecord(const Slice& slice);
+  // If "bytes_written" is non-NULL, it is set to the space the record
+  // took in the file, including headers and padding.
+  Status AddRecord(const Slice& slice, uint64_t* bytes_written = NULL);
+
+  // The end of the space claimed by the records added so far.  Records
+  // still being added may not be fully written below it yet.
+  uint64_t Offset();
 
  private:
   ConcurrentWritableFile* dest_;
   uint64_t offset_; // Current offset in file
+  const bool recycle_;
+  const uint32_t log_number_;   // Low 32 bits, only stored when recycle_
+  const uint64_t header_size_;
+  const CompressionType compression_;
+  Status status_;               // Of writing the kSetCompressionType record
 
   // crc32c values for all supported record types.  These are
   // pre-computed to reduce the overhead of computing the crc of the
   // record type stored in the header.
   uint32_t type_crc_[kMaxRecordType + 1];
 
+  void InitTypeCrc();
+  void FrameRecord(const Slice& slice, std::string* framed);
   uint64_t ComputeRecordSize(uint64_t start, uint64_t remain);
   Status EmitPhysicalRecordAt(RecordType type, const char* ptr, uint64_t offset, size_t length);
 
@@ -10,6 +10,7 @@
 #include "pebblesdb/env.h"
 #include "pebblesdb/iterator.h"
 #include "util/coding.h"
+#include "util/dynamic_bloom.h"
 #include "util/mutexlock.h"
 
 namespace leveldb {
@@ -21,17 +22,33 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
+// Bits set per key in the bloom filter
+static const int kBloomProbes = 6;
+
 MemTable::MemTable(const InternalKeyComparator& cmp)
-    : comparator_(cmp),
+    : num_entries(0),
+      comparator_(cmp),
       extractor_(cmp),
       refs_(0),
       arena_(),
       table_(comparator_, extractor_, &arena_),
-	  num_entries(0) {
+      bloom_(NULL) {
+}
+
+MemTable::MemTable(const InternalKeyComparator& cmp, size_t bloom_bytes)
+    : num_entries(0),
+      comparator_(cmp),
+      extractor_(cmp),
+      refs_(0),
+      arena_(),
+      table_(comparator_, extractor_, &arena_),
+      bloom_(bloom_bytes > 0 ?
+             new DynamicBloom(&arena_, bloom_bytes, kBloomProbes) : NULL) {
 }
 
 MemTable::~MemTable() {
   assert(refs_ == 0);
+  delete bloom_;
 }
 
 size_t MemTable::ApproximateMemoryUsage() { return arena_.MemoryUsage(); }
@@ -51,7 +68,7 @@ uint64_t MemTable::KeyExtractor::operator()(const char* k)
   }
   uint32_t key_length;
   const char* key_ptr = GetVarint32Ptr(k, k+5, &key_length);
-  return comparator.user_comparator()->KeyNum(Slice(key_ptr, key_length - 8));
+  return comparator.UserKeyNum(Slice(key_ptr, key_length - 8));
 }
 
 // Encode a suitable internal key target for "target" and return it.
@@ -119,11 +136,19 @@ void MemTable::Add(SequenceNumber s, ValueType type,
   p = EncodeVarint32(p, val_size);
   memcpy(p, value.data(), val_size);
   assert(static_cast<size_t>((p + val_size) - buf) == encoded_len);
+  if (bloom_ != NULL) {
+    // Before the insert, so that a reader that finds the entry also
+    // finds its bits
+    bloom_->Add(key);
+  }
   table_.Insert(buf);
   num_entries++;
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
+  if (bloom_ != NULL && !bloom_->MayContain(key.user_key())) {
+    return false;
+  }
   Slice memkey = key.memtable_key();
   Table::Iterator iter(&table_);
   iter.Seek(memkey.data());
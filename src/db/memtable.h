@@ -14,6 +14,7 @@
 
 namespace leveldb {
 
+class DynamicBloom;
 class InternalKeyComparator;
 class Mutex;
 class MemTableIterator;
@@ -24,6 +25,10 @@ class MemTable {
   // is zero and the caller must call Ref() at least once.
   explicit MemTable(const InternalKeyComparator& comparator);
 
+  // Like MemTable(comparator), but with a bloom filter of about
+  // "bloom_bytes" bytes over the user keys unless "bloom_bytes" is 0.
+  MemTable(const InternalKeyComparator& comparator, size_t bloom_bytes);
+
   // Increase reference count.
   void Ref() { atomic::increment_64_fullbarrier(&refs_, 1); }
 
@@ -88,6 +93,7 @@ class MemTable {
   uint64_t refs_;
   Arena arena_;
   Table table_;
+  DynamicBloom* bloom_;  // Over the user keys, or NULL
 
   // No copying allowed
   MemTable(const MemTable&);
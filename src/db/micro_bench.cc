@@ -0,0 +1,749 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// Microbenchmarks of the components on the read and write paths, so that
+// changes to one of them can be measured in isolation.  All inputs come
+// from fixed seeds, so runs are repeatable.
+
+#include <algorithm>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "db/memtable.h"
+#include "db/version_edit.h"
+#include "db/version_set.h"
+#include "db/write_batch_internal.h"
+#include "pebblesdb/cache.h"
+#include "pebblesdb/comparator.h"
+#include "pebblesdb/env.h"
+#include "pebblesdb/filter_policy.h"
+#include "pebblesdb/iterator.h"
+#include "pebblesdb/options.h"
+#include "pebblesdb/write_batch.h"
+#include "port/port.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "table/merger.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/random.h"
+
+// Comma-separated list of benchmarks to run; a name selects every
+// benchmark it is a prefix of.  Runs everything if NULL.
+//      skiplist_insert   -- concurrent SkipList::Insert of random keys
+//      skiplist_insert_seq -- concurrent SkipList::Insert of ascending keys
+//      skiplist_seek     -- concurrent SkipList::Iterator::Seek
+//      arena_allocate    -- concurrent Arena::Allocate of 1..128 bytes
+//      cache_lookup      -- concurrent hits in a sharded LRU cache
+//      cache_insert      -- concurrent inserts into a full LRU cache
+//      bloom_create      -- build bloom filters of 1000 keys
+//      bloom_probe       -- probe a bloom filter, half of the keys absent
+//      block_seek        -- Seek in a 4KB data block
+//      block_seek_keynums -- block_seek with restart KeyNums in the block
+//      merging_seek      -- Seek a MergingIterator over K block iterators
+//      merging_next      -- Next through a MergingIterator over K children
+//      memtable_miss     -- memtable Get of absent keys, with and without a
+//                           bloom filter
+//      memtable_prefix   -- memtable insert and Get of keys sharing a 16 byte
+//                           prefix, with and without a KeyNumExtractor
+//      find_guard        -- FindGuard over G guards
+//      guard_inserter    -- pick the guards of a 1000 key WriteBatch
+static const char* FLAGS_benchmarks = NULL;
+
+// Number of operations of each benchmark run
+static int FLAGS_num = 1000000;
+
+// The concurrent benchmarks run with 1, 2, 4, ... up to this many threads
+static int FLAGS_threads = 4;
+
+namespace leveldb {
+
+namespace {
+
+// Spread small integers over the key space.  Multiplying by an odd
+// constant is a bijection, so distinct inputs give distinct keys.
+uint64_t Scatter(uint64_t x) {
+  return x * 0x9e3779b97f4a7c15ull;
+}
+
+uint64_t Random64(Random* rnd) {
+  return (static_cast<uint64_t>(rnd->Next()) << 32) | rnd->Next();
+}
+
+std::string KeyString(uint64_t k) {
+  char buf[20];
+  snprintf(buf, sizeof(buf), "%016llx", static_cast<unsigned long long>(k));
+  return buf;
+}
+
+void Report(const std::string& name, uint64_t ops, uint64_t micros) {
+  if (micros == 0) micros = 1;
+  fprintf(stdout, "%-28s : %10.1f ns/op %10.2f Mops/s\n",
+          name.c_str(), micros * 1e3 / ops,
+          static_cast<double>(ops) / micros);
+  fflush(stdout);
+}
+
+std::string WithArg(const char* name, int arg) {
+  char buf[100];
+  snprintf(buf, sizeof(buf), "%s/%d", name, arg);
+  return buf;
+}
+
+// Thread counts of the concurrent benchmarks
+std::vector<int> ThreadCounts() {
+  std::vector<int> counts;
+  for (int n = 1; n < FLAGS_threads; n *= 2) {
+    counts.push_back(n);
+  }
+  counts.push_back(FLAGS_threads);
+  return counts;
+}
+
+// Runs a body on n threads that start together.
+class ThreadGroup {
+ public:
+  typedef void (*Body)(void* arg, int tid, int n);
+
+  // Run body(arg, tid, n) for every tid in [0,n) on its own thread.
+  // Returns the micros from the start of the threads to the end of the
+  // last one.
+  static uint64_t Run(int n, Body body, void* arg) {
+    ThreadGroup group(n, body, arg);
+    std::vector<Thread> threads(n);
+    for (int i = 0; i < n; i++) {
+      threads[i].group = &group;
+      threads[i].tid = i;
+      Env::Default()->StartThread(&ThreadGroup::ThreadBody, &threads[i]);
+    }
+    MutexLock l(&group.mu_);
+    while (group.ready_ < n) {
+      group.cv_.Wait();
+    }
+    const uint64_t start = Env::Default()->NowMicros();
+    group.start_ = true;
+    group.cv_.SignalAll();
+    while (group.done_ < n) {
+      group.cv_.Wait();
+    }
+    return Env::Default()->NowMicros() - start;
+  }
+
+ private:
+  struct Thread {
+    ThreadGroup* group;
+    int tid;
+  };
+
+  ThreadGroup(int n, Body body, void* arg)
+      : n_(n), body_(body), arg_(arg), mu_(), cv_(&mu_),
+        ready_(0), done_(0), start_(false) {
+  }
+  ThreadGroup(const ThreadGroup&);
+  ThreadGroup& operator = (const ThreadGroup&);
+
+  static void ThreadBody(void* v) {
+    Thread* t = reinterpret_cast<Thread*>(v);
+    ThreadGroup* group = t->group;
+    {
+      MutexLock l(&group->mu_);
+      group->ready_++;
+      group->cv_.SignalAll();
+      while (!group->start_) {
+        group->cv_.Wait();
+      }
+    }
+    (*group->body_)(group->arg_, t->tid, group->n_);
+    MutexLock l(&group->mu_);
+    group->done_++;
+    group->cv_.SignalAll();
+  }
+
+  const int n_;
+  const Body body_;
+  void* const arg_;
+  port::Mutex mu_;
+  port::CondVar cv_;
+  int ready_;
+  int done_;
+  bool start_;
+};
+
+// SkipList
+
+typedef uint64_t Key;
+
+struct KeyComparator {
+  int operator()(const Key& a, const Key& b) const {
+    if (a < b) {
+      return -1;
+    } else if (a > b) {
+      return +1;
+    } else {
+      return 0;
+    }
+  }
+};
+
+struct KeyExtractor {
+  uint64_t operator()(const Key& k) const {
+    return k;
+  }
+};
+
+typedef SkipList<Key, KeyComparator, KeyExtractor> KeyList;
+
+// Keys are below UINT64_MAX, which the list reserves for its tail
+Key SkipListKey(uint64_t i) {
+  return Scatter(i + 1) >> 1;
+}
+
+void SkipListInsertBody(void* arg, int tid, int n) {
+  KeyList* list = reinterpret_cast<KeyList*>(arg);
+  for (uint64_t i = tid; i < static_cast<uint64_t>(FLAGS_num); i += n) {
+    list->Insert(SkipListKey(i));
+  }
+}
+
+void SkipListInsert() {
+  std::vector<int> counts = ThreadCounts();
+  for (size_t i = 0; i < counts.size(); i++) {
+    Arena arena;
+    KeyList list(KeyComparator(), KeyExtractor(), &arena);
+    uint64_t micros = ThreadGroup::Run(counts[i], &SkipListInsertBody, &list);
+    Report(WithArg("skiplist_insert", counts[i]), FLAGS_num, micros);
+  }
+}
+
+void SkipListInsertSeqBody(void* arg, int tid, int n) {
+  KeyList* list = reinterpret_cast<KeyList*>(arg);
+  for (uint64_t i = tid; i < static_cast<uint64_t>(FLAGS_num); i += n) {
+    list->Insert(i + 1);
+  }
+}
+
+void SkipListInsertSeq() {
+  std::vector<int> counts = ThreadCounts();
+  for (size_t i = 0; i < counts.size(); i++) {
+    Arena arena;
+    KeyList list(KeyComparator(), KeyExtractor(), &arena);
+    uint64_t micros = ThreadGroup::Run(counts[i], &SkipListInsertSeqBody,
+                                       &list);
+    Report(WithArg("skiplist_insert_seq", counts[i]), FLAGS_num, micros);
+  }
+}
+
+void SkipListSeekBody(void* arg, int tid, int n) {
+  KeyList* list = reinterpret_cast<KeyList*>(arg);
+  KeyList::Iterator iter(list);
+  Random rnd(301 + tid);
+  uint64_t found = 0;
+  for (int i = tid; i < FLAGS_num; i += n) {
+    iter.Seek(Random64(&rnd) >> 1);
+    found += iter.Valid();
+  }
+  if (found > static_cast<uint64_t>(FLAGS_num)) abort();
+}
+
+void SkipListSeek() {
+  Arena arena;
+  KeyList list(KeyComparator(), KeyExtractor(), &arena);
+  for (int i = 0; i < FLAGS_num; i++) {
+    list.Insert(SkipListKey(i));
+  }
+  std::vector<int> counts = ThreadCounts();
+  for (size_t i = 0; i < counts.size(); i++) {
+    uint64_t micros = ThreadGroup::Run(counts[i], &SkipListSeekBody, &list);
+    Report(WithArg("skiplist_seek", counts[i]), FLAGS_num, micros);
+  }
+}
+
+// Arena
+
+void ArenaAllocateBody(void* arg, int tid, int n) {
+  Arena* arena = reinterpret_cast<Arena*>(arg);
+  Random rnd(301 + tid);
+  for (int i = tid; i < FLAGS_num; i += n) {
+    char* p = arena->Allocate(1 + rnd.Uniform(128));
+    p[0] = 0;
+  }
+}
+
+void ArenaAllocate() {
+  std::vector<int> counts = ThreadCounts();
+  for (size_t i = 0; i < counts.size(); i++) {
+    Arena arena;
+    uint64_t micros = ThreadGroup::Run(counts[i], &ArenaAllocateBody, &arena);
+    Report(WithArg("arena_allocate", counts[i]), FLAGS_num, micros);
+  }
+}
+
+// Cache
+
+const int kCacheEntries = 100000;
+
+void NoopDeleter(const Slice& key, void* value) {
+}
+
+void CacheLookupBody(void* arg, int tid, int n) {
+  Cache* cache = reinterpret_cast<Cache*>(arg);
+  Random rnd(301 + tid);
+  char key[4];
+  for (int i = tid; i < FLAGS_num; i += n) {
+    EncodeFixed32(key, rnd.Uniform(kCacheEntries));
+    Cache::Handle* h = cache->Lookup(Slice(key, sizeof(key)));
+    if (h != NULL) {
+      cache->Release(h);
+    }
+  }
+}
+
+void CacheLookup() {
+  Cache* cache = NewLRUCache(kCacheEntries);
+  char key[4];
+  for (int i = 0; i < kCacheEntries; i++) {
+    EncodeFixed32(key, i);
+    cache->Release(cache->Insert(Slice(key, sizeof(key)), NULL, 1,
+                                 &NoopDeleter));
+  }
+  std::vector<int> counts = ThreadCounts();
+  for (size_t i = 0; i < counts.size(); i++) {
+    uint64_t micros = ThreadGroup::Run(counts[i], &CacheLookupBody, cache);
+    Report(WithArg("cache_lookup", counts[i]), FLAGS_num, micros);
+  }
+  delete cache;
+}
+
+void CacheInsertBody(void* arg, int tid, int n) {
+  Cache* cache = reinterpret_cast<Cache*>(arg);
+  Random rnd(301 + tid);
+  char key[4];
+  for (int i = tid; i < FLAGS_num; i += n) {
+    EncodeFixed32(key, rnd.Uniform(4 * kCacheEntries));
+    cache->Release(cache->Insert(Slice(key, sizeof(key)), NULL, 1,
+                                 &NoopDeleter));
+  }
+}
+
+void CacheInsert() {
+  std::vector<int> counts = ThreadCounts();
+  for (size_t i = 0; i < counts.size(); i++) {
+    // Most inserts evict an entry once the cache has filled up
+    Cache* cache = NewLRUCache(kCacheEntries);
+    uint64_t micros = ThreadGroup::Run(counts[i], &CacheInsertBody, cache);
+    Report(WithArg("cache_insert", counts[i]), FLAGS_num, micros);
+    delete cache;
+  }
+}
+
+// Bloom filter
+
+const int kKeysPerFilter = 1000;
+
+void BloomKeys(std::vector<std::string>* keys, std::vector<Slice>* slices) {
+  for (int i = 0; i < kKeysPerFilter; i++) {
+    keys->push_back(KeyString(Scatter(i)));
+  }
+  std::sort(keys->begin(), keys->end());
+  for (int i = 0; i < kKeysPerFilter; i++) {
+    slices->push_back((*keys)[i]);
+  }
+}
+
+void BloomCreate() {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  std::vector<std::string> keys;
+  std::vector<Slice> slices;
+  BloomKeys(&keys, &slices);
+  const int filters = std::max(1, FLAGS_num / kKeysPerFilter);
+  std::string filter;
+  const uint64_t start = Env::Default()->NowMicros();
+  for (int i = 0; i < filters; i++) {
+    filter.clear();
+    policy->CreateFilter(&slices[0], kKeysPerFilter, &filter);
+  }
+  Report("bloom_create", static_cast<uint64_t>(filters) * kKeysPerFilter,
+         Env::Default()->NowMicros() - start);
+  delete policy;
+}
+
+void BloomProbe() {
+  const FilterPolicy* policy = NewBloomFilterPolicy(10);
+  std::vector<std::string> keys;
+  std::vector<Slice> slices;
+  BloomKeys(&keys, &slices);
+  std::string filter;
+  policy->CreateFilter(&slices[0], kKeysPerFilter, &filter);
+
+  // Even probes are keys of the filter, odd probes are absent
+  std::vector<std::string> probes;
+  for (int i = 0; i < kKeysPerFilter; i++) {
+    probes.push_back(KeyString(Scatter(i)));
+    probes.push_back(KeyString(Scatter(kKeysPerFilter + i)));
+  }
+  int matches = 0;
+  const uint64_t start = Env::Default()->NowMicros();
+  for (int i = 0; i < FLAGS_num; i++) {
+    matches += policy->KeyMayMatch(probes[i % probes.size()], filter);
+  }
+  Report("bloom_probe", FLAGS_num, Env::Default()->NowMicros() - start);
+  if (matches < FLAGS_num / 2) abort();
+  delete policy;
+}
+
+// Blocks and merging iterators
+
+// Store in *contents a block of the keys i * stride + offset for i in
+// [0, n), each with a 32 byte value.
+void BuildBlock(int n, int stride, int offset, std::string* contents) {
+  Options options;
+  BlockBuilder builder(&options);
+  std::string value(32, 'v');
+  for (int i = 0; i < n; i++) {
+    builder.Add(KeyString(static_cast<uint64_t>(i) * stride + offset), value);
+  }
+  *contents = builder.Finish().ToString();
+}
+
+Block* NewBlock(const std::string& contents) {
+  BlockContents block_contents;
+  block_contents.data = contents;
+  block_contents.cachable = false;
+  block_contents.heap_allocated = false;
+  return new Block(block_contents);
+}
+
+// Seek in a block of about 4KB, the default block size, whose keys
+// differ within their first 8 bytes so that restart KeyNums can tell
+// them apart
+void RunBlockSeek(const char* name, int restart_interval, bool key_nums) {
+  const int kEntries = 80;
+  const uint64_t kStride = 1ull << 40;
+  Options options;
+  options.block_restart_interval = restart_interval;
+  options.block_key_nums = key_nums;
+  BlockBuilder builder(&options);
+  std::string value(32, 'v');
+  for (int i = 0; i < kEntries; i++) {
+    builder.Add(KeyString(i * kStride), value);
+  }
+  std::string contents = builder.Finish().ToString();
+  Block* block = NewBlock(contents);
+  Iterator* iter = block->NewIterator(BytewiseComparator());
+  std::vector<std::string> targets;
+  for (int i = 0; i < kEntries; i++) {
+    targets.push_back(KeyString((Scatter(i) % kEntries) * kStride));
+  }
+  int found = 0;
+  const uint64_t start = Env::Default()->NowMicros();
+  for (int i = 0; i < FLAGS_num; i++) {
+    iter->Seek(targets[i % kEntries]);
+    found += iter->Valid();
+  }
+  Report(WithArg(name, restart_interval), FLAGS_num,
+         Env::Default()->NowMicros() - start);
+  if (found != FLAGS_num) abort();
+  delete iter;
+  delete block;
+}
+
+void BlockSeek() {
+  RunBlockSeek("block_seek", 16, false);
+  RunBlockSeek("block_seek", 1, false);
+}
+
+void BlockSeekKeyNums() {
+  RunBlockSeek("block_seek_keynums", 16, true);
+  RunBlockSeek("block_seek_keynums", 1, true);
+}
+
+// Build k blocks whose keys interleave and a MergingIterator over them
+Iterator* NewMergedBlocks(int k, std::vector<std::string>* contents,
+                          std::vector<Block*>* blocks) {
+  const int kEntriesPerChild = 1000;
+  contents->resize(k);
+  std::vector<Iterator*> children;
+  for (int c = 0; c < k; c++) {
+    BuildBlock(kEntriesPerChild, k, c, &(*contents)[c]);
+    blocks->push_back(NewBlock((*contents)[c]));
+    children.push_back(blocks->back()->NewIterator(BytewiseComparator()));
+  }
+  return NewMergingIterator(BytewiseComparator(), &children[0], k, NULL);
+}
+
+const int kMergeWidths[] = { 2, 8, 32 };
+
+void MergingSeek() {
+  for (size_t w = 0; w < sizeof(kMergeWidths) / sizeof(int); w++) {
+    const int k = kMergeWidths[w];
+    std::vector<std::string> contents;
+    std::vector<Block*> blocks;
+    Iterator* iter = NewMergedBlocks(k, &contents, &blocks);
+    std::vector<std::string> targets;
+    for (int i = 0; i < 1024; i++) {
+      targets.push_back(KeyString(Scatter(i) % (1000 * k)));
+    }
+    int found = 0;
+    const uint64_t start = Env::Default()->NowMicros();
+    for (int i = 0; i < FLAGS_num; i++) {
+      iter->Seek(targets[i % targets.size()]);
+      found += iter->Valid();
+    }
+    Report(WithArg("merging_seek", k), FLAGS_num,
+           Env::Default()->NowMicros() - start);
+    if (found != FLAGS_num) abort();
+    delete iter;
+    for (int c = 0; c < k; c++) {
+      delete blocks[c];
+    }
+  }
+}
+
+void MergingNext() {
+  for (size_t w = 0; w < sizeof(kMergeWidths) / sizeof(int); w++) {
+    const int k = kMergeWidths[w];
+    std::vector<std::string> contents;
+    std::vector<Block*> blocks;
+    Iterator* iter = NewMergedBlocks(k, &contents, &blocks);
+    iter->SeekToFirst();
+    const uint64_t start = Env::Default()->NowMicros();
+    for (int i = 0; i < FLAGS_num; i++) {
+      iter->Next();
+      if (!iter->Valid()) {
+        iter->SeekToFirst();
+      }
+    }
+    Report(WithArg("merging_next", k), FLAGS_num,
+           Env::Default()->NowMicros() - start);
+    delete iter;
+    for (int c = 0; c < k; c++) {
+      delete blocks[c];
+    }
+  }
+}
+
+// MemTable Get of absent keys
+
+// Get FLAGS_num keys absent from a memtable of 100000 keys that has a
+// bloom filter of "bloom_bytes" bytes
+void RunMemTableMiss(const char* name, size_t bloom_bytes) {
+  const int kKeys = 100000;
+  InternalKeyComparator icmp(BytewiseComparator());
+  MemTable* mem = new MemTable(icmp, bloom_bytes);
+  mem->Ref();
+  for (int i = 0; i < kKeys; i++) {
+    mem->Add(i + 1, kTypeValue, KeyString(Scatter(2 * i)), Slice());
+  }
+  std::vector<std::string> targets;
+  for (int i = 0; i < 1024; i++) {
+    targets.push_back(KeyString(Scatter(2 * i + 1)));
+  }
+  int found = 0;
+  std::string value;
+  const uint64_t start = Env::Default()->NowMicros();
+  for (int i = 0; i < FLAGS_num; i++) {
+    LookupKey lkey(targets[i % targets.size()], kMaxSequenceNumber);
+    Status s;
+    found += mem->Get(lkey, &value, &s);
+  }
+  Report(name, FLAGS_num, Env::Default()->NowMicros() - start);
+  if (found != 0) abort();
+  mem->Unref();
+}
+
+void MemTableMiss() {
+  RunMemTableMiss("memtable_miss", 0);
+  // 16 bits per key
+  RunMemTableMiss("memtable_miss_bloom", 100000 * 2);
+}
+
+// Keys with a long common prefix
+
+const char kTenantPrefix[] = "tenant:0042:obj:";
+
+// Insert FLAGS_num keys that start with kTenantPrefix into a memtable and
+// then Get each of them, taking KeyNums from "extractor" if non-NULL
+void RunMemTablePrefix(const char* name, const KeyNumExtractor* extractor) {
+  InternalKeyComparator icmp(BytewiseComparator(), extractor);
+  MemTable* mem = new MemTable(icmp);
+  mem->Ref();
+  std::vector<std::string> keys(FLAGS_num);
+  for (int i = 0; i < FLAGS_num; i++) {
+    keys[i] = kTenantPrefix + KeyString(Scatter(i));
+  }
+  uint64_t start = Env::Default()->NowMicros();
+  for (int i = 0; i < FLAGS_num; i++) {
+    mem->Add(i + 1, kTypeValue, keys[i], Slice());
+  }
+  Report(std::string(name) + "_insert", FLAGS_num,
+         Env::Default()->NowMicros() - start);
+  int found = 0;
+  std::string value;
+  start = Env::Default()->NowMicros();
+  for (int i = 0; i < FLAGS_num; i++) {
+    LookupKey lkey(keys[Scatter(i) % FLAGS_num], kMaxSequenceNumber);
+    Status s;
+    found += mem->Get(lkey, &value, &s);
+  }
+  Report(std::string(name) + "_get", FLAGS_num,
+         Env::Default()->NowMicros() - start);
+  if (found != FLAGS_num) abort();
+  mem->Unref();
+}
+
+void MemTablePrefix() {
+  RunMemTablePrefix("memtable_prefix", NULL);
+  const KeyNumExtractor* extractor =
+      NewPrefixSkippingKeyNumExtractor(kTenantPrefix);
+  RunMemTablePrefix("memtable_prefix_extractor", extractor);
+  delete extractor;
+}
+
+// Guards
+
+const int kGuardCounts[] = { 16, 256, 4096 };
+
+void FindGuardBench() {
+  InternalKeyComparator icmp(BytewiseComparator());
+  for (size_t g = 0; g < sizeof(kGuardCounts) / sizeof(int); g++) {
+    const int n = kGuardCounts[g];
+    std::vector<std::string> guard_keys;
+    for (int i = 0; i < n; i++) {
+      guard_keys.push_back(KeyString(Scatter(i)));
+    }
+    std::sort(guard_keys.begin(), guard_keys.end());
+    std::vector<GuardMetaData*> guards;
+    for (int i = 0; i < n; i++) {
+      GuardMetaData* guard = new GuardMetaData;
+      guard->guard_key = InternalKey(guard_keys[i], 0, kTypeValue);
+      guards.push_back(guard);
+    }
+    std::vector<std::string> targets;
+    Random rnd(301);
+    for (int i = 0; i < 1024; i++) {
+      InternalKey ikey(KeyString(Random64(&rnd)), kMaxSequenceNumber,
+                       kValueTypeForSeek);
+      targets.push_back(ikey.Encode().ToString());
+    }
+    int64_t sum = 0;
+    const uint64_t start = Env::Default()->NowMicros();
+    for (int i = 0; i < FLAGS_num; i++) {
+      sum += FindGuard(icmp, guards, targets[i % targets.size()]);
+    }
+    Report(WithArg("find_guard", n), FLAGS_num,
+           Env::Default()->NowMicros() - start);
+    if (sum < 0) abort();
+    for (int i = 0; i < n; i++) {
+      delete guards[i];
+    }
+  }
+}
+
+void GuardInserterBench() {
+  const int kBatchKeys = 1000;
+  WriteBatch batch;
+  std::string value(100, 'v');
+  for (int i = 0; i < kBatchKeys; i++) {
+    batch.Put(KeyString(Scatter(i)), value);
+  }
+  const int batches = std::max(1, FLAGS_num / kBatchKeys);
+  WriteBatch guards;
+  const uint64_t start = Env::Default()->NowMicros();
+  for (int i = 0; i < batches; i++) {
+    guards.Clear();
+    WriteBatchInternal::SetGuards(&batch, &guards);
+  }
+  Report("guard_inserter", static_cast<uint64_t>(batches) * kBatchKeys,
+         Env::Default()->NowMicros() - start);
+}
+
+struct MicroBenchmark {
+  const char* name;
+  void (*run)();
+};
+
+const MicroBenchmark kBenchmarks[] = {
+  { "skiplist_insert", &SkipListInsert },
+  { "skiplist_insert_seq", &SkipListInsertSeq },
+  { "skiplist_seek", &SkipListSeek },
+  { "arena_allocate", &ArenaAllocate },
+  { "cache_lookup", &CacheLookup },
+  { "cache_insert", &CacheInsert },
+  { "bloom_create", &BloomCreate },
+  { "bloom_probe", &BloomProbe },
+  { "block_seek", &BlockSeek },
+  { "block_seek_keynums", &BlockSeekKeyNums },
+  { "merging_seek", &MergingSeek },
+  { "merging_next", &MergingNext },
+  { "memtable_miss", &MemTableMiss },
+  { "memtable_prefix", &MemTablePrefix },
+  { "find_guard", &FindGuardBench },
+  { "guard_inserter", &GuardInserterBench },
+};
+
+// Whether a name of the comma-separated FLAGS_benchmarks is a prefix of
+// "name"
+bool Selected(const char* name) {
+  if (FLAGS_benchmarks == NULL) {
+    return true;
+  }
+  const char* p = FLAGS_benchmarks;
+  while (*p != '\0') {
+    const char* sep = strchr(p, ',');
+    const size_t len = sep == NULL ? strlen(p) : sep - p;
+    if (len > 0 && strncmp(name, p, len) == 0) {
+      return true;
+    }
+    p += len;
+    if (*p == ',') p++;
+  }
+  return false;
+}
+
+}  // namespace
+
+void RunMicroBenchmarks() {
+#if defined(__GNUC__) && !defined(__OPTIMIZE__)
+  fprintf(stdout,
+          "WARNING: Optimization is disabled: benchmarks unnecessarily slow\n");
+#endif
+#ifndef NDEBUG
+  fprintf(stdout,
+          "WARNING: Assertions are enabled; benchmarks unnecessarily slow\n");
+#endif
+  fprintf(stdout, "Operations: %d per run\n", FLAGS_num);
+  fprintf(stdout, "Threads:    up to %d\n", FLAGS_threads);
+  fprintf(stdout, "------------------------------------------------\n");
+  for (size_t i = 0; i < sizeof(kBenchmarks) / sizeof(kBenchmarks[0]); i++) {
+    if (Selected(kBenchmarks[i].name)) {
+      (*kBenchmarks[i].run)();
+    }
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (strncmp(argv[i], "--benchmarks=", 13) == 0) {
+      FLAGS_benchmarks = argv[i] + 13;
+    } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_num = n;
+    } else if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_threads = n;
+    } else {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      exit(1);
+    }
+  }
+  leveldb::RunMicroBenchmarks();
+  return 0;
+}
@@ -49,7 +49,7 @@ class Repairer {
   Repairer(const std::string& dbname, const Options& options)
       : dbname_(dbname),
         env_(options.env),
-        icmp_(options.comparator),
+        icmp_(options.comparator, options.key_num_extractor),
         ipolicy_(options.filter_policy),
         options_(SanitizeOptions(dbname, &icmp_, &ipolicy_, options)),
         file_options_(options_),
@@ -212,7 +212,7 @@ class Repairer {
     // propagating bad information (like overly large sequence
     // numbers).
     log::Reader reader(lfile, &reporter, false/*do not checksum*/,
-                       0/*initial_offset*/);
+                       0/*initial_offset*/, log);
 
     // Read all the records and add to a memtable
     std::string scratch;
@@ -37,6 +37,13 @@ namespace leveldb {
 
 class Arena;
 
+// Returns a new number on every call; used for skiplist ids and for
+// seeding the per-thread height generators.
+inline uint64_t NextSkipListSequence() {
+  static uint64_t sequence = 0;
+  return atomic::increment_64_fullbarrier(&sequence, 1);
+}
+
 template<typename Key, class Comparator, class Extractor>
 class SkipList {
  private:
@@ -48,7 +55,8 @@ class SkipList {
   // must remain allocated for the lifetime of the skiplist object.
   explicit SkipList(Comparator cmp, Extractor ext, Arena* arena);
 
-  // Insert key into the list.
+  // Insert key into the list.  Each thread remembers where its last
+  // insert went, so runs of ascending keys do not search from the head.
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
@@ -101,15 +109,23 @@ class SkipList {
   Comparator const compare_;
   Extractor const extractor_;
   Arena* const arena_;    // Arena used for allocations of nodes
+  uint64_t const id_;     // Tells the insert hints of different lists apart
 
   Node* const head_;
 
-  // Read/written only by Insert().
-  port::Mutex rnd_mutex_;
-  Random rnd_;
+  // The predecessors, at every level, of the last key a thread inserted.
+  // Nodes are never deleted, so the hint stays valid for the lifetime of
+  // list "list"; hints of other lists are ignored.
+  struct Splice {
+    uint64_t list;
+    Node* prev[kMaxHeight];
+  };
+
+  // The calling thread's hint for this type of list
+  static Splice* ThreadSplice();
 
   Node* NewNode(const Key& key, unsigned height);
-  int RandomHeight();
+  static int RandomHeight();
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -122,6 +138,17 @@ class SkipList {
   // node at "level" for every level in [0..max_height_-1].
   Node* FindGreaterOrEqual(const Key& key, Node** prev, Node** obs) const;
 
+  // Like FindGreaterOrEqual, but descends from node "x", which must
+  // precede key, starting at "level".  Fills prev[] and obs[] only for the
+  // levels in [0..level].
+  Node* FindGreaterOrEqualFrom(const Key& key, Node* x, int level,
+                               Node** prev, Node** obs) const;
+
+  // Fill prev[] and obs[] for key at every level, starting from the
+  // splice of the previous insert where it still brackets key.
+  void FindSplice(const Key& key, const Splice* splice,
+                  Node** prev, Node** obs) const;
+
   // Return the latest node with a key < key.
   // Return head_ if there is no such node.
   Node* FindLessThan(const Key& key) const;
@@ -258,14 +285,15 @@ inline void SkipList<Key,Comparator,Extractor>::Iterator::SeekToLast() {
 
 template<typename Key, class Comparator, class Extractor>
 int SkipList<Key,Comparator,Extractor>::RandomHeight() {
+  // Every thread has its own generator, so that concurrent inserts do not
+  // serialize on a shared one.
+  static thread_local Random rnd(0xdeadbeef + NextSkipListSequence());
   // Increase height with probability 1 in kBranching
   static const unsigned int kBranching = 4;
   int height = 1;
-  rnd_mutex_.Lock();
-  while (height < kMaxHeight && ((rnd_.Next() % kBranching) == 0)) {
+  while (height < kMaxHeight && ((rnd.Next() % kBranching) == 0)) {
     height++;
   }
-  rnd_mutex_.Unlock();
   assert(height > 0);
   assert(height <= kMaxHeight);
   return height;
@@ -277,12 +305,24 @@ bool SkipList<Key,Comparator,Extractor>::KeyIsAfterNode(const Key& key, Node* n)
   return (n != NULL) && (compare_(n->key, key) < 0);
 }
 
+template<typename Key, class Comparator, class Extractor>
+typename SkipList<Key,Comparator,Extractor>::Splice*
+SkipList<Key,Comparator,Extractor>::ThreadSplice() {
+  static thread_local Splice splice;
+  return &splice;
+}
+
 template<typename Key, class Comparator, class Extractor>
 typename SkipList<Key,Comparator,Extractor>::Node* SkipList<Key,Comparator,Extractor>::FindGreaterOrEqual(const Key& key, Node** prev, Node** obs)
     const {
+  return FindGreaterOrEqualFrom(key, head_, kMaxHeight - 1, prev, obs);
+}
+
+template<typename Key, class Comparator, class Extractor>
+typename SkipList<Key,Comparator,Extractor>::Node*
+SkipList<Key,Comparator,Extractor>::FindGreaterOrEqualFrom(
+    const Key& key, Node* x, int level, Node** prev, Node** obs) const {
   const uint64_t cmp = extractor_(key);
-  Node* x = head_;
-  int level = kMaxHeight - 1;
   while (true) {
     while (level > 0 && x->NoBarrier_Cmp(level) > cmp) {
       if (prev != NULL) prev[level] = x;
@@ -308,6 +348,45 @@ typename SkipList<Key,Comparator,Extractor>::Node* SkipList<Key,Comparator,Extra
   }
 }
 
+template<typename Key, class Comparator, class Extractor>
+void SkipList<Key,Comparator,Extractor>::FindSplice(
+    const Key& key, const Splice* splice, Node** prev, Node** obs) const {
+  // Find the lowest level at which the splice still brackets key
+  int level = 0;
+  for (; level < kMaxHeight; level++) {
+    Node* p = splice->prev[level];
+    if ((p == head_ || compare_(p->key, key) < 0) &&
+        !KeyIsAfterNode(key, p->Next(level))) {
+      break;
+    }
+  }
+  // The levels above must precede key too.  Adjacent levels mostly share
+  // their node, which then needs no comparison.
+  for (int i = level + 1; i < kMaxHeight; i++) {
+    Node* p = splice->prev[i];
+    if (p != head_ && p != splice->prev[i - 1] &&
+        compare_(p->key, key) >= 0) {
+      level = kMaxHeight;
+      break;
+    }
+  }
+  if (level >= kMaxHeight) {
+    FindGreaterOrEqual(key, prev, obs);
+    return;
+  }
+
+  // The upper levels only need their current successor: Insert() checks
+  // it against the full key and advances prev[i] past any node that
+  // precedes key before linking.
+  for (int i = kMaxHeight - 1; i >= level; i--) {
+    prev[i] = splice->prev[i];
+    obs[i] = prev[i]->Next(i);
+  }
+  if (level > 0) {
+    FindGreaterOrEqualFrom(key, prev[level], level - 1, prev, obs);
+  }
+}
+
 #if 0
 template<typename Key, class Comparator, class Extractor>
 typename SkipList<Key,Comparator,Extractor>::Node* SkipList<Key,Comparator,Extractor>::FindGreaterOrEqual(const Key& key, Node** prev, Node** obs)
@@ -384,9 +463,8 @@ SkipList<Key,Comparator,Extractor>::SkipList(Comparator cmp, Extractor ext, Aren
     : compare_(cmp),
       extractor_(ext),
       arena_(arena),
-      head_(NewNode(0 /* any key will do */, kMaxHeight)),
-      rnd_mutex_(),
-      rnd_(0xdeadbeef) {
+      id_(NextSkipListSequence()),
+      head_(NewNode(0 /* any key will do */, kMaxHeight)) {
   for (int i = 0; i < kMaxHeight; i++) {
     head_->SetNext(i, UINT64_MAX, NULL);
   }
@@ -398,20 +476,29 @@ void SkipList<Key,Comparator,Extractor>::Insert(const Key& key) {
   // here since Insert() is externally synchronized.
   Node* obs[kMaxHeight];
   Node* prev[kMaxHeight];
-  Node* x = FindGreaterOrEqual(key, prev, obs);
+  Splice* splice = ThreadSplice();
+  if (splice->list == id_) {
+    FindSplice(key, splice, prev, obs);
+  } else {
+    FindGreaterOrEqual(key, prev, obs);
+  }
 
   // Our data structure does not allow duplicate insertion
-  assert(x == NULL || !Equal(key, x->key));
+  assert(obs[0] == NULL || !Equal(key, obs[0]->key));
 
   int height = RandomHeight();
 
-  x = NewNode(key, height);
+  Node* x = NewNode(key, height);
   for (int i = 0; i < height; i++) {
     while (true) {
       Node* n = obs[i];
       uint64_t c = n ? n->cmp : UINT64_MAX;
       x->NoBarrier_SetNext(i, c, n);
-      if (c >= x->cmp && prev[i]->CasNext(i, n, x)) {
+      // Equal numbers say nothing about the order of the full keys, and
+      // n may be a node that landed after the splice was taken.
+      if (c >= x->cmp &&
+          (c > x->cmp || !KeyIsAfterNode(x->key, n)) &&
+          prev[i]->CasNext(i, n, x)) {
         break;
       }
 
@@ -428,6 +515,11 @@ void SkipList<Key,Comparator,Extractor>::Insert(const Key& key) {
       }
     }
   }
+
+  splice->list = id_;
+  for (int i = 0; i < kMaxHeight; i++) {
+    splice->prev[i] = i < height ? x : prev[i];
+  }
 }
 
 template<typename Key, class Comparator, class Extractor>
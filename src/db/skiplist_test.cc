@@ -9,6 +9,7 @@
 #include "pebblesdb/env.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testharness.h"
 
@@ -132,6 +133,44 @@ TEST(SkipTest, InsertAndLookup) {
   }
 }
 
+// Exercise the per-thread insert hint: runs of ascending and descending
+// keys, jumps around, and alternating between two lists.
+TEST(SkipTest, InsertHint) {
+  Random rnd(301);
+  Arena arena;
+  Comparator cmp;
+  Extractor ext;
+  SkipList<Key, Comparator, Extractor> a(cmp, ext, &arena);
+  SkipList<Key, Comparator, Extractor> b(cmp, ext, &arena);
+  std::set<Key> a_keys;
+  std::set<Key> b_keys;
+  for (int run = 0; run < 200; run++) {
+    Key start = 1000 + rnd.Uniform(1000000);
+    int step = static_cast<int>(rnd.Uniform(5)) - 2;
+    SkipList<Key, Comparator, Extractor>* list = run % 3 == 0 ? &b : &a;
+    std::set<Key>* keys = run % 3 == 0 ? &b_keys : &a_keys;
+    for (int i = 0; i < 50; i++) {
+      Key key = step == 0 ? rnd.Uniform(1000000) : start + i * step;
+      if (keys->insert(key).second) {
+        list->Insert(key);
+      }
+    }
+  }
+
+  SkipList<Key, Comparator, Extractor>::Iterator iter(&a);
+  iter.SeekToFirst();
+  for (std::set<Key>::iterator it = a_keys.begin(); it != a_keys.end(); ++it) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(*it, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (std::set<Key>::iterator it = b_keys.begin(); it != b_keys.end(); ++it) {
+    ASSERT_TRUE(b.Contains(*it));
+    ASSERT_TRUE(a_keys.count(*it) > 0 || !a.Contains(*it));
+  }
+}
+
 // We want to make sure that with a single writer and multiple
 // concurrent readers (with no synchronization other than when a
 // reader's iterator is created), the reader always observes all the
@@ -381,6 +420,85 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Like the memtable's UserKeyNum, maps runs of neighbouring keys to the
+// same number, so that comparisons often have to fall back to the full key
+struct PrefixExtractor {
+  uint64_t operator()(const Key& k) const {
+    return k >> 4;
+  }
+};
+
+// Several writers inserting interleaved ascending keys, each from its own
+// insert hint
+template<class Ext>
+struct WriterState {
+  SkipList<Key, Comparator, Ext>* list;
+  int id;
+  int writers;
+  port::Mutex* mu;
+  port::CondVar* cv;
+  int* done;
+};
+
+static const int kKeysPerWriter = 20000;
+
+template<class Ext>
+static void ConcurrentWriter(void* arg) {
+  WriterState<Ext>* state = reinterpret_cast<WriterState<Ext>*>(arg);
+  for (int i = 0; i < kKeysPerWriter; i++) {
+    state->list->Insert(static_cast<Key>(i) * state->writers + state->id);
+  }
+  MutexLock l(state->mu);
+  ++*state->done;
+  state->cv->SignalAll();
+}
+
+template<class Ext>
+static void RunConcurrentWriters() {
+  const int kWriters = 4;
+  Arena arena;
+  Comparator cmp;
+  Ext ext;
+  SkipList<Key, Comparator, Ext> list(cmp, ext, &arena);
+  port::Mutex mu;
+  port::CondVar cv(&mu);
+  int done = 0;
+  WriterState<Ext> states[kWriters];
+  for (int i = 0; i < kWriters; i++) {
+    WriterState<Ext> s = { &list, i, kWriters, &mu, &cv, &done };
+    states[i] = s;
+    Env::Default()->StartThread(ConcurrentWriter<Ext>, &states[i]);
+  }
+  {
+    MutexLock l(&mu);
+    while (done < kWriters) {
+      cv.Wait();
+    }
+  }
+
+  typename SkipList<Key, Comparator, Ext>::Iterator iter(&list);
+  iter.SeekToFirst();
+  for (Key k = 0; k < static_cast<Key>(kWriters) * kKeysPerWriter; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+  for (Key k = 0; k < static_cast<Key>(kWriters) * kKeysPerWriter; k++) {
+    ASSERT_TRUE(list.Contains(k)) << k;
+  }
+}
+
+TEST(SkipTest, ConcurrentWriters) {
+  RunConcurrentWriters<Extractor>();
+}
+
+TEST(SkipTest, ConcurrentWritersSharedKeyNum) {
+  for (int run = 0; run < 20; run++) {
+    RunConcurrentWriters<PrefixExtractor>();
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_SNAPSHOT_H_
 #define STORAGE_LEVELDB_DB_SNAPSHOT_H_
 
+#include <vector>
 #include "pebblesdb/db.h"
 
 namespace leveldb {
@@ -58,6 +59,18 @@ class SnapshotList {
     return s;
   }
 
+  // Append the distinct sequence numbers of all live snapshots to
+  // *snapshots in increasing order.  Snapshots are created with
+  // non-decreasing sequence numbers, so list order is already sorted.
+  void GetAll(std::vector<SequenceNumber>* snapshots) const {
+    for (const SnapshotImpl* s = list_.next_; s != &list_; s = s->next_) {
+      assert(snapshots->empty() || snapshots->back() <= s->number_);
+      if (snapshots->empty() || snapshots->back() != s->number_) {
+        snapshots->push_back(s->number_);
+      }
+    }
+  }
+
   void Delete(const SnapshotImpl* s) {
     assert(s->list_ == this);
     s->prev_->next_ = s->next_;
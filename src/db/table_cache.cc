@@ -37,6 +37,37 @@ static void UnrefEntry(void* arg1, void* arg2) {
   cache->Release(h);
 }
 
+// A row cache entry holds the 8-byte sequence/type tag of the newest
+// entry for a user key in a table, followed by its value.
+static void DeleteRow(const Slice& /*key*/, void* value) {
+  delete reinterpret_cast<std::string*>(value);
+}
+
+// Passes the entry a table finds on to the caller's handler, keeping a
+// copy of it when it is for the user key looked up
+struct RowSaver {
+  RowSaver() : user_key(), arg(NULL), saver(NULL), matched(false), row() {}
+  Slice user_key;
+  void* arg;
+  void (*saver)(void*, const Slice&, const Slice&);
+  bool matched;
+  std::string row;
+ private:
+  RowSaver(const RowSaver&);
+  RowSaver& operator = (const RowSaver&);
+};
+
+static void SaveRow(void* arg, const Slice& ikey, const Slice& v) {
+  RowSaver* r = reinterpret_cast<RowSaver*>(arg);
+  ParsedInternalKey parsed;
+  if (ParseInternalKey(ikey, &parsed) && parsed.user_key == r->user_key) {
+    r->matched = true;
+    r->row.assign(ikey.data() + ikey.size() - 8, 8);
+    r->row.append(v.data(), v.size());
+  }
+  (*r->saver)(r->arg, ikey, v);
+}
+
 TableCache::TableCache(const std::string& dbname,
                        const Options* options,
                        const FileOptions* file_options,
@@ -45,7 +76,13 @@ TableCache::TableCache(const std::string& dbname,
       dbname_(dbname),
       options_(options),
       file_options_(file_options),
-      cache_(NewLRUCache(entries)) {
+      cache_(NewLRUCache(entries)),
+      row_cache_(options->row_cache_size > 0 ?
+                 NewLRUCache(options->row_cache_size) : NULL),
+      secondary_id_(options->secondary_cache != NULL ?
+                    options->secondary_cache->NewId() : 0),
+      row_cache_hits_(0),
+      row_cache_misses_(0) {
 	for (int i = 0; i < NUM_SEEK_THREADS; i++) {
 		static_timers_[i] = new Timer();
 	}
@@ -64,6 +101,7 @@ TableCache::~TableCache() {
 	  }
   }
   delete cache_;
+  delete row_cache_;
 }
 
 Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
@@ -89,7 +127,11 @@ Status TableCache::FindTable(uint64_t file_number, uint64_t file_size,
 		}
 		if (s.ok()) {
 			start_timer(GET_TABLE_CACHE_GET_TABLE_OPEN);
-			s = Table::Open(*options_, file, file_size, &table, timer);
+			char secondary_prefix[16];
+			EncodeFixed64(secondary_prefix, secondary_id_);
+			EncodeFixed64(secondary_prefix + 8, file_number);
+			s = Table::Open(*options_, file, file_size, &table, timer,
+			                Slice(secondary_prefix, sizeof(secondary_prefix)));
 			record_timer(GET_TABLE_CACHE_GET_TABLE_OPEN);
 		}
 
@@ -159,6 +201,39 @@ Status TableCache::Get(const ReadOptions& options,
                        void (*saver)(void*, const Slice&, const Slice&),
 					   Timer* timer) {
 //  printf("Tablecache Get().\n");
+  std::string row_key;
+  RowSaver row_saver;
+  if (row_cache_ != NULL) {
+    // The cached entry is the newest in the file, so it answers any
+    // lookup whose sequence number is at least the entry's
+    const Slice user_key = ExtractUserKey(k);
+    PutFixed64(&row_key, file_number);
+    row_key.append(user_key.data(), user_key.size());
+    Cache::Handle* row = row_cache_->Lookup(row_key);
+    if (row != NULL) {
+      const std::string* entry =
+          reinterpret_cast<std::string*>(row_cache_->Value(row));
+      const uint64_t tag = DecodeFixed64(entry->data());
+      if ((tag >> 8) <= (DecodeFixed64(k.data() + k.size() - 8) >> 8)) {
+        std::string ikey(user_key.data(), user_key.size());
+        ikey.append(entry->data(), 8);
+        (*saver)(arg, ikey, Slice(entry->data() + 8, entry->size() - 8));
+        row_cache_->Release(row);
+        atomic::increment_64_nobarrier(&row_cache_hits_, 1);
+        return Status::OK();
+      }
+      row_cache_->Release(row);
+    }
+    atomic::increment_64_nobarrier(&row_cache_misses_, 1);
+    // Only a read of the latest state finds the newest entry in the file
+    if (options.snapshot == NULL && options.fill_cache) {
+      row_saver.user_key = user_key;
+      row_saver.arg = arg;
+      row_saver.saver = saver;
+      arg = &row_saver;
+      saver = &SaveRow;
+    }
+  }
   Cache::Handle* handle = NULL;
   Status s;
   start_timer(GET_TABLE_CACHE_FIND_TABLE);
@@ -175,6 +250,44 @@ Status TableCache::Get(const ReadOptions& options,
     cache_->Release(handle);
     record_timer(GET_TABLE_CACHE_INTERNAL_GET);
   }
+  if (s.ok() && saver == &SaveRow && row_saver.matched) {
+    std::string* row = new std::string;
+    row->swap(row_saver.row);
+    row_cache_->Release(row_cache_->Insert(row_key, row,
+                                           row_key.size() + row->size(),
+                                           &DeleteRow));
+  }
+  return s;
+}
+
+Status TableCache::GetTableProperties(uint64_t file_number,
+                                      uint64_t file_size,
+                                      TableProperties* props) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle, NULL);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    if (t->properties() != NULL) {
+      *props = *t->properties();
+    } else {
+      s = Status::NotFound("table has no properties");
+    }
+    cache_->Release(handle);
+  }
+  return s;
+}
+
+Status TableCache::ApproximateOffsetOf(uint64_t file_number,
+                                       uint64_t file_size,
+                                       const Slice& k,
+                                       uint64_t* offset) {
+  Cache::Handle* handle = NULL;
+  Status s = FindTable(file_number, file_size, &handle, NULL);
+  if (s.ok()) {
+    Table* t = reinterpret_cast<TableAndFile*>(cache_->Value(handle))->table;
+    *offset = t->ApproximateOffsetOf(k);
+    cache_->Release(handle);
+  }
   return s;
 }
 
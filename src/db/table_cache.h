@@ -15,6 +15,7 @@
 #include "pebblesdb/env.h"
 #include "pebblesdb/table.h"
 #include "port/port.h"
+#include "util/atomic.h"
 #include "util/timer.h"
 #include "db/version_set.h"
 //#include <unordered_map>
@@ -42,7 +43,9 @@ class TableCache {
                         Table** tableptr = NULL);
 
   // If a seek to internal key "k" in specified file finds an entry,
-  // call (*handle_result)(arg, found_key, found_value).
+  // call (*handle_result)(arg, found_key, found_value).  With a row cache
+  // (see Options::row_cache_size), an entry for the user key of "k" may
+  // come from the cache instead of the table.
   Status Get(const ReadOptions& options,
              uint64_t file_number,
              uint64_t file_size,
@@ -51,9 +54,31 @@ class TableCache {
              void (*handle_result)(void*, const Slice&, const Slice&),
 			 Timer* timer);
 
+  // Store the properties of the specified file in "*props".  Returns
+  // NotFound if the table was built without properties.
+  Status GetTableProperties(uint64_t file_number,
+                            uint64_t file_size,
+                            TableProperties* props);
+
+  // Store in "*offset" the approximate offset within the specified file
+  // of the data for internal key "k".
+  Status ApproximateOffsetOf(uint64_t file_number,
+                             uint64_t file_size,
+                             const Slice& k,
+                             uint64_t* offset);
+
   // Evict any entry for the specified file number
   void Evict(uint64_t file_number);
 
+  // Number of Get calls the row cache answered, and of those it could
+  // not.  Both stay 0 without a row cache.
+  uint64_t RowCacheHits() const {
+    return atomic::load_64_nobarrier(&row_cache_hits_);
+  }
+  uint64_t RowCacheMisses() const {
+    return atomic::load_64_nobarrier(&row_cache_misses_);
+  }
+
   void SetFileMetaDataMap(uint64_t file_number, uint64_t file_size, InternalKey smallest, InternalKey largest);
 
   FileMetaData* GetFileMetaDataForFile(uint64_t file_number) {
@@ -102,6 +127,12 @@ class TableCache {
   const Options* options_;
   const FileOptions* file_options_;
   Cache* cache_;
+  Cache* row_cache_;  // NULL without Options::row_cache_size
+  // Keys of this database's tables in Options::secondary_cache start with
+  // this id and the file number, so they outlive entries in cache_
+  const uint64_t secondary_id_;
+  uint64_t row_cache_hits_;
+  uint64_t row_cache_misses_;
   std::map<uint64_t, FileMetaData*> file_metadata_map;
 //  std::unordered_map<uint64_t, Cache::Handle*> cache_handle_map;
 
@@ -0,0 +1,280 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "db/trace.h"
+
+#include <algorithm>
+#include "pebblesdb/env.h"
+#include "pebblesdb/write_batch.h"
+#include "util/coding.h"
+
+namespace leveldb {
+
+static const char kTraceMagic[] = "pebblesdb-trace";
+static const size_t kTraceMagicSize = sizeof(kTraceMagic) - 1;
+
+// Buffered records are written out once they reach this size
+static const size_t kTraceFlushBytes = 64 << 10;
+
+// Read granularity of TraceReader
+static const size_t kTraceReadBytes = 64 << 10;
+
+namespace {
+
+// Encodes the updates of a batch as the ops of a kTraceWrite record.
+class TraceBatchHandler : public WriteBatch::Handler {
+ public:
+  explicit TraceBatchHandler(bool record_keys)
+      : count_(0), ops_(), record_keys_(record_keys) { }
+  virtual void Put(const Slice& key, const Slice& value) {
+    Add(kTypeValue, key, value.size());
+  }
+  virtual void Delete(const Slice& key) {
+    Add(kTypeDeletion, key, 0);
+  }
+  virtual void HandleGuard(const Slice& key, unsigned level) { }
+
+  uint32_t count_;
+  std::string ops_;
+
+ private:
+  TraceBatchHandler(const TraceBatchHandler&);
+  TraceBatchHandler& operator = (const TraceBatchHandler&);
+
+  void Add(ValueType type, const Slice& key, size_t value_size) {
+    ++count_;
+    ops_.push_back(static_cast<char>(type));
+    PutVarint32(&ops_, key.size());
+    PutVarint32(&ops_, value_size);
+    if (record_keys_) {
+      ops_.append(key.data(), key.size());
+    }
+  }
+
+  const bool record_keys_;
+};
+
+}  // namespace
+
+Status TraceWriter::Open(Env* env, const std::string& fname, bool record_keys,
+                         TraceWriter** result) {
+  *result = NULL;
+  WritableFile* file;
+  Status s = env->NewWritableFile(fname, &file);
+  if (!s.ok()) {
+    return s;
+  }
+  TraceWriter* writer = new TraceWriter(env, file, record_keys);
+  writer->buffer_.append(kTraceMagic, kTraceMagicSize);
+  writer->buffer_.push_back(record_keys ? kTraceKeys : 0);
+  *result = writer;
+  return s;
+}
+
+TraceWriter::TraceWriter(Env* env, WritableFile* file, bool record_keys)
+    : env_(env),
+      file_(file),
+      record_keys_(record_keys),
+      start_micros_(env->NowMicros()),
+      buffer_(),
+      status_() {
+}
+
+TraceWriter::~TraceWriter() {
+  if (file_ != NULL) {
+    Close();
+  }
+}
+
+void TraceWriter::StartRecord(TraceType type) {
+  buffer_.push_back(static_cast<char>(type));
+  PutVarint64(&buffer_, env_->NowMicros() - start_micros_);
+}
+
+void TraceWriter::AddKey(const Slice& key) {
+  PutVarint32(&buffer_, key.size());
+  if (record_keys_) {
+    buffer_.append(key.data(), key.size());
+  }
+}
+
+void TraceWriter::MaybeFlush() {
+  if (buffer_.size() >= kTraceFlushBytes) {
+    if (status_.ok()) {
+      status_ = file_->Append(buffer_);
+    }
+    buffer_.clear();
+  }
+}
+
+void TraceWriter::Get(const Slice& key) {
+  StartRecord(kTraceGet);
+  AddKey(key);
+  MaybeFlush();
+}
+
+void TraceWriter::Seek(const Slice& key) {
+  StartRecord(kTraceSeek);
+  AddKey(key);
+  MaybeFlush();
+}
+
+void TraceWriter::Write(const WriteBatch* batch) {
+  TraceBatchHandler handler(record_keys_);
+  batch->Iterate(&handler);
+  StartRecord(kTraceWrite);
+  PutVarint32(&buffer_, handler.count_);
+  buffer_.append(handler.ops_);
+  MaybeFlush();
+}
+
+Status TraceWriter::Close() {
+  if (file_ == NULL) {
+    return status_;
+  }
+  if (status_.ok() && !buffer_.empty()) {
+    status_ = file_->Append(buffer_);
+  }
+  buffer_.clear();
+  Status s = file_->Close();
+  if (status_.ok()) {
+    status_ = s;
+  }
+  delete file_;
+  file_ = NULL;
+  return status_;
+}
+
+Status TraceReader::Open(Env* env, const std::string& fname,
+                         TraceReader** result) {
+  *result = NULL;
+  SequentialFile* file;
+  Status s = env->NewSequentialFile(fname, FileOptions(), &file);
+  if (!s.ok()) {
+    return s;
+  }
+  TraceReader* reader = new TraceReader(file);
+  std::string magic;
+  uint8_t flags;
+  if (!reader->GetBytes(kTraceMagicSize, &magic) ||
+      magic != Slice(kTraceMagic, kTraceMagicSize) ||
+      !reader->GetByte(&flags)) {
+    s = reader->status_.ok() ? Status::Corruption(fname, "not a trace file")
+                             : reader->status_;
+    delete reader;
+    return s;
+  }
+  reader->has_keys_ = (flags & kTraceKeys) != 0;
+  *result = reader;
+  return s;
+}
+
+TraceReader::TraceReader(SequentialFile* file)
+    : file_(file),
+      has_keys_(false),
+      eof_(false),
+      buffer_(),
+      pos_(0),
+      status_() {
+}
+
+TraceReader::~TraceReader() {
+  delete file_;
+}
+
+bool TraceReader::Fill(size_t n) {
+  while (buffer_.size() - pos_ < n && !eof_ && status_.ok()) {
+    buffer_.erase(0, pos_);
+    pos_ = 0;
+    size_t want = std::max(n - buffer_.size(), kTraceReadBytes);
+    std::string scratch(want, '\0');
+    Slice chunk;
+    status_ = file_->Read(want, &chunk, &scratch[0]);
+    if (chunk.empty()) {
+      eof_ = true;
+    }
+    buffer_.append(chunk.data(), chunk.size());
+  }
+  return buffer_.size() - pos_ >= n;
+}
+
+bool TraceReader::GetByte(uint8_t* b) {
+  if (!Fill(1)) {
+    return false;
+  }
+  *b = static_cast<uint8_t>(buffer_[pos_++]);
+  return true;
+}
+
+bool TraceReader::GetVarint32(uint32_t* v) {
+  Fill(5);
+  const char* p = buffer_.data() + pos_;
+  const char* limit = buffer_.data() + buffer_.size();
+  const char* q = GetVarint32Ptr(p, limit, v);
+  if (q == NULL) {
+    return false;
+  }
+  pos_ += q - p;
+  return true;
+}
+
+bool TraceReader::GetVarint64(uint64_t* v) {
+  Fill(10);
+  const char* p = buffer_.data() + pos_;
+  const char* limit = buffer_.data() + buffer_.size();
+  const char* q = GetVarint64Ptr(p, limit, v);
+  if (q == NULL) {
+    return false;
+  }
+  pos_ += q - p;
+  return true;
+}
+
+bool TraceReader::GetBytes(size_t n, std::string* s) {
+  if (!Fill(n)) {
+    return false;
+  }
+  s->assign(buffer_.data() + pos_, n);
+  pos_ += n;
+  return true;
+}
+
+bool TraceReader::Read(TraceRecord* record) {
+  uint8_t type;
+  if (!GetByte(&type)) {
+    return false;  // Clean end of the trace, or a read error
+  }
+  record->ops.clear();
+  bool ok = GetVarint64(&record->micros);
+  if (ok && (type == kTraceGet || type == kTraceSeek)) {
+    record->type = static_cast<TraceType>(type);
+    record->ops.resize(1);
+    TraceOp* op = &record->ops[0];
+    ok = GetVarint32(&op->key_size) &&
+         (!has_keys_ || GetBytes(op->key_size, &op->key));
+  } else if (ok && type == kTraceWrite) {
+    record->type = kTraceWrite;
+    uint32_t count = 0;
+    ok = GetVarint32(&count);
+    for (uint32_t i = 0; ok && i < count; i++) {
+      record->ops.push_back(TraceOp());
+      TraceOp* op = &record->ops.back();
+      uint8_t value_type;
+      ok = GetByte(&value_type) &&
+           (value_type == kTypeValue || value_type == kTypeDeletion) &&
+           GetVarint32(&op->key_size) &&
+           GetVarint32(&op->value_size) &&
+           (!has_keys_ || GetBytes(op->key_size, &op->key));
+      op->type = static_cast<ValueType>(value_type);
+    }
+  } else {
+    ok = false;
+  }
+  if (!ok && status_.ok()) {
+    status_ = Status::Corruption("bad trace record");
+  }
+  return ok;
+}
+
+}  // namespace leveldb
@@ -0,0 +1,141 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A trace records the operations issued against a DB so that they can be
+// replayed later, e.g. by db_bench's "replay" benchmark.  The file format:
+//
+//    trace  := header record*
+//    header := "pebblesdb-trace" flags:uint8
+//    record := type:uint8 micros:varint64 payload
+//
+// "micros" is the time the operation was issued, relative to the start of
+// the trace.  The payload depends on the type:
+//
+//    kTraceGet, kTraceSeek := key_size:varint32 [key]
+//    kTraceWrite           := count:varint32 op*count
+//    op                    := value_type:uint8 key_size:varint32
+//                             value_size:varint32 [key]
+//
+// Keys are present iff (flags & kTraceKeys); values are never recorded.
+
+#ifndef STORAGE_LEVELDB_DB_TRACE_H_
+#define STORAGE_LEVELDB_DB_TRACE_H_
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "pebblesdb/slice.h"
+#include "pebblesdb/status.h"
+
+namespace leveldb {
+
+class Env;
+class SequentialFile;
+class WritableFile;
+class WriteBatch;
+
+enum TraceType {
+  kTraceGet = 1,
+  kTraceWrite = 2,
+  kTraceSeek = 3
+};
+
+// Header flags
+static const uint8_t kTraceKeys = 0x1;
+
+struct TraceOp {
+  TraceOp() : type(kTypeValue), key_size(0), value_size(0), key() { }
+  ValueType type;     // kTypeValue or kTypeDeletion for writes
+  uint32_t key_size;
+  uint32_t value_size;
+  std::string key;    // Empty unless the trace records keys
+};
+
+struct TraceRecord {
+  TraceRecord() : type(kTraceGet), micros(0), ops() { }
+  TraceType type;
+  uint64_t micros;
+  // A single op for kTraceGet and kTraceSeek, one per update for
+  // kTraceWrite.
+  std::vector<TraceOp> ops;
+};
+
+// Appends records to a trace file.  Not thread-safe; callers serialize.
+class TraceWriter {
+ public:
+  // Create the trace file "fname" and write its header.  On success,
+  // stores a writer in *result that the caller must delete.
+  static Status Open(Env* env, const std::string& fname, bool record_keys,
+                     TraceWriter** result);
+
+  ~TraceWriter();
+
+  void Get(const Slice& key);
+  void Seek(const Slice& key);
+  void Write(const WriteBatch* batch);
+
+  // Flush buffered records and close the file.  Returns the first error
+  // met while writing the trace, if any.
+  Status Close();
+
+ private:
+  TraceWriter(Env* env, WritableFile* file, bool record_keys);
+  TraceWriter(const TraceWriter&);
+  TraceWriter& operator = (const TraceWriter&);
+
+  void StartRecord(TraceType type);
+  void AddKey(const Slice& key);
+  void MaybeFlush();
+
+  Env* const env_;
+  WritableFile* file_;
+  const bool record_keys_;
+  const uint64_t start_micros_;
+  std::string buffer_;
+  Status status_;
+};
+
+// Reads the records of a trace file in order.
+class TraceReader {
+ public:
+  // Open the trace file "fname" and read its header.  On success, stores a
+  // reader in *result that the caller must delete.
+  static Status Open(Env* env, const std::string& fname,
+                     TraceReader** result);
+
+  ~TraceReader();
+
+  // Whether the records carry keys
+  bool has_keys() const { return has_keys_; }
+
+  // Read the next record into *record.  Returns false at the end of the
+  // trace or on error; status() tells the two apart.
+  bool Read(TraceRecord* record);
+
+  Status status() const { return status_; }
+
+ private:
+  explicit TraceReader(SequentialFile* file);
+  TraceReader(const TraceReader&);
+  TraceReader& operator = (const TraceReader&);
+
+  // Make at least "n" unread bytes available unless the file ends first.
+  bool Fill(size_t n);
+  bool GetByte(uint8_t* b);
+  bool GetVarint32(uint32_t* v);
+  bool GetVarint64(uint64_t* v);
+  bool GetBytes(size_t n, std::string* s);
+
+  SequentialFile* file_;
+  bool has_keys_;
+  bool eof_;
+  std::string buffer_;
+  size_t pos_;
+  Status status_;
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_DB_TRACE_H_
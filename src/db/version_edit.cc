@@ -27,7 +27,11 @@ enum Tag {
   kNewSentinelFile      = 13,
   kDeletedSentinelFile  = 14,
   kNewCompleteGuard     = 15,
-  kNewSentinelFileNo	= 16
+  kNewSentinelFileNo	= 16,
+  // Same fields as kNewFile, for a file with fully_compacted set
+  kNewCompactedFile     = 17,
+  // Entry and deletion counts of the file added just before
+  kFileStats            = 18
 };
 
 void VersionEdit::Clear() {
@@ -89,12 +93,19 @@ void VersionEdit::EncodeTo(std::string* dst) const {
 
   for (size_t i = 0; i < new_files_.size(); i++) {
     const FileMetaData& f = new_files_[i].second;
-    PutVarint32(dst, kNewFile);
+    PutVarint32(dst, f.fully_compacted ? kNewCompactedFile : kNewFile);
     PutVarint32(dst, new_files_[i].first);  // level
     PutVarint64(dst, f.number);
     PutVarint64(dst, f.file_size);
     PutLengthPrefixedSlice(dst, f.smallest.Encode());
     PutLengthPrefixedSlice(dst, f.largest.Encode());
+    if (f.num_entries > 0) {
+      PutVarint32(dst, kFileStats);
+      PutVarint32(dst, new_files_[i].first);  // level
+      PutVarint64(dst, f.number);
+      PutVarint64(dst, f.num_entries);
+      PutVarint64(dst, f.num_deletions);
+    }
   }
 
   // Encode deleted guards
@@ -252,16 +263,34 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
       break;
 
     case kNewFile:
+    case kNewCompactedFile:
       if (GetLevel(&input, &level) &&
 	  GetVarint64(&input, &f.number) &&
 	  GetVarint64(&input, &f.file_size) &&
 	  GetInternalKey(&input, &f.smallest) &&
 	  GetInternalKey(&input, &f.largest)) {
+    	  f.fully_compacted = (tag == kNewCompactedFile);
+    	  f.num_entries = 0;
+    	  f.num_deletions = 0;
     	  new_files_.push_back(std::make_pair(level, f));
       } else {
 	msg = "new-file entry";
       }
 	    break;
+
+    case kFileStats:
+      if (GetLevel(&input, &level) &&
+          GetVarint64(&input, &fnumber) &&
+          !new_files_.empty() &&
+          new_files_.back().first == level &&
+          new_files_.back().second.number == fnumber &&
+          GetVarint64(&input, &new_files_.back().second.num_entries) &&
+          GetVarint64(&input, &new_files_.back().second.num_deletions)) {
+        // Stats belong to the file added just before
+      } else {
+        msg = "file-stats entry";
+      }
+      break;
 	    
     case kNewSentinelFile:
       if (GetLevel(&input, &level) &&
@@ -278,6 +307,9 @@ Status VersionEdit::DecodeFrom(const Slice& src) {
 	  GetVarint64(&input, &f.file_size) &&
 	  GetInternalKey(&input, &f.smallest) &&
 	  GetInternalKey(&input, &f.largest)) {
+	f.fully_compacted = false;
+	f.num_entries = 0;
+	f.num_deletions = 0;
 	new_files_.push_back(std::make_pair(level, f));
       } else {
 	msg = "new-sentinel-file entry";
@@ -389,6 +421,15 @@ std::string VersionEdit::DebugString() const {
     r.append(f.smallest.DebugString());
     r.append(" .. ");
     r.append(f.largest.DebugString());
+    if (f.fully_compacted) {
+      r.append(" (compacted)");
+    }
+    if (f.num_entries > 0) {
+      r.append(" entries=");
+      AppendNumberTo(&r, f.num_entries);
+      r.append(" deletions=");
+      AppendNumberTo(&r, f.num_deletions);
+    }
   }
   // Add guards to the debug string
   for (DeletedGuardSet::const_iterator iter = deleted_guards_.begin();
@@ -24,8 +24,12 @@ struct FileMetaData {
   InternalKey smallest;       // Smallest internal key served by table
   InternalKey largest;        // Largest internal key served by table
   GuardMetaData* guard;       // The guard that the file belongs to.
+  bool fully_compacted;       // Written by a compaction that left no deletion
+                              // markers and at most one entry per user key
+  uint64_t num_entries;       // Entries in the table, 0 if unknown
+  uint64_t num_deletions;     // Deletion markers among those entries
   
-FileMetaData() : refs(0), allowed_seeks(1 << 30), number(0), file_size(0), smallest(), largest(), guard() { }
+FileMetaData() : refs(0), allowed_seeks(1 << 30), number(0), file_size(0), smallest(), largest(), guard(), fully_compacted(false), num_entries(0), num_deletions(0) { }
 };
 
 /* 
@@ -44,8 +48,11 @@ struct GuardMetaData {
   // The list of file numbers that form a part of this guard.
   std::vector<uint64_t> files;
   std::vector<FileMetaData*> file_metas;
+  // Sampled count of reads that had to search more than one of the
+  // files.  Updated without locks and carried over to later versions.
+  uint64_t read_samples;
   
-GuardMetaData() : refs(0), level(-1), guard_key(), smallest(), largest(), number_segments(0) { files.clear();}
+GuardMetaData() : refs(0), level(-1), guard_key(), smallest(), largest(), number_segments(0), read_samples(0) { files.clear();}
 };
  
 class VersionEdit {
@@ -109,6 +116,20 @@ class VersionEdit {
     new_files_.push_back(std::make_pair(level, f));
   }
 
+  // Add "meta" at the specified level, together with the statistics and
+  // flags it carries.
+  void AddFile(int level, const FileMetaData& meta) {
+    FileMetaData f;
+    f.number = meta.number;
+    f.file_size = meta.file_size;
+    f.smallest = meta.smallest;
+    f.largest = meta.largest;
+    f.fully_compacted = meta.fully_compacted;
+    f.num_entries = meta.num_entries;
+    f.num_deletions = meta.num_deletions;
+    new_files_.push_back(std::make_pair(level, f));
+  }
+
   /* Add the file to the appropriate sentinel. */
   void AddFileToSentinel(FileMetaData* f, int level) {
     assert(level >= 0 && level < config::kNumLevels);
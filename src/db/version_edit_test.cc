@@ -39,6 +39,57 @@ TEST(VersionEditTest, EncodeDecode) {
   TestEncodeDecode(edit);
 }
 
+TEST(VersionEditTest, CompactedFile) {
+  VersionEdit edit;
+  FileMetaData f;
+  f.number = 300;
+  f.file_size = 400;
+  f.smallest = InternalKey("foo", 500, kTypeValue);
+  f.largest = InternalKey("zoo", 600, kTypeValue);
+  f.fully_compacted = true;
+  edit.AddFile(6, f);
+  edit.AddFile(6, 301, 401,
+               InternalKey("zoo", 501, kTypeValue),
+               InternalKey("zzz", 601, kTypeValue));
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  const std::string debug = parsed.DebugString();
+  const size_t first = debug.find("AddFile: 6 300");
+  const size_t second = debug.find("AddFile: 6 301");
+  ASSERT_TRUE(first != std::string::npos && second != std::string::npos);
+  ASSERT_TRUE(debug.substr(first, second - first).find("(compacted)") != std::string::npos);
+  ASSERT_EQ(std::string::npos, debug.find("(compacted)", second));
+}
+
+TEST(VersionEditTest, FileStats) {
+  VersionEdit edit;
+  FileMetaData f;
+  f.number = 300;
+  f.file_size = 400;
+  f.smallest = InternalKey("foo", 500, kTypeValue);
+  f.largest = InternalKey("zoo", 600, kTypeDeletion);
+  f.num_entries = 1000;
+  f.num_deletions = 700;
+  edit.AddFile(3, f);
+  edit.AddFile(4, 301, 401,
+               InternalKey("zoo", 501, kTypeValue),
+               InternalKey("zzz", 601, kTypeValue));
+  TestEncodeDecode(edit);
+
+  std::string encoded;
+  edit.EncodeTo(&encoded);
+  VersionEdit parsed;
+  ASSERT_OK(parsed.DecodeFrom(encoded));
+  const std::string debug = parsed.DebugString();
+  ASSERT_TRUE(debug.find("AddFile: 3 300 400") != std::string::npos);
+  ASSERT_TRUE(debug.find("entries=1000 deletions=700") != std::string::npos);
+  ASSERT_EQ(std::string::npos, debug.find("entries=", debug.find("AddFile: 4 301")));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
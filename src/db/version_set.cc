@@ -19,6 +19,7 @@
 #include "pebblesdb/table_builder.h"
 #include "table/merger.h"
 #include "table/two_level_iterator.h"
+#include "util/atomic.h"
 #include "util/coding.h"
 #include "util/logging.h"
 #include "util/timer.h"
@@ -137,6 +138,57 @@ static int64_t TotalFileSize(const std::vector<FileMetaData*>& files) {
   return sum;
 }
 
+// Compacting a guard that holds a single fully compacted file would only
+// write the same entries out again
+static bool HoldsOneCompactedFile(const std::vector<FileMetaData*>& files) {
+  return files.size() == 1 && files[0]->fully_compacted;
+}
+
+// Compaction score earned by the deletion markers in "files": 1 once they
+// make up kTombstoneCompactionRatio of the entries, more for denser ones.
+// In the last level deletion markers only go away by merging them with the
+// other files they shadow, so a lone file earns nothing.
+static double TombstoneScore(const std::vector<FileMetaData*>& files,
+                             bool last_level) {
+  if (last_level && files.size() <= 1) {
+    return 0;
+  }
+  uint64_t entries = 0;
+  uint64_t deletions = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    entries += files[i]->num_entries;
+    deletions += files[i]->num_deletions;
+  }
+  if (entries < config::kTombstoneCompactionMinEntries) {
+    return 0;
+  }
+  return static_cast<double>(deletions) / entries / config::kTombstoneCompactionRatio;
+}
+
+// Whether the user key range of "f" overlaps that of any of "files"
+static bool OverlapsFiles(const Comparator* ucmp, const FileMetaData* f,
+                          const std::vector<FileMetaData*>& files) {
+  for (size_t i = 0; i < files.size(); i++) {
+    if (ucmp->Compare(f->smallest.user_key(), files[i]->largest.user_key()) <= 0 &&
+        ucmp->Compare(files[i]->smallest.user_key(), f->largest.user_key()) <= 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Whether the user key range of any of "a" overlaps that of any of "b"
+static bool OverlapsFiles(const Comparator* ucmp,
+                          const std::vector<FileMetaData*>& a,
+                          const std::vector<FileMetaData*>& b) {
+  for (size_t i = 0; i < a.size(); i++) {
+    if (OverlapsFiles(ucmp, a[i], b)) {
+      return true;
+    }
+  }
+  return false;
+}
+
 #pragma GCC diagnostic push
 #pragma GCC diagnostic ignored "-Wunsafe-loop-optimizations"
 
@@ -399,6 +451,17 @@ class Version::LevelFileNumIterator : public Iterator {
   mutable char value_buf_[16];
 };
 
+// LevelGuardNumIterator::value() encodes a fixed64 file count followed by one
+// entry per file: fixed64 number, fixed64 size and the FileMetaData pointer.
+// The pointer never leaves this process and stays valid while the Version
+// that owns the iterator is referenced.
+static const int kGuardFileEntrySize = 24;
+
+static FileMetaData* DecodeGuardFileMeta(const char* entry) {
+  return reinterpret_cast<FileMetaData*>(
+      static_cast<uintptr_t>(DecodeFixed64(entry + 16)));
+}
+
 static Iterator* GetFileIterator(void* arg,
                                  const ReadOptions& options,
                                  const Slice& file_value) {
@@ -501,36 +564,34 @@ class Version::LevelGuardNumIterator : public Iterator {
 
   Slice value() const {
     assert(Valid());
-    std::vector<uint64_t> files;
-    std::vector<uint64_t> file_sizes;
-    uint64_t num_files = 0;
+    std::vector<FileMetaData*> files;
     if (index_ == -1) {
     	for (int i = 0; i < sentinel_list_->size(); i++) {
     		if (sentinel_list_->at(i)->number > number_) {
-    			files.push_back(sentinel_list_->at(i)->number);
-    			file_sizes.push_back(sentinel_list_->at(i)->file_size);
-    			num_files++;
+    			files.push_back(sentinel_list_->at(i));
     		}
     	}
     } else {
     	for (int i = 0; i < glist_->at(index_)->number_segments; i++) {
     		if (glist_->at(index_)->files[i] > number_) {
-    			files.push_back(glist_->at(index_)->files[i]);
-    			file_sizes.push_back(glist_->at(index_)->file_metas[i]->file_size);
-    			num_files++;
+    			files.push_back(glist_->at(index_)->file_metas[i]);
     		}
     	}
     }
 
-    int num_bytes = 16 * num_files + 8;
+    uint64_t num_files = files.size();
+    value_buf_.resize(kGuardFileEntrySize * num_files + 8);
 
-    // For each file 16 bytes to store file number and file size and 8 more bytes to store the number of files (first 8 bytes)
-    EncodeFixed64(value_buf_, num_files);
+    // The first 8 bytes store the number of files, followed by one
+    // kGuardFileEntrySize entry per file.
+    EncodeFixed64(&value_buf_[0], num_files);
     for (int i = 0; i < files.size(); i++) {
-        EncodeFixed64(value_buf_+ i*16 + 8, files[i]);
-        EncodeFixed64(value_buf_+ i*16 + 16, file_sizes[i]);
+        char* entry = &value_buf_[0] + i*kGuardFileEntrySize + 8;
+        EncodeFixed64(entry, files[i]->number);
+        EncodeFixed64(entry + 8, files[i]->file_size);
+        EncodeFixed64(entry + 16, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(files[i])));
     }
-    return Slice(value_buf_, num_bytes);
+    return Slice(value_buf_);
   }
 
   virtual const Status& status() const { return status_; }
@@ -598,8 +659,9 @@ class Version::LevelGuardNumIterator : public Iterator {
   Status status_;
   Timer* timer;
 
-  // Backing store for value().  Holds the file number and size.
-  mutable char value_buf_[16384];
+  // Backing store for value().  Holds the number, size and metadata of
+  // every file in the guard.
+  mutable std::string value_buf_;
 };
 
 #ifdef SEEK_PARALLEL
@@ -607,7 +669,7 @@ static Iterator* GetGuardIteratorParallel(void* arg1, const void* arg2, void* ar
   TableCache* table_cache = reinterpret_cast<TableCache*> (arg1);
   const InternalKeyComparator* icmp = reinterpret_cast<const InternalKeyComparator*> (arg2);
   VersionSet* vset = reinterpret_cast<VersionSet*> (arg3);
-  int num_files = (file_values.size() - 8) / 16;
+  int num_files = (file_values.size() - 8) / kGuardFileEntrySize;
   assert(num_files > 0);
   Iterator** list = new Iterator*[num_files];
   FileMetaData** file_meta_list = new FileMetaData*[num_files];
@@ -622,11 +684,10 @@ static Iterator* GetGuardIteratorParallel(void* arg1, const void* arg2, void* ar
   int group_index;
 
   for (int i = 0; i < num_files; i++) {
-	  int file_num_pos = i * 16 + 8;
-	  int file_size_pos = file_num_pos + 8;
-	  uint64_t file_number = DecodeFixed64(file_values.data() + file_num_pos);
-	  uint64_t file_size = DecodeFixed64(file_values.data() + file_size_pos);
-	  file_meta_list[i] = table_cache->GetFileMetaDataForFile(file_number);
+	  const char* entry = file_values.data() + i * kGuardFileEntrySize + 8;
+	  uint64_t file_number = DecodeFixed64(entry);
+	  uint64_t file_size = DecodeFixed64(entry + 8);
+	  file_meta_list[i] = DecodeGuardFileMeta(entry);
 #ifdef SEEK_TWO_WAY_SIGNAL
 	// Get a group_index which is used to coordinate among the parallel threads being triggered
 	// to maintain the count of pending threds, to signal back using cv etc.
@@ -713,7 +774,7 @@ static Iterator* GetGuardIteratorSeq(void* arg1, const void* arg2, void* arg3, u
   TableCache* table_cache = reinterpret_cast<TableCache*> (arg1);
   const InternalKeyComparator* icmp = reinterpret_cast<const InternalKeyComparator*> (arg2);
   VersionSet* vset = reinterpret_cast<VersionSet*> (arg3);
-  int num_files = (file_values.size() - 8) / 16;
+  int num_files = (file_values.size() - 8) / kGuardFileEntrySize;
   assert(num_files > 0);
   Iterator** list = new Iterator*[num_files];
   FileMetaData** file_meta_list = new FileMetaData*[num_files];
@@ -721,11 +782,10 @@ static Iterator* GetGuardIteratorSeq(void* arg1, const void* arg2, void* arg3, u
   assert(num_files == DecodeFixed64(file_values.data()));
   vvstart_timer(SEEK_TITERATOR_SEQUENTIAL_TOTAL);
   for (int i = 0; i < num_files; i++) {
-	  int file_num_pos = i * 16 + 8;
-	  int file_size_pos = file_num_pos + 8;
-	  uint64_t file_number = DecodeFixed64(file_values.data() + file_num_pos);
-	  uint64_t file_size = DecodeFixed64(file_values.data() + file_size_pos);
-	  file_meta_list[i] = table_cache->GetFileMetaDataForFile(file_number);
+	  const char* entry = file_values.data() + i * kGuardFileEntrySize + 8;
+	  uint64_t file_number = DecodeFixed64(entry);
+	  uint64_t file_size = DecodeFixed64(entry + 8);
+	  file_meta_list[i] = DecodeGuardFileMeta(entry);
 	  list[i] = table_cache->NewIterator(options, file_number, file_size);
   }
   vvrecord_timer2(SEEK_TITERATOR_SEQUENTIAL_TOTAL, num_files);
@@ -742,7 +802,7 @@ static Iterator* GetGuardIterator(void* arg1, const void* arg2, void* arg3, unsi
   const InternalKeyComparator* icmp = reinterpret_cast<const InternalKeyComparator*> (arg2);
   VersionSet* vset = reinterpret_cast<VersionSet*> (arg3);
 
-  int num_files = (file_values.size() - 8) / 16;
+  int num_files = (file_values.size() - 8) / kGuardFileEntrySize;
   assert(num_files > 0);
 
 #ifdef SEEK_PARALLEL
@@ -798,6 +858,56 @@ void Version::AddSomeIteratorsGuards(const ReadOptions& options, uint64_t num,
   }
 }
 
+void Version::GetGuardSplitKeys(int n, std::vector<std::string>* splits) const {
+  splits->clear();
+  int deepest = -1;
+  for (int level = config::kNumLevels - 1; level >= 0; level--) {
+    if (!complete_guards_[level].empty()) {
+      deepest = level;
+      break;
+    }
+  }
+  if (deepest < 0 || n <= 1) {
+    return;
+  }
+
+  // bytes[0] covers keys before the first guard; bytes[i+1] covers guard i.
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const std::vector<GuardMetaData*>& guards = complete_guards_[deepest];
+  std::vector<uint64_t> bytes(guards.size() + 1, 0);
+  uint64_t total = 0;
+  for (unsigned level = 0; level < config::kNumLevels; level++) {
+    for (size_t i = 0; i < files_[level].size(); i++) {
+      const FileMetaData* f = files_[level][i];
+      size_t bucket = 0;
+      if (ucmp->Compare(f->smallest.user_key(),
+                        guards[0]->guard_key.user_key()) >= 0) {
+        bucket = FindGuard(vset_->icmp_, guards, f->smallest.Encode()) + 1;
+      }
+      bytes[bucket] += f->file_size;
+      total += f->file_size;
+    }
+  }
+  if (total == 0) {
+    // Nothing on disk yet; fall back to an even split by guard count.
+    for (size_t i = 0; i < bytes.size(); i++) {
+      bytes[i] = 1;
+    }
+    total = bytes.size();
+  }
+
+  // Cut at guard i once the bytes before it reach the next 1/n share.
+  uint64_t before = 0;
+  for (size_t i = 0; i < guards.size() &&
+                     splits->size() + 1 < static_cast<size_t>(n); i++) {
+    before += bytes[i];
+    if (before > 0 &&
+        before * n >= total * (splits->size() + 1)) {
+      splits->push_back(guards[i]->guard_key.user_key().ToString());
+    }
+  }
+}
+
 // Callback from TableCache::Get()
 namespace {
 }
@@ -850,6 +960,25 @@ void Version::ForEachOverlapping(Slice user_key, Slice internal_key,
   }
 }
 
+// Charge a Get that had to search more than one file of a guard to the
+// guard's "read_samples", sampling so that the counters of hot guards are
+// not written by every read.  Returns true if the guard just became due a
+// read compaction.
+static bool SampleGuardRead(uint64_t* read_samples) {
+  static thread_local uint32_t reads = 0;
+  if (++reads % config::kGuardReadSamplePeriod != 0) {
+    return false;
+  }
+  return atomic::increment_64_nobarrier(read_samples, 1) ==
+         config::kGuardReadCompactionTrigger;
+}
+
+static bool IsReadHot(const uint64_t* read_samples, size_t num_files) {
+  return num_files > 1 &&
+         atomic::load_64_nobarrier(read_samples) >=
+         config::kGuardReadCompactionTrigger;
+}
+
 Status Version::Get(const ReadOptions& options,
                     const LookupKey& k,
                     std::string* value,
@@ -864,6 +993,7 @@ Status Version::Get(const ReadOptions& options,
 
   stats->seek_file = NULL;
   stats->seek_file_level = -1;
+  stats->guard_read_hot = false;
   FileMetaData* last_file_read = NULL;
   int last_file_read_level = -1;
 
@@ -893,6 +1023,7 @@ Status Version::Get(const ReadOptions& options,
     if (num_guards > 0) {
     	g = guards_[level][guard_index];
     }
+    uint64_t* read_samples = NULL;
 
 	// If the guard chosen is the first in the level and if the lookup key is less
     // than the guard key of the first guard, it means that the key might be present in one
@@ -922,6 +1053,7 @@ Status Version::Get(const ReadOptions& options,
     	std::sort(tmp2.begin(), tmp2.end(), NewestFirst);
    		files = &tmp2[0];
    		num_files = tmp2.size();
+   		read_samples = &sentinel_read_samples_[level];
    		vrecord_timer(GET_SORT_SENTINEL_FILES, BEGIN, 1);
     } else if (g->number_segments > 0) {
 		vstart_timer(GET_CHECK_GUARD_FILES, BEGIN, 1);
@@ -940,6 +1072,7 @@ Status Version::Get(const ReadOptions& options,
     	std::sort(tmp2.begin(), tmp2.end(), NewestFirst);
 		files = &tmp2[0];
 		num_files = tmp2.size();
+		read_samples = &g->read_samples;
    		vrecord_timer(GET_SORT_GUARD_FILES, BEGIN, 1);
     } else {
     	num_files = 0;
@@ -948,6 +1081,9 @@ Status Version::Get(const ReadOptions& options,
     vrecord_timer(GET_FIND_LIST_OF_FILES, BEGIN, 1);
 
 #ifndef READ_PARALLEL
+    // Files of this level actually searched, as opposed to ruled out by
+    // their file-level filter
+    uint32_t num_probed = 0;
     for (uint32_t i = 0; i < num_files; ++i) {
       if (last_file_read != NULL && stats->seek_file == NULL) {
         // We have had more than one seek for this read.  Charge the 1st file.
@@ -986,6 +1122,11 @@ Status Version::Get(const ReadOptions& options,
 			  ikey, &saver, SaveValue, vset_->timer);
       vrecord_timer(GET_TABLE_CACHE_GET, BEGIN, 1);
       num_files_read++;
+      // files only holds those whose range covers the key, so this read
+      // has now searched two overlapping files of the guard
+      if (++num_probed == 2 && level > 0 && SampleGuardRead(read_samples)) {
+        stats->guard_read_hot = true;
+      }
 
       if (!s.ok()) {
         return s;
@@ -1018,6 +1159,9 @@ Status Version::Get(const ReadOptions& options,
         stats->seek_file = last_file_read;
         stats->seek_file_level = last_file_read_level;
       }
+      if (i == 1 && level > 0 && SampleGuardRead(read_samples)) {
+        stats->guard_read_hot = true;
+      }
 
       // Iterate through the files and do binary search.
       FileMetaData* f = files[i];
@@ -1124,7 +1268,7 @@ bool Version::UpdateStats(const GetStats& stats) {
       return true;
     }
   }
-  return false;
+  return stats.guard_read_hot;
 }
 
 bool Version::RecordReadSample(Slice internal_key) {
@@ -1152,15 +1296,70 @@ bool Version::RecordReadSample(Slice internal_key) {
 
   State state;
   state.matches = 0;
+  state.stats.guard_read_hot = false;
   ForEachOverlapping(ikey.user_key, internal_key, &state, &State::Match);
 
+  bool compact = RecordGuardReadSample(ikey.user_key, internal_key);
+
   // Must have at least two matches since we want to merge across
   // files. But what if we have a single file that contains many
   // overwrites and deletions?  Should we have another mechanism for
   // finding such files?
   if (state.matches >= 2) {
     // 1MB cost is about 1 seek (see comment in Builder::Apply).
-    return UpdateStats(state.stats);
+    compact = UpdateStats(state.stats) || compact;
+  }
+  return compact;
+}
+
+bool Version::RecordGuardReadSample(Slice user_key, Slice internal_key) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  bool hot = false;
+  for (unsigned level = 1; level < config::kNumLevels; level++) {
+    const std::vector<GuardMetaData*>& guards = guards_[level];
+    uint32_t guard_index = FindGuard(vset_->icmp_, guards, internal_key);
+    const std::vector<FileMetaData*>* files;
+    uint64_t* read_samples;
+    if (guards.empty() ||
+        (guard_index == 0 &&
+         ucmp->Compare(guards[0]->guard_key.user_key(), user_key) > 0)) {
+      files = &sentinel_files_[level];
+      read_samples = &sentinel_read_samples_[level];
+    } else {
+      files = &guards[guard_index]->file_metas;
+      read_samples = &guards[guard_index]->read_samples;
+    }
+
+    uint64_t overlapping = 0;
+    for (size_t i = 0; i < files->size(); i++) {
+      FileMetaData* f = (*files)[i];
+      if (f != NULL && ucmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(user_key, f->largest.user_key()) <= 0) {
+        overlapping++;
+      }
+    }
+    if (overlapping > 1) {
+      const uint64_t samples = atomic::increment_64_nobarrier(
+          read_samples, overlapping - 1);
+      if (samples >= config::kGuardReadCompactionTrigger &&
+          samples - (overlapping - 1) < config::kGuardReadCompactionTrigger) {
+        hot = true;
+      }
+    }
+  }
+  return hot;
+}
+
+bool Version::HasReadHotGuard(unsigned level) const {
+  if (IsReadHot(&sentinel_read_samples_[level],
+                sentinel_files_[level].size())) {
+    return true;
+  }
+  for (size_t i = 0; i < guards_[level].size(); i++) {
+    GuardMetaData* g = guards_[level][i];
+    if (IsReadHot(&g->read_samples, g->number_segments)) {
+      return true;
+    }
   }
   return false;
 }
@@ -1178,6 +1377,14 @@ void Version::Unref() {
   }
 }
 
+void Version::AddLiveFiles(std::set<uint64_t>* live) const {
+  for (unsigned level = 0; level < config::kNumLevels; level++) {
+    for (size_t i = 0; i < files_[level].size(); i++) {
+      live->insert(files_[level][i]->number);
+    }
+  }
+}
+
 bool Version::OverlapInLevel(unsigned level,
                              const Slice* smallest_user_key,
                              const Slice* largest_user_key) {
@@ -1692,6 +1899,9 @@ class VersionSet::Builder {
     guard_cmp.internal_comparator = &vset_->icmp_;
 
     for (unsigned level = 0; level < config::kNumLevels; level++) {
+      v->sentinel_read_samples_[level] =
+          atomic::load_64_nobarrier(&base_->sentinel_read_samples_[level]);
+
       // Merge the set of added files with the set of pre-existing files.
       // Drop any deleted files.  Store the result in *v.
       vstart_timer(MTC_SAVETO_ADD_FILES, BGC_SAVETO_ADD_FILES, mtc);
@@ -1923,6 +2133,7 @@ class VersionSet::Builder {
       new_g->guard_key = g->guard_key;
       new_g->level = g->level;
       new_g->refs = 1;
+      new_g->read_samples = atomic::load_64_nobarrier(&g->read_samples);
       guards->push_back(new_g);
       *last_inserted = g;
     }
@@ -2030,7 +2241,9 @@ VersionSet::VersionSet(const std::string& dbname,
 #ifdef SEEK_PARALLEL
 	  stop_seek_threads_(0),
 #endif
-	  num_seek_threads_(NUM_SEEK_THREADS) {
+	  num_seek_threads_(NUM_SEEK_THREADS),
+      read_compaction_credit_(0),
+      read_compaction_micros_(env_->NowMicros()) {
 
 #ifdef SEEK_PARALLEL
   current_thread_ = GetCurrentThreadId();
@@ -2582,6 +2795,15 @@ void VersionSet::Finalize(Version* v) {
 	}
 
 	v->guard_compaction_scores_[level].clear();
+    std::vector<uint64_t>& bytes_before = v->guard_bytes_before_[level];
+    bytes_before.clear();
+    bytes_before.push_back(0);
+    uint64_t running_bytes = TotalFileSize(v->sentinel_files_[level]);
+    for (size_t i = 0; i < v->guards_[level].size(); i++) {
+      bytes_before.push_back(running_bytes);
+      running_bytes += TotalFileSize(v->guards_[level][i]->file_metas);
+    }
+
     double score;
     if (level == 0) {
       // We treat level-0 specially by bounding the number of files
@@ -2624,6 +2846,12 @@ void VersionSet::Finalize(Version* v) {
       score1 = sentinel_bytes / MaxBytesPerGuardForLevel(level);
       score2 = static_cast<double>(num_sentinel_files) / static_cast<double>(max_files_per_segment+1);
       score = std::max(score1, score2);
+      // The last level has nowhere to push data, so its clean guards are left alone
+      const bool last_level = (level == config::kNumLevels - 1);
+      if (last_level && HoldsOneCompactedFile(v->sentinel_files_[level])) {
+        score = 0;
+      }
+      score = std::max(score, TombstoneScore(v->sentinel_files_[level], last_level));
       v->sentinel_compaction_scores_[level] = score;
       double max_score_in_level = v->sentinel_compaction_scores_[level];
 
@@ -2634,6 +2862,10 @@ void VersionSet::Finalize(Version* v) {
     	  score1 = guard_file_bytes / MaxBytesPerGuardForLevel(level);
     	  score2 = static_cast<double>(g->files.size()) / static_cast<double>(max_files_per_segment+1);
           score = std::max(score1, score2);
+          if (last_level && HoldsOneCompactedFile(g->file_metas)) {
+            score = 0;
+          }
+          score = std::max(score, TombstoneScore(g->file_metas, last_level));
           v->guard_compaction_scores_[level].push_back(score);
     	  max_score_in_level = std::max(max_score_in_level, v->guard_compaction_scores_[level][i]);
       }
@@ -2661,7 +2893,7 @@ Status VersionSet::WriteSnapshot(log::Writer* log) {
 	const std::vector<FileMetaData*>& files = current_->files_[level];
     for (size_t i = 0; i < files.size(); i++) {
       const FileMetaData* f = files[i];
-      edit.AddFile(level, f->number, f->file_size, f->smallest, f->largest);
+      edit.AddFile(level, *f);
     }
 
     // Save sentinel files
@@ -2803,31 +3035,41 @@ const char* VersionSet::LevelSummary(LevelSummaryStorage* scratch) const {
 }
 
 uint64_t VersionSet::ApproximateOffsetOf(Version* v, const InternalKey& ikey) {
+  const Comparator* ucmp = icmp_.user_comparator();
   uint64_t result = 0;
   for (unsigned level = 0; level < config::kNumLevels; level++) {
-    const std::vector<FileMetaData*>& files = v->files_[level];
-    for (size_t i = 0; i < files.size(); i++) {
-      if (icmp_.Compare(files[i]->largest, ikey) <= 0) {
+    // Every guard before the one covering "ikey" holds only smaller user
+    // keys and every guard after it only larger ones, so only the files of
+    // the covering guard have to be looked at.
+    const std::vector<GuardMetaData*>& guards = v->guards_[level];
+    size_t bucket = 0;  // 0 for the sentinel, i + 1 for guard i
+    const std::vector<FileMetaData*>* files = &v->sentinel_files_[level];
+    if (!guards.empty()) {
+      const size_t i = FindGuard(icmp_, guards, ikey.Encode());
+      if (ucmp->Compare(ikey.user_key(), guards[i]->guard_key.user_key()) >= 0) {
+        bucket = i + 1;
+        files = &guards[i]->file_metas;
+      }
+    }
+    result += v->guard_bytes_before_[level][bucket];
+
+    // Files within a guard may overlap, so each one is checked
+    for (size_t i = 0; i < files->size(); i++) {
+      const FileMetaData* f = (*files)[i];
+      if (f == NULL) {
+        continue;
+      }
+      if (icmp_.Compare(f->largest, ikey) <= 0) {
         // Entire file is before "ikey", so just add the file size
-        result += files[i]->file_size;
-      } else if (icmp_.Compare(files[i]->smallest, ikey) > 0) {
-        // Entire file is after "ikey", so ignore
-        if (level > 0) {
-          // Files other than level 0 are sorted by meta->smallest, so
-          // no further files in this level will contain data for
-          // "ikey".
-          break;
-        }
-      } else {
+        result += f->file_size;
+      } else if (icmp_.Compare(f->smallest, ikey) < 0) {
         // "ikey" falls in the range for this table.  Add the
         // approximate offset of "ikey" within the table.
-        Table* tableptr;
-        Iterator* iter = table_cache_->NewIterator(
-            ReadOptions(), files[i]->number, files[i]->file_size, &tableptr);
-        if (tableptr != NULL) {
-          result += tableptr->ApproximateOffsetOf(ikey.Encode());
+        uint64_t offset;
+        if (table_cache_->ApproximateOffsetOf(f->number, f->file_size,
+                                              ikey.Encode(), &offset).ok()) {
+          result += offset;
         }
-        delete iter;
       }
     }
   }
@@ -2847,11 +3089,31 @@ void VersionSet::AddLiveFiles(std::set<uint64_t>* live) {
   }
 }
 
+uint64_t VersionSet::ManifestFileSize() const {
+  return descriptor_log_ != NULL ? descriptor_log_->Offset() : 0;
+}
+
 int64_t VersionSet::NumLevelBytes(unsigned level) const {
   assert(level < config::kNumLevels);
   return TotalFileSize(current_->files_[level]);
 }
 
+int64_t VersionSet::PendingCompactionBytes() const {
+  int64_t result = 0;
+  for (unsigned level = 0; level < config::kNumLevels; level++) {
+    if (current_->sentinel_compaction_scores_[level] >= 1) {
+      result += TotalFileSize(current_->sentinel_files_[level]);
+    }
+    const std::vector<GuardMetaData*>& guards = current_->guards_[level];
+    for (size_t i = 0; i < guards.size(); i++) {
+      if (current_->GetGuardCompactionScore(level, i) >= 1) {
+        result += TotalFileSize(guards[i]->file_metas);
+      }
+    }
+  }
+  return result;
+}
+
 int64_t VersionSet::MaxNextLevelOverlappingBytes() {
   int64_t result = 0;
   std::vector<FileMetaData*> overlaps;
@@ -3018,12 +3280,22 @@ bool VersionSet::IsAllLevelsCompacted() {
 	return true;
 }
 
-unsigned VersionSet::PickCompactionLevel(bool* locked, bool seek_driven, bool* force_compact) const {
+double VersionSet::ReadCompactionCredit() const {
+  const double rate = options_->read_compaction_bytes_per_sec;
+  const uint64_t now = env_->NowMicros();
+  const double credit = read_compaction_credit_ +
+      rate * (now - read_compaction_micros_) / 1000000.0;
+  return std::min(credit, rate * config::kReadCompactionBurstSeconds);
+}
+
+unsigned VersionSet::PickCompactionLevel(bool* locked, bool seek_driven, bool* force_compact,
+                                         bool* read_driven) const {
   // Find an unlocked level has score >= 1 where level + 1 has score < 1.
   unsigned level = config::kNumLevels;
   bool no_horizontal_compact = false;
   int count_guard_scores = 0;
   *force_compact = false;
+  *read_driven = false;
   for (unsigned i = 1; i + 1 < config::kNumLevels; ++i) {
     if (locked[i] || locked[i + 1]) {
       continue;
@@ -3117,6 +3389,21 @@ unsigned VersionSet::PickCompactionLevel(bool* locked, bool seek_driven, bool* f
           }
 	  }
   }
+
+  // With nothing else to do, compact a guard whose reads keep searching
+  // several of its files, as long as the read compaction budget allows
+  if (level == config::kNumLevels && ReadCompactionCredit() > 0) {
+    for (unsigned i = 1; i < config::kNumLevels; ++i) {
+      if (locked[i] || (i + 1 < config::kNumLevels && locked[i + 1])) {
+        continue;
+      }
+      if (current_->HasReadHotGuard(i)) {
+        *read_driven = true;
+        level = i;
+        break;
+      }
+    }
+  }
   return level;
 }
 
@@ -3124,7 +3411,8 @@ static bool OldestFirst(FileMetaData* a, FileMetaData* b) {
   return a->number < b->number;
 }
 
-Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std::vector<GuardMetaData*> *complete_guards_used_in_bg_compaction, bool force_compact) {
+Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std::vector<GuardMetaData*> *complete_guards_used_in_bg_compaction, bool force_compact,
+                                                bool read_driven) {
 	  assert(level < config::kNumLevels);
 
 	  if (v->files_[level].empty()) {
@@ -3142,8 +3430,15 @@ Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std:
 		  int64_t current_level_size_in_mb = current_level_size / (1024 * 1024);
 		  int64_t next_level_size = TotalFileSize(current_->files_[level+1]);
 
+		  // Guards dense with deletion markers are pushed down to the last level instead,
+		  // where the markers meet the entries they shadow
+		  bool tombstone_dense = TombstoneScore(v->sentinel_files_[level], false) >= 1.0;
+		  for (size_t i = 0; !tombstone_dense && i < v->guards_[level].size(); i++) {
+			  tombstone_dense = TombstoneScore(v->guards_[level][i]->file_metas, false) >= 1.0;
+		  }
+
 		  // If the penultimate level contains very less data compared to last level, do horizontal compaction in that level
-		  if (current_level_size > 0 && next_level_size / current_level_size > 25.0) {
+		  if (current_level_size > 0 && next_level_size / current_level_size > 25.0 && !tombstone_dense) {
 			  horizontal_compaction = true;
 		  }
 	  }
@@ -3199,6 +3494,11 @@ Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std:
 	  c->input_version_->Ref();
 	  c->is_horizontal_compaction = horizontal_compaction;
 
+	  // Files of level compacted for their deletion markers.  Everything they
+	  // overlap in level + 1 joins the compaction so the markers can be dropped.
+	  std::vector<FileMetaData*> tombstone_files;
+	  const Comparator* ucmp = icmp_.user_comparator();
+
 	  for (int which = 0; which < num_input_levels_for_compaction; which++) {
 		  std::vector<GuardMetaData*> guards_to_add_to_compaction;
 		  std::vector<bool> guards_compaction_add_all_files;
@@ -3232,6 +3532,24 @@ Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std:
 			  add_sentinel_files = true;
 			  add_all_sentinel_files = false;
 		  }
+		  const bool last_level = (current_level == config::kNumLevels - 1);
+		  if (add_sentinel_files && which == 0 &&
+		      TombstoneScore(v->sentinel_files_[current_level], last_level) >= 1.0) {
+			  add_all_sentinel_files = true;
+			  tombstone_files.insert(tombstone_files.end(), v->sentinel_files_[current_level].begin(),
+			                         v->sentinel_files_[current_level].end());
+		  }
+		  if (!add_sentinel_files && which == 1 &&
+		      OverlapsFiles(ucmp, v->sentinel_files_[current_level], tombstone_files)) {
+			  add_sentinel_files = true;
+			  add_all_sentinel_files = true;
+		  }
+		  if (!add_sentinel_files && which == 0 && read_driven &&
+		      IsReadHot(&v->sentinel_read_samples_[current_level], v->sentinel_files_[current_level].size())) {
+			  add_sentinel_files = true;
+			  add_all_sentinel_files = true;
+			  atomic::store_64_nobarrier(&v->sentinel_read_samples_[current_level], 0);
+		  }
 
 		  int max_files_per_guard = MaxFilesPerGuardForLevel(current_level);
 		  if (max_files_per_guard <= 0) {
@@ -3312,8 +3630,24 @@ Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std:
 				  }
 			  }
 			  if (!guard_added && which == 0 && (force_compact || v->guard_compaction_scores_[current_level][guard_index] >= 1.0)) {
+				  const bool tombstone_dense = TombstoneScore(g->file_metas, last_level) >= 1.0;
 				  guards_to_add_to_compaction.push_back(g);
-				  guards_compaction_add_all_files.push_back(false);
+				  guards_compaction_add_all_files.push_back(tombstone_dense);
+				  if (tombstone_dense) {
+					  tombstone_files.insert(tombstone_files.end(), g->file_metas.begin(), g->file_metas.end());
+				  }
+				  continue;
+			  }
+			  if (!guard_added && which == 1 && OverlapsFiles(ucmp, g->file_metas, tombstone_files)) {
+				  guards_to_add_to_compaction.push_back(g);
+				  guards_compaction_add_all_files.push_back(true);
+				  continue;
+			  }
+			  if (!guard_added && which == 0 && read_driven && IsReadHot(&g->read_samples, g->number_segments)) {
+				  // Merge all of the files so that reads search only one
+				  guards_to_add_to_compaction.push_back(g);
+				  guards_compaction_add_all_files.push_back(true);
+				  atomic::store_64_nobarrier(&g->read_samples, 0);
 				  continue;
 			  }
 		  }
@@ -3367,6 +3701,13 @@ Compaction* VersionSet::PickCompactionForGuards(Version* v, unsigned level, std:
 		  }
 		  guards_to_add_to_compaction.clear();
 	  }
+
+	  if (read_driven) {
+		  read_compaction_credit_ = ReadCompactionCredit() -
+				  (TotalFileSize(c->inputs_[0]) + TotalFileSize(c->inputs_[1]));
+		  read_compaction_micros_ = env_->NowMicros();
+	  }
+	  c->SetupInputNumbers();
 	  return c;
 }
 
@@ -3484,14 +3825,13 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   GetRange(c->inputs_[0], &smallest, &largest);
   c->input_version_->GetOverlappingInputs(level+1, &smallest, &largest, &c->inputs_[1]);
   if (level + 2 < config::kNumLevels) {
-    const Comparator* user_cmp = icmp_.user_comparator();
     std::vector<FileMetaData*> tmp;
     c->input_version_->GetOverlappingInputs(level + 2, &smallest, &largest, &tmp);
     for (size_t i = 0; i < tmp.size(); ++i) {
       leveldb::Slice boundary1 = tmp[i]->smallest.user_key();
       leveldb::Slice boundary2 = tmp[i]->largest.user_key();
-      c->boundaries_.push_back(std::make_pair(user_cmp->KeyNum(boundary1), boundary1));
-      c->boundaries_.push_back(std::make_pair(user_cmp->KeyNum(boundary2), boundary2));
+      c->boundaries_.push_back(std::make_pair(icmp_.UserKeyNum(boundary1), boundary1));
+      c->boundaries_.push_back(std::make_pair(icmp_.UserKeyNum(boundary2), boundary2));
     }
   }
 
@@ -3518,6 +3858,30 @@ Compaction* VersionSet::CompactRange(
     return NULL;
   }
 
+  // Leave out the guards of level + 1 that already hold a single fully
+  // compacted file and receive no data from level, so that repeated full
+  // compactions only rewrite what changed since the last one
+  const Comparator* ucmp = icmp_.user_comparator();
+  if (!sentinel_inputs[1].empty() &&
+      HoldsOneCompactedFile(sentinel_inputs[1]) &&
+      !OverlapsFiles(ucmp, sentinel_inputs[1][0], inputs[0])) {
+    sentinel_inputs[1].clear();
+  }
+  std::vector<GuardMetaData*> guards_to_compact;
+  for (size_t i = 0; i < guard_inputs[1].size(); i++) {
+    GuardMetaData* g = guard_inputs[1][i];
+    if (!HoldsOneCompactedFile(g->file_metas) ||
+        OverlapsFiles(ucmp, g->file_metas[0], inputs[0])) {
+      guards_to_compact.push_back(g);
+    }
+  }
+  guard_inputs[1].swap(guards_to_compact);
+  inputs[1] = sentinel_inputs[1];
+  for (size_t i = 0; i < guard_inputs[1].size(); i++) {
+    inputs[1].insert(inputs[1].end(), guard_inputs[1][i]->file_metas.begin(),
+                     guard_inputs[1][i]->file_metas.end());
+  }
+
   // Avoid compacting too much in one shot in case the range is large.
   // But we cannot do this for level-0 since level-0 files can overlap
   // and we must not pick one file and drop another older file if the
@@ -3547,6 +3911,7 @@ Compaction* VersionSet::CompactRange(
   c->guard_inputs_[1] = guard_inputs[1];
   c->sentinel_inputs_[1] = sentinel_inputs[1];
   c->is_horizontal_compaction = false; // Not sure if we should do horizontal compaction during manual compaction
+  c->SetupInputNumbers();
   return c;
 }
 
@@ -3556,10 +3921,8 @@ Compaction::Compaction(unsigned l)
       max_output_file_size_(MaxFileSizeForLevel(l)),
       input_version_(NULL),
       edit_(),
-      boundaries_() {
-  for (unsigned i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
-  }
+      boundaries_(),
+      input_numbers_() {
 }
 
 #pragma GCC diagnostic push
@@ -3580,9 +3943,10 @@ bool Compaction::CrossesBoundary(const ParsedInternalKey& old_key,
   if (boundaries_.empty()) {
     return false;
   }
-  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  uint64_t lower_num = user_cmp->KeyNum(old_key.user_key);
-  uint64_t upper_num = user_cmp->KeyNum(new_key.user_key);
+  const InternalKeyComparator& icmp = input_version_->vset_->icmp_;
+  const Comparator* user_cmp = icmp.user_comparator();
+  uint64_t lower_num = icmp.UserKeyNum(old_key.user_key);
+  uint64_t upper_num = icmp.UserKeyNum(new_key.user_key);
   while (*hint < boundaries_.size()) {
     assert(lower_num < upper_num ||
            (lower_num == upper_num &&
@@ -3702,26 +4066,48 @@ std::string Compaction::DebugString() {
 }
 
 bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
-  // Maybe use binary search to find right entry instead of linear search?
-  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
-  for (unsigned lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
-    const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    for (; level_ptrs_[lvl] < files.size(); ) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
-      if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
-        // We've advanced far enough
-        if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
-          // Key falls in this file's range, so definitely not base level
-          return false;
-        }
-        break;
+  // Older entries for the key may sit in the levels below, or in this
+  // level if the compaction is horizontal.  Files are located the way
+  // Version::Get finds them, through the sentinel or the covering guard.
+  const InternalKeyComparator& icmp = input_version_->vset_->icmp_;
+  const Comparator* user_cmp = icmp.user_comparator();
+  const InternalKey ikey(user_key, kMaxSequenceNumber, kValueTypeForSeek);
+  for (unsigned lvl = is_horizontal_compaction ? level_ : level_ + 1;
+       lvl < config::kNumLevels; lvl++) {
+    const std::vector<GuardMetaData*>& guards = input_version_->guards_[lvl];
+    const std::vector<FileMetaData*>* files = &input_version_->sentinel_files_[lvl];
+    if (!guards.empty()) {
+      GuardMetaData* g = guards[FindGuard(icmp, guards, ikey.Encode())];
+      if (user_cmp->Compare(user_key, g->guard_key.user_key()) >= 0) {
+        files = &g->file_metas;
+      }
+    }
+    for (size_t i = 0; i < files->size(); i++) {
+      FileMetaData* f = (*files)[i];
+      if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0 &&
+          user_cmp->Compare(user_key, f->largest.user_key()) <= 0 &&
+          !IsInput(f)) {
+        // Key falls in a file left out of the compaction
+        return false;
       }
-      level_ptrs_[lvl]++;
     }
   }
   return true;
 }
 
+void Compaction::SetupInputNumbers() {
+  input_numbers_.clear();
+  for (int which = 0; which < 2; which++) {
+    for (size_t i = 0; i < inputs_[which].size(); i++) {
+      input_numbers_.insert(inputs_[which][i]->number);
+    }
+  }
+}
+
+bool Compaction::IsInput(const FileMetaData* f) const {
+  return input_numbers_.count(f->number) > 0;
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != NULL) {
     input_version_->Unref();
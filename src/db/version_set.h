@@ -152,12 +152,22 @@ class Version {
   // This function is with taking guards into account
   void AddSomeIteratorsGuards(const ReadOptions&, uint64_t num, std::vector<Iterator*>* iters);
 
+  // Store in *splits up to n-1 user keys, in increasing order, that cut
+  // the key space into ranges holding roughly equal bytes.  Every split
+  // is a guard key (persisted or not) of the deepest level that has
+  // guards; files of all levels are attributed to the deepest-level guard
+  // containing their smallest key.  *splits is left empty when there are
+  // no guards.
+  // REQUIRES: lock is held
+  void GetGuardSplitKeys(int n, std::vector<std::string>* splits) const;
+
   // Lookup the value for key.  If found, store it in *val and
   // return OK.  Else return a non-OK status.  Fills *stats.
   // REQUIRES: lock is not held
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
+    bool guard_read_hot;  // Some guard became due a read compaction
   };
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
@@ -178,6 +188,9 @@ class Version {
   void Ref();
   void Unref();
 
+  // Add the numbers of all files referenced by this version to *live.
+  void AddLiveFiles(std::set<uint64_t>* live) const;
+
   void GetOverlappingInputs(
       unsigned level,
       const InternalKey* begin,         // NULL means before all keys
@@ -355,6 +368,29 @@ class Version {
 	  return guards_[level];
   }
 
+  const std::vector<FileMetaData*>& GetFilesAtLevel(unsigned level) const {
+	  assert(level < config::kNumLevels);
+	  return files_[level];
+  }
+
+  const std::vector<FileMetaData*>& GetSentinelFilesAtLevel(unsigned level) const {
+	  assert(level < config::kNumLevels);
+	  return sentinel_files_[level];
+  }
+
+  // Compaction scores computed by VersionSet::Finalize; a score >= 1 means
+  // the sentinel (or guard i of GetGuardsAtLevel) is due for compaction.
+  double GetSentinelCompactionScore(unsigned level) const {
+	  assert(level < config::kNumLevels);
+	  return sentinel_compaction_scores_[level];
+  }
+
+  double GetGuardCompactionScore(unsigned level, size_t i) const {
+	  assert(level < config::kNumLevels);
+	  return i < guard_compaction_scores_[level].size() ?
+			  guard_compaction_scores_[level][i] : 0;
+  }
+
   int GetNumLevelsWithFiles(int *min_level, int *max_level, double* max_level_compaction_score) {
 	  *min_level = -1; *max_level = -1;
 	  int cnt = 0;
@@ -406,6 +442,15 @@ class Version {
                           void* arg,
                           bool (*func)(void*, unsigned, FileMetaData*));
 
+  // Charge every guard (or sentinel) in which user_key lies within the
+  // range of more than one file with a read sample per extra file.
+  // Returns true if one of them became due a read compaction.
+  bool RecordGuardReadSample(Slice user_key, Slice internal_key);
+
+  // Returns true iff a guard (or the sentinel) at "level" is due a
+  // read compaction.
+  bool HasReadHotGuard(unsigned level) const;
+
   VersionSet* vset_;            // VersionSet to which this Version belongs
   Version* next_;               // Next version in linked list
   Version* prev_;               // Previous version in linked list
@@ -438,6 +483,14 @@ class Version {
   // To hold the compaction score of sentinel files in each level
   double sentinel_compaction_scores_[config::kNumLevels];
 
+  // Like GuardMetaData::read_samples, for the sentinel of each level
+  uint64_t sentinel_read_samples_[config::kNumLevels];
+
+  // Bytes at "level" that sort before the sentinel (always 0) and before
+  // each guard: guard_bytes_before_[level][i + 1] is the size of the
+  // sentinel files and of guards 0..i-1.  Initialized by Finalize().
+  std::vector<uint64_t> guard_bytes_before_[config::kNumLevels];
+
   explicit Version(VersionSet* vset)
       : vset_(vset), next_(this), prev_(this), refs_(0),
         file_to_compact_(NULL),
@@ -445,6 +498,8 @@ class Version {
     for (unsigned i = 0; i < config::kNumLevels; ++i) {
       compaction_scores_[i] = -1;
       num_complete_guards_[i] = 0;
+      sentinel_read_samples_[i] = 0;
+      guard_bytes_before_[i].assign(1, 0);
     }
   }
 
@@ -670,6 +725,10 @@ class VersionSet {
   // Return the current manifest file number
   uint64_t ManifestFileNumber() const { return manifest_file_number_; }
 
+  // Return the number of bytes written to the current manifest file.
+  // REQUIRES: no LogAndApply is writing the manifest
+  uint64_t ManifestFileSize() const;
+
   // Allocate and return a new file number
   uint64_t NewFileNumber() { return next_file_number_++; }
 
@@ -688,6 +747,11 @@ class VersionSet {
   // Return the combined file size of all files at the specified level.
   int64_t NumLevelBytes(unsigned level) const;
 
+  // Return the combined file size of the sentinels and guards whose
+  // compaction score is at least 1, i.e. the bytes that are due to be
+  // compacted into the next level.
+  int64_t PendingCompactionBytes() const;
+
   // Returns the number of guards at a given level
   int NumGuards(unsigned level) const;
   
@@ -736,7 +800,10 @@ class VersionSet {
   // Pick level for a new compaction.
   // Returns kNumLevels if there is no compaction to be done.
   // Otherwise returns the lowest unlocked level that may compact upwards.
-  unsigned PickCompactionLevel(bool* locked, bool seek_driven, bool* force_compact) const;
+  // Sets *read_driven if the level was picked only because a guard in it
+  // is due a read compaction.
+  unsigned PickCompactionLevel(bool* locked, bool seek_driven, bool* force_compact,
+                               bool* read_driven) const;
 
   unsigned NumUncompactedLevels();
   // Pick inputs for a new compaction at the specified level.
@@ -751,7 +818,10 @@ class VersionSet {
 
   // To pick the required compaction object to compact the guard files
   // in a level and assign them to proper guards
-  Compaction* PickCompactionForGuards(Version* v, unsigned level, std::vector<GuardMetaData*>* complete_guards_used_in_bg_compaction, bool force_compact);
+  // With read_driven, also compacts the guards that are due a read
+  // compaction and charges them to the read compaction budget.
+  Compaction* PickCompactionForGuards(Version* v, unsigned level, std::vector<GuardMetaData*>* complete_guards_used_in_bg_compaction, bool force_compact,
+                                      bool read_driven);
 
   // Return a compaction object for compacting the range [begin,end] in
   // the specified level.  Returns NULL if there is nothing in that
@@ -774,8 +844,9 @@ class VersionSet {
 
   // Returns true iff some level needs a compaction.
   bool NeedsCompaction(bool* levels, bool seek_driven) const {
-	bool force_compact;
-    return PickCompactionLevel(levels, seek_driven, &force_compact) != config::kNumLevels;
+	bool force_compact, read_driven;
+    return PickCompactionLevel(levels, seek_driven, &force_compact,
+                               &read_driven) != config::kNumLevels;
   }
 
   // Add all files listed in any live version to *live.
@@ -783,7 +854,8 @@ class VersionSet {
   void AddLiveFiles(std::set<uint64_t>* live);
 
   // Return the approximate offset in the database of the data for
-  // "key" as of version "v".
+  // "key" as of version "v".  Only the tables of the guard (or sentinel)
+  // covering "key" at each level are opened.
   uint64_t ApproximateOffsetOf(Version* v, const InternalKey& key);
   
   // Return a human-readable short (single-line) summary of the number
@@ -842,6 +914,9 @@ class VersionSet {
 
   void SetupOtherInputs(Compaction* c);
 
+  // Bytes of input that read-triggered compactions may use right now
+  double ReadCompactionCredit() const;
+
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
 
@@ -954,6 +1029,11 @@ class VersionSet {
   // Either an empty string, or a valid InternalKey.
   // vijayc: this could be the start of a guard.
   std::string compact_pointer_[config::kNumLevels];
+
+  // Bytes of input that read-triggered compactions could still use as of
+  // read_compaction_micros_; negative while they are over budget.
+  double read_compaction_credit_;
+  uint64_t read_compaction_micros_;
         
   // No copying allowed
   VersionSet(const VersionSet&);
@@ -999,8 +1079,8 @@ class Compaction {
   void AddInputDeletions(VersionEdit* edit);
   
   // Returns true if the information we have available guarantees that
-  // the compaction is producing data in "level+1" for which no data exists
-  // in levels greater than "level+1".
+  // no file outside of the compaction inputs, in the output level or
+  // below, holds data for "user_key".
   bool IsBaseLevelForKey(const Slice& user_key);
 
   // Release the input version for the compaction, once the compaction
@@ -1031,14 +1111,13 @@ class Compaction {
   std::vector<GuardMetaData*> guard_inputs_[2];
   std::vector<FileMetaData*> sentinel_inputs_[2]; // inputs_ = guard_inputs_ + sentinel_inputs_
   std::vector<std::pair<uint64_t, leveldb::Slice> > boundaries_;
+  std::set<uint64_t> input_numbers_;  // Numbers of the files in inputs_
 
-  // State for implementing IsBaseLevelForKey
+  // Fill input_numbers_ once inputs_ is final
+  void SetupInputNumbers();
 
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
+  // Whether "f" is one of the files being compacted
+  bool IsInput(const FileMetaData* f) const;
 };
 
 }  // namespace leveldb
@@ -275,6 +275,13 @@ class InMemoryEnv : public EnvWrapper {
     return Status::OK();
   }
 
+  // In-memory files have nothing to tune
+  virtual Status NewWritableFile(const std::string& fname,
+                                 const FileOptions& file_options,
+                                 WritableFile** result) {
+    return NewWritableFile(fname, result);
+  }
+
   virtual bool FileExists(const std::string& fname) {
     MutexLock lock(&mutex_);
     return file_map_.find(fname) != file_map_.end();
@@ -19,16 +19,29 @@
 #define STORAGE_LEVELDB_INCLUDE_CACHE_H_
 
 #include <stdint.h>
+#include <string>
 #include "pebblesdb/slice.h"
+#include "pebblesdb/status.h"
 
 namespace leveldb {
 
 class Cache;
+class Env;
+class SecondaryCache;
 
 // Create a new cache with a fixed size capacity.  This implementation
 // of Cache uses a least-recently-used eviction policy.
 extern Cache* NewLRUCache(size_t capacity);
 
+// Create a secondary cache of roughly "capacity" bytes that keeps its
+// entries in log-structured segment files under the directory "dirname"
+// (preferably on a fast local device or tmpfs), indexed in memory.  Any
+// segment files left in "dirname" by an earlier instance are removed.
+// On success, stores the cache in *result and returns OK.
+extern Status NewFileSecondaryCache(Env* env, const std::string& dirname,
+                                    size_t capacity,
+                                    SecondaryCache** result);
+
 class Cache {
  public:
   Cache() : rep_() { }
@@ -94,6 +107,39 @@ class Cache {
   void operator=(const Cache&);
 };
 
+// A SecondaryCache holds copies of entries evicted from a primary cache
+// so that they can be recovered more cheaply than from their source.
+// Entries are plain byte strings and may be dropped at any time.  It has
+// internal synchronization and may be safely accessed concurrently from
+// multiple threads.
+class SecondaryCache {
+ public:
+  SecondaryCache() { }
+  virtual ~SecondaryCache();
+
+  // Store a copy of "contents" under "key", replacing any earlier entry.
+  virtual void Insert(const Slice& key, const Slice& contents) = 0;
+
+  // If the cache holds an entry for "key", store a copy of it in
+  // *contents and return true.  Else return false.
+  virtual bool Lookup(const Slice& key, std::string* contents) = 0;
+
+  // Return a new numeric id.  May be used by multiple clients who are
+  // sharing the same cache to partition the key space.  Typically the
+  // client will allocate a new id at startup and prepend the id to
+  // its cache keys.
+  virtual uint64_t NewId() = 0;
+
+  // Number of Lookup() calls that did / did not find their key.
+  virtual uint64_t Hits() const = 0;
+  virtual uint64_t Misses() const = 0;
+
+ private:
+  // No copying allowed
+  SecondaryCache(const SecondaryCache&);
+  void operator=(const SecondaryCache&);
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_UTIL_CACHE_H_
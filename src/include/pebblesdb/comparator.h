@@ -62,6 +62,30 @@ class Comparator {
 // must not be deleted.
 extern const Comparator* BytewiseComparator();
 
+// A KeyNumExtractor stands in for Comparator::KeyNum() when the first
+// eight bytes of the keys say little about their order, for example
+// because most keys start with the same long prefix.  It must agree
+// with the comparator: if a < b then KeyNum(a) <= KeyNum(b).
+class KeyNumExtractor {
+ public:
+  virtual ~KeyNumExtractor();
+
+  // The name of the mapping.  Tables record it next to the KeyNums they
+  // store (see Options::block_key_nums) and ignore those KeyNums when
+  // opened with another name, so switch to a new name whenever the
+  // mapping changes.
+  virtual const char* Name() const = 0;
+
+  virtual uint64_t KeyNum(const Slice& key) const = 0;
+};
+
+// Return a new extractor for the bytewise comparator that skips
+// "prefix" and returns the next eight bytes of the keys that start
+// with it.  Keys that do not start with "prefix" map to 0 or to ~0.
+// The caller should delete the result when it is no longer needed.
+extern const KeyNumExtractor* NewPrefixSkippingKeyNumExtractor(
+    const Slice& prefix);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_INCLUDE_COMPARATOR_H_
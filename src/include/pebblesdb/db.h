@@ -7,6 +7,7 @@
 
 #include <stdint.h>
 #include <stdio.h>
+#include <vector>
 #include "pebblesdb/iterator.h"
 #include "pebblesdb/options.h"
 #include "pebblesdb/replay_iterator.h"
@@ -98,6 +99,20 @@ class DB {
   // The returned iterator should be deleted before this db is deleted.
   virtual Iterator* NewIterator(const ReadOptions& options) = 0;
 
+  // Split the database into at most "n" key ranges and store one
+  // heap-allocated iterator per range in "*iterators", in key order.  The
+  // ranges are disjoint, cover the whole key space, and are cut at guard
+  // keys of the deepest level so that each holds roughly the same number
+  // of bytes.  All iterators observe the same snapshot (options.snapshot
+  // if set, otherwise the state at the time of the call) and may be used
+  // concurrently from different threads.  Fewer than "n" iterators are
+  // returned when there are not enough guards to cut at.
+  //
+  // Caller should delete the iterators when they are no longer needed.
+  // The returned iterators should be deleted before this db is deleted.
+  virtual Status NewParallelIterators(const ReadOptions& options, int n,
+                                      std::vector<Iterator*>* iterators) = 0;
+
   // Return a handle to the current DB state.  Iterators created with
   // this handle will all observe a stable snapshot of the current DB
   // state.  The caller must call ReleaseSnapshot(result) when the
@@ -122,6 +137,25 @@ class DB {
   //     about the internal operation of the DB.
   //  "leveldb.sstables" - returns a multi-line string that describes all
   //     of the sstables that make up the db contents.
+  //  "leveldb.num-bytes-at-level<N>" - return the total size of the files
+  //     at level <N>.
+  //  "leveldb.pending-compaction-bytes" - return the size of the files in
+  //     guards and sentinels that are due for compaction.
+  //  "leveldb.compaction-bytes-written" - return the bytes written by
+  //     memtable flushes and compactions since the DB was opened.
+  //  "leveldb.user-bytes-written" - return the bytes of write batches
+  //     applied since the DB was opened.
+  //  "leveldb.wal-bytes-written" - return the bytes the log records of
+  //     those write batches took in the log files, after compression.
+  //  "leveldb.write-stall-micros" - return the time writers have spent
+  //     stalled on a full memtable or on level-0 since the DB was opened.
+  //  "leveldb.row-cache-hits" - return the number of table lookups the row
+  //     cache answered since the DB was opened.
+  //  "leveldb.row-cache-misses" - return the number of table lookups the
+  //     row cache could not answer since the DB was opened.
+  //  "leveldb.table-properties-at-level<N>" - return one line per file at
+  //     level <N> with the properties stored in its table (entry and
+  //     deletion counts, raw and stored sizes, sequence number range).
   virtual bool GetProperty(const Slice& property, std::string* value) = 0;
 
   // For each i in [0,n-1], store in "sizes[i]", the approximate
@@ -154,6 +188,28 @@ class DB {
   // hard-links.
   virtual Status LiveBackup(const Slice& name) = 0;
 
+  // Create an openable copy of the database in directory "dir" without
+  // stalling writers.  Table files are hard-linked, so "dir" must be on
+  // the same file system as the database; the MANIFEST and the logs not
+  // yet compacted are copied up to where they stood at the call.  The
+  // checkpoint holds every write that completed before the call, and is
+  // on disk by the time OK is returned.
+  //
+  // If "incremental" is true and "dir" already holds a checkpoint of this
+  // database, only table files created since then are linked and files
+  // the new checkpoint no longer needs are removed.  Otherwise "dir" must
+  // not already hold a checkpoint.
+  virtual Status Checkpoint(const Slice& dir, bool incremental) = 0;
+
+  // Record every Get, Write (and so Put and Delete) and iterator Seek issued
+  // from now on to the file "fname", with the time and the key and value
+  // sizes of each.  Keys are recorded too if "record_keys" is true; values
+  // never are.  Only one trace may be running at a time.
+  virtual Status StartTrace(const std::string& fname, bool record_keys) = 0;
+
+  // Stop the running trace and close its file.
+  virtual Status EndTrace() = 0;
+
   // Return an opaque timestamp that identifies the current point in time of the
   // database.  This timestamp may be subsequently presented to the
   // NewReplayIterator method to create a ReplayIterator.
@@ -85,9 +85,34 @@ public:
     virtual Status
     NewWritableFile(const std::string &fname,
                     WritableFile **result) = 0;
+
+    // Like the two argument forms, but the file is opened as directed by
+    // "file_options".  The default implementations ignore "file_options",
+    // so Envs that do not override these behave exactly like the two
+    // argument forms.  EnvWrapper forwards them to its target, so wrappers
+    // that intercept the two argument forms must override these too.
+    virtual Status
+    NewWritableFile(const std::string &fname,
+                    const FileOptions &file_options,
+                    WritableFile **result);
     virtual Status
     NewConcurrentWritableFile(const std::string &fname,
                               ConcurrentWritableFile **result) = 0;
+    virtual Status
+    NewConcurrentWritableFile(const std::string &fname,
+                              const FileOptions &file_options,
+                              ConcurrentWritableFile **result);
+
+    // Rename the existing file "old_fname" to "fname" and write to it as
+    // NewConcurrentWritableFile would, but without truncating it first, so
+    // the blocks it already has are overwritten in place.  Whatever is not
+    // overwritten keeps its old contents.  The default implementation
+    // renames the file and then creates it afresh.
+    virtual Status
+    ReuseConcurrentWritableFile(const std::string &fname,
+                                const std::string &old_fname,
+                                const FileOptions &file_options,
+                                ConcurrentWritableFile **result);
 
     // Returns true iff the named file exists.
     virtual bool
@@ -131,6 +156,11 @@ public:
     LinkFile(const std::string &src,
              const std::string &target) = 0;
 
+    // Make the entries of directory "dirname" (files created, linked or
+    // renamed in it) durable.  The default implementation does nothing.
+    virtual Status
+    SyncDir(const std::string &dirname);
+
     // Lock the specified file.  Used to prevent concurrent access to
     // the same db by multiple processes.  On failure, stores NULL in
     // *lock and returns non-OK.
@@ -387,11 +417,24 @@ private:
 class FileOptions {
 
   public:
-    FileOptions() : use_direct_reads(false) {}
+    FileOptions()
+        : use_direct_reads(false),
+          use_direct_writes(false),
+          preallocation_size(0),
+          bytes_per_sync(0) {}
     explicit FileOptions(Options options)
-        : use_direct_reads(options.use_direct_reads) {}
+        : use_direct_reads(options.use_direct_reads),
+          use_direct_writes(options.use_direct_io_for_flush_and_compaction),
+          preallocation_size(0),
+          bytes_per_sync(options.bytes_per_sync) {}
     // If true, then use O_DIRECT for reading data
     bool use_direct_reads;
+    // If true, then use O_DIRECT for writing data
+    bool use_direct_writes;
+    // Bytes to reserve for a new writable file, 0 for none
+    uint64_t preallocation_size;
+    // Start writeback of a writable file every this many bytes, 0 for never
+    uint64_t bytes_per_sync;
 };
 
 // Log the specified data to *info_log if info_log is non-NULL.
@@ -453,6 +496,12 @@ public:
         return target_->NewWritableFile(f, r);
     }
 
+    Status
+    NewWritableFile(const std::string &f, const FileOptions &o,
+                    WritableFile **r)
+    {
+        return target_->NewWritableFile(f, o, r);
+    }
 
     Status
     NewConcurrentWritableFile(const std::string &f, ConcurrentWritableFile **r)
@@ -460,6 +509,13 @@ public:
         return target_->NewConcurrentWritableFile(f, r);
     }
 
+    Status
+    NewConcurrentWritableFile(const std::string &f, const FileOptions &o,
+                              ConcurrentWritableFile **r)
+    {
+        return target_->NewConcurrentWritableFile(f, o, r);
+    }
+
 
     bool
     FileExists(const std::string &f)
@@ -524,6 +580,13 @@ public:
     }
 
 
+    Status
+    SyncDir(const std::string &d)
+    {
+        return target_->SyncDir(d);
+    }
+
+
     Status
     LockFile(const std::string &f, FileLock **l)
     {
@@ -13,7 +13,9 @@ class Cache;
 class Comparator;
 class Env;
 class FilterPolicy;
+class KeyNumExtractor;
 class Logger;
+class SecondaryCache;
 class Snapshot;
 
 // DB contents are stored in a set of blocks, each of which holds a
@@ -40,6 +42,16 @@ struct Options {
   // comparator provided to previous open calls on the same DB.
   const Comparator* comparator;
 
+  // If non-NULL, use the specified extractor instead of
+  // comparator->KeyNum() to turn user keys into the 8-byte numbers that
+  // the memtable, merging iterators, compactions and (with
+  // block_key_nums) blocks compare before falling back to the
+  // comparator.  Set it when most keys share a long prefix.  It may be
+  // changed between opens of the same DB.
+  //
+  // Default: NULL
+  const KeyNumExtractor* key_num_extractor;
+
   // If true, the database will be created if it is missing.
   // Default: false
   bool create_if_missing;
@@ -82,6 +94,15 @@ struct Options {
   // Default: 4MB
   size_t write_buffer_size;
 
+  // If positive, every memtable gets a bloom filter of
+  // write_buffer_size * memtable_bloom_size_ratio bytes over the user
+  // keys written to it, so that a Get of a key missing from the memtable
+  // usually skips the search of the memtable.  The filter counts toward
+  // the write buffer.  0.02 suits entries of about 100 bytes.
+  //
+  // Default: 0 (no memtable bloom filter)
+  double memtable_bloom_size_ratio;
+
   // Number of open files that can be used by the DB.  You may need to
   // increase this if your database has a large working set (budget
   // one open file per 2MB of working set).
@@ -97,6 +118,22 @@ struct Options {
   // Default: NULL
   Cache* block_cache;
 
+  // If non-NULL, blocks evicted from block_cache are kept in this cache
+  // and read back from it before falling back to the table file.  It may
+  // be shared by several databases and block caches.  It must outlive
+  // block_cache; note that destroying block_cache also moves its
+  // remaining blocks into this cache.
+  // Default: NULL
+  SecondaryCache* secondary_cache;
+
+  // If positive, keep the newest entry read for a user key from each
+  // table in a cache of this many bytes, so that Gets of hot keys are
+  // answered without searching the table.  Only reads without a
+  // snapshot fill the cache.
+  //
+  // Default: 0 (no row cache)
+  size_t row_cache_size;
+
   // Approximate size of user data packed per block.  Note that the
   // block size specified here corresponds to uncompressed data.  The
   // actual size of the unit read from disk may be smaller if
@@ -112,6 +149,15 @@ struct Options {
   // Default: 16
   int block_restart_interval;
 
+  // If true, blocks also store comparator->KeyNum() of the key at every
+  // restart point, so that a seek within a data or index block mostly
+  // compares integers instead of keys.  Tables written with this option
+  // cannot be read by versions that predate it.  Only useful when the
+  // comparator implements KeyNum() or key_num_extractor is set.
+  //
+  // Default: false
+  bool block_key_nums;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -135,6 +181,14 @@ struct Options {
   // Default: NULL
   const FilterPolicy* filter_policy;
 
+  // Guards whose reads keep having to search several of their files are
+  // compacted even when they are below their size limits.  Such
+  // read-triggered compactions read at most this many bytes of input per
+  // second on average.  0 disables them.
+  //
+  // Default: 4MB
+  size_t read_compaction_bytes_per_sec;
+
   // Is the database used with the Replay mechanism?  If yes, the lower bound on
   // values to compact is (somewhat) left up to the application; if no, then
   // LevelDB functions as usual, and uses snapshots to determine the lower
@@ -159,6 +213,48 @@ struct Options {
   // Default: false
   bool use_direct_reads;
 
+  // Write the table files produced by memtable flushes and compactions
+  // through a large aligned buffer with O_DIRECT, so that they do not
+  // evict recently read data from the page cache.  Space for each file is
+  // preallocated up to its maximum size.  Falls back to buffered writes
+  // on file systems without O_DIRECT support.
+  // Default: false
+  bool use_direct_io_for_flush_and_compaction;
+
+  // Start writeback of table files written by memtable flushes and
+  // compactions every bytes_per_sync bytes, without waiting for it, so the
+  // kernel does not build up a large amount of dirty data and write it all
+  // out when the file is synced.  0 leaves writeback to the final sync.
+  // Default: 0
+  size_t bytes_per_sync;
+
+  // Like bytes_per_sync, for the log files.
+  // Default: 0
+  size_t wal_bytes_per_sync;
+
+  // Keep up to this many obsolete log files and reuse them for new logs
+  // instead of deleting them and creating new ones, so that writing a new
+  // log overwrites blocks the file system already allocated.  Logs are then
+  // written in a format that lets recovery ignore the old contents.
+  // Default: 0
+  size_t recycle_log_file_num;
+
+  // Have a background thread create the next log file ahead of the
+  // memtable switch that needs it, with the first write_buffer_size bytes
+  // already mapped and faulted in, so writes right after the switch do not
+  // stall on growing the new log.
+  // Default: false
+  bool preallocate_next_log;
+
+  // Compress the records written to the log files with this algorithm.
+  // Each record (one WriteBatch, guards included) is compressed on its
+  // own, so recovery still skips only the records that are damaged.
+  // Records that do not shrink are stored as is, and nothing is
+  // compressed if the algorithm is not available.  Logs written with
+  // compression cannot be read by earlier versions of this library.
+  // Default: kNoCompression
+  CompressionType wal_compression;
+
   // Create an Options object with default values for all fields.
   Options();
 };
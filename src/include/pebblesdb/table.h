@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_TABLE_H_
 
 #include <stdint.h>
+#include <string>
 #include "pebblesdb/iterator.h"
 #include "util/timer.h"
 
@@ -19,6 +20,31 @@ class RandomAccessFile;
 struct ReadOptions;
 class TableCache;
 
+// Statistics about the contents of a table, which TableBuilder stores in a
+// meta block of the table.  Deletions and sequence numbers are recorded by
+// the DB for the tables it writes (TableBuilder::SetInternalKeyStats) and
+// are zero in other tables.
+struct TableProperties {
+  TableProperties();
+
+  uint64_t num_entries;
+  uint64_t num_deletions;
+  uint64_t raw_key_size;       // Bytes of the keys added
+  uint64_t raw_value_size;     // Bytes of the values added
+  uint64_t num_data_blocks;
+  uint64_t data_size;          // Bytes of the data blocks in the file
+  uint64_t index_size;         // Bytes of the index block before compression
+  uint64_t filter_size;        // Bytes of the filter block, 0 without one
+  uint64_t smallest_seqno;
+  uint64_t largest_seqno;
+
+  // Bytes of keys and values per byte of stored data blocks
+  double CompressionRatio() const;
+
+  // One line summary of the properties
+  std::string ToString() const;
+};
+
 // A Table is a sorted map from strings to strings.  Tables are
 // immutable and persistent.  A Table may be safely accessed from
 // multiple threads without external synchronization.
@@ -36,11 +62,18 @@ class Table {
   // for the duration of the returned table's lifetime.
   //
   // *file must remain live while this Table is in use.
+  //
+  // Blocks of the table are kept in options.secondary_cache under keys
+  // that start with "secondary_key_prefix".  A prefix that names the file,
+  // such as one built from its file number, lets a later Table for the
+  // same file find them.  If it is empty, a new id from the secondary
+  // cache is used instead.
   static Status Open(const Options& options,
                      RandomAccessFile* file,
                      uint64_t file_size,
                      Table** table,
-					 Timer* timer);
+					 Timer* timer,
+                     const Slice& secondary_key_prefix = Slice());
 
   ~Table();
 
@@ -57,6 +90,10 @@ class Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // Returns the properties stored in the table, or NULL if it was built
+  // before tables carried them.
+  const TableProperties* properties() const;
+
   Timer* static_timers_[NUM_SEEK_THREADS];
 
   void SetStaticTimers(Timer* static_timers[]) {
@@ -85,6 +122,7 @@ class Table {
 
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
+  void ReadProperties(const Slice& properties_handle_value);
 
   // No copying allowed
   Table(const Table&);
@@ -52,6 +52,14 @@ class TableBuilder {
   // REQUIRES: Finish(), Abandon() have not been called
   void Flush();
 
+  // Record the number of deletion markers and the range of sequence numbers
+  // among the keys added, which only the DB layer can tell apart in its
+  // internal keys.  Tables built without a call record zero for each.
+  // REQUIRES: Finish(), Abandon() have not been called
+  void SetInternalKeyStats(uint64_t num_deletions,
+                           uint64_t smallest_seqno,
+                           uint64_t largest_seqno);
+
   // Return non-ok iff some error has been detected.
   Status status() const;
 
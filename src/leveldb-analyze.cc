@@ -0,0 +1,407 @@
+// Copyright (c) 2012-2013 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+// Report the guard layout of a database and what it costs.
+//
+//   leveldb-analyze [--scan=0|1] <dbdir>
+//
+// The MANIFEST named by CURRENT is replayed and, for every level, the
+// sentinel and each guard holding files are described by one JSON object:
+//
+//   files, bytes         what the MANIFEST places in the guard
+//   smallest, largest    the user key range covered by those files
+//   max_overlap          the most files whose ranges contain a single key,
+//                        i.e. the worst case number of tables a point
+//                        lookup in this guard has to search
+//   entries, deletions   taken from the properties block of every table,
+//                        or counted by reading tables that have none
+//                        (unless --scan=0);
+//   deleted_fraction     deletions / entries
+//   score                the compaction score the database would compute
+//   debt_bytes           bytes the next compaction of this guard rewrites,
+//                        that is all of them once score >= 1, else 0
+//
+// Each level is then summarized, followed by a summary of the database
+// with two estimates: read_amp sums, over levels, the byte weighted mean
+// of max_overlap, and space_amp divides all bytes by those of the deepest
+// non-empty level, which holds the bulk of the live data.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
+#include "db/dbformat.h"
+#include "db/table_cache.h"
+#include "db/version_edit.h"
+#include "db/version_set.h"
+#include "pebblesdb/comparator.h"
+#include "pebblesdb/env.h"
+#include "pebblesdb/filter_policy.h"
+#include "pebblesdb/iterator.h"
+#include "pebblesdb/options.h"
+#include "pebblesdb/status.h"
+#include "pebblesdb/table.h"
+#include "util/logging.h"
+#include "util/timer.h"
+
+// Read every table to count entries and deletions
+static bool FLAGS_scan = true;
+
+namespace leveldb {
+
+namespace {
+
+struct TableStats {
+  TableStats() : entries(0), deletions(0) { }
+  uint64_t entries;
+  uint64_t deletions;
+};
+
+struct GuardStats {
+  GuardStats()
+    : files(0), bytes(0), max_overlap(0), entries(0), deletions(0),
+      score(0), debt_bytes(0) {
+  }
+  uint64_t files;
+  uint64_t bytes;
+  uint64_t max_overlap;
+  uint64_t entries;
+  uint64_t deletions;
+  double score;
+  uint64_t debt_bytes;
+};
+
+// Orders the endpoints of file ranges so that, at equal keys, a range
+// opening sorts before one closing: ranges are inclusive on both ends.
+struct EndpointLess {
+  explicit EndpointLess(const Comparator* c) : cmp(c) { }
+  bool operator () (const std::pair<Slice, int>& a,
+                    const std::pair<Slice, int>& b) const {
+    int r = cmp->Compare(a.first, b.first);
+    if (r != 0) {
+      return r < 0;
+    }
+    return a.second > b.second;
+  }
+  const Comparator* cmp;
+};
+
+uint64_t MaxOverlap(const Comparator* ucmp,
+                    const std::vector<FileMetaData*>& files) {
+  std::vector<std::pair<Slice, int> > points;
+  for (size_t i = 0; i < files.size(); i++) {
+    points.push_back(std::make_pair(files[i]->smallest.user_key(), 1));
+    points.push_back(std::make_pair(files[i]->largest.user_key(), -1));
+  }
+  std::sort(points.begin(), points.end(), EndpointLess(ucmp));
+  int64_t depth = 0;
+  int64_t max_depth = 0;
+  for (size_t i = 0; i < points.size(); i++) {
+    depth += points[i].second;
+    max_depth = std::max(max_depth, depth);
+  }
+  return max_depth;
+}
+
+double Ratio(uint64_t num, uint64_t den) {
+  return den == 0 ? 0 : static_cast<double>(num) / den;
+}
+
+class Analyzer {
+ public:
+  explicit Analyzer(const std::string& dbname)
+      : dbname_(dbname),
+        env_(Env::Default()),
+        icmp_(BytewiseComparator()),
+        bloom_(NewBloomFilterPolicy(10)),
+        ipolicy_(bloom_),
+        options_(),
+        file_options_(),
+        table_cache_(NULL),
+        timer_() {
+    options_.env = env_;
+    options_.comparator = &icmp_;
+    options_.filter_policy = &ipolicy_;
+    table_cache_ = new TableCache(dbname_, &options_, &file_options_, 100);
+  }
+
+  ~Analyzer() {
+    delete table_cache_;
+    delete bloom_;
+  }
+
+  Status Run();
+
+ private:
+  Analyzer(const Analyzer&);
+  Analyzer& operator = (const Analyzer&);
+
+  Status ScanTable(const FileMetaData* f, TableStats* stats);
+  Status Describe(unsigned level, const GuardMetaData* guard,
+                  const std::vector<FileMetaData*>& files, double score,
+                  GuardStats* stats);
+
+  const std::string dbname_;
+  Env* const env_;
+  const InternalKeyComparator icmp_;
+  const FilterPolicy* bloom_;
+  const InternalFilterPolicy ipolicy_;
+  Options options_;
+  FileOptions file_options_;
+  TableCache* table_cache_;
+  Timer timer_;
+};
+
+Status Analyzer::ScanTable(const FileMetaData* f, TableStats* stats) {
+  TableProperties props;
+  Status s = table_cache_->GetTableProperties(f->number, f->file_size, &props);
+  if (s.ok()) {
+    stats->entries += props.num_entries;
+    stats->deletions += props.num_deletions;
+    return s;
+  } else if (!s.IsNotFound()) {
+    return s;
+  }
+
+  // Tables built before properties were recorded are read in full
+  ReadOptions ro;
+  ro.fill_cache = false;
+  Iterator* iter = table_cache_->NewIterator(ro, f->number, f->file_size);
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(iter->key(), &ikey)) {
+      continue;
+    }
+    ++stats->entries;
+    if (ikey.type == kTypeDeletion) {
+      ++stats->deletions;
+    }
+  }
+  s = iter->status();
+  delete iter;
+  return s;
+}
+
+Status Analyzer::Describe(unsigned level, const GuardMetaData* guard,
+                          const std::vector<FileMetaData*>& files,
+                          double score, GuardStats* stats) {
+  const Comparator* ucmp = icmp_.user_comparator();
+  Slice smallest;
+  Slice largest;
+  for (size_t i = 0; i < files.size(); i++) {
+    const FileMetaData* f = files[i];
+    ++stats->files;
+    stats->bytes += f->file_size;
+    if (i == 0 || ucmp->Compare(f->smallest.user_key(), smallest) < 0) {
+      smallest = f->smallest.user_key();
+    }
+    if (i == 0 || ucmp->Compare(f->largest.user_key(), largest) > 0) {
+      largest = f->largest.user_key();
+    }
+    if (FLAGS_scan) {
+      TableStats t;
+      Status s = ScanTable(f, &t);
+      if (!s.ok()) {
+        return s;
+      }
+      stats->entries += t.entries;
+      stats->deletions += t.deletions;
+    }
+  }
+  stats->max_overlap = MaxOverlap(ucmp, files);
+  stats->score = score;
+  stats->debt_bytes = score >= 1 ? stats->bytes : 0;
+
+  std::string guard_key = guard == NULL ? std::string("null") :
+      "\"" + JsonEscapeString(guard->guard_key.user_key()) + "\"";
+  fprintf(stdout, "{\"level\":%u,\"guard\":%s,\"files\":%llu,\"bytes\":%llu,"
+          "\"smallest\":\"%s\",\"largest\":\"%s\",\"max_overlap\":%llu,",
+          level, guard_key.c_str(),
+          static_cast<unsigned long long>(stats->files),
+          static_cast<unsigned long long>(stats->bytes),
+          JsonEscapeString(smallest).c_str(), JsonEscapeString(largest).c_str(),
+          static_cast<unsigned long long>(stats->max_overlap));
+  if (FLAGS_scan) {
+    fprintf(stdout, "\"entries\":%llu,\"deletions\":%llu,"
+            "\"deleted_fraction\":%.4f,",
+            static_cast<unsigned long long>(stats->entries),
+            static_cast<unsigned long long>(stats->deletions),
+            Ratio(stats->deletions, stats->entries));
+  }
+  fprintf(stdout, "\"score\":%.3f,\"debt_bytes\":%llu}\n",
+          stats->score, static_cast<unsigned long long>(stats->debt_bytes));
+  return Status::OK();
+}
+
+Status Analyzer::Run() {
+  VersionSet versions(dbname_, &options_, &file_options_, table_cache_, &icmp_,
+                      &timer_);
+  Status s = versions.Recover();
+  if (!s.ok()) {
+    return s;
+  }
+  Version* v = versions.current();
+
+  uint64_t total_bytes = 0;
+  uint64_t total_files = 0;
+  uint64_t total_entries = 0;
+  uint64_t total_deletions = 0;
+  uint64_t total_debt = 0;
+  uint64_t deepest_bytes = 0;
+  double read_amp = 0;
+  for (unsigned level = 0; level < config::kNumLevels; level++) {
+    std::map<uint64_t, FileMetaData*> by_number;
+    const std::vector<FileMetaData*>& level_files = v->GetFilesAtLevel(level);
+    for (size_t i = 0; i < level_files.size(); i++) {
+      by_number[level_files[i]->number] = level_files[i];
+    }
+
+    GuardStats level_stats;
+    uint64_t weighted_overlap = 0;
+    uint64_t guards_with_files = 0;
+    uint64_t segments_due = 0;
+
+    const std::vector<FileMetaData*>& sentinels =
+        v->GetSentinelFilesAtLevel(level);
+    std::vector<GuardStats> segments;
+    if (!sentinels.empty()) {
+      segments.push_back(GuardStats());
+      s = Describe(level, NULL, sentinels,
+                   v->GetSentinelCompactionScore(level), &segments.back());
+      if (!s.ok()) {
+        return s;
+      }
+    }
+    std::vector<GuardMetaData*> guards = v->GetGuardsAtLevel(level);
+    for (size_t g = 0; g < guards.size(); g++) {
+      std::vector<FileMetaData*> files;
+      for (size_t i = 0; i < guards[g]->files.size(); i++) {
+        std::map<uint64_t, FileMetaData*>::iterator it =
+            by_number.find(guards[g]->files[i]);
+        if (it != by_number.end()) {
+          files.push_back(it->second);
+        }
+      }
+      if (files.empty()) {
+        continue;
+      }
+      ++guards_with_files;
+      segments.push_back(GuardStats());
+      s = Describe(level, guards[g], files,
+                   v->GetGuardCompactionScore(level, g), &segments.back());
+      if (!s.ok()) {
+        return s;
+      }
+    }
+
+    for (size_t i = 0; i < segments.size(); i++) {
+      const GuardStats& g = segments[i];
+      level_stats.files += g.files;
+      level_stats.bytes += g.bytes;
+      level_stats.entries += g.entries;
+      level_stats.deletions += g.deletions;
+      level_stats.debt_bytes += g.debt_bytes;
+      level_stats.max_overlap = std::max(level_stats.max_overlap,
+                                         g.max_overlap);
+      weighted_overlap += g.max_overlap * g.bytes;
+      if (g.score >= 1) {
+        ++segments_due;
+      }
+    }
+    double mean_overlap = Ratio(weighted_overlap, level_stats.bytes);
+
+    fprintf(stdout, "{\"level_summary\":{\"level\":%u,\"files\":%llu,"
+            "\"bytes\":%llu,\"guards\":%llu,\"complete_guards\":%llu,"
+            "\"guards_with_files\":%llu,\"sentinel_files\":%llu,"
+            "\"max_overlap\":%llu,\"mean_overlap\":%.3f,",
+            level,
+            static_cast<unsigned long long>(level_stats.files),
+            static_cast<unsigned long long>(level_stats.bytes),
+            static_cast<unsigned long long>(guards.size()),
+            static_cast<unsigned long long>(
+                v->GetCompleteGuardsAtLevel(level).size()),
+            static_cast<unsigned long long>(guards_with_files),
+            static_cast<unsigned long long>(sentinels.size()),
+            static_cast<unsigned long long>(level_stats.max_overlap),
+            mean_overlap);
+    if (FLAGS_scan) {
+      fprintf(stdout, "\"entries\":%llu,\"deletions\":%llu,"
+              "\"deleted_fraction\":%.4f,",
+              static_cast<unsigned long long>(level_stats.entries),
+              static_cast<unsigned long long>(level_stats.deletions),
+              Ratio(level_stats.deletions, level_stats.entries));
+    }
+    fprintf(stdout, "\"segments_due\":%llu,\"debt_bytes\":%llu}}\n",
+            static_cast<unsigned long long>(segments_due),
+            static_cast<unsigned long long>(level_stats.debt_bytes));
+
+    total_bytes += level_stats.bytes;
+    total_files += level_stats.files;
+    total_entries += level_stats.entries;
+    total_deletions += level_stats.deletions;
+    total_debt += level_stats.debt_bytes;
+    read_amp += mean_overlap;
+    if (level_stats.bytes > 0) {
+      deepest_bytes = level_stats.bytes;
+    }
+  }
+
+  fprintf(stdout, "{\"summary\":{\"files\":%llu,\"bytes\":%llu,",
+          static_cast<unsigned long long>(total_files),
+          static_cast<unsigned long long>(total_bytes));
+  if (FLAGS_scan) {
+    fprintf(stdout, "\"entries\":%llu,\"deletions\":%llu,"
+            "\"deleted_fraction\":%.4f,",
+            static_cast<unsigned long long>(total_entries),
+            static_cast<unsigned long long>(total_deletions),
+            Ratio(total_deletions, total_entries));
+  }
+  fprintf(stdout, "\"debt_bytes\":%llu,\"read_amp\":%.3f,"
+          "\"space_amp\":%.3f}}\n",
+          static_cast<unsigned long long>(total_debt), read_amp,
+          Ratio(total_bytes, deepest_bytes));
+  fflush(stdout);
+  return Status::OK();
+}
+
+}  // namespace
+
+}  // namespace leveldb
+
+static void Usage(const char* argv0) {
+  fprintf(stderr, "Usage: %s [--scan=0|1] <dbdir>\n", argv0);
+}
+
+int main(int argc, char** argv) {
+  const char* dbname = NULL;
+  for (int i = 1; i < argc; i++) {
+    int n;
+    char junk;
+    if (sscanf(argv[i], "--scan=%d%c", &n, &junk) == 1 &&
+        (n == 0 || n == 1)) {
+      FLAGS_scan = n;
+    } else if (argv[i][0] != '-' && dbname == NULL) {
+      dbname = argv[i];
+    } else {
+      Usage(argv[0]);
+      return 1;
+    }
+  }
+  if (dbname == NULL) {
+    Usage(argv[0]);
+    return 1;
+  }
+
+  leveldb::Analyzer analyzer(dbname);
+  leveldb::Status s = analyzer.Run();
+  if (!s.ok()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    return 1;
+  }
+  return 0;
+}
@@ -2,25 +2,78 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+// Verify the files of a database, in parallel and with bounded memory.
+//
+//   leveldb-verify [--threads=N] [--rate_mb=R] [--comparator=NAME]
+//                  [--bloom_bits=B] <dbdir> | <file>...
+//
+// Given a database directory, the MANIFEST named by CURRENT is replayed and
+// every table it references is checked: block checksums, key order, that a
+// point lookup of every key finds it again (index and filter agree with the
+// data), that the first and last keys match the MANIFEST, and that every key
+// lies inside the guard the MANIFEST places the file in.  Logs are checked
+// record by record.  Given individual files, the same checks run minus the
+// ones that need the MANIFEST.
+//
+// One JSON object per file is written to stdout as soon as the file is done,
+// followed by a summary object.  --rate_mb caps the combined read rate so
+// the tool can run against the directory of a live database; files that a
+// compaction deletes while the tool runs are reported as skipped.  Memory
+// stays bounded: the workers share one block cache of 8MB per thread and
+// each table is evicted from the table cache once it has been read.
+
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
 #include "db/dbformat.h"
 #include "db/filename.h"
 #include "db/log_reader.h"
+#include "db/table_cache.h"
 #include "db/version_edit.h"
+#include "db/version_set.h"
 #include "db/write_batch_internal.h"
+#include "pebblesdb/cache.h"
+#include "pebblesdb/comparator.h"
 #include "pebblesdb/env.h"
+#include "pebblesdb/filter_policy.h"
 #include "pebblesdb/iterator.h"
 #include "pebblesdb/options.h"
 #include "pebblesdb/status.h"
-#include "pebblesdb/table.h"
 #include "pebblesdb/write_batch.h"
+#include "port/port.h"
 #include "util/logging.h"
+#include "util/mutexlock.h"
+#include "util/timer.h"
+
+// Number of files verified concurrently
+static int FLAGS_threads = 4;
+
+// Combined read rate limit in MB/s; 0 means unlimited
+static double FLAGS_rate_mb = 0;
+
+// Name of the user comparator the database was written with.  Only the
+// built-in comparator can be loaded by this tool.
+static const char* FLAGS_comparator = "leveldb.BytewiseComparator";
+
+// Bits per key of the bloom filter policy used to read filter blocks;
+// negative means no filter policy, so filter blocks are not checked
+static int FLAGS_bloom_bits = 10;
 
 namespace leveldb {
 
 namespace {
 
-bool GuessType(const std::string& fname, FileType* type) {
+// At most this many errors are kept per file
+static const size_t kMaxErrorsPerFile = 10;
+
+// Reads are charged to the rate limiter in chunks of this many bytes
+static const uint64_t kRateChunk = 1 << 20;
+
+bool GuessType(const std::string& fname, FileType* type, uint64_t* number) {
   size_t pos = fname.rfind('/');
   std::string basename;
   if (pos == std::string::npos) {
@@ -28,189 +81,651 @@ bool GuessType(const std::string& fname, FileType* type) {
   } else {
     basename = std::string(fname.data() + pos + 1, fname.size() - pos - 1);
   }
-  uint64_t ignored;
-  return ParseFileName(basename, &ignored, type);
+  return ParseFileName(basename, number, type);
 }
 
-// Notified when log reader encounters corruption.
-class CorruptionReporter : public log::Reader::Reporter {
+std::string DirName(const std::string& fname) {
+  size_t pos = fname.rfind('/');
+  return pos == std::string::npos ? std::string(".") : fname.substr(0, pos);
+}
+
+// Token bucket shared by all worker threads.
+class RateLimiter {
  public:
-  virtual void Corruption(size_t bytes, const Status& status) {
-    printf("corruption: %d bytes; %s\n",
-            static_cast<int>(bytes),
-            status.ToString().c_str());
+  RateLimiter(Env* env, double bytes_per_second)
+      : env_(env), bytes_per_second_(bytes_per_second), mu_(), next_free_(0) {
   }
+
+  // Block until "bytes" more bytes may be read.
+  void Request(uint64_t bytes) {
+    if (bytes_per_second_ <= 0 || bytes == 0) {
+      return;
+    }
+    uint64_t wait = 0;
+    {
+      MutexLock l(&mu_);
+      uint64_t now = env_->NowMicros();
+      if (next_free_ < now) {
+        next_free_ = now;
+      }
+      wait = next_free_ - now;
+      next_free_ += static_cast<uint64_t>(bytes * 1e6 / bytes_per_second_);
+    }
+    if (wait > 0) {
+      env_->SleepForMicroseconds(static_cast<int>(wait));
+    }
+  }
+
+ private:
+  RateLimiter(const RateLimiter&);
+  RateLimiter& operator = (const RateLimiter&);
+
+  Env* const env_;
+  const double bytes_per_second_;
+  port::Mutex mu_;
+  uint64_t next_free_;
 };
 
-// Print contents of a log file. (*func)() is called on every record.
-bool PrintLogContents(Env* env, const std::string& fname,
-                      void (*func)(Slice)) {
-  SequentialFile* file;
-  Status s = env->NewSequentialFile(fname, &file);
-  if (!s.ok()) {
-    fprintf(stderr, "%s\n", s.ToString().c_str());
-    return false;
+// One file to check, together with what the MANIFEST says about it.
+struct Task {
+  Task()
+    : fname(), type(kTableFile), number(0), in_manifest(false), level(-1),
+      file_size(0), smallest(), largest(), has_lower(false), lower(),
+      has_upper(false), upper() {
   }
-  CorruptionReporter reporter;
-  log::Reader reader(file, &reporter, true, 0);
-  Slice record;
-  std::string scratch;
-  while (reader.ReadRecord(&record, &scratch)) {
-    (*func)(record);
+  std::string fname;
+  FileType type;
+  uint64_t number;
+  bool in_manifest;
+  int level;
+  uint64_t file_size;
+  InternalKey smallest;
+  InternalKey largest;
+  // Guard range [lower, upper) in user keys
+  bool has_lower;
+  std::string lower;
+  bool has_upper;
+  std::string upper;
+};
+
+struct Result {
+  Result() : skipped(false), entries(0), bytes(0), num_errors(0), errors() { }
+  bool skipped;
+  uint64_t entries;
+  uint64_t bytes;
+  uint64_t num_errors;
+  std::vector<std::string> errors;
+
+  void AddError(const std::string& msg) {
+    if (errors.size() < kMaxErrorsPerFile) {
+      errors.push_back(msg);
+    }
+    ++num_errors;
   }
-  delete file;
-  return true;
+};
+
+// Collects corruption reported by the log reader.
+class CorruptionReporter : public log::Reader::Reporter {
+ public:
+  explicit CorruptionReporter(Result* r) : result_(r) { }
+  virtual void Corruption(size_t bytes, const Status& status) {
+    char buf[64];
+    snprintf(buf, sizeof(buf), "log corruption, %d bytes dropped: ",
+             static_cast<int>(bytes));
+    result_->AddError(buf + status.ToString());
+  }
+
+ private:
+  CorruptionReporter(const CorruptionReporter&);
+  CorruptionReporter& operator = (const CorruptionReporter&);
+  Result* result_;
+};
+
+// Counts the items of a WriteBatch.
+class WriteBatchCounter : public WriteBatch::Handler {
+ public:
+  WriteBatchCounter() : count_(0) { }
+  uint64_t count_;
+  virtual void Put(const Slice& /*key*/, const Slice& /*value*/) { ++count_; }
+  virtual void Delete(const Slice& /*key*/) { ++count_; }
+  virtual void HandleGuard(const Slice& /*key*/, unsigned /*level*/) { }
+};
+
+// Remembers whether a point lookup returned exactly the key looked up.
+struct LookupState {
+  const InternalKeyComparator* icmp;
+  Slice target;
+  bool found;
+};
+
+void SaveLookup(void* arg, const Slice& key, const Slice& /*value*/) {
+  LookupState* state = reinterpret_cast<LookupState*>(arg);
+  state->found = state->icmp->Compare(key, state->target) == 0;
 }
 
-// Called on every item found in a WriteBatch.
-class WriteBatchItemPrinter : public WriteBatch::Handler {
+class Verifier {
  public:
-  WriteBatchItemPrinter()
-    : offset_(),
-      sequence_() {
+  Verifier(Env* env, const Comparator* user_comparator, bool live)
+      : env_(env),
+        live_(live),
+        manifest_ok_(false),
+        icmp_(user_comparator),
+        bloom_(FLAGS_bloom_bits >= 0 ? NewBloomFilterPolicy(FLAGS_bloom_bits)
+                                     : NULL),
+        ipolicy_(bloom_),
+        block_cache_(NewLRUCache(static_cast<size_t>(FLAGS_threads) << 23)),
+        options_(),
+        file_options_(),
+        limiter_(env, FLAGS_rate_mb * 1048576.0),
+        tables_(),
+        tasks_(),
+        mu_(),
+        cv_(&mu_),
+        next_task_(0),
+        running_(0),
+        files_(0),
+        ok_(0),
+        corrupt_(0),
+        skipped_(0),
+        entries_(0),
+        bytes_(0) {
+    // Bloom filters record their probe count, so any bloom policy reads
+    // the filter blocks the database wrote.
+    options_.env = env;
+    options_.comparator = &icmp_;
+    options_.filter_policy = bloom_ != NULL ? &ipolicy_ : NULL;
+    options_.block_cache = block_cache_;
   }
-  uint64_t offset_;
-  uint64_t sequence_;
 
-  virtual void Put(const Slice& /*key*/, const Slice& /*value*/) {
+  ~Verifier() {
+    for (std::map<std::string, TableCache*>::iterator it = tables_.begin();
+         it != tables_.end(); ++it) {
+      delete it->second;
+    }
+    delete block_cache_;
+    delete bloom_;
   }
-  virtual void Delete(const Slice& /*key*/) {
+
+  // Queue every file of the database in "dbname", checking tables against
+  // its MANIFEST.
+  Status AddDatabase(const std::string& dbname);
+
+  // Queue a single file with no MANIFEST information.
+  Status AddFile(const std::string& fname);
+
+  // Verify all queued files.  Returns true iff none is corrupt.
+  bool Run();
+
+ private:
+  Verifier(const Verifier&);
+  Verifier& operator = (const Verifier&);
+
+  TableCache* CacheFor(const std::string& dir) {
+    TableCache*& cache = tables_[dir];
+    if (cache == NULL) {
+      cache = new TableCache(dir, &options_, &file_options_,
+                             FLAGS_threads * 4);
+    }
+    return cache;
   }
-  virtual void HandleGuard(const Slice& key, unsigned level) {
-    assert(0);
+
+  static void WorkerWrapper(void* arg) {
+    reinterpret_cast<Verifier*>(arg)->Worker();
   }
+  void Worker();
+  void VerifyTable(const Task& t, Timer* timer, Result* r);
+  void VerifyLog(const Task& t, Result* r);
+  void VerifyDescriptor(const Task& t, Result* r);
+  void Report(const Task& t, const Result& r);
+
+  Env* const env_;
+  const bool live_;
+  bool manifest_ok_;
+  const InternalKeyComparator icmp_;
+  const FilterPolicy* bloom_;
+  const InternalFilterPolicy ipolicy_;
+  Cache* block_cache_;  // Shared by all workers; 8MB per thread
+  Options options_;
+  FileOptions file_options_;
+  RateLimiter limiter_;
+  std::map<std::string, TableCache*> tables_;  // Built before Run()
+  std::vector<Task> tasks_;
+
+  port::Mutex mu_;
+  port::CondVar cv_;
+  size_t next_task_;
+  int running_;
+  uint64_t files_;
+  uint64_t ok_;
+  uint64_t corrupt_;
+  uint64_t skipped_;
+  uint64_t entries_;
+  uint64_t bytes_;
 };
 
-// Called on every log record (each one of which is a WriteBatch)
-// found in a kLogFile.
-static void WriteBatchPrinter(Slice record) {
-  if (record.size() < 12) {
-    printf("log record length %d is too small\n",
-           static_cast<int>(record.size()));
-    return;
+Status Verifier::AddDatabase(const std::string& dbname) {
+  // The MANIFEST is checked while it is replayed here
+  Timer timer;
+  TableCache* cache = CacheFor(dbname);
+  VersionSet versions(dbname, &options_, &file_options_, cache, &icmp_,
+                      &timer);
+  Status manifest_status = versions.Recover();
+  manifest_ok_ = manifest_status.ok();
+
+  std::map<uint64_t, Task> referenced;
+  if (manifest_status.ok()) {
+    Version* v = versions.current();
+    for (unsigned level = 0; level < config::kNumLevels; level++) {
+      const std::vector<FileMetaData*>& files = v->GetFilesAtLevel(level);
+      for (size_t i = 0; i < files.size(); i++) {
+        Task& t = referenced[files[i]->number];
+        t.type = kTableFile;
+        t.number = files[i]->number;
+        t.in_manifest = true;
+        t.level = level;
+        t.file_size = files[i]->file_size;
+        t.smallest = files[i]->smallest;
+        t.largest = files[i]->largest;
+      }
+      std::vector<GuardMetaData*> guards = v->GetGuardsAtLevel(level);
+      for (size_t g = 0; g < guards.size(); g++) {
+        for (size_t i = 0; i < guards[g]->files.size(); i++) {
+          Task& t = referenced[guards[g]->files[i]];
+          t.has_lower = true;
+          t.lower = guards[g]->guard_key.user_key().ToString();
+          if (g + 1 < guards.size()) {
+            t.has_upper = true;
+            t.upper = guards[g + 1]->guard_key.user_key().ToString();
+          }
+        }
+      }
+      const std::vector<FileMetaData*>& sentinels =
+          v->GetSentinelFilesAtLevel(level);
+      for (size_t i = 0; i < sentinels.size() && !guards.empty(); i++) {
+        Task& t = referenced[sentinels[i]->number];
+        t.has_upper = true;
+        t.upper = guards[0]->guard_key.user_key().ToString();
+      }
+    }
   }
-  WriteBatch batch;
-  WriteBatchInternal::SetContents(&batch, record);
-  WriteBatchItemPrinter batch_item_printer;
-  Status s = batch.Iterate(&batch_item_printer);
+
+  std::vector<std::string> filenames;
+  Status s = env_->GetChildren(dbname, &filenames);
   if (!s.ok()) {
-    fprintf(stderr, "error: %s\n", s.ToString().c_str());
+    return s;
+  }
+  std::sort(filenames.begin(), filenames.end());
+  for (size_t i = 0; i < filenames.size(); i++) {
+    uint64_t number;
+    FileType type;
+    if (!ParseFileName(filenames[i], &number, &type)) {
+      continue;
+    }
+    Task t;
+    if (type == kTableFile) {
+      std::map<uint64_t, Task>::iterator it = referenced.find(number);
+      if (it != referenced.end()) {
+        t = it->second;
+        referenced.erase(it);
+      }
+    } else if (type != kLogFile && type != kDescriptorFile) {
+      continue;
+    }
+    t.fname = dbname + "/" + filenames[i];
+    t.type = type;
+    t.number = number;
+    tasks_.push_back(t);
+  }
+
+  // Referenced by the MANIFEST but absent from the directory
+  for (std::map<uint64_t, Task>::iterator it = referenced.begin();
+       it != referenced.end(); ++it) {
+    Task t = it->second;
+    t.fname = TableFileName(dbname, it->first);
+    tasks_.push_back(t);
   }
-}
 
-bool DumpLog(Env* env, const std::string& fname) {
-  return PrintLogContents(env, fname, WriteBatchPrinter);
+  if (!manifest_status.ok()) {
+    fprintf(stdout, "{\"manifest\":\"%s\",\"status\":\"corrupt\",\"errors\":[\"%s\"]}\n",
+            JsonEscapeString(dbname).c_str(),
+            JsonEscapeString(manifest_status.ToString()).c_str());
+    MutexLock l(&mu_);
+    ++corrupt_;
+  }
+  return Status::OK();
 }
 
-// Called on every log record (each one of which is a WriteBatch)
-// found in a kDescriptorFile.
-static void VersionEditPrinter(Slice record) {
-  VersionEdit edit;
-  Status s = edit.DecodeFrom(record);
-  if (!s.ok()) {
-    fprintf(stderr, "%s\n", s.ToString().c_str());
-    return;
+Status Verifier::AddFile(const std::string& fname) {
+  Task t;
+  if (!GuessType(fname, &t.type, &t.number) ||
+      (t.type != kTableFile && t.type != kLogFile &&
+       t.type != kDescriptorFile)) {
+    return Status::InvalidArgument(fname, "not a verifiable file type");
+  }
+  t.fname = fname;
+  if (t.type == kTableFile) {
+    CacheFor(DirName(fname));
   }
+  tasks_.push_back(t);
+  return Status::OK();
 }
 
-bool DumpDescriptor(Env* env, const std::string& fname) {
-  return PrintLogContents(env, fname, VersionEditPrinter);
+bool Verifier::Run() {
+  uint64_t start = env_->NowMicros();
+  int threads = std::max(1, std::min(FLAGS_threads,
+                                     static_cast<int>(tasks_.size())));
+  {
+    MutexLock l(&mu_);
+    running_ = threads;
+  }
+  for (int i = 0; i < threads; i++) {
+    env_->StartThread(&Verifier::WorkerWrapper, this);
+  }
+  MutexLock l(&mu_);
+  while (running_ > 0) {
+    cv_.Wait();
+  }
+  fprintf(stdout, "{\"summary\":{\"files\":%llu,\"ok\":%llu,\"corrupt\":%llu,"
+          "\"skipped\":%llu,\"entries\":%llu,\"bytes\":%llu,\"seconds\":%.3f}}\n",
+          static_cast<unsigned long long>(files_),
+          static_cast<unsigned long long>(ok_),
+          static_cast<unsigned long long>(corrupt_),
+          static_cast<unsigned long long>(skipped_),
+          static_cast<unsigned long long>(entries_),
+          static_cast<unsigned long long>(bytes_),
+          (env_->NowMicros() - start) * 1e-6);
+  fflush(stdout);
+  return corrupt_ == 0;
 }
 
-bool DumpTable(Env* env, const std::string& fname) {
-  uint64_t file_size;
-  RandomAccessFile* file = NULL;
-  Table* table = NULL;
-  Status s = env->GetFileSize(fname, &file_size);
-  if (s.ok()) {
-    s = env->NewRandomAccessFile(fname, &file);
-  }
-  if (s.ok()) {
-    // We use the default comparator, which may or may not match the
-    // comparator used in this database. However this should not cause
-    // problems since we only use Table operations that do not require
-    // any comparisons.  In particular, we do not call Seek or Prev.
-    s = Table::Open(Options(), file, file_size, &table, NULL);
+void Verifier::Worker() {
+  Timer timer;
+  while (true) {
+    const Task* t = NULL;
+    {
+      MutexLock l(&mu_);
+      if (next_task_ < tasks_.size()) {
+        t = &tasks_[next_task_++];
+      }
+    }
+    if (t == NULL) {
+      break;
+    }
+    Result r;
+    switch (t->type) {
+      case kTableFile:      VerifyTable(*t, &timer, &r); break;
+      case kLogFile:        VerifyLog(*t, &r); break;
+      case kDescriptorFile: VerifyDescriptor(*t, &r); break;
+      default: break;
+    }
+    Report(*t, r);
   }
+  MutexLock l(&mu_);
+  --running_;
+  cv_.SignalAll();
+}
+
+void Verifier::VerifyTable(const Task& t, Timer* timer, Result* r) {
+  uint64_t file_size = 0;
+  Status s = env_->GetFileSize(t.fname, &file_size);
   if (!s.ok()) {
-    fprintf(stderr, "%s\n", s.ToString().c_str());
-    delete table;
-    delete file;
-    return false;
+    if (live_ && !env_->FileExists(t.fname)) {
+      r->skipped = true;  // Compacted away since the MANIFEST was read
+    } else {
+      r->AddError(t.in_manifest ? "referenced by MANIFEST but missing: " +
+                                  s.ToString()
+                                : s.ToString());
+    }
+    return;
+  }
+  if (t.in_manifest && file_size != t.file_size) {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "size %llu differs from MANIFEST size %llu",
+             static_cast<unsigned long long>(file_size),
+             static_cast<unsigned long long>(t.file_size));
+    r->AddError(buf);
+    return;
+  }
+  if (!t.in_manifest && live_ && manifest_ok_) {
+    // Possibly an output that a compaction is still writing
+    r->skipped = true;
+    return;
   }
 
+  TableCache* cache = tables_[DirName(t.fname)];
   ReadOptions ro;
   ro.verify_checksums = true;
-  Iterator* iter = table->NewIterator(ro);
-  Iterator* verify = table->NewIterator(ro);
+  Iterator* iter = cache->NewIterator(ro, t.number, file_size);
+  std::string prev;
+  uint64_t unpaced = 0;
+  const Comparator* ucmp = icmp_.user_comparator();
   for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
-    if (!iter->status().ok()) {
-      fprintf(stderr, "bad iteration %s\n", iter->status().ToString().c_str());
+    Slice key = iter->key();
+    ParsedInternalKey ikey;
+    if (!ParseInternalKey(key, &ikey)) {
+      r->AddError("unparsable key '" + EscapeString(key) + "'");
+      prev.clear();
+      continue;
     }
-    ParsedInternalKey key;
-    if (!ParseInternalKey(iter->key(), &key)) {
-      fprintf(stderr, "badkey '%s' => '%s'\n",
-             EscapeString(iter->key()).c_str(),
-             EscapeString(iter->value()).c_str());
+    if (r->entries == 0) {
+      if (t.in_manifest && icmp_.Compare(key, t.smallest.Encode()) != 0) {
+        r->AddError("first key " + ikey.DebugString() +
+                    " differs from MANIFEST smallest");
+      }
+    } else if (!prev.empty() && icmp_.Compare(prev, key) >= 0) {
+      r->AddError("key " + ikey.DebugString() + " out of order");
     }
-    verify->SeekToFirst();
-    if (!verify->status().ok()) {
-      fprintf(stderr, "bad iteration %s\n", verify->status().ToString().c_str());
+    if ((t.has_lower && ucmp->Compare(ikey.user_key, t.lower) < 0) ||
+        (t.has_upper && ucmp->Compare(ikey.user_key, t.upper) >= 0)) {
+      r->AddError("key " + ikey.DebugString() + " outside its guard");
     }
-    verify->Seek(key.user_key);
-    if (!verify->status().ok()) {
-      fprintf(stderr, "bad iteration %s\n", verify->status().ToString().c_str());
+
+    // The index and the filter must both lead back to this entry
+    LookupState state;
+    state.icmp = &icmp_;
+    state.target = key;
+    state.found = false;
+    s = cache->Get(ro, t.number, file_size, key, &state, SaveLookup, timer);
+    if (!s.ok() || !state.found) {
+      r->AddError("point lookup of " + ikey.DebugString() + " failed" +
+                  (s.ok() ? std::string() : ": " + s.ToString()));
+    }
+
+    prev.assign(key.data(), key.size());
+    ++r->entries;
+    uint64_t n = key.size() + iter->value().size();
+    r->bytes += n;
+    unpaced += n;
+    if (unpaced >= kRateChunk) {
+      limiter_.Request(unpaced);
+      unpaced = 0;
     }
   }
-  s = iter->status();
-  if (!s.ok()) {
-    fprintf(stderr, "iterator error: %s\n", s.ToString().c_str());
+  limiter_.Request(unpaced);
+  if (!iter->status().ok()) {
+    r->AddError(iter->status().ToString());
+  } else if (t.in_manifest) {
+    if (r->entries == 0) {
+      r->AddError("table is empty");
+    } else if (icmp_.Compare(prev, t.largest.Encode()) != 0) {
+      r->AddError("last key differs from MANIFEST largest");
+    }
   }
-
   delete iter;
-  delete verify;
-  delete table;
-  delete file;
-  return true;
+  // Each table is read once; do not let finished ones pin memory
+  cache->Evict(t.number);
 }
 
-bool DumpFile(Env* env, const std::string& fname) {
-  FileType ftype;
-  if (!GuessType(fname, &ftype)) {
-    fprintf(stderr, "%s: unknown file type\n", fname.c_str());
-    return false;
-  }
-  switch (ftype) {
-    case kLogFile:         return DumpLog(env, fname);
-    case kDescriptorFile:  return DumpDescriptor(env, fname);
-    case kTableFile:       return DumpTable(env, fname);
-
-    case kDBLockFile:
-    case kCurrentFile:
-    case kTempFile:
-    case kInfoLogFile:
-    default: {
-      fprintf(stderr, "%s: not a dump-able file type\n", fname.c_str());
-      break;
+void Verifier::VerifyLog(const Task& t, Result* r) {
+  SequentialFile* file;
+  Status s = env_->NewSequentialFile(t.fname, file_options_, &file);
+  if (!s.ok()) {
+    if (live_ && !env_->FileExists(t.fname)) {
+      r->skipped = true;
+    } else {
+      r->AddError(s.ToString());
+    }
+    return;
+  }
+  CorruptionReporter reporter(r);
+  log::Reader reader(file, &reporter, true, 0);
+  Slice record;
+  std::string scratch;
+  uint64_t unpaced = 0;
+  while (reader.ReadRecord(&record, &scratch)) {
+    r->bytes += record.size();
+    unpaced += record.size();
+    if (unpaced >= kRateChunk) {
+      limiter_.Request(unpaced);
+      unpaced = 0;
+    }
+    if (record.size() < 12) {
+      r->AddError("log record is too small");
+      continue;
     }
+    WriteBatch batch;
+    WriteBatchInternal::SetContents(&batch, record);
+    WriteBatchCounter counter;
+    s = batch.Iterate(&counter);
+    if (!s.ok()) {
+      r->AddError(s.ToString());
+    }
+    r->entries += counter.count_;
   }
-  return false;
+  limiter_.Request(unpaced);
+  delete file;
 }
 
-bool HandleDumpCommand(Env* env, char** files, int num) {
-  bool ok = true;
-  for (int i = 0; i < num; i++) {
-    ok &= DumpFile(env, files[i]);
+void Verifier::VerifyDescriptor(const Task& t, Result* r) {
+  SequentialFile* file;
+  Status s = env_->NewSequentialFile(t.fname, file_options_, &file);
+  if (!s.ok()) {
+    if (live_ && !env_->FileExists(t.fname)) {
+      r->skipped = true;
+    } else {
+      r->AddError(s.ToString());
+    }
+    return;
   }
-  return ok;
+  CorruptionReporter reporter(r);
+  log::Reader reader(file, &reporter, true, 0);
+  Slice record;
+  std::string scratch;
+  while (reader.ReadRecord(&record, &scratch)) {
+    r->bytes += record.size();
+    VersionEdit edit;
+    s = edit.DecodeFrom(record);
+    if (!s.ok()) {
+      r->AddError(s.ToString());
+    }
+    ++r->entries;
+  }
+  limiter_.Request(r->bytes);
+  delete file;
 }
 
+void Verifier::Report(const Task& t, const Result& r) {
+  static const char* kTypeNames[] = {
+    "log", "lock", "table", "manifest", "current", "temp", "info"
+  };
+  const char* status = r.skipped ? "skipped" :
+                       r.num_errors > 0 ? "corrupt" : "ok";
+  std::string line = "{\"file\":\"" + JsonEscapeString(t.fname) +
+                     "\",\"type\":\"" + kTypeNames[t.type] + "\"";
+  char buf[200];
+  if (t.in_manifest) {
+    snprintf(buf, sizeof(buf), ",\"level\":%d", t.level);
+    line += buf;
+  }
+  snprintf(buf, sizeof(buf),
+           ",\"status\":\"%s\",\"entries\":%llu,\"bytes\":%llu,\"errors\":%llu",
+           status,
+           static_cast<unsigned long long>(r.entries),
+           static_cast<unsigned long long>(r.bytes),
+           static_cast<unsigned long long>(r.num_errors));
+  line += buf;
+  if (!r.errors.empty()) {
+    line += ",\"messages\":[";
+    for (size_t i = 0; i < r.errors.size(); i++) {
+      line += (i > 0 ? ",\"" : "\"") + JsonEscapeString(r.errors[i]) + "\"";
+    }
+    line += "]";
+  }
+  line += "}\n";
+
+  MutexLock l(&mu_);
+  fputs(line.c_str(), stdout);
+  fflush(stdout);
+  ++files_;
+  if (r.skipped) {
+    ++skipped_;
+  } else if (r.num_errors > 0) {
+    ++corrupt_;
+  } else {
+    ++ok_;
+  }
+  entries_ += r.entries;
+  bytes_ += r.bytes;
 }
+
+}  // namespace
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
   leveldb::Env* env = leveldb::Env::Default();
-  bool ok = true;
-  ok = leveldb::HandleDumpCommand(env, argv+1, argc-1);
-  return (ok ? 0 : 1);
+  std::vector<std::string> paths;
+  for (int i = 1; i < argc; i++) {
+    int n;
+    double d;
+    char junk;
+    if (sscanf(argv[i], "--threads=%d%c", &n, &junk) == 1 && n > 0) {
+      FLAGS_threads = n;
+    } else if (sscanf(argv[i], "--rate_mb=%lf%c", &d, &junk) == 1 && d >= 0) {
+      FLAGS_rate_mb = d;
+    } else if (strncmp(argv[i], "--comparator=", 13) == 0) {
+      FLAGS_comparator = argv[i] + 13;
+    } else if (sscanf(argv[i], "--bloom_bits=%d%c", &n, &junk) == 1) {
+      FLAGS_bloom_bits = n;
+    } else if (strncmp(argv[i], "--", 2) == 0) {
+      fprintf(stderr, "Invalid flag '%s'\n", argv[i]);
+      exit(1);
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty()) {
+    fprintf(stderr,
+            "Usage: %s [--threads=N] [--rate_mb=R] [--comparator=NAME]\n"
+            "       [--bloom_bits=B] <dbdir> | <file>...\n"
+            "  --comparator  user comparator of the database "
+            "(default leveldb.BytewiseComparator)\n"
+            "  --bloom_bits  bits per key of the bloom filters; "
+            "negative skips filter checks (default 10)\n",
+            argv[0]);
+    exit(1);
+  }
+  const leveldb::Comparator* comparator = leveldb::BytewiseComparator();
+  if (strcmp(FLAGS_comparator, comparator->Name()) != 0) {
+    fprintf(stderr, "Unknown comparator '%s'\n", FLAGS_comparator);
+    exit(1);
+  }
+
+  // A lone directory with a CURRENT file is verified as a whole database,
+  // which may be in use by another process.
+  bool whole_db = paths.size() == 1 &&
+                  env->FileExists(leveldb::CurrentFileName(paths[0]));
+  leveldb::Verifier verifier(env, comparator, whole_db);
+  leveldb::Status s;
+  if (whole_db) {
+    s = verifier.AddDatabase(paths[0]);
+  } else {
+    for (size_t i = 0; s.ok() && i < paths.size(); i++) {
+      s = verifier.AddFile(paths[i]);
+    }
+  }
+  if (!s.ok()) {
+    fprintf(stderr, "%s\n", s.ToString().c_str());
+    return 1;
+  }
+  return verifier.Run() ? 0 : 1;
 }
@@ -17,7 +17,12 @@ namespace leveldb {
 
 inline uint32_t Block::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
-  return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & ~kBlockKeyNumsFlag;
+}
+
+inline bool Block::HasKeyNums() const {
+  assert(size_ >= sizeof(uint32_t));
+  return DecodeFixed32(data_ + size_ - sizeof(uint32_t)) & kBlockKeyNumsFlag;
 }
 
 Block::Block(const BlockContents& contents)
@@ -28,12 +33,18 @@ Block::Block(const BlockContents& contents)
   if (size_ < sizeof(uint32_t)) {
     size_ = 0;  // Error marker
   } else {
-    size_t max_restarts_allowed = (size_-sizeof(uint32_t)) / sizeof(uint32_t);
-    if (NumRestarts() > max_restarts_allowed) {
+    // With KeyNums, each restart also has a uint64 and the block a tag
+    const size_t restart_size = sizeof(uint32_t) +
+                                (HasKeyNums() ? sizeof(uint64_t) : 0);
+    const size_t trailer_size = sizeof(uint32_t) +
+                                (HasKeyNums() ? sizeof(uint32_t) : 0);
+    if (size_ < trailer_size ||
+        NumRestarts() > (size_ - trailer_size) / restart_size) {
       // The size is too small for NumRestarts()
       size_ = 0;
     } else {
-      restart_offset_ = size_ - (1 + NumRestarts()) * sizeof(uint32_t);
+      restart_offset_ = size_ - trailer_size -
+                        NumRestarts() * restart_size;
     }
   }
 }
@@ -82,6 +93,7 @@ class Block::Iter : public Iterator {
   const char* const data_;      // underlying block contents
   uint32_t const restarts_;     // Offset of restart array (list of fixed32)
   uint32_t const num_restarts_; // Number of uint32_t entries in restart array
+  const char* const key_nums_;  // KeyNum of each restart key, or NULL
 
   // current_ is offset in data_ of current entry.  >= restarts_ if !Valid
   uint32_t current_;
@@ -104,6 +116,11 @@ class Block::Iter : public Iterator {
     return DecodeFixed32(data_ + restarts_ + index * sizeof(uint32_t));
   }
 
+  uint64_t GetRestartKeyNum(uint32_t index) {
+    assert(key_nums_ != NULL && index < num_restarts_);
+    return DecodeFixed64(key_nums_ + index * sizeof(uint64_t));
+  }
+
   void SeekToRestartPoint(uint32_t index) {
     key_.clear();
     restart_index_ = index;
@@ -118,11 +135,13 @@ class Block::Iter : public Iterator {
   Iter(const Comparator* comparator,
        const char* data,
        uint32_t restarts,
-       uint32_t num_restarts)
+       uint32_t num_restarts,
+       const char* key_nums)
       : comparator_(comparator),
         data_(data),
         restarts_(restarts),
         num_restarts_(num_restarts),
+        key_nums_(key_nums),
         current_(restarts_),
         restart_index_(num_restarts_),
         key_(),
@@ -173,8 +192,21 @@ class Block::Iter : public Iterator {
     // with a key < target
     uint32_t left = 0;
     uint32_t right = num_restarts_ - 1;
+    const uint64_t target_num =
+        key_nums_ != NULL ? comparator_->KeyNum(target) : 0;
     while (left < right) {
       uint32_t mid = (left + right + 1) / 2;
+      if (key_nums_ != NULL) {
+        // Differing KeyNums order the keys; equal ones say nothing
+        const uint64_t mid_num = GetRestartKeyNum(mid);
+        if (mid_num < target_num) {
+          left = mid;
+          continue;
+        } else if (mid_num > target_num) {
+          right = mid - 1;
+          continue;
+        }
+      }
       uint32_t region_offset = GetRestartPoint(mid);
       uint32_t shared, non_shared, value_length;
       const char* key_ptr = DecodeEntry(data_ + region_offset,
@@ -260,6 +292,10 @@ class Block::Iter : public Iterator {
 };
 
 Iterator* Block::NewIterator(const Comparator* cmp) {
+  return NewIterator(cmp, 0);
+}
+
+Iterator* Block::NewIterator(const Comparator* cmp, uint32_t key_num_tag) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
   }
@@ -267,7 +303,14 @@ Iterator* Block::NewIterator(const Comparator* cmp) {
   if (num_restarts == 0) {
     return NewEmptyIterator();
   } else {
-    return new Iter(cmp, data_, restart_offset_, num_restarts);
+    const char* key_nums = NULL;
+    if (HasKeyNums()) {
+      const char* tag = data_ + size_ - 2 * sizeof(uint32_t);
+      if (DecodeFixed32(tag) == key_num_tag) {
+        key_nums = data_ + restart_offset_ + num_restarts * sizeof(uint32_t);
+      }
+    }
+    return new Iter(cmp, data_, restart_offset_, num_restarts, key_nums);
   }
 }
 
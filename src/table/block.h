@@ -22,10 +22,16 @@ class Block {
   ~Block();
 
   size_t size() const { return size_; }
+  const char* data() const { return data_; }
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Like NewIterator(comparator), but seeks use the KeyNums stored in the
+  // block only if they were written with KeyNumTag() "key_num_tag".
+  Iterator* NewIterator(const Comparator* comparator, uint32_t key_num_tag);
+
  private:
   uint32_t NumRestarts() const;
+  bool HasKeyNums() const;
 
   const char* data_;
   size_t size_;
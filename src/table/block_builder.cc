@@ -25,6 +25,15 @@
 //     restarts: uint32[num_restarts]
 //     num_restarts: uint32
 // restarts[i] contains the offset within the block of the ith restart point.
+//
+// With options->block_key_nums, the trailer instead has the form:
+//     restarts: uint32[num_restarts]
+//     restart_nums: uint64[num_restarts]
+//     key_num_tag: uint32
+//     num_restarts | kBlockKeyNumsFlag: uint32
+// restart_nums[i] is the comparator's KeyNum of the key at restarts[i].
+// key_num_tag is KeyNumTag(*options); readers expecting another tag
+// ignore restart_nums.
 
 #include "table/block_builder.h"
 
@@ -32,6 +41,7 @@
 #include <assert.h>
 #include "pebblesdb/comparator.h"
 #include "pebblesdb/table_builder.h"
+#include "table/format.h"
 #include "util/coding.h"
 
 namespace leveldb {
@@ -40,6 +50,7 @@ BlockBuilder::BlockBuilder(const Options* options)
     : options_(options),
       buffer_(),
       restarts_(),
+      restart_nums_(),
       counter_(0),
       finished_(false),
       last_key_() {
@@ -51,6 +62,7 @@ void BlockBuilder::Reset() {
   buffer_.clear();
   restarts_.clear();
   restarts_.push_back(0);       // First restart point is at offset 0
+  restart_nums_.clear();
   counter_ = 0;
   finished_ = false;
   last_key_.clear();
@@ -59,6 +71,8 @@ void BlockBuilder::Reset() {
 size_t BlockBuilder::CurrentSizeEstimate() const {
   return (buffer_.size() +                        // Raw data buffer
           restarts_.size() * sizeof(uint32_t) +   // Restart array
+          restart_nums_.size() * sizeof(uint64_t) +
+          (restart_nums_.empty() ? 0 : sizeof(uint32_t)) +  // KeyNum tag
           sizeof(uint32_t));                      // Restart array length
 }
 
@@ -67,7 +81,16 @@ Slice BlockBuilder::Finish() {
   for (size_t i = 0; i < restarts_.size(); i++) {
     PutFixed32(&buffer_, restarts_[i]);
   }
-  PutFixed32(&buffer_, restarts_.size());
+  // An empty block has a restart point but no key for it
+  if (!restart_nums_.empty() && restart_nums_.size() == restarts_.size()) {
+    for (size_t i = 0; i < restart_nums_.size(); i++) {
+      PutFixed64(&buffer_, restart_nums_[i]);
+    }
+    PutFixed32(&buffer_, KeyNumTag(*options_));
+    PutFixed32(&buffer_, restarts_.size() | kBlockKeyNumsFlag);
+  } else {
+    PutFixed32(&buffer_, restarts_.size());
+  }
   finished_ = true;
   return buffer_.slice();
 }
@@ -94,6 +117,9 @@ void BlockBuilder::Add(const Slice& key, const Slice& value) {
     restarts_.push_back(buffer_.size());
     counter_ = 0;
   }
+  if (counter_ == 0 && options_->block_key_nums) {
+    restart_nums_.push_back(options_->comparator->KeyNum(key));
+  }
   const size_t non_shared = key.size() - shared;
 
   // Add "<shared><non_shared><value_size>" to buffer_
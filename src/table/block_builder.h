@@ -44,6 +44,7 @@ class BlockBuilder {
   const Options*        options_;
   StringBuilder         buffer_;      // Destination buffer
   std::vector<uint32_t> restarts_;    // Restart points
+  std::vector<uint64_t> restart_nums_; // KeyNum of the restart keys
   int                   counter_;     // Number of entries emitted since restart
   bool                  finished_;    // Has Finish() been called?
   StringBuilder         last_key_;
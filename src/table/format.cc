@@ -4,11 +4,17 @@
 
 #include "table/format.h"
 
+#include <stdio.h>
+#include <string.h>
+#include "pebblesdb/comparator.h"
 #include "pebblesdb/env.h"
+#include "pebblesdb/options.h"
+#include "pebblesdb/table.h"
 #include "port/port.h"
 #include "table/block.h"
 #include "util/coding.h"
 #include "util/crc32c.h"
+#include "util/hash.h"
 
 namespace leveldb {
 
@@ -20,6 +26,15 @@ void BlockHandle::EncodeTo(std::string* dst) const {
   PutVarint64(dst, size_);
 }
 
+uint32_t KeyNumTag(const Options& options) {
+  if (options.key_num_extractor == NULL) {
+    return 0;
+  }
+  const char* name = options.key_num_extractor->Name();
+  // Never 0, which stands for the comparator's own KeyNum
+  return Hash(name, strlen(name), 0x6b6e756d) | 1;
+}
+
 Status BlockHandle::DecodeFrom(Slice* input) {
   if (GetVarint64(input, &offset_) &&
       GetVarint64(input, &size_)) {
@@ -147,4 +162,95 @@ Status ReadBlock(RandomAccessFile* file,
   return Status::OK();
 }
 
+const char kPropertiesBlockName[] = "leveldb.properties";
+
+namespace {
+
+struct PropertyField {
+  const char* name;
+  uint64_t TableProperties::*field;
+};
+
+const PropertyField kPropertyFields[] = {
+  { "leveldb.num.entries",     &TableProperties::num_entries },
+  { "leveldb.num.deletions",   &TableProperties::num_deletions },
+  { "leveldb.raw.key.size",    &TableProperties::raw_key_size },
+  { "leveldb.raw.value.size",  &TableProperties::raw_value_size },
+  { "leveldb.num.data.blocks", &TableProperties::num_data_blocks },
+  { "leveldb.data.size",       &TableProperties::data_size },
+  { "leveldb.index.size",      &TableProperties::index_size },
+  { "leveldb.filter.size",     &TableProperties::filter_size },
+  { "leveldb.smallest.seqno",  &TableProperties::smallest_seqno },
+  { "leveldb.largest.seqno",   &TableProperties::largest_seqno },
+};
+
+}  // namespace
+
+TableProperties::TableProperties()
+    : num_entries(0),
+      num_deletions(0),
+      raw_key_size(0),
+      raw_value_size(0),
+      num_data_blocks(0),
+      data_size(0),
+      index_size(0),
+      filter_size(0),
+      smallest_seqno(0),
+      largest_seqno(0) {
+}
+
+double TableProperties::CompressionRatio() const {
+  if (data_size == 0) {
+    return 1.0;
+  }
+  return static_cast<double>(raw_key_size + raw_value_size) / data_size;
+}
+
+std::string TableProperties::ToString() const {
+  char buf[400];
+  snprintf(buf, sizeof(buf),
+           "entries=%llu deletions=%llu raw_key_bytes=%llu "
+           "raw_value_bytes=%llu data_blocks=%llu data_bytes=%llu "
+           "index_bytes=%llu filter_bytes=%llu seqno=%llu..%llu "
+           "compression=%.2f",
+           static_cast<unsigned long long>(num_entries),
+           static_cast<unsigned long long>(num_deletions),
+           static_cast<unsigned long long>(raw_key_size),
+           static_cast<unsigned long long>(raw_value_size),
+           static_cast<unsigned long long>(num_data_blocks),
+           static_cast<unsigned long long>(data_size),
+           static_cast<unsigned long long>(index_size),
+           static_cast<unsigned long long>(filter_size),
+           static_cast<unsigned long long>(smallest_seqno),
+           static_cast<unsigned long long>(largest_seqno),
+           CompressionRatio());
+  return buf;
+}
+
+void EncodeTableProperties(const TableProperties& props, std::string* dst) {
+  for (size_t i = 0; i < sizeof(kPropertyFields) / sizeof(kPropertyFields[0]); i++) {
+    PutLengthPrefixedSlice(dst, kPropertyFields[i].name);
+    PutVarint64(dst, props.*kPropertyFields[i].field);
+  }
+}
+
+Status DecodeTableProperties(const Slice& input, TableProperties* props) {
+  Slice in = input;
+  *props = TableProperties();
+  while (!in.empty()) {
+    Slice name;
+    uint64_t value;
+    if (!GetLengthPrefixedSlice(&in, &name) || !GetVarint64(&in, &value)) {
+      return Status::Corruption("bad table properties block");
+    }
+    for (size_t i = 0; i < sizeof(kPropertyFields) / sizeof(kPropertyFields[0]); i++) {
+      if (name == Slice(kPropertyFields[i].name)) {
+        props->*kPropertyFields[i].field = value;
+        break;
+      }
+    }
+  }
+  return Status::OK();
+}
+
 }  // namespace leveldb
@@ -16,6 +16,7 @@ namespace leveldb {
 class Block;
 class RandomAccessFile;
 struct ReadOptions;
+struct TableProperties;
 
 // BlockHandle is a pointer to the extent of a file that stores a data
 // block or a meta block.
@@ -86,6 +87,25 @@ static const uint64_t kTableMagicNumber = 0xdb4775248b80fb57ull;
 // 1-byte type + 32-bit crc
 static const size_t kBlockTrailerSize = 5;
 
+// Set in the num_restarts field of a block whose restart array is followed
+// by the KeyNum of every restart point (see block_builder.cc)
+static const uint32_t kBlockKeyNumsFlag = 0x80000000u;
+
+// Identifies where the KeyNums of blocks built with "options" come from:
+// 0 for the comparator, otherwise a hash of options.key_num_extractor's
+// name.  Blocks store it next to their KeyNums.
+extern uint32_t KeyNumTag(const Options& options);
+
+// Name of the metaindex entry that points at the properties block
+extern const char kPropertiesBlockName[];
+
+// The properties block is a sequence of (length prefixed name, varint64
+// value) pairs, so that readers skip the properties they do not know.
+extern void EncodeTableProperties(const TableProperties& props,
+                                  std::string* dst);
+extern Status DecodeTableProperties(const Slice& input,
+                                    TableProperties* props);
+
 struct BlockContents {
   BlockContents() : data(), cachable(), heap_allocated() {}
   Slice data;           // Actual contents of data
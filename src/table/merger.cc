@@ -30,25 +30,53 @@
 namespace leveldb {
 
 namespace {
-class MergingIterator;
 
-struct HeapComparator {
-  HeapComparator(MergingIterator* mi) : mi_(mi) {}
-  HeapComparator(const HeapComparator& other) : mi_(other.mi_) {}
+// A tournament (loser) tree over the children.  tree_[1..tree_sz_-1] hold the
+// loser of the match played at each internal node and tree_[0] holds the
+// overall winner, i.e. the current child.  Leaf i lives at position
+// tree_sz_ + i; leaves past n_ are padding that never win.  Advancing the
+// winner replays a single leaf-to-root path: one comparison per tree level,
+// instead of the sift-down and sift-up pair the binary heap did.
+//
+// When a child is a table file with known metadata, Seek/SeekToFirst/
+// SeekToLast do not position it if the whole file lies on the far side of the
+// target.  Such a child enters the tree keyed by its file's smallest (or
+// largest) key, and is only positioned once it actually wins the tournament.
+// Within a guard this avoids reading index and data blocks for files that
+// the caller never reaches.
+class MergingIterator : public Iterator {
+ private:
+  // How a child's tournament key is obtained.
+  enum ChildState {
+    kPositioned,    // children_[i] is positioned; use its key()
+    kDeferredFirst, // not yet positioned; first entry is file smallest
+    kDeferredLast   // not yet positioned; last entry is file largest
+  };
 
-  MergingIterator* mi_;
+  void RebuildTree();
+  void ReplayChild(unsigned idx);
+  void FindWinner();
+  bool Beats(unsigned lhs, unsigned rhs) const;
+  void PositionChild(unsigned idx, const Slice& target);
+  void ChildMoved(unsigned idx);
 
-  bool operator () (unsigned lhs, unsigned rhs) const;
+  bool Live(unsigned idx) const {
+    return idx < static_cast<unsigned>(n_) &&
+           (state_[idx] != kPositioned || children_[idx].Valid());
+  }
 
-  private:
-    HeapComparator& operator = (const HeapComparator&);
-};
+  Slice ChildKey(unsigned idx) const {
+    switch (state_[idx]) {
+      case kDeferredFirst: return file_meta_list[idx]->smallest.Encode();
+      case kDeferredLast:  return file_meta_list[idx]->largest.Encode();
+      default:             return children_[idx].key();
+    }
+  }
+
+  FileMetaData* ChildFile(unsigned idx) const {
+    return (file_meta_list != NULL) ? file_meta_list[idx] : NULL;
+  }
 
-class MergingIterator : public Iterator {
- private:
-  void ReinitializeComparisons();
-  void PopCurrentComparison();
-  void PushCurrentComparison();
  public:
   MergingIterator(const Comparator* comparator, Iterator** children,
 		  FileMetaData** file_meta_list, int n,
@@ -56,28 +84,32 @@ class MergingIterator : public Iterator {
 		  bool is_merging_iterator_for_files,
 		  VersionSet* vset, unsigned l)
       : comparator_(comparator),
-		icmp_(icmp),
         children_(new IteratorWrapper[n]),
 		file_meta_list(file_meta_list),
         comparisons_(new uint64_t[n]),
-        heap_(new unsigned[n]),
-        heap_sz_(0),
+        state_(new ChildState[n]),
+        tree_(NULL),
+        scratch_(NULL),
+        tree_sz_(1),
         n_(n),
-        comparisons_intialized_(false),
         current_(NULL),
         status_(),
-        direction_(kForward),
+		icmp_(icmp),
 		is_merging_iterator_for_files_(is_merging_iterator_for_files),
 		vset_(vset),
-		level(l){
+		level(l),
+        direction_(kForward) {
+    while (tree_sz_ < static_cast<unsigned>(n)) {
+      tree_sz_ <<= 1;
+    }
+    tree_ = new unsigned[tree_sz_];
+    scratch_ = new unsigned[2 * tree_sz_];
     for (int i = 0; i < n; i++) {
       children_[i].Set(children[i]);
+      state_[i] = kPositioned;
+      ChildMoved(i);
     }
-    ReinitializeComparisons();
-//    for (int i = 0; i < n; i++) {
-//    	thread_status_[i] = IDLE;
-//    	iterators_to_seek_[i] = NULL;
-//    }
+    RebuildTree();
     if (vset_ != NULL) {
     	current_thread = vset_->GetCurrentThreadId();
     }
@@ -86,7 +118,9 @@ class MergingIterator : public Iterator {
   virtual ~MergingIterator() {
     delete[] children_;
     delete[] comparisons_;
-    delete[] heap_;
+    delete[] state_;
+    delete[] tree_;
+    delete[] scratch_;
     if (file_meta_list != NULL) {
     	delete[] file_meta_list;
     }
@@ -97,20 +131,34 @@ class MergingIterator : public Iterator {
   }
 
   virtual void SeekToFirst() {
+    status_ = Status::OK();
     for (int i = 0; i < n_; i++) {
-      children_[i].SeekToFirst();
+      if (ChildFile(i) != NULL) {
+        state_[i] = kDeferredFirst;
+      } else {
+        state_[i] = kPositioned;
+        children_[i].SeekToFirst();
+      }
+      ChildMoved(i);
     }
     direction_ = kForward;
-    ReinitializeComparisons();
+    RebuildTree();
     FindSmallest();
   }
 
   virtual void SeekToLast() {
+    status_ = Status::OK();
     for (int i = 0; i < n_; i++) {
-      children_[i].SeekToLast();
+      if (ChildFile(i) != NULL) {
+        state_[i] = kDeferredLast;
+      } else {
+        state_[i] = kPositioned;
+        children_[i].SeekToLast();
+      }
+      ChildMoved(i);
     }
     direction_ = kReverse;
-    ReinitializeComparisons();
+    RebuildTree();
     FindLargest();
   }
 
@@ -201,6 +249,10 @@ class MergingIterator : public Iterator {
 	}
     vrecord_timer2(SEEK_PARALLEL_WAIT_FOR_THREADS, n_);
 #endif
+    for (int i = 0; i < n_; i++) {
+      state_[i] = kPositioned;
+      ChildMoved(i);
+    }
     vrecord_timer2(SEEK_PARALLEL_TOTAL, n_);
   }
 #endif
@@ -214,14 +266,8 @@ class MergingIterator : public Iterator {
 	}
 #endif
 
-	uint64_t start, end;
 	for (int i = 0; i < n_; i++) {
-//		start = Env::Default()->NowMicros();
-		children_[i].Seek(target);
-//		end = Env::Default()->NowMicros();
-//		if (is_merging_iterator_for_files_) {
-//			printf("SeekInSequence::%d start: %llu end: %llu diff: %llu \n", i, start, end, end - start);
-//		}
+		PositionChild(i, target);
 	}
 
 #ifdef TIMER_LOG_SEEK
@@ -234,6 +280,7 @@ class MergingIterator : public Iterator {
   }
 
   virtual void Seek(const Slice& target) {
+    status_ = Status::OK();
 #ifdef SEEK_PARALLEL
 	if (is_merging_iterator_for_files_ && level == config::kNumLevels-1) {
 		SeekInParallel(target);
@@ -253,7 +300,7 @@ class MergingIterator : public Iterator {
 		vstart_timer(SEEK_REINIT);
 	}
 #endif
-    ReinitializeComparisons();
+    RebuildTree();
     FindSmallest();
 #ifdef TIMER_LOG_SEEK
 	if (is_merging_iterator_for_files_) {
@@ -264,37 +311,6 @@ class MergingIterator : public Iterator {
 #endif
   }
 
-  /*  virtual void Seek(const Slice& target) {
-/*		for (int i = 0; i < n_; i++) {
-		  children_[i].Seek(target);
-		}
-/	if (n_ == 1 || file_meta_list == NULL) {
-		for (int i = 0; i < n_; i++) {
-		  children_[i].Seek(target);
-		}
-	} else {
-		for (int i = 0; i < n_; i++) {
-			if (file_meta_list[i] == NULL) {
-				children_[i].Seek(target);
-				continue;
-			}
-			InternalKey target_ikey;
-			target_ikey.DecodeFrom(target);
-			if (icmp_->user_comparator()->Compare(file_meta_list[i]->largest.user_key(), target_ikey.user_key()) < 0) {
-			  children_[i].MakeInvalid();
-		  } else if (icmp_->user_comparator()->Compare(file_meta_list[i]->smallest.user_key(), target_ikey.user_key()) >= 0) {
-			  children_[i].SeekToFirst();
-		  } else {
-			children_[i].Seek(target);
-		  }
-		}
-	}
-    direction_ = kForward;
-    ReinitializeComparisons();
-    FindSmallest();
-  }
-*/
-
   virtual void Next() {
 #ifdef TIMER_LOG_SEEK
 	if (is_merging_iterator_for_files_) {
@@ -314,54 +330,46 @@ class MergingIterator : public Iterator {
       for (int i = 0; i < n_; i++) {
         IteratorWrapper* child = &children_[i];
         if (child != current_) {
+          state_[i] = kPositioned;
           child->Seek(key());
           if (child->Valid() &&
               comparator_->Compare(key(), child->key()) == 0) {
             child->Next();
           }
+          ChildMoved(i);
         }
       }
       direction_ = kForward;
-      ReinitializeComparisons();
+      RebuildTree();
     }
 
+    unsigned idx = current_ - children_;
 #ifdef TIMER_LOG_SEEK
     if (is_merging_iterator_for_files_) {
-    	vstart_timer(SEEK_NEXT_POP_FILE_LEVEL);
-    	PopCurrentComparison();
-    	vrecord_timer(SEEK_NEXT_POP_FILE_LEVEL);
-
     	vstart_timer(SEEK_NEXT_CURRENT_NEXT_FILE_LEVEL);
         current_->Next();
         vrecord_timer(SEEK_NEXT_CURRENT_NEXT_FILE_LEVEL);
 
         vstart_timer(SEEK_NEXT_PUSH_FILE_LEVEL);
-        PushCurrentComparison();
+        ChildMoved(idx);
+        ReplayChild(idx);
         vrecord_timer(SEEK_NEXT_PUSH_FILE_LEVEL);
-
-        FindSmallest();
-
     } else {
-    	vstart_timer(SEEK_NEXT_POP);
-    	PopCurrentComparison();
-    	vrecord_timer(SEEK_NEXT_POP);
-
     	vstart_timer(SEEK_NEXT_CURRENT_NEXT);
         current_->Next();
         vrecord_timer(SEEK_NEXT_CURRENT_NEXT);
 
         vstart_timer(SEEK_NEXT_PUSH);
-        PushCurrentComparison();
+        ChildMoved(idx);
+        ReplayChild(idx);
         vrecord_timer(SEEK_NEXT_PUSH);
-
-        FindSmallest();
     }
 #else
-    PopCurrentComparison();
     current_->Next();
-    PushCurrentComparison();
-    FindSmallest();
+    ChildMoved(idx);
+    ReplayChild(idx);
 #endif
+    FindSmallest();
 
 #ifdef TIMER_LOG_SEEK
 	if (is_merging_iterator_for_files_) {
@@ -384,6 +392,7 @@ class MergingIterator : public Iterator {
       for (int i = 0; i < n_; i++) {
         IteratorWrapper* child = &children_[i];
         if (child != current_) {
+          state_[i] = kPositioned;
           child->Seek(key());
           if (child->Valid()) {
             // Child is at first entry >= key().  Step back one to be < key()
@@ -392,15 +401,17 @@ class MergingIterator : public Iterator {
             // Child has no entries >= key().  Position at last entry.
             child->SeekToLast();
           }
+          ChildMoved(i);
         }
       }
       direction_ = kReverse;
-      ReinitializeComparisons();
+      RebuildTree();
     }
 
-    PopCurrentComparison();
+    unsigned idx = current_ - children_;
     current_->Prev();
-    PushCurrentComparison();
+    ChildMoved(idx);
+    ReplayChild(idx);
     FindLargest();
   }
 
@@ -415,19 +426,12 @@ class MergingIterator : public Iterator {
   }
 
   virtual const Status& status() const {
-    // XXX this value can easily be cached
-    for (int i = 0; i < n_; i++) {
-      if (!children_[i].status().ok()) {
-        return children_[i].status();
-      }
-    }
     return status_;
   }
 
  private:
   MergingIterator(const MergingIterator&);
   MergingIterator& operator = (const MergingIterator&);
-  friend class HeapComparator;
   void FindSmallest();
   void FindLargest();
 
@@ -435,12 +439,14 @@ class MergingIterator : public Iterator {
   IteratorWrapper* children_;
   FileMetaData** file_meta_list;
   uint64_t* comparisons_;
-  unsigned* heap_;
-  size_t heap_sz_;
+  ChildState* state_;
+  unsigned* tree_;
+  unsigned* scratch_;   // Winners of each node; only used by RebuildTree
+  unsigned tree_sz_;    // Number of leaves; n_ rounded up to a power of two
   int n_;
-  bool comparisons_intialized_;
   IteratorWrapper* current_;
-  Status status_;
+  Status status_;       // First non-ok status seen on any child since the
+                        // last Seek, SeekToFirst or SeekToLast
   const InternalKeyComparator* icmp_;
   bool is_merging_iterator_for_files_;
   VersionSet* vset_;
@@ -455,64 +461,118 @@ class MergingIterator : public Iterator {
   Direction direction_;
 };
 
-bool HeapComparator::operator ()(unsigned lhs, unsigned rhs) const {
-  if (mi_->direction_ == MergingIterator::kForward) {
-    std::swap(lhs, rhs);
+// Returns true if child "lhs" should be yielded before child "rhs" in the
+// current direction.  Exhausted children and padding leaves never win; ties
+// go to the lower index so that the order is deterministic.
+bool MergingIterator::Beats(unsigned lhs, unsigned rhs) const {
+  if (!Live(lhs)) {
+    return false;
+  }
+  if (!Live(rhs)) {
+    return true;
+  }
+  if (comparisons_[lhs] != comparisons_[rhs]) {
+    return (direction_ == kForward) == (comparisons_[lhs] < comparisons_[rhs]);
+  }
+  int r = comparator_->Compare(ChildKey(lhs), ChildKey(rhs));
+  if (r == 0) {
+    return lhs < rhs;
+  }
+  return (direction_ == kForward) == (r < 0);
+}
+
+// Must be called whenever child "idx" is repositioned or its state changes.
+// Refreshes its key prefix and folds its status into the cached status.
+void MergingIterator::ChildMoved(unsigned idx) {
+  if (state_[idx] == kPositioned && status_.ok() &&
+      !children_[idx].status().ok()) {
+    status_ = children_[idx].status();
+  }
+  if (Live(idx)) {
+    comparisons_[idx] = comparator_->KeyNum(ChildKey(idx));
   }
-  return mi_->comparisons_[lhs] < mi_->comparisons_[rhs] ||
-         (mi_->comparisons_[lhs] == mi_->comparisons_[rhs] &&
-          mi_->comparator_->Compare(mi_->children_[lhs].key(), mi_->children_[rhs].key()) < 0);
 }
 
-void MergingIterator::ReinitializeComparisons() {
-  heap_sz_ = 0;
-  for (int i = 0; i < n_; ++i) {
-    if (children_[i].Valid()) {
-      comparisons_[i] = comparator_->KeyNum(children_[i].key());
-      heap_[heap_sz_] = i;
-      ++heap_sz_;
+void MergingIterator::PositionChild(unsigned idx, const Slice& target) {
+  FileMetaData* f = ChildFile(idx);
+  if (f != NULL && icmp_->Compare(target, f->smallest.Encode()) <= 0) {
+    // Every entry of the file is >= target; its first entry is the answer.
+    state_[idx] = kDeferredFirst;
+  } else if (f != NULL && icmp_->Compare(target, f->largest.Encode()) > 0) {
+    // Nothing in the file is >= target.
+    state_[idx] = kPositioned;
+    children_[idx].MakeInvalid();
+  } else {
+    state_[idx] = kPositioned;
+    children_[idx].Seek(target);
+  }
+  ChildMoved(idx);
+}
+
+void MergingIterator::RebuildTree() {
+  for (unsigned i = 0; i < tree_sz_; ++i) {
+    scratch_[tree_sz_ + i] = i;
+  }
+  for (unsigned node = tree_sz_ - 1; node > 0; --node) {
+    unsigned lhs = scratch_[2 * node];
+    unsigned rhs = scratch_[2 * node + 1];
+    if (Beats(rhs, lhs)) {
+      scratch_[node] = rhs;
+      tree_[node] = lhs;
+    } else {
+      scratch_[node] = lhs;
+      tree_[node] = rhs;
     }
   }
-  HeapComparator hc(this);
-  std::make_heap(heap_, heap_ + heap_sz_, hc);
+  tree_[0] = scratch_[1];
 }
 
-void MergingIterator::PopCurrentComparison() {
-  unsigned idx = current_ - children_;
-  assert(heap_[0] == idx);
-  HeapComparator hc(this);
-  std::pop_heap(heap_, heap_ + heap_sz_, hc);
-  --heap_sz_;
+// Re-run the matches on the path from leaf "idx" to the root.  Only valid
+// when "idx" is the only child whose key changed since the tree was last
+// consistent, which holds for the winner after Next()/Prev().
+void MergingIterator::ReplayChild(unsigned idx) {
+  unsigned winner = idx;
+  for (unsigned node = (tree_sz_ + idx) >> 1; node > 0; node >>= 1) {
+    if (Beats(tree_[node], winner)) {
+      std::swap(tree_[node], winner);
+    }
+  }
+  tree_[0] = winner;
 }
 
-void MergingIterator::PushCurrentComparison() {
-  unsigned idx = current_ - children_;
-  assert(&children_[idx] == current_);
-  if (current_->Valid()) {
-    comparisons_[idx] = comparator_->KeyNum(current_->key());
-    heap_[heap_sz_] = idx;
-    ++heap_sz_;
-    HeapComparator hc(this);
-    std::push_heap(heap_, heap_ + heap_sz_, hc);
+void MergingIterator::FindWinner() {
+  while (true) {
+    unsigned winner = tree_[0];
+    if (!Live(winner)) {
+      current_ = NULL;
+      return;
+    }
+    if (state_[winner] == kPositioned) {
+      current_ = &children_[winner];
+      return;
+    }
+    // The winner is standing in with its file's boundary key.  Position it
+    // for real; its key can only move away from the target, so replaying its
+    // path either confirms it or hands the win to another child.
+    if (state_[winner] == kDeferredFirst) {
+      children_[winner].SeekToFirst();
+    } else {
+      children_[winner].SeekToLast();
+    }
+    state_[winner] = kPositioned;
+    ChildMoved(winner);
+    ReplayChild(winner);
   }
 }
 
 void MergingIterator::FindSmallest() {
   assert(direction_ == kForward);
-  if (heap_sz_ > 0) {
-    current_ = &children_[heap_[0]];
-  } else {
-    current_ = NULL;
-  }
+  FindWinner();
 }
 
 void MergingIterator::FindLargest() {
   assert(direction_ == kReverse);
-  if (heap_sz_ > 0) {
-    current_ = &children_[heap_[0]];
-  } else {
-    current_ = NULL;
-  }
+  FindWinner();
 }
 }  // namespace
 
@@ -543,6 +603,9 @@ Iterator* NewMergingIteratorForFiles(const Comparator* cmp, Iterator** list,
 		const InternalKeyComparator* icmp,
 		VersionSet* vset, unsigned level) {
   assert(n >= 0);
+  if (n <= 1) {
+    delete[] file_meta_list;
+  }
   if (n == 0) {
     return NewEmptyIterator();
   } else if (n == 1) {
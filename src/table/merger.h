@@ -27,6 +27,11 @@ extern Iterator* NewMergingIterator(
 extern Iterator* NewMergingIterator(
     const Comparator* comparator, Iterator** children, int n, VersionSet* vset);
 
+// Like NewMergingIterator, but every child is a table iterator and
+// file_meta_list[i] (may be NULL) describes the file behind children[i].
+// Children whose file lies entirely past a seek target are not positioned
+// until the merge actually reaches them.  Takes ownership of file_meta_list
+// (the array, not the FileMetaData objects, which must outlive the result).
 extern Iterator* NewMergingIteratorForFiles(
 		const Comparator* cmp, Iterator** list, FileMetaData** file_meta_list, int n, const InternalKeyComparator* icmp, VersionSet* vset, unsigned level);
 
@@ -0,0 +1,365 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#define __STDC_LIMIT_MACROS
+
+#include "table/merger.h"
+
+#include <algorithm>
+#include <string>
+#include <vector>
+#include "db/dbformat.h"
+#include "db/version_edit.h"
+#include "pebblesdb/env.h"
+#include "pebblesdb/iterator.h"
+#include "pebblesdb/options.h"
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/random.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static std::string IKey(int user_key, SequenceNumber seq) {
+  char buf[30];
+  snprintf(buf, sizeof(buf), "%08d", user_key);
+  std::string result;
+  AppendInternalKey(&result, ParsedInternalKey(buf, seq, kTypeValue));
+  return result;
+}
+
+namespace {
+
+// Forwards to a block iterator and counts how many times the merger had to
+// position it.  Fails with "*status" while that is not ok.
+class CountingIterator : public Iterator {
+ public:
+  CountingIterator(Iterator* iter, int* positions, const Status* status)
+      : iter_(iter), positions_(positions), status_(status) { }
+  virtual ~CountingIterator() { delete iter_; }
+  virtual bool Valid() const { return status_->ok() && iter_->Valid(); }
+  virtual void Seek(const Slice& k) { ++*positions_; iter_->Seek(k); }
+  virtual void SeekToFirst() { ++*positions_; iter_->SeekToFirst(); }
+  virtual void SeekToLast() { ++*positions_; iter_->SeekToLast(); }
+  virtual void Next() { iter_->Next(); }
+  virtual void Prev() { iter_->Prev(); }
+  virtual Slice key() const { return iter_->key(); }
+  virtual Slice value() const { return iter_->value(); }
+  virtual const Status& status() const {
+    return status_->ok() ? iter_->status() : *status_;
+  }
+
+ private:
+  CountingIterator(const CountingIterator&);
+  CountingIterator& operator = (const CountingIterator&);
+
+  Iterator* iter_;
+  int* positions_;
+  const Status* status_;
+};
+
+// A set of in-memory "files" of one guard, each a single block plus the
+// FileMetaData the version would hold for it.
+class GuardFiles {
+ public:
+  GuardFiles() : icmp_(BytewiseComparator()), positions_(0) { }
+
+  ~GuardFiles() {
+    for (size_t i = 0; i < blocks_.size(); i++) {
+      delete blocks_[i];
+      delete files_[i];
+    }
+  }
+
+  // REQUIRES: keys are sorted by icmp_ and non-empty
+  void AddFile(const std::vector<std::string>& keys) {
+    Options options;
+    BlockBuilder builder(&options);
+    for (size_t i = 0; i < keys.size(); i++) {
+      builder.Add(keys[i], "v");
+    }
+    contents_.push_back(builder.Finish().ToString());
+    BlockContents contents;
+    contents.data = contents_.back();
+    contents.cachable = false;
+    contents.heap_allocated = false;
+    blocks_.push_back(new Block(contents));
+    FileMetaData* f = new FileMetaData;
+    f->number = files_.size() + 1;
+    f->smallest.DecodeFrom(keys.front());
+    f->largest.DecodeFrom(keys.back());
+    files_.push_back(f);
+    all_keys_.insert(all_keys_.end(), keys.begin(), keys.end());
+  }
+
+  void FailFile(size_t i) {
+    errors_.resize(files_.size());
+    errors_[i] = Status::Corruption("injected");
+  }
+
+  void ClearErrors() {
+    errors_.assign(files_.size(), Status());
+  }
+
+  Iterator* NewIterator(bool with_metadata) {
+    size_t n = files_.size();
+    Iterator** list = new Iterator*[n];
+    FileMetaData** metas = new FileMetaData*[n];
+    errors_.resize(n);
+    for (size_t i = 0; i < n; i++) {
+      list[i] = new CountingIterator(blocks_[i]->NewIterator(&icmp_),
+                                     &positions_, &errors_[i]);
+      metas[i] = with_metadata ? files_[i] : NULL;
+    }
+    Iterator* result = NewMergingIteratorForFiles(&icmp_, list, metas, n,
+                                                  &icmp_, NULL, 0);
+    delete[] list;
+    return result;
+  }
+
+  std::vector<std::string> SortedKeys() const {
+    std::vector<std::string> keys = all_keys_;
+    std::sort(keys.begin(), keys.end(), KeyLess(&icmp_));
+    return keys;
+  }
+
+  const InternalKeyComparator* icmp() const { return &icmp_; }
+  int positions() const { return positions_; }
+  void ResetPositions() { positions_ = 0; }
+
+ private:
+  struct KeyLess {
+    explicit KeyLess(const InternalKeyComparator* c) : cmp(c) { }
+    bool operator () (const std::string& a, const std::string& b) const {
+      return cmp->Compare(a, b) < 0;
+    }
+    const InternalKeyComparator* cmp;
+  };
+
+  InternalKeyComparator icmp_;
+  std::vector<std::string> contents_;
+  std::vector<Block*> blocks_;
+  std::vector<FileMetaData*> files_;
+  std::vector<Status> errors_;
+  std::vector<std::string> all_keys_;
+  int positions_;
+};
+
+// Files whose key ranges interleave, as level-0 and guard files do.
+static void BuildOverlappingFiles(Random* rnd, int num_files, int keys_per_file,
+                                  GuardFiles* guard) {
+  SequenceNumber seq = 1;
+  for (int f = 0; f < num_files; f++) {
+    std::vector<std::string> keys;
+    int k = rnd->Uniform(10);
+    for (int i = 0; i < keys_per_file; i++) {
+      k += 1 + rnd->Uniform(num_files * 2);
+      keys.push_back(IKey(k, seq++));
+    }
+    guard->AddFile(keys);
+  }
+}
+
+}  // namespace
+
+class MergerTest { };
+
+TEST(MergerTest, ForwardAndReverseMatchSortedOrder) {
+  for (int n = 2; n <= 9; n++) {
+    Random rnd(301 + n);
+    GuardFiles guard;
+    BuildOverlappingFiles(&rnd, n, 50, &guard);
+    std::vector<std::string> expected = guard.SortedKeys();
+
+    Iterator* iter = guard.NewIterator(true);
+    size_t pos = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), pos++) {
+      ASSERT_LT(pos, expected.size());
+      ASSERT_EQ(expected[pos], iter->key().ToString());
+    }
+    ASSERT_EQ(expected.size(), pos);
+
+    pos = expected.size();
+    for (iter->SeekToLast(); iter->Valid(); iter->Prev()) {
+      ASSERT_GT(pos, 0);
+      pos--;
+      ASSERT_EQ(expected[pos], iter->key().ToString());
+    }
+    ASSERT_EQ(0, pos);
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+}
+
+TEST(MergerTest, SeekAndDirectionChanges) {
+  Random rnd(17);
+  GuardFiles guard;
+  BuildOverlappingFiles(&rnd, 7, 40, &guard);
+  std::vector<std::string> expected = guard.SortedKeys();
+  Iterator* iter = guard.NewIterator(true);
+
+  for (int trial = 0; trial < 200; trial++) {
+    std::string target = IKey(rnd.Uniform(700), kMaxSequenceNumber);
+    size_t pos = 0;
+    while (pos < expected.size() &&
+           guard.icmp()->Compare(expected[pos], target) < 0) {
+      pos++;
+    }
+    iter->Seek(target);
+    if (pos == expected.size()) {
+      ASSERT_TRUE(!iter->Valid());
+      continue;
+    }
+    ASSERT_TRUE(iter->Valid());
+    ASSERT_EQ(expected[pos], iter->key().ToString());
+
+    // Wander a few steps in both directions.
+    for (int step = 0; step < 10 && iter->Valid(); step++) {
+      if (rnd.OneIn(2)) {
+        iter->Next();
+        pos++;
+      } else {
+        iter->Prev();
+        if (pos == 0) {
+          ASSERT_TRUE(!iter->Valid());
+          break;
+        }
+        pos--;
+      }
+      if (pos == expected.size()) {
+        ASSERT_TRUE(!iter->Valid());
+        break;
+      }
+      ASSERT_TRUE(iter->Valid());
+      ASSERT_EQ(expected[pos], iter->key().ToString());
+    }
+  }
+  delete iter;
+}
+
+TEST(MergerTest, SeekPositionsOnlyReachedFiles) {
+  // Eight files with disjoint, increasing ranges: [0,100), [100,200), ...
+  GuardFiles guard;
+  SequenceNumber seq = 1;
+  for (int f = 0; f < 8; f++) {
+    std::vector<std::string> keys;
+    for (int k = f * 100; k < f * 100 + 100; k += 2) {
+      keys.push_back(IKey(k, seq++));
+    }
+    guard.AddFile(keys);
+  }
+
+  Iterator* iter = guard.NewIterator(true);
+  iter->Seek(IKey(350, kMaxSequenceNumber));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ("00000350", ExtractUserKey(iter->key()).ToString());
+  // Only the file covering the target is read.
+  ASSERT_EQ(1, guard.positions());
+
+  // Walking off the end of file 3 positions exactly one more file.
+  while (iter->Valid() &&
+         guard.icmp()->Compare(iter->key(), IKey(399, 0)) <= 0) {
+    iter->Next();
+  }
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(2, guard.positions());
+
+  guard.ResetPositions();
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(1, guard.positions());
+  delete iter;
+
+  // Without metadata every child is positioned eagerly.
+  guard.ResetPositions();
+  iter = guard.NewIterator(false);
+  iter->Seek(IKey(350, kMaxSequenceNumber));
+  ASSERT_TRUE(iter->Valid());
+  ASSERT_EQ(8, guard.positions());
+  delete iter;
+}
+
+TEST(MergerTest, StatusReportsChildError) {
+  Random rnd(5);
+  GuardFiles guard;
+  BuildOverlappingFiles(&rnd, 4, 10, &guard);
+  guard.FailFile(2);
+  Iterator* iter = guard.NewIterator(false);
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->status().IsCorruption());
+  delete iter;
+}
+
+TEST(MergerTest, StatusClearedBySeek) {
+  Random rnd(7);
+  GuardFiles guard;
+  BuildOverlappingFiles(&rnd, 4, 10, &guard);
+  guard.FailFile(1);
+  Iterator* iter = guard.NewIterator(false);
+  iter->SeekToFirst();
+  ASSERT_TRUE(iter->status().IsCorruption());
+
+  // The error was transient; repositioning reports the children afresh
+  guard.ClearErrors();
+  iter->SeekToFirst();
+  ASSERT_OK(iter->status());
+  ASSERT_TRUE(iter->Valid());
+
+  guard.FailFile(3);
+  iter->SeekToLast();
+  ASSERT_TRUE(iter->status().IsCorruption());
+  guard.ClearErrors();
+  iter->Seek(IKey(0, kMaxSequenceNumber));
+  ASSERT_OK(iter->status());
+  ASSERT_TRUE(iter->Valid());
+  guard.FailFile(0);
+  iter->Seek(IKey(0, kMaxSequenceNumber));
+  ASSERT_TRUE(iter->status().IsCorruption());
+  guard.ClearErrors();
+  iter->SeekToLast();
+  ASSERT_OK(iter->status());
+  delete iter;
+}
+
+// Seek-heavy workload over a single guard with "num_files" overlapping
+// files, the shape of a busy guard in a deep level.
+void BM_MergingIteratorSeek(int iters, int num_files, bool with_metadata) {
+  Random rnd(301);
+  GuardFiles guard;
+  BuildOverlappingFiles(&rnd, num_files, 1000, &guard);
+  std::vector<std::string> keys = guard.SortedKeys();
+  Iterator* iter = guard.NewIterator(with_metadata);
+
+  Env* env = Env::Default();
+  uint64_t start_micros = env->NowMicros();
+  for (int i = 0; i < iters; i++) {
+    iter->Seek(keys[rnd.Uniform(keys.size())]);
+    for (int j = 0; j < 10 && iter->Valid(); j++) {
+      iter->Next();
+    }
+  }
+  uint64_t stop_micros = env->NowMicros();
+  delete iter;
+
+  unsigned int us = stop_micros - start_micros;
+  fprintf(stderr,
+          "BM_MergingIteratorSeek/%-2d files %-8s %8d iters : %9u us (%7.3f us / iter)\n",
+          num_files, with_metadata ? "lazy" : "eager", iters, us,
+          ((float)us) / iters);
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  if (argc > 1 && std::string(argv[1]) == "--benchmark") {
+    for (int files = 2; files <= 32; files *= 2) {
+      leveldb::BM_MergingIteratorSeek(100000, files, false);
+      leveldb::BM_MergingIteratorSeek(100000, files, true);
+    }
+    return 0;
+  }
+
+  return leveldb::test::RunAllTests();
+}
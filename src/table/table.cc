@@ -41,26 +41,33 @@ struct Table::Rep {
       status(),
       file(NULL),
       cache_id(),
+      secondary_prefix(),
       filter(),
       filter_data(),
       metaindex_handle(),
-      index_block() {
+      index_block(),
+      key_num_tag(),
+      properties() {
   }
   ~Rep() {
     delete filter;
     delete [] filter_data;
     delete index_block;
+    delete properties;
   }
 
   Options options;
   Status status;
   RandomAccessFile* file;
   uint64_t cache_id;
+  std::string secondary_prefix;
   FilterBlockReader* filter;
   const char* filter_data;
 
   BlockHandle metaindex_handle;  // Handle to metaindex_block: saved from footer
   Block* index_block;
+  uint32_t key_num_tag;  // KeyNumTag(options), checked against blocks
+  TableProperties* properties;  // NULL if the table has none
 
  private:
   Rep(const Rep&);
@@ -71,7 +78,8 @@ Status Table::Open(const Options& options,
                    RandomAccessFile* file,
                    uint64_t size,
                    Table** table,
-				   Timer* timer) {
+				   Timer* timer,
+                   const Slice& secondary_key_prefix) {
   *table = NULL;
   if (size < Footer::kEncodedLength) {
     return Status::InvalidArgument("file is too short to be an sstable");
@@ -109,7 +117,17 @@ Status Table::Open(const Options& options,
     rep->file = file;
     rep->metaindex_handle = footer.metaindex_handle();
     rep->index_block = index_block;
+    rep->key_num_tag = KeyNumTag(options);
     rep->cache_id = (options.block_cache ? options.block_cache->NewId() : 0);
+    if (options.secondary_cache != NULL) {
+      if (secondary_key_prefix.empty()) {
+        char buf[8];
+        EncodeFixed64(buf, options.secondary_cache->NewId());
+        rep->secondary_prefix.assign(buf, sizeof(buf));
+      } else {
+        rep->secondary_prefix = secondary_key_prefix.ToString();
+      }
+    }
     rep->filter_data = NULL;
     rep->filter = NULL;
     *table = new Table(rep);
@@ -124,12 +142,6 @@ Status Table::Open(const Options& options,
 }
 
 void Table::ReadMeta(const Footer& footer) {
-  if (rep_->options.filter_policy == NULL) {
-    return;  // Do not need any metadata
-  }
-
-  // TODO(sanjay): Skip this if footer.metaindex_handle() size indicates
-  // it is an empty block.
   ReadOptions opt;
   BlockContents contents;
   if (!ReadBlock(rep_->file, opt, footer.metaindex_handle(), &contents).ok()) {
@@ -139,16 +151,50 @@ void Table::ReadMeta(const Footer& footer) {
   Block* meta = new Block(contents);
 
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "filter.";
-  key.append(rep_->options.filter_policy->Name());
-  iter->Seek(key);
-  if (iter->Valid() && iter->key() == Slice(key)) {
-    ReadFilter(iter->value());
+  if (rep_->options.filter_policy != NULL) {
+    std::string key = "filter.";
+    key.append(rep_->options.filter_policy->Name());
+    iter->Seek(key);
+    if (iter->Valid() && iter->key() == Slice(key)) {
+      ReadFilter(iter->value());
+    }
+  }
+  iter->Seek(kPropertiesBlockName);
+  if (iter->Valid() && iter->key() == Slice(kPropertiesBlockName)) {
+    ReadProperties(iter->value());
   }
   delete iter;
   delete meta;
 }
 
+void Table::ReadProperties(const Slice& properties_handle_value) {
+  Slice v = properties_handle_value;
+  BlockHandle properties_handle;
+  if (!properties_handle.DecodeFrom(&v).ok()) {
+    return;
+  }
+
+  ReadOptions opt;
+  opt.verify_checksums = true;
+  BlockContents block;
+  if (!ReadBlock(rep_->file, opt, properties_handle, &block).ok()) {
+    return;
+  }
+  TableProperties* props = new TableProperties;
+  if (DecodeTableProperties(block.data, props).ok()) {
+    rep_->properties = props;
+  } else {
+    delete props;
+  }
+  if (block.heap_allocated) {
+    delete[] block.data.data();
+  }
+}
+
+const TableProperties* Table::properties() const {
+  return rep_->properties;
+}
+
 void Table::ReadFilter(const Slice& filter_handle_value) {
   Slice v = filter_handle_value;
   BlockHandle filter_handle;
@@ -177,9 +223,27 @@ static void DeleteBlock(void* arg, void* /*ignored*/) {
   delete reinterpret_cast<Block*>(arg);
 }
 
+// A block in the block cache, along with the secondary cache that
+// receives its contents once it leaves the block cache.  Block cache ids
+// are only unique within one block cache, so the secondary cache is
+// keyed by the table's secondary_prefix instead.
+struct CachedBlock {
+  Block* block;
+  SecondaryCache* secondary_cache;
+  std::string secondary_key;
+};
+
+// Runs under the block cache's lock, so the secondary cache only queues
+// a copy of the block here
 static void DeleteCachedBlock(const Slice& /*key*/, void* value) {
-  Block* block = reinterpret_cast<Block*>(value);
-  delete block;
+  CachedBlock* cached = reinterpret_cast<CachedBlock*>(value);
+  if (cached->secondary_cache != NULL) {
+    cached->secondary_cache->Insert(
+        cached->secondary_key,
+        Slice(cached->block->data(), cached->block->size()));
+  }
+  delete cached->block;
+  delete cached;
 }
 
 static void ReleaseBlock(void* arg, void* h) {
@@ -219,17 +283,38 @@ Iterator* Table::BlockReader(void* arg,
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
       cache_handle = block_cache->Lookup(key);
       if (cache_handle != NULL) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+        block = reinterpret_cast<CachedBlock*>(
+            block_cache->Value(cache_handle))->block;
       } else {
-    	sstart_timer(SEEK_BLOCK_READER_READ_BLOCK);
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
-        srecord_timer(SEEK_BLOCK_READER_READ_BLOCK);
+        SecondaryCache* secondary_cache =
+            table->rep_->options.secondary_cache;
+        std::string secondary_key = table->rep_->secondary_prefix;
+        PutFixed64(&secondary_key, handle.offset());
+        std::string secondary_contents;
+        if (secondary_cache != NULL &&
+            secondary_cache->Lookup(secondary_key, &secondary_contents)) {
+          // The secondary cache holds the block as it was in the block
+          // cache, so it needs no decompression
+          char* buf = new char[secondary_contents.size()];
+          memcpy(buf, secondary_contents.data(), secondary_contents.size());
+          contents.data = Slice(buf, secondary_contents.size());
+          contents.cachable = true;
+          contents.heap_allocated = true;
+        } else {
+          sstart_timer(SEEK_BLOCK_READER_READ_BLOCK);
+          s = ReadBlock(table->rep_->file, options, handle, &contents);
+          srecord_timer(SEEK_BLOCK_READER_READ_BLOCK);
+        }
 
         if (s.ok()) {
           block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
+            CachedBlock* cached = new CachedBlock;
+            cached->block = block;
+            cached->secondary_cache = secondary_cache;
+            cached->secondary_key.swap(secondary_key);
             cache_handle = block_cache->Insert(
-                key, block, block->size(), &DeleteCachedBlock);
+                key, cached, block->size(), &DeleteCachedBlock);
           }
         }
       }
@@ -246,7 +331,8 @@ Iterator* Table::BlockReader(void* arg,
 
   Iterator* iter;
   if (block != NULL) {
-    iter = block->NewIterator(table->rep_->options.comparator);
+    iter = block->NewIterator(table->rep_->options.comparator,
+                              table->rep_->key_num_tag);
     if (cache_handle == NULL) {
       iter->RegisterCleanup(&DeleteBlock, block, NULL);
     } else {
@@ -262,7 +348,8 @@ Iterator* Table::BlockReader(void* arg,
 
 Iterator* Table::NewIterator(const ReadOptions& options) const {
   return NewTwoLevelIterator(
-      rep_->index_block->NewIterator(rep_->options.comparator),
+      rep_->index_block->NewIterator(rep_->options.comparator,
+                                     rep_->key_num_tag),
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
@@ -271,7 +358,8 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
                           void (*saver)(void*, const Slice&, const Slice&),
 						  Timer* timer) {
   Status s;
-  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator);
+  Iterator* iiter = rep_->index_block->NewIterator(rep_->options.comparator,
+                                                   rep_->key_num_tag);
   start_timer(GET_TABLE_CACHE_INDEX_ITER_SEEK);
   iiter->Seek(k);
   record_timer(GET_TABLE_CACHE_INDEX_ITER_SEEK);
@@ -315,7 +403,8 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k,
 
 uint64_t Table::ApproximateOffsetOf(const Slice& key) const {
   Iterator* index_iter =
-      rep_->index_block->NewIterator(rep_->options.comparator);
+      rep_->index_block->NewIterator(rep_->options.comparator,
+                                     rep_->key_num_tag);
   index_iter->Seek(key);
   uint64_t result;
   if (index_iter->Valid()) {
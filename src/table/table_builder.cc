@@ -5,10 +5,12 @@
 #include "pebblesdb/table_builder.h"
 
 #include <assert.h>
+#include "db/dbformat.h"
 #include "pebblesdb/comparator.h"
 #include "pebblesdb/env.h"
 #include "pebblesdb/filter_policy.h"
 #include "pebblesdb/options.h"
+#include "pebblesdb/table.h"
 #include "table/block_builder.h"
 #include "table/filter_block.h"
 #include "table/format.h"
@@ -26,7 +28,7 @@ struct TableBuilder::Rep {
   BlockBuilder data_block;
   BlockBuilder index_block;
   std::string last_key;
-  int64_t num_entries;
+  TableProperties props;
   bool closed;          // Either Finish() or Abandon() has been called.
   FilterBlockBuilder* filter_block;
 
@@ -53,7 +55,7 @@ struct TableBuilder::Rep {
         data_block(&options),
         index_block(&index_block_options),
         last_key(),
-        num_entries(0),
+        props(),
         closed(false),
         filter_block(opt.filter_policy == NULL ? NULL
                      : new FilterBlockBuilder(opt.filter_policy)),
@@ -102,7 +104,7 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   assert(!r->closed);
   if (!ok()) return;
 #ifdef STRICT_ASSERT
-  if (r->num_entries > 0) {
+  if (r->props.num_entries > 0) {
     assert(r->options.comparator->Compare(key, Slice(r->last_key)) > 0);
   }
 #endif
@@ -121,7 +123,9 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
   }
 
   r->last_key.assign(key.data(), key.size());
-  r->num_entries++;
+  r->props.num_entries++;
+  r->props.raw_key_size += key.size();
+  r->props.raw_value_size += value.size();
   r->data_block.Add(key, value);
 
   const size_t estimated_block_size = r->data_block.CurrentSizeEstimate();
@@ -138,6 +142,8 @@ void TableBuilder::Flush() {
   assert(!r->pending_index_entry);
   WriteBlock(&r->data_block, &r->pending_handle);
   if (ok()) {
+    r->props.num_data_blocks++;
+    r->props.data_size += r->pending_handle.size() + kBlockTrailerSize;
     r->pending_index_entry = true;
     r->status = r->file->Flush();
   }
@@ -146,6 +152,16 @@ void TableBuilder::Flush() {
   }
 }
 
+void TableBuilder::SetInternalKeyStats(uint64_t num_deletions,
+                                       uint64_t smallest_seqno,
+                                       uint64_t largest_seqno) {
+  Rep* r = rep_;
+  assert(!r->closed);
+  r->props.num_deletions = num_deletions;
+  r->props.smallest_seqno = smallest_seqno;
+  r->props.largest_seqno = largest_seqno;
+}
+
 void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
   // File format contains a sequence of blocks where each block has:
   //    block_data: uint8[n]
@@ -215,16 +231,37 @@ Status TableBuilder::Finish() {
   r->closed = true;
 
   BlockHandle filter_block_handle, metaindex_block_handle, index_block_handle;
+  BlockHandle properties_block_handle;
 
   // Write filter block
   if (ok() && r->filter_block != NULL) {
     WriteRawBlock(r->filter_block->Finish(), kNoCompression,
                   &filter_block_handle);
+    r->props.filter_size = filter_block_handle.size() + kBlockTrailerSize;
+  }
+
+  // Write properties block
+  if (ok()) {
+    if (r->pending_index_entry) {
+      r->options.comparator->FindShortSuccessor(&r->last_key);
+      std::string handle_encoding;
+      r->pending_handle.EncodeTo(&handle_encoding);
+      r->index_block.Add(r->last_key, Slice(handle_encoding));
+      r->pending_index_entry = false;
+    }
+    r->props.index_size = r->index_block.CurrentSizeEstimate();
+    std::string properties;
+    EncodeTableProperties(r->props, &properties);
+    WriteRawBlock(properties, kNoCompression, &properties_block_handle);
   }
 
   // Write metaindex block
   if (ok()) {
-    BlockBuilder meta_index_block(&r->options);
+    // The metaindex is searched with BytewiseComparator(), whose KeyNum
+    // may differ from that of the table's comparator
+    Options meta_index_options = r->options;
+    meta_index_options.block_key_nums = false;
+    BlockBuilder meta_index_block(&meta_index_options);
     if (r->filter_block != NULL) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
@@ -234,19 +271,15 @@ Status TableBuilder::Finish() {
       meta_index_block.Add(key, handle_encoding);
     }
 
-    // TODO(postrelease): Add stats and other meta blocks
+    // "leveldb.properties" sorts after "filter.Name"
+    std::string handle_encoding;
+    properties_block_handle.EncodeTo(&handle_encoding);
+    meta_index_block.Add(kPropertiesBlockName, handle_encoding);
     WriteBlock(&meta_index_block, &metaindex_block_handle);
   }
 
   // Write index block
   if (ok()) {
-    if (r->pending_index_entry) {
-      r->options.comparator->FindShortSuccessor(&r->last_key);
-      std::string handle_encoding;
-      r->pending_handle.EncodeTo(&handle_encoding);
-      r->index_block.Add(r->last_key, Slice(handle_encoding));
-      r->pending_index_entry = false;
-    }
     WriteBlock(&r->index_block, &index_block_handle);
   }
 
@@ -272,7 +305,7 @@ void TableBuilder::Abandon() {
 }
 
 uint64_t TableBuilder::NumEntries() const {
-  return rep_->num_entries;
+  return rep_->props.num_entries;
 }
 
 uint64_t TableBuilder::FileSize() const {
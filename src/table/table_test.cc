@@ -11,6 +11,7 @@
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
+#include "pebblesdb/cache.h"
 #include "pebblesdb/db.h"
 #include "pebblesdb/env.h"
 #include "pebblesdb/iterator.h"
@@ -258,6 +259,8 @@ class TableConstructor: public Constructor {
     source_ = new StringSource(sink.contents());
     Options table_options;
     table_options.comparator = options.comparator;
+    table_options.block_cache = options.block_cache;
+    table_options.secondary_cache = options.secondary_cache;
     return Table::Open(table_options, source_, sink.contents().size(), &table_, nullptr);
   }
 
@@ -269,6 +272,8 @@ class TableConstructor: public Constructor {
     return table_->ApproximateOffsetOf(key);
   }
 
+  const Table* table() const { return table_; }
+
  private:
   void Reset() {
     delete table_;
@@ -418,30 +423,38 @@ struct TestArgs {
   TestType type;
   bool reverse_compare;
   int restart_interval;
+  bool key_nums;
 };
 
 static const TestArgs kTestArgList[] = {
-  { TABLE_TEST, false, 16 },
-  { TABLE_TEST, false, 1 },
-  { TABLE_TEST, false, 1024 },
-  { TABLE_TEST, true, 16 },
-  { TABLE_TEST, true, 1 },
-  { TABLE_TEST, true, 1024 },
-
-  { BLOCK_TEST, false, 16 },
-  { BLOCK_TEST, false, 1 },
-  { BLOCK_TEST, false, 1024 },
-  { BLOCK_TEST, true, 16 },
-  { BLOCK_TEST, true, 1 },
-  { BLOCK_TEST, true, 1024 },
+  { TABLE_TEST, false, 16, false },
+  { TABLE_TEST, false, 1, false },
+  { TABLE_TEST, false, 1024, false },
+  { TABLE_TEST, true, 16, false },
+  { TABLE_TEST, true, 1, false },
+  { TABLE_TEST, true, 1024, false },
+  { TABLE_TEST, false, 16, true },
+  { TABLE_TEST, false, 1, true },
+  { TABLE_TEST, true, 16, true },
+
+  { BLOCK_TEST, false, 16, false },
+  { BLOCK_TEST, false, 1, false },
+  { BLOCK_TEST, false, 1024, false },
+  { BLOCK_TEST, true, 16, false },
+  { BLOCK_TEST, true, 1, false },
+  { BLOCK_TEST, true, 1024, false },
+  { BLOCK_TEST, false, 16, true },
+  { BLOCK_TEST, false, 1, true },
+  { BLOCK_TEST, true, 16, true },
 
   // Restart interval does not matter for memtables
-  { MEMTABLE_TEST, false, 16 },
-  { MEMTABLE_TEST, true, 16 },
+  { MEMTABLE_TEST, false, 16, false },
+  { MEMTABLE_TEST, true, 16, false },
 
   // Do not bother with restart interval variations for DB
-  { DB_TEST, false, 16 },
-  { DB_TEST, true, 16 },
+  { DB_TEST, false, 16, false },
+  { DB_TEST, true, 16, false },
+  { DB_TEST, false, 16, true },
 };
 static const int kNumTestArgs = sizeof(kTestArgList) / sizeof(kTestArgList[0]);
 
@@ -455,6 +468,7 @@ class Harness {
     options_ = Options();
 
     options_.block_restart_interval = args.restart_interval;
+    options_.block_key_nums = args.key_nums;
     // Use shorter block size for tests to exercise block boundary
     // conditions more.
     options_.block_size = 256;
@@ -746,7 +760,7 @@ TEST(Harness, Randomized) {
 
 TEST(Harness, RandomizedLongDB) {
   Random rnd(test::RandomSeed());
-  TestArgs args = { DB_TEST, false, 16 };
+  TestArgs args = { DB_TEST, false, 16, false };
   Init(args);
   int num_entries = 100000;
   for (int e = 0; e < num_entries; e++) {
@@ -844,6 +858,216 @@ static bool SnappyCompressionSupported() {
   return port::Snappy_Compress(in.data(), in.size(), &out);
 }
 
+TEST(TableTest, SecondaryCache) {
+  const std::string dir = test::TmpDir() + "/table_test_secondary";
+  SecondaryCache* secondary = NULL;
+  ASSERT_OK(NewFileSecondaryCache(Env::Default(), dir, 1 << 20, &secondary));
+  // Room for only a few of the table's 1KB blocks
+  Cache* block_cache = NewLRUCache(16 << 10);
+  {
+    TableConstructor c(BytewiseComparator());
+    for (int i = 0; i < 200; i++) {
+      char key[100];
+      snprintf(key, sizeof(key), "k%04d", i);
+      c.Add(key, std::string(1000, 'a' + i % 26));
+    }
+    std::vector<std::string> keys;
+    KVMap kvmap;
+    Options options;
+    options.block_size = 1024;
+    options.compression = kNoCompression;
+    options.block_cache = block_cache;
+    options.secondary_cache = secondary;
+    c.Finish(options, &keys, &kvmap);
+
+    for (int pass = 0; pass < 2; pass++) {
+      Iterator* iter = c.NewIterator();
+      KVMap::const_iterator model = kvmap.begin();
+      for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++model) {
+        ASSERT_TRUE(model != kvmap.end());
+        ASSERT_EQ(model->first, iter->key().ToString());
+        ASSERT_EQ(model->second, iter->value().ToString());
+      }
+      ASSERT_TRUE(model == kvmap.end());
+      ASSERT_OK(iter->status());
+      delete iter;
+      if (pass == 0) {
+        ASSERT_EQ(0u, secondary->Hits());
+      }
+    }
+    // Blocks evicted during the first pass are found in the second
+    ASSERT_GT(secondary->Hits(), 0u);
+  }
+  delete block_cache;
+  delete secondary;
+  Env::Default()->DeleteDir(dir);
+}
+
+// Read every entry of a table of 200 1KB values, all equal to "fill",
+// through a block cache of only a few blocks, and check them
+static void CheckSecondaryCacheTable(Cache* block_cache,
+                                     SecondaryCache* secondary, char fill) {
+  TableConstructor c(BytewiseComparator());
+  for (int i = 0; i < 200; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "k%04d", i);
+    c.Add(key, std::string(1000, fill));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.block_cache = block_cache;
+  options.secondary_cache = secondary;
+  c.Finish(options, &keys, &kvmap);
+
+  for (int pass = 0; pass < 2; pass++) {
+    Iterator* iter = c.NewIterator();
+    int n = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), n++) {
+      ASSERT_EQ(std::string(1000, fill), iter->value().ToString());
+    }
+    ASSERT_EQ(200, n);
+    ASSERT_OK(iter->status());
+    delete iter;
+  }
+}
+
+TEST(TableTest, SecondaryCacheSharedAcrossBlockCaches) {
+  const std::string dir = test::TmpDir() + "/table_test_secondary_shared";
+  SecondaryCache* secondary = NULL;
+  ASSERT_OK(NewFileSecondaryCache(Env::Default(), dir, 4 << 20, &secondary));
+
+  // Each block cache hands out the same ids, as a database does when it
+  // is reopened with a fresh internal block cache.  Deleting the first
+  // one moves its blocks into the secondary cache.
+  Cache* first = NewLRUCache(16 << 10);
+  CheckSecondaryCacheTable(first, secondary, 'a');
+  delete first;
+  ASSERT_GT(secondary->Hits(), 0u);
+
+  Cache* second = NewLRUCache(16 << 10);
+  CheckSecondaryCacheTable(second, secondary, 'b');
+  delete second;
+
+  delete secondary;
+  Env::Default()->DeleteDir(dir);
+}
+
+TEST(TableTest, SecondaryCacheSurvivesReopen) {
+  const std::string dir = test::TmpDir() + "/table_test_secondary_reopen";
+  SecondaryCache* secondary = NULL;
+  ASSERT_OK(NewFileSecondaryCache(Env::Default(), dir, 4 << 20, &secondary));
+
+  Options options;
+  options.block_size = 1024;
+  options.compression = kNoCompression;
+  options.secondary_cache = secondary;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  for (int i = 0; i < 200; i++) {
+    char key[100];
+    snprintf(key, sizeof(key), "k%04d", i);
+    builder.Add(key, std::string(1000, 'r'));
+  }
+  ASSERT_OK(builder.Finish());
+  StringSource source(sink.contents());
+
+  // A table opened again under the same prefix, as the table cache does
+  // for a file number, finds the blocks its earlier instance spilled
+  const Slice prefix("table-7");
+  for (int open = 0; open < 2; open++) {
+    Cache* block_cache = NewLRUCache(16 << 10);
+    options.block_cache = block_cache;
+    Table* table = NULL;
+    ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table,
+                          NULL, prefix));
+    Iterator* iter = table->NewIterator(ReadOptions());
+    int n = 0;
+    for (iter->SeekToFirst(); iter->Valid(); iter->Next(), n++) {
+      ASSERT_EQ(std::string(1000, 'r'), iter->value().ToString());
+      if (n == 0) {
+        // Only blocks that left the earlier instance's block cache count
+        ASSERT_EQ(open > 0, secondary->Hits() > 0);
+      }
+    }
+    ASSERT_EQ(200, n);
+    ASSERT_OK(iter->status());
+    delete iter;
+    delete table;
+    delete block_cache;
+  }
+
+  delete secondary;
+  Env::Default()->DeleteDir(dir);
+}
+
+TEST(TableTest, Properties) {
+  TableConstructor c(BytewiseComparator());
+  for (int i = 0; i < 100; i++) {
+    char user_key[100];
+    snprintf(user_key, sizeof(user_key), "k%04d", i);
+    std::string key;
+    AppendInternalKey(&key, ParsedInternalKey(user_key, 100 + i,
+                                              i % 2 ? kTypeDeletion : kTypeValue));
+    c.Add(key, std::string(10, 'v'));
+  }
+  std::vector<std::string> keys;
+  KVMap kvmap;
+  Options options;
+  options.block_size = 256;
+  options.compression = kNoCompression;
+  c.Finish(options, &keys, &kvmap);
+
+  const TableProperties* props = c.table()->properties();
+  ASSERT_TRUE(props != NULL);
+  ASSERT_EQ(100u, props->num_entries);
+  ASSERT_EQ(100u * 13, props->raw_key_size);
+  ASSERT_EQ(100u * 10, props->raw_value_size);
+  ASSERT_GT(props->num_data_blocks, 1u);
+  ASSERT_GT(props->data_size, 0u);
+  ASSERT_LT(props->data_size, c.ApproximateOffsetOf("xyz"));
+  ASSERT_GT(props->index_size, 0u);
+  ASSERT_EQ(0u, props->filter_size);
+  ASSERT_GT(props->CompressionRatio(), 0.0);
+
+  // Without the DB layer the keys are not taken apart as internal keys
+  ASSERT_EQ(0u, props->num_deletions);
+  ASSERT_EQ(0u, props->smallest_seqno);
+  ASSERT_EQ(0u, props->largest_seqno);
+}
+
+TEST(TableTest, InternalKeyStats) {
+  Options options;
+  StringSink sink;
+  TableBuilder builder(options, &sink);
+  InternalKeyStats stats;
+  for (int i = 0; i < 100; i++) {
+    char user_key[100];
+    snprintf(user_key, sizeof(user_key), "k%04d", i);
+    std::string key;
+    AppendInternalKey(&key, ParsedInternalKey(user_key, 100 + i,
+                                              i % 2 ? kTypeDeletion : kTypeValue));
+    builder.Add(key, "v");
+    stats.Add(key);
+  }
+  stats.SaveTo(&builder);
+  ASSERT_OK(builder.Finish());
+
+  StringSource source(sink.contents());
+  Table* table = NULL;
+  ASSERT_OK(Table::Open(options, &source, sink.contents().size(), &table,
+                        nullptr));
+  const TableProperties* props = table->properties();
+  ASSERT_TRUE(props != NULL);
+  ASSERT_EQ(100u, props->num_entries);
+  ASSERT_EQ(50u, props->num_deletions);
+  ASSERT_EQ(100u, props->smallest_seqno);
+  ASSERT_EQ(199u, props->largest_seqno);
+  delete table;
+}
+
 TEST(TableTest, ApproximateOffsetOfCompressed) {
   if (!SnappyCompressionSupported()) {
     fprintf(stderr, "skipping compression tests\n");
@@ -44,6 +44,12 @@ void PutFixed32(StringBuilder* dst, uint32_t value) {
   dst->append(buf, sizeof(buf));
 }
 
+void PutFixed64(StringBuilder* dst, uint64_t value) {
+  char buf[sizeof(value)];
+  EncodeFixed64(buf, value);
+  dst->append(buf, sizeof(buf));
+}
+
 void PutFixed64(std::string* dst, uint64_t value) {
   char buf[sizeof(value)];
   EncodeFixed64(buf, value);
@@ -26,6 +26,7 @@ extern void PutVarint32(std::string* dst, uint32_t value);
 extern void PutVarint64(std::string* dst, uint64_t value);
 extern void PutLengthPrefixedSlice(std::string* dst, const Slice& value);
 extern void PutFixed32(StringBuilder* dst, uint32_t value);
+extern void PutFixed64(StringBuilder* dst, uint64_t value);
 extern void PutVarint32(StringBuilder* dst, uint32_t value);
 
 // Standard Get... routines parse a value from the beginning of a Slice
@@ -18,7 +18,27 @@ uint64_t Comparator::KeyNum(const Slice& /*key*/) const {
   return 0;
 }
 
+KeyNumExtractor::~KeyNumExtractor() { }
+
 namespace {
+// The first eight bytes of "key", padded with zeroes, as a big-endian
+// number; it orders as the bytewise comparator orders the keys
+uint64_t BigEndianPrefix(const Slice& key) {
+  unsigned char buf[sizeof(uint64_t)];
+  memset(buf, 0, sizeof(buf));
+  memmove(buf, key.data(), std::min(key.size(), sizeof(uint64_t)));
+  uint64_t number;
+  number = static_cast<uint64_t>(buf[0]) << 56
+         | static_cast<uint64_t>(buf[1]) << 48
+         | static_cast<uint64_t>(buf[2]) << 40
+         | static_cast<uint64_t>(buf[3]) << 32
+         | static_cast<uint64_t>(buf[4]) << 24
+         | static_cast<uint64_t>(buf[5]) << 16
+         | static_cast<uint64_t>(buf[6]) << 8
+         | static_cast<uint64_t>(buf[7]);
+  return number;
+}
+
 class BytewiseComparatorImpl : public Comparator {
  public:
   BytewiseComparatorImpl() { }
@@ -70,21 +90,34 @@ class BytewiseComparatorImpl : public Comparator {
   }
 
   virtual uint64_t KeyNum(const Slice& key) const {
-    unsigned char buf[sizeof(uint64_t)];
-    memset(buf, 0, sizeof(buf));
-    memmove(buf, key.data(), std::min(key.size(), sizeof(uint64_t)));
-    uint64_t number;
-    number = static_cast<uint64_t>(buf[0]) << 56
-           | static_cast<uint64_t>(buf[1]) << 48
-           | static_cast<uint64_t>(buf[2]) << 40
-           | static_cast<uint64_t>(buf[3]) << 32
-           | static_cast<uint64_t>(buf[4]) << 24
-           | static_cast<uint64_t>(buf[5]) << 16
-           | static_cast<uint64_t>(buf[6]) << 8
-           | static_cast<uint64_t>(buf[7]);
-    return number;
+    return BigEndianPrefix(key);
   }
 };
+
+class PrefixSkippingKeyNumExtractor : public KeyNumExtractor {
+ public:
+  explicit PrefixSkippingKeyNumExtractor(const Slice& prefix)
+      : prefix_(prefix.data(), prefix.size()),
+        name_("leveldb.PrefixSkippingKeyNumExtractor:" + prefix_) {
+  }
+
+  virtual const char* Name() const {
+    return name_.c_str();
+  }
+
+  virtual uint64_t KeyNum(const Slice& key) const {
+    if (key.starts_with(prefix_)) {
+      return BigEndianPrefix(Slice(key.data() + prefix_.size(),
+                                   key.size() - prefix_.size()));
+    }
+    // Every key without the prefix sorts before or after all keys with it
+    return key.compare(prefix_) < 0 ? 0 : ~static_cast<uint64_t>(0);
+  }
+
+ private:
+  const std::string prefix_;
+  const std::string name_;
+};
 }  // namespace
 
 static port::OnceType once = LEVELDB_ONCE_INIT;
@@ -99,4 +132,8 @@ const Comparator* BytewiseComparator() {
   return bytewise;
 }
 
+const KeyNumExtractor* NewPrefixSkippingKeyNumExtractor(const Slice& prefix) {
+  return new PrefixSkippingKeyNumExtractor(prefix);
+}
+
 }  // namespace leveldb
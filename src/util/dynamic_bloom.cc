@@ -0,0 +1,80 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include <string.h>
+#include "util/arena.h"
+#include "util/atomic.h"
+#include "util/hash.h"
+
+namespace leveldb {
+
+namespace {
+const size_t kCacheLineSize = 64;
+
+uint32_t BloomHash(const Slice& key) {
+  return Hash(key.data(), key.size(), 0xbc9f1d34);
+}
+
+// Map "h" to [0, n) by its high bits, leaving the low bits that pick
+// the bits within the line independent of the line
+inline uint32_t LineIndex(uint32_t h, uint32_t n) {
+  return (static_cast<uint64_t>(h) * n) >> 32;
+}
+}  // namespace
+
+DynamicBloom::DynamicBloom(Arena* arena, size_t bytes, int num_probes)
+    : num_lines_((bytes + kCacheLineSize - 1) / kCacheLineSize),
+      num_probes_(num_probes),
+      data_(NULL) {
+  if (num_lines_ == 0) {
+    num_lines_ = 1;
+  }
+  // Over-allocate so that the lines can start on a cache line boundary
+  const size_t size = num_lines_ * kCacheLineSize;
+  char* raw = arena->AllocateAligned(size + kCacheLineSize - 1);
+  const uintptr_t aligned = (reinterpret_cast<uintptr_t>(raw) +
+                             kCacheLineSize - 1) & ~(kCacheLineSize - 1);
+  data_ = reinterpret_cast<uint64_t*>(aligned);
+  memset(data_, 0, size);
+}
+
+void DynamicBloom::Add(const Slice& key) {
+  uint32_t h = BloomHash(key);
+  uint64_t* line = data_ + LineIndex(h, num_lines_) * kLineWords;
+  const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = h % (kLineWords * 64);
+    h += delta;
+    volatile uint64_t* word = line + bitpos / 64;
+    const uint64_t mask = 1ull << (bitpos % 64);
+    uint64_t old_value = atomic::load_64_nobarrier(word);
+    while ((old_value & mask) == 0) {
+      const uint64_t seen = atomic::compare_and_swap_64_nobarrier(
+          word, old_value, old_value | mask);
+      if (seen == old_value) {
+        break;
+      }
+      old_value = seen;
+    }
+  }
+}
+
+bool DynamicBloom::MayContain(const Slice& key) const {
+  uint32_t h = BloomHash(key);
+  const uint64_t* line = data_ + LineIndex(h, num_lines_) * kLineWords;
+  const uint32_t delta = (h >> 17) | (h << 15);  // Rotate right 17 bits
+  for (int i = 0; i < num_probes_; i++) {
+    const uint32_t bitpos = h % (kLineWords * 64);
+    h += delta;
+    const uint64_t word = atomic::load_64_nobarrier(line + bitpos / 64);
+    if ((word & (1ull << (bitpos % 64))) == 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+}  // namespace leveldb
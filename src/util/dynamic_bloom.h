@@ -0,0 +1,47 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#ifndef STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+#define STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include "pebblesdb/slice.h"
+
+namespace leveldb {
+
+class Arena;
+
+// A bloom filter that keys may be added to while other threads add and
+// probe keys, for use in a memtable.  Unlike the filters built by
+// NewBloomFilterPolicy(), its size is fixed up front.  All the bits of a
+// key fall in one 64-byte cache line, so that adding or probing a key
+// touches a single line.
+class DynamicBloom {
+ public:
+  // Use about "bytes" bytes of memory from "arena", which must outlive
+  // the filter, and set "num_probes" bits per key.
+  DynamicBloom(Arena* arena, size_t bytes, int num_probes);
+
+  void Add(const Slice& key);
+
+  // Return false if "key" was never added.  May return true for a key
+  // that was never added.
+  bool MayContain(const Slice& key) const;
+
+ private:
+  enum { kLineWords = 8 };  // uint64 words per 64-byte cache line
+
+  uint32_t num_lines_;
+  const int num_probes_;
+  uint64_t* data_;
+
+  // No copying allowed
+  DynamicBloom(const DynamicBloom&);
+  void operator=(const DynamicBloom&);
+};
+
+}  // namespace leveldb
+
+#endif  // STORAGE_LEVELDB_UTIL_DYNAMIC_BLOOM_H_
@@ -0,0 +1,119 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "util/dynamic_bloom.h"
+
+#include "pebblesdb/env.h"
+#include "port/port.h"
+#include "util/arena.h"
+#include "util/coding.h"
+#include "util/mutexlock.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static Slice Key(int i, char* buffer) {
+  EncodeFixed32(buffer, i);
+  return Slice(buffer, sizeof(uint32_t));
+}
+
+class DynamicBloomTest { };
+
+TEST(DynamicBloomTest, EmptyFilter) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 1024, 6);
+  ASSERT_TRUE(!bloom.MayContain("hello"));
+  ASSERT_TRUE(!bloom.MayContain("world"));
+}
+
+TEST(DynamicBloomTest, Small) {
+  Arena arena;
+  DynamicBloom bloom(&arena, 0, 6);
+  bloom.Add("hello");
+  bloom.Add("world");
+  ASSERT_TRUE(bloom.MayContain("hello"));
+  ASSERT_TRUE(bloom.MayContain("world"));
+  ASSERT_TRUE(!bloom.MayContain("x"));
+  ASSERT_TRUE(!bloom.MayContain("foo"));
+}
+
+TEST(DynamicBloomTest, FalsePositiveRate) {
+  char buffer[sizeof(int)];
+  for (int length = 100; length <= 100000; length *= 10) {
+    // 10 bits per key
+    Arena arena;
+    DynamicBloom bloom(&arena, length * 10 / 8, 6);
+    for (int i = 0; i < length; i++) {
+      bloom.Add(Key(i, buffer));
+    }
+    for (int i = 0; i < length; i++) {
+      ASSERT_TRUE(bloom.MayContain(Key(i, buffer))) << length << " " << i;
+    }
+    int false_positives = 0;
+    for (int i = 0; i < 10000; i++) {
+      false_positives += bloom.MayContain(Key(i + 1000000000, buffer));
+    }
+    // Blocking costs a little over the 1% of a standard filter
+    ASSERT_LE(false_positives, 300) << length;
+  }
+}
+
+namespace {
+struct AddState {
+  DynamicBloom* bloom;
+  port::Mutex mu;
+  int next_thread;
+  int done;
+};
+
+const int kThreads = 4;
+const int kKeysPerThread = 20000;
+
+void AddThread(void* arg) {
+  AddState* state = reinterpret_cast<AddState*>(arg);
+  int id;
+  {
+    MutexLock l(&state->mu);
+    id = state->next_thread++;
+  }
+  char buffer[sizeof(int)];
+  for (int i = id; i < kThreads * kKeysPerThread; i += kThreads) {
+    state->bloom->Add(Key(i, buffer));
+  }
+  MutexLock l(&state->mu);
+  state->done++;
+}
+}  // namespace
+
+TEST(DynamicBloomTest, ConcurrentAdd) {
+  Arena arena;
+  // Small enough that the threads often set bits in the same words
+  DynamicBloom bloom(&arena, kThreads * kKeysPerThread / 8, 6);
+  AddState state;
+  state.bloom = &bloom;
+  state.next_thread = 0;
+  state.done = 0;
+  for (int i = 0; i < kThreads; i++) {
+    Env::Default()->StartThread(&AddThread, &state);
+  }
+  while (true) {
+    {
+      MutexLock l(&state.mu);
+      if (state.done == kThreads) {
+        break;
+      }
+    }
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+  char buffer[sizeof(int)];
+  for (int i = 0; i < kThreads * kKeysPerThread; i++) {
+    ASSERT_TRUE(bloom.MayContain(Key(i, buffer))) << i;
+  }
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
@@ -9,6 +9,34 @@ namespace leveldb {
 Env::~Env() {
 }
 
+Status Env::NewWritableFile(const std::string& fname,
+                            const FileOptions& file_options,
+                            WritableFile** result) {
+  return NewWritableFile(fname, result);
+}
+
+Status Env::NewConcurrentWritableFile(const std::string& fname,
+                                      const FileOptions& file_options,
+                                      ConcurrentWritableFile** result) {
+  return NewConcurrentWritableFile(fname, result);
+}
+
+Status Env::ReuseConcurrentWritableFile(const std::string& fname,
+                                        const std::string& old_fname,
+                                        const FileOptions& file_options,
+                                        ConcurrentWritableFile** result) {
+  Status s = RenameFile(old_fname, fname);
+  if (!s.ok()) {
+    *result = NULL;
+    return s;
+  }
+  return NewConcurrentWritableFile(fname, file_options, result);
+}
+
+Status Env::SyncDir(const std::string& dirname) {
+  return Status::OK();
+}
+
 SequentialFile::~SequentialFile() {
 }
 
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file. See the AUTHORS file for names of contributors.
 
+#include <algorithm>
 #include <cstddef>
 #include <deque>
 #include <memory>
@@ -42,6 +43,15 @@ static Status IOError(const std::string& context, int err_number) {
     return ((x + y - 1) / y) * y;
   }
 
+// Start writeback of [offset, offset + n) of the file without waiting for
+// it, so dirty pages go out steadily instead of in one burst at Sync().
+// A no-op where the platform offers no way to do so.
+static void RangeSync(int fd, uint64_t offset, uint64_t n) {
+#if defined(OS_LINUX)
+  sync_file_range(fd, offset, n, SYNC_FILE_RANGE_WRITE);
+#endif
+}
+
 class PosixSequentialFile: public SequentialFile {
  private:
   PosixSequentialFile(const PosixSequentialFile&);
@@ -221,10 +231,15 @@ class PosixWritableFile : public WritableFile {
   PosixWritableFile& operator = (const PosixWritableFile&);
   std::string filename_;
   FILE* file_;
+  const uint64_t bytes_per_sync_;  // 0 to leave writeback to Sync()
+  uint64_t written_;               // Bytes appended so far
+  uint64_t synced_;                // Bytes handed to RangeSync
 
  public:
-  PosixWritableFile(const std::string& fname, FILE* f)
-      : filename_(fname), file_(f) { }
+  PosixWritableFile(const std::string& fname, FILE* f,
+                    uint64_t bytes_per_sync = 0)
+      : filename_(fname), file_(f), bytes_per_sync_(bytes_per_sync),
+        written_(0), synced_(0) { }
 
   ~PosixWritableFile() {
     if (file_ != NULL) {
@@ -238,6 +253,14 @@ class PosixWritableFile : public WritableFile {
     if (r != data.size()) {
       return IOError(filename_, errno);
     }
+    written_ += r;
+    if (bytes_per_sync_ > 0 && written_ - synced_ >= bytes_per_sync_) {
+      if (fflush_unlocked(file_) != 0) {
+        return IOError(filename_, errno);
+      }
+      RangeSync(fileno(file_), synced_, written_ - synced_);
+      synced_ = written_;
+    }
     return Status::OK();
   }
 
@@ -298,6 +321,150 @@ class PosixWritableFile : public WritableFile {
   }
 };
 
+// Writes through a large buffer aligned for O_DIRECT.  Data reaches the
+// file only when the buffer fills, on Sync() and on Close(); Flush() does
+// nothing, since table files are not read until they have been closed.
+// With O_DIRECT the partial block at the end of the buffer is written out
+// padded and rewritten by the next write, and the file is truncated to its
+// real size.  Without O_DIRECT written data is handed to writeback every
+// bytes_per_sync bytes (every buffer by default), rather than leaving the
+// whole file dirty until Sync().
+class PosixAlignedWritableFile : public WritableFile {
+ private:
+  PosixAlignedWritableFile(const PosixAlignedWritableFile&);
+  PosixAlignedWritableFile& operator = (const PosixAlignedWritableFile&);
+  std::string filename_;
+  int fd_;
+  const bool direct_;        // fd_ was opened with O_DIRECT
+  const uint64_t bytes_per_sync_;
+  uint64_t synced_;          // Bytes handed to RangeSync
+  uint64_t preallocated_;    // Bytes reserved with fallocate
+  char* buf_;                // kBufferSize bytes, aligned to kDefaultPageSize
+  size_t pos_;               // Bytes of buf_ in use
+  uint64_t file_offset_;     // Offset in the file of buf_[0]
+
+  uint64_t FileSize() const { return file_offset_ + pos_; }
+
+  Status WriteBuffer() {
+    size_t n = pos_;
+    if (direct_) {
+      n = Roundup(pos_, kDefaultPageSize);
+      memset(buf_ + pos_, 0, n - pos_);
+    }
+    const char* src = buf_;
+    uint64_t offset = file_offset_;
+    while (n > 0) {
+      ssize_t r = pwrite(fd_, src, n, static_cast<off_t>(offset));
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+        return IOError(filename_, errno);
+      }
+      src += r;
+      offset += r;
+      n -= r;
+    }
+    if (!direct_ && file_offset_ + pos_ - synced_ >= bytes_per_sync_) {
+      RangeSync(fd_, synced_, file_offset_ + pos_ - synced_);
+      synced_ = file_offset_ + pos_;
+    }
+    // Keep the partial block so that it is rewritten in full next time
+    const size_t keep = direct_ ? pos_ % kDefaultPageSize : 0;
+    memmove(buf_, buf_ + pos_ - keep, keep);
+    file_offset_ += pos_ - keep;
+    pos_ = keep;
+    return Status::OK();
+  }
+
+  // Write out the buffer and drop any padding past the end of the data
+  Status WriteAll() {
+    Status s;
+    if (pos_ > 0) {
+      s = WriteBuffer();
+      if (s.ok() && direct_ && ftruncate(fd_, FileSize()) != 0) {
+        s = IOError(filename_, errno);
+      }
+    }
+    return s;
+  }
+
+ public:
+  static const size_t kBufferSize = 1 << 20;
+
+  // Takes ownership of "buf", which must hold kBufferSize bytes aligned
+  // to kDefaultPageSize.
+  PosixAlignedWritableFile(const std::string& fname, int fd, bool direct,
+                           char* buf, uint64_t preallocation_size,
+                           uint64_t bytes_per_sync)
+      : filename_(fname), fd_(fd), direct_(direct),
+        bytes_per_sync_(bytes_per_sync > 0 ? bytes_per_sync : kBufferSize),
+        synced_(0), preallocated_(0),
+        buf_(buf), pos_(0), file_offset_(0) {
+#if defined(OS_LINUX)
+    if (preallocation_size > 0 &&
+        fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, preallocation_size) == 0) {
+      preallocated_ = preallocation_size;
+    }
+#endif
+  }
+
+  ~PosixAlignedWritableFile() {
+    if (fd_ >= 0) {
+      // Ignoring any potential errors
+      Close();
+    }
+    free(buf_);
+  }
+
+  virtual Status Append(const Slice& data) {
+    const char* src = data.data();
+    size_t left = data.size();
+    while (left > 0) {
+      const size_t n = std::min(left, kBufferSize - pos_);
+      memcpy(buf_ + pos_, src, n);
+      pos_ += n;
+      src += n;
+      left -= n;
+      if (pos_ == kBufferSize) {
+        Status s = WriteBuffer();
+        if (!s.ok()) {
+          return s;
+        }
+      }
+    }
+    return Status::OK();
+  }
+
+  virtual Status Close() {
+    Status s = WriteAll();
+#if defined(OS_LINUX)
+    // Give back the reserved space the file did not grow into
+    if (preallocated_ > FileSize()) {
+      fallocate(fd_, FALLOC_FL_KEEP_SIZE | FALLOC_FL_PUNCH_HOLE,
+                FileSize(), preallocated_ - FileSize());
+    }
+#endif
+    if (close(fd_) != 0 && s.ok()) {
+      s = IOError(filename_, errno);
+    }
+    fd_ = -1;
+    return s;
+  }
+
+  virtual Status Flush() {
+    return Status::OK();
+  }
+
+  virtual Status Sync() {
+    Status s = WriteAll();
+    if (s.ok() && fdatasync(fd_) != 0) {
+      s = IOError(filename_, errno);
+    }
+    return s;
+  }
+};
+
 // We preallocate up to an extra megabyte and use memcpy to append new
 // data to the file.  This is safe since we either properly close the
 // file before reading from it, or for log files, the reading code
@@ -312,7 +479,8 @@ class PosixMmapFile : public ConcurrentWritableFile {
 
   std::string filename_;    // Path to the file
   int fd_;                  // The open file
-  const size_t block_size_; // System page size
+  const size_t page_size_;  // System page size
+  const size_t block_size_; // Size of each mmap'ed segment
   uint64_t end_offset_;     // Where does the file end?
   MmapSegment* segments_;   // mmap'ed regions of memory
   size_t segments_sz_;      // number of segments that are truncated
@@ -320,6 +488,9 @@ class PosixMmapFile : public ConcurrentWritableFile {
   uint64_t trunc_waiters_;  // number of threads waiting for truncate
   port::Mutex mtx_;         // Protection for state
   port::CondVar cnd_;       // Wait for truncate
+  const uint64_t bytes_per_sync_; // 0 to leave writeback to Sync()
+  uint64_t synced_;         // Bytes handed to writeback
+  uint64_t file_size_;      // Size of the file on disk
 
   bool GrowViaTruncate(uint64_t block) {
     mtx_.Lock();
@@ -335,8 +506,13 @@ class PosixMmapFile : public ConcurrentWritableFile {
     bool error = false;
     if (cur_sz <= block) {
       uint64_t new_sz = ((block + 7) & ~7ULL) + 1;
-      if (ftruncate(fd_, new_sz * block_size_) < 0) {
-        error = true;
+      // Never shrink a reused file; its blocks are already allocated
+      if (new_sz * block_size_ > file_size_) {
+        if (ftruncate(fd_, new_sz * block_size_) < 0) {
+          error = true;
+        } else {
+          file_size_ = new_sz * block_size_;
+        }
       }
       MmapSegment* new_segs = new MmapSegment[new_sz];
       MmapSegment* old_segs = NULL;
@@ -362,6 +538,41 @@ class PosixMmapFile : public ConcurrentWritableFile {
     return munmap(base, block_size_) >= 0;
   }
 
+  // Hand every whole bytes_per_sync_ chunk before "end" that has not been
+  // handed out yet to writeback.  Writes to the chunk still in progress
+  // elsewhere are simply picked up by the next Sync().
+  void MaybeRangeSync(uint64_t end) {
+    const uint64_t sync_to = end - end % bytes_per_sync_;
+    mtx_.Lock();
+    const uint64_t start = synced_;
+    const int fd = fd_;
+    const bool claimed = fd >= 0 && sync_to > synced_;
+    if (claimed) {
+      synced_ = sync_to;
+    }
+    mtx_.Unlock();
+    if (!claimed) {
+      return;
+    }
+#if defined(OS_LINUX)
+    RangeSync(fd, start, sync_to - start);
+#else
+    // Without sync_file_range, flush the segments that were completed
+    for (uint64_t block = start / block_size_;
+         block < sync_to / block_size_; ++block) {
+      char* base = NULL;
+      mtx_.Lock();
+      if (block < segments_sz_) {
+        base = segments_[block].base_;
+      }
+      mtx_.Unlock();
+      if (base != NULL) {
+        msync(base, block_size_, MS_ASYNC);
+      }
+    }
+#endif
+  }
+
   // Call holding mtx_
   char* GetSegment(uint64_t block) {
     char* base = NULL;
@@ -406,9 +617,11 @@ class PosixMmapFile : public ConcurrentWritableFile {
   }
 
  public:
-  PosixMmapFile(const std::string& fname, int fd, size_t page_size)
+  PosixMmapFile(const std::string& fname, int fd, size_t page_size,
+                uint64_t bytes_per_sync = 0, uint64_t file_size = 0)
       : filename_(fname),
         fd_(fd),
+        page_size_(page_size),
         block_size_(Roundup(page_size, 262144)),
         end_offset_(0),
         segments_(NULL),
@@ -416,7 +629,10 @@ class PosixMmapFile : public ConcurrentWritableFile {
         trunc_in_progress_(false),
         trunc_waiters_(0),
         mtx_(),
-        cnd_(&mtx_) {
+        cnd_(&mtx_),
+        bytes_per_sync_(bytes_per_sync),
+        synced_(0),
+        file_size_(file_size) {
     assert((page_size & (page_size - 1)) == 0);
   }
 
@@ -424,6 +640,28 @@ class PosixMmapFile : public ConcurrentWritableFile {
     PosixMmapFile::Close();
   }
 
+  // Map the segments that hold the first "size" bytes and fault in their
+  // pages, so that the writes filling them later neither wait on the
+  // filesystem to grow the file nor take page faults.
+  Status Preallocate(uint64_t size) {
+    const uint64_t blocks = (size + block_size_ - 1) / block_size_;
+#if defined(OS_LINUX)
+    // Best effort; the pages are faulted in either way
+    fallocate(fd_, FALLOC_FL_KEEP_SIZE, 0, blocks * block_size_);
+#endif
+    for (uint64_t block = 0; block < blocks; ++block) {
+      char* base = GetSegment(block);
+      if (!base) {
+        return IOError(filename_, errno);
+      }
+      const volatile char* page = base;
+      for (size_t off = 0; off < block_size_; off += page_size_) {
+        page[off];
+      }
+    }
+    return Status::OK();
+  }
+
   virtual Status WriteAt(uint64_t offset, const Slice& data) {
     const uint64_t end = offset + data.size();
     const char* src = data.data();
@@ -445,6 +683,9 @@ class PosixMmapFile : public ConcurrentWritableFile {
       src += n;
       offset += n;
     }
+    if (bytes_per_sync_ > 0) {
+      MaybeRangeSync(end);
+    }
     return Status::OK();
   }
 
@@ -657,28 +898,94 @@ class PosixEnv : public Env {
 
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) {
-    Status s;
-    FILE* f = fopen(fname.c_str(), "w");
-    if (f == NULL) {
+    return NewWritableFile(fname, FileOptions(), result);
+  }
+
+  virtual Status NewWritableFile(const std::string& fname,
+                                 const FileOptions& file_options,
+                                 WritableFile** result) {
+    if (!file_options.use_direct_writes) {
+      FILE* f = fopen(fname.c_str(), "w");
+      if (f == NULL) {
+        *result = NULL;
+        return IOError(fname, errno);
+      }
+      *result = new PosixWritableFile(fname, f, file_options.bytes_per_sync);
+      return Status::OK();
+    }
+    const int flags = O_CREAT | O_WRONLY | O_TRUNC;
+    bool direct = false;
+    int fd = -1;
+#if !defined(OS_MACOSX)
+    fd = open(fname.c_str(), flags | O_DIRECT, 0644);
+    direct = fd >= 0;
+    if (fd < 0 && errno == EINVAL) {
+      // The file system does not support O_DIRECT
+      fd = open(fname.c_str(), flags, 0644);
+    }
+#else
+    fd = open(fname.c_str(), flags, 0644);
+    if (fd >= 0 && fcntl(fd, F_NOCACHE, 1) == -1) {
+      close(fd);
       *result = NULL;
-      s = IOError(fname, errno);
-    } else {
-      *result = new PosixWritableFile(fname, f);
+      return IOError("while fcntl NoCache", errno);
     }
-    return s;
+#endif
+    if (fd < 0) {
+      *result = NULL;
+      return IOError(fname, errno);
+    }
+    // O_DIRECT writes must come from an aligned buffer
+    void* buf = NULL;
+    const int err = posix_memalign(&buf, kDefaultPageSize,
+                                   PosixAlignedWritableFile::kBufferSize);
+    if (err != 0) {
+      close(fd);
+      *result = NULL;
+      return IOError(fname, err);
+    }
+    *result = new PosixAlignedWritableFile(fname, fd, direct,
+                                           reinterpret_cast<char*>(buf),
+                                           file_options.preallocation_size,
+                                           file_options.bytes_per_sync);
+    return Status::OK();
   }
 
   virtual Status NewConcurrentWritableFile(const std::string& fname,
                                            ConcurrentWritableFile** result) {
-    Status s;
+    return NewConcurrentWritableFile(fname, FileOptions(), result);
+  }
+
+  virtual Status NewConcurrentWritableFile(const std::string& fname,
+                                           const FileOptions& file_options,
+                                           ConcurrentWritableFile** result) {
     const int fd = open(fname.c_str(), O_CREAT | O_RDWR | O_TRUNC, 0644);
     if (fd < 0) {
       *result = NULL;
-      s = IOError(fname, errno);
-    } else {
-      *result = new PosixMmapFile(fname, fd, page_size_);
+      return IOError(fname, errno);
     }
-    return s;
+    return NewMmapFile(fname, fd, 0, file_options, result);
+  }
+
+  virtual Status ReuseConcurrentWritableFile(const std::string& fname,
+                                             const std::string& old_fname,
+                                             const FileOptions& file_options,
+                                             ConcurrentWritableFile** result) {
+    *result = NULL;
+    if (rename(old_fname.c_str(), fname.c_str()) != 0) {
+      return IOError(old_fname, errno);
+    }
+    const int fd = open(fname.c_str(), O_RDWR);
+    if (fd < 0) {
+      return IOError(fname, errno);
+    }
+    struct stat sbuf;
+    if (fstat(fd, &sbuf) != 0) {
+      Status s = IOError(fname, errno);
+      close(fd);
+      return s;
+    }
+    return NewMmapFile(fname, fd, sbuf.st_size, file_options, result);
   }
 
   virtual bool FileExists(const std::string& fname) {
@@ -792,6 +1099,20 @@ class PosixEnv : public Env {
     return result;
   }
 
+  virtual Status SyncDir(const std::string& dirname) {
+    Status result;
+    int fd = open(dirname.c_str(), O_RDONLY);
+    if (fd < 0) {
+      result = IOError(dirname, errno);
+    } else {
+      if (fsync(fd) < 0) {
+        result = IOError(dirname, errno);
+      }
+      close(fd);
+    }
+    return result;
+  }
+
   virtual Status LockFile(const std::string& fname, FileLock** lock) {
     *lock = NULL;
     Status result;
@@ -889,6 +1210,26 @@ class PosixEnv : public Env {
     }
   }
 
+  // Wrap "fd", which holds "file_size" bytes, for concurrent writes and
+  // preallocate it as "file_options" asks.  Takes ownership of "fd".
+  Status NewMmapFile(const std::string& fname, int fd, uint64_t file_size,
+                     const FileOptions& file_options,
+                     ConcurrentWritableFile** result) {
+    PosixMmapFile* file = new PosixMmapFile(fname, fd, page_size_,
+                                            file_options.bytes_per_sync,
+                                            file_size);
+    if (file_options.preallocation_size > 0) {
+      Status s = file->Preallocate(file_options.preallocation_size);
+      if (!s.ok()) {
+        delete file;
+        *result = NULL;
+        return s;
+      }
+    }
+    *result = file;
+    return Status::OK();
+  }
+
   // BGThread() is the body of the background thread
   void BGThread();
   static void* BGThreadWrapper(void* arg) {
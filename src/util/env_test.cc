@@ -97,6 +97,72 @@ TEST(EnvPosixTest, StartThread) {
   ASSERT_EQ(state.val, 3);
 }
 
+TEST(EnvPosixTest, AlignedWritableFile) {
+  const std::string fname = test::TmpDir() + "/aligned_writable_file";
+  FileOptions file_options;
+  file_options.use_direct_writes = true;
+  file_options.preallocation_size = 8 << 20;
+  WritableFile* file;
+  ASSERT_OK(env_->NewWritableFile(fname, file_options, &file));
+
+  // Appends of odd sizes cross block and buffer boundaries, and the Sync
+  // in the middle leaves a partial block that is written again later
+  std::string expected;
+  for (int i = 0; i < 300; i++) {
+    std::string piece(i * 37 % 10007 + 1, static_cast<char>('a' + i % 26));
+    ASSERT_OK(file->Append(piece));
+    expected += piece;
+    if (i == 150) {
+      ASSERT_OK(file->Flush());
+      ASSERT_OK(file->Sync());
+    }
+  }
+  ASSERT_OK(file->Sync());
+  ASSERT_OK(file->Close());
+  delete file;
+
+  uint64_t size;
+  ASSERT_OK(env_->GetFileSize(fname, &size));
+  ASSERT_EQ(expected.size(), size);
+  std::string contents;
+  ASSERT_OK(ReadFileToString(env_, fname, &contents));
+  ASSERT_TRUE(contents == expected);
+  ASSERT_OK(env_->DeleteFile(fname));
+}
+
+TEST(EnvPosixTest, BytesPerSync) {
+  const std::string fname = test::TmpDir() + "/bytes_per_sync";
+  FileOptions file_options;
+  file_options.bytes_per_sync = 4096;
+  std::string expected;
+  for (int i = 0; i < 200; i++) {
+    expected.append(i * 37 % 1009 + 1, static_cast<char>('a' + i % 26));
+  }
+
+  // Both the table and the log file writers start writeback as they go
+  for (int concurrent = 0; concurrent < 2; concurrent++) {
+    WritableFile* file;
+    ConcurrentWritableFile* cfile;
+    if (concurrent) {
+      ASSERT_OK(env_->NewConcurrentWritableFile(fname, file_options, &cfile));
+      file = cfile;
+    } else {
+      ASSERT_OK(env_->NewWritableFile(fname, file_options, &file));
+    }
+    for (size_t pos = 0; pos < expected.size(); pos += 1000) {
+      ASSERT_OK(file->Append(expected.substr(pos, 1000)));
+    }
+    ASSERT_OK(file->Sync());
+    ASSERT_OK(file->Close());
+    delete file;
+
+    std::string contents;
+    ASSERT_OK(ReadFileToString(env_, fname, &contents));
+    ASSERT_TRUE(contents == expected);
+    ASSERT_OK(env_->DeleteFile(fname));
+  }
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
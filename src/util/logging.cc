@@ -53,6 +53,24 @@ std::string EscapeString(const Slice& value) {
   return r;
 }
 
+std::string JsonEscapeString(const Slice& value) {
+  std::string r;
+  for (size_t i = 0; i < value.size(); i++) {
+    unsigned char c = value[i];
+    if (c == '"' || c == '\\') {
+      r.push_back('\\');
+      r.push_back(c);
+    } else if (c < ' ' || c > '~') {
+      char buf[10];
+      snprintf(buf, sizeof(buf), "\\u%04x", static_cast<unsigned int>(c));
+      r.append(buf);
+    } else {
+      r.push_back(c);
+    }
+  }
+  return r;
+}
+
 bool ConsumeChar(Slice* in, char c) {
   if (!in->empty() && (*in)[0] == c) {
     in->remove_prefix(1);
@@ -35,6 +35,11 @@ extern std::string NumberToString(uint64_t num);
 // Escapes any non-printable characters found in "value".
 extern std::string EscapeString(const Slice& value);
 
+// Return "value" escaped for use inside a JSON string: quotes and
+// backslashes are backslash-escaped and any other byte outside the
+// printable ASCII range becomes a \u00XX escape.
+extern std::string JsonEscapeString(const Slice& value);
+
 // If *in starts with "c", advances *in past the first character and
 // returns true.  Otherwise, returns false.
 extern bool ConsumeChar(Slice* in, char c);
@@ -11,20 +11,32 @@ namespace leveldb {
 
 Options::Options()
     : comparator(BytewiseComparator()),
+      key_num_extractor(NULL),
       create_if_missing(false),
       error_if_exists(false),
       paranoid_checks(false),
       env(Env::Default()),
       info_log(NULL),
       write_buffer_size(4<<20),
+      memtable_bloom_size_ratio(0),
       max_open_files(1000),
       block_cache(NULL),
+      secondary_cache(NULL),
+      row_cache_size(0),
       block_size(4096),
       block_restart_interval(16),
+      block_key_nums(false),
       compression(kNoCompression),
       filter_policy(NULL),
+      read_compaction_bytes_per_sec(4 << 20),
       manual_garbage_collection(false),
-      use_direct_reads(false) {
+      use_direct_reads(false),
+      use_direct_io_for_flush_and_compaction(false),
+      bytes_per_sync(0),
+      wal_bytes_per_sync(0),
+      recycle_log_file_num(0),
+      preallocate_next_log(false),
+      wal_compression(kNoCompression) {
 }
 
 
@@ -0,0 +1,401 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+//
+// A SecondaryCache that appends entries to segment files.  Entries are
+// first appended to an in-memory buffer for the active segment.  Once the
+// buffer is full a background task writes it out as a segment file and
+// later entries are read back from that file.  When the segments exceed
+// the capacity the oldest one is deleted together with the index entries
+// that point into it, so eviction is FIFO at segment granularity.
+
+#include <assert.h>
+#include <stdio.h>
+#include <algorithm>
+#include <deque>
+#include <unordered_map>
+#include <vector>
+
+#include "pebblesdb/cache.h"
+#include "pebblesdb/env.h"
+#include "port/port.h"
+#include "util/atomic.h"
+#include "util/crc32c.h"
+#include "util/mutexlock.h"
+
+namespace leveldb {
+
+SecondaryCache::~SecondaryCache() {
+}
+
+namespace {
+
+static const size_t kMaxSegmentSize = 4 << 20;
+static const char kSegmentSuffix[] = ".seg";
+
+struct Segment {
+  explicit Segment(uint64_t n)
+    : number(n), refs(1), file(NULL), buffer(), items() {
+  }
+
+  struct Item {
+    std::string key;
+    uint64_t offset;
+    uint32_t size;
+    uint32_t crc;  // Set once the segment has been written out
+  };
+
+  uint64_t number;
+  int refs;
+  RandomAccessFile* file;   // NULL until the segment has been written out
+  std::string buffer;       // Contents until the segment has been written out
+  std::vector<Item> items;  // Entries appended here, in order
+
+ private:
+  // No copying allowed
+  Segment(const Segment&);
+  void operator=(const Segment&);
+};
+
+struct IndexEntry {
+  Segment* segment;
+  size_t item;
+};
+
+class FileSecondaryCache : public SecondaryCache {
+ public:
+  FileSecondaryCache(Env* env, const std::string& dirname, size_t capacity)
+    : env_(env),
+      dirname_(dirname),
+      segment_size_(std::max<size_t>(1, std::min(kMaxSegmentSize,
+                                                 capacity / 4))),
+      max_sealed_(std::max<size_t>(2, capacity / segment_size_) - 1),
+      mutex_(),
+      bg_cv_(&mutex_),
+      bg_scheduled_(false),
+      shutting_down_(false),
+      next_number_(1),
+      active_(new Segment(next_number_++)),
+      writing_(NULL),
+      unwritten_(),
+      sealed_(),
+      obsolete_(),
+      index_(),
+      last_id_(0),
+      hits_(0),
+      misses_(0) {
+  }
+
+  virtual ~FileSecondaryCache() {
+    {
+      MutexLock l(&mutex_);
+      shutting_down_ = true;
+      while (bg_scheduled_) {
+        bg_cv_.Wait();
+      }
+    }
+    while (!sealed_.empty()) {
+      Unref(sealed_.front());
+      sealed_.pop_front();
+    }
+    while (!unwritten_.empty()) {
+      Unref(unwritten_.front());
+      unwritten_.pop_front();
+    }
+    Unref(active_);
+    DeleteObsolete(&obsolete_);
+  }
+
+  // Called from the deleter of the primary cache, so this only copies the
+  // entry into the active segment.  Writing out full segments, computing
+  // their checksums and removing evicted ones is left to the background.
+  virtual void Insert(const Slice& key, const Slice& contents) {
+    if (contents.size() > segment_size_) {
+      return;
+    }
+    MutexLock l(&mutex_);
+    if (active_->buffer.size() + contents.size() > segment_size_) {
+      unwritten_.push_back(active_);
+      active_ = new Segment(next_number_++);
+      EvictOldest();
+      MaybeScheduleWork();
+    }
+    Segment::Item item;
+    item.key = key.ToString();
+    item.offset = active_->buffer.size();
+    item.size = contents.size();
+    item.crc = 0;
+    active_->buffer.append(contents.data(), contents.size());
+    active_->items.push_back(item);
+    IndexEntry e;
+    e.segment = active_;
+    e.item = active_->items.size() - 1;
+    index_[item.key] = e;
+  }
+
+  virtual bool Lookup(const Slice& key, std::string* contents) {
+    IndexEntry e;
+    uint64_t offset;
+    uint32_t size, crc;
+    {
+      MutexLock l(&mutex_);
+      Index::iterator it = index_.find(key.ToString());
+      if (it == index_.end()) {
+        atomic::increment_64_nobarrier(&misses_, 1);
+        return false;
+      }
+      e = it->second;
+      const Segment::Item& item = e.segment->items[e.item];
+      offset = item.offset;
+      size = item.size;
+      crc = item.crc;
+      if (e.segment->file == NULL) {
+        contents->assign(e.segment->buffer.data() + offset, size);
+        atomic::increment_64_nobarrier(&hits_, 1);
+        return true;
+      }
+      // Keep the segment file open while it is read without the lock
+      e.segment->refs++;
+    }
+
+    contents->resize(size);
+    Slice result;
+    Status s = e.segment->file->Read(offset, size, &result,
+                                     size > 0 ? &(*contents)[0] : NULL);
+    bool found = s.ok() && result.size() == size &&
+                 crc32c::Value(result.data(), result.size()) == crc;
+    if (found && result.data() != contents->data()) {
+      contents->assign(result.data(), result.size());
+    }
+
+    MutexLock l(&mutex_);
+    if (!found) {
+      // Drop the damaged entry unless it was replaced in the meantime
+      Index::iterator it = index_.find(key.ToString());
+      if (it != index_.end() && it->second.segment == e.segment &&
+          it->second.item == e.item) {
+        index_.erase(it);
+      }
+    }
+    Unref(e.segment);
+    atomic::increment_64_nobarrier(found ? &hits_ : &misses_, 1);
+    return found;
+  }
+
+  virtual uint64_t NewId() {
+    MutexLock l(&mutex_);
+    return ++last_id_;
+  }
+
+  virtual uint64_t Hits() const {
+    return atomic::load_64_nobarrier(&hits_);
+  }
+
+  virtual uint64_t Misses() const {
+    return atomic::load_64_nobarrier(&misses_);
+  }
+
+ private:
+  typedef std::unordered_map<std::string, IndexEntry> Index;
+
+  std::string SegmentFileName(uint64_t number) const {
+    char buf[100];
+    snprintf(buf, sizeof(buf), "/%06llu%s",
+             static_cast<unsigned long long>(number), kSegmentSuffix);
+    return dirname_ + buf;
+  }
+
+  // REQUIRES: mutex_ held
+  void MaybeScheduleWork() {
+    if (!bg_scheduled_ && !shutting_down_ &&
+        (!unwritten_.empty() || !obsolete_.empty())) {
+      bg_scheduled_ = true;
+      env_->Schedule(&FileSecondaryCache::BGWork, this);
+    }
+  }
+
+  static void BGWork(void* cache) {
+    reinterpret_cast<FileSecondaryCache*>(cache)->BackgroundCall();
+  }
+
+  // Write out full segments and remove the files of evicted ones, without
+  // holding mutex_ during any file operation.  Unwritten segments are
+  // served from their buffers in the meantime.
+  void BackgroundCall() {
+    MutexLock l(&mutex_);
+    while (!shutting_down_ && (!unwritten_.empty() || !obsolete_.empty())) {
+      std::vector<Segment*> obsolete;
+      obsolete.swap(obsolete_);
+      Segment* seg = NULL;
+      if (!unwritten_.empty()) {
+        seg = unwritten_.front();
+        unwritten_.pop_front();
+        writing_ = seg;
+      }
+
+      mutex_.Unlock();
+      DeleteObsolete(&obsolete);
+      RandomAccessFile* file = NULL;
+      std::vector<uint32_t> crcs;
+      Status s;
+      if (seg != NULL) {
+        s = WriteSegment(seg, &file, &crcs);
+      }
+      mutex_.Lock();
+
+      if (seg != NULL) {
+        writing_ = NULL;
+        if (s.ok()) {
+          for (size_t i = 0; i < crcs.size(); i++) {
+            seg->items[i].crc = crcs[i];
+          }
+          seg->file = file;
+          std::string().swap(seg->buffer);
+          sealed_.push_back(seg);
+        } else {
+          Drop(seg);
+        }
+        EvictOldest();
+      }
+    }
+    bg_scheduled_ = false;
+    bg_cv_.SignalAll();
+  }
+
+  // Write the buffer of "seg" to its file, open it for reading in *file
+  // and store the checksum of each of its entries in *crcs.
+  // REQUIRES: seg == writing_, mutex_ not held
+  Status WriteSegment(Segment* seg, RandomAccessFile** file,
+                      std::vector<uint32_t>* crcs) {
+    for (size_t i = 0; i < seg->items.size(); i++) {
+      const Segment::Item& item = seg->items[i];
+      crcs->push_back(crc32c::Value(seg->buffer.data() + item.offset,
+                                    item.size));
+    }
+    const std::string fname = SegmentFileName(seg->number);
+    WritableFile* out = NULL;
+    Status s = env_->NewWritableFile(fname, &out);
+    if (s.ok()) {
+      s = out->Append(seg->buffer);
+      if (s.ok()) {
+        s = out->Close();
+      }
+      delete out;
+    }
+    if (s.ok()) {
+      s = env_->NewRandomAccessFile(fname, FileOptions(), file);
+    }
+    if (!s.ok()) {
+      env_->DeleteFile(fname);
+    }
+    return s;
+  }
+
+  // Drop the oldest segments while there are more than fit in the
+  // capacity, preferring ones that have already been written out.
+  // REQUIRES: mutex_ held
+  void EvictOldest() {
+    while (sealed_.size() + unwritten_.size() +
+           (writing_ != NULL ? 1 : 0) > max_sealed_) {
+      if (!sealed_.empty()) {
+        Drop(sealed_.front());
+        sealed_.pop_front();
+      } else if (!unwritten_.empty()) {
+        Drop(unwritten_.front());
+        unwritten_.pop_front();
+      } else {
+        break;
+      }
+    }
+  }
+
+  // Remove the index entries that still point into "seg" and release it.
+  // REQUIRES: mutex_ held
+  void Drop(Segment* seg) {
+    for (size_t i = 0; i < seg->items.size(); i++) {
+      Index::iterator it = index_.find(seg->items[i].key);
+      if (it != index_.end() && it->second.segment == seg) {
+        index_.erase(it);
+      }
+    }
+    Unref(seg);
+  }
+
+  // The file of a segment is removed by the background work, so that
+  // it is never deleted with mutex_ held.
+  // REQUIRES: mutex_ held, or no other references to "seg"
+  void Unref(Segment* seg) {
+    assert(seg->refs > 0);
+    if (--seg->refs == 0) {
+      if (seg->file != NULL) {
+        obsolete_.push_back(seg);
+        MaybeScheduleWork();
+      } else {
+        delete seg;
+      }
+    }
+  }
+
+  // REQUIRES: mutex_ not held
+  void DeleteObsolete(std::vector<Segment*>* obsolete) {
+    for (size_t i = 0; i < obsolete->size(); i++) {
+      Segment* seg = (*obsolete)[i];
+      delete seg->file;
+      env_->DeleteFile(SegmentFileName(seg->number));
+      delete seg;
+    }
+    obsolete->clear();
+  }
+
+  Env* const env_;
+  const std::string dirname_;
+  const size_t segment_size_;
+  const size_t max_sealed_;
+
+  port::Mutex mutex_;
+  port::CondVar bg_cv_;          // Signalled when background work finishes
+  bool bg_scheduled_;
+  bool shutting_down_;
+  uint64_t next_number_;
+  Segment* active_;
+  Segment* writing_;                 // Being written out by the background
+  std::deque<Segment*> unwritten_;   // Full, waiting to be written out
+  std::deque<Segment*> sealed_;      // Written out, oldest first
+  std::vector<Segment*> obsolete_;   // Files waiting to be removed
+  Index index_;
+  uint64_t last_id_;
+
+  uint64_t hits_;
+  uint64_t misses_;
+
+  // No copying allowed
+  FileSecondaryCache(const FileSecondaryCache&);
+  void operator=(const FileSecondaryCache&);
+};
+
+}  // anonymous namespace
+
+Status NewFileSecondaryCache(Env* env, const std::string& dirname,
+                             size_t capacity, SecondaryCache** result) {
+  *result = NULL;
+  env->CreateDir(dirname);  // Ignore error from CreateDir
+  std::vector<std::string> children;
+  Status s = env->GetChildren(dirname, &children);
+  if (!s.ok()) {
+    return s;
+  }
+  // Segments of an earlier instance are keyed by ids that may be reused
+  const size_t suffix_len = sizeof(kSegmentSuffix) - 1;
+  for (size_t i = 0; i < children.size(); i++) {
+    const std::string& name = children[i];
+    if (name.size() > suffix_len &&
+        name.compare(name.size() - suffix_len, suffix_len,
+                     kSegmentSuffix) == 0) {
+      env->DeleteFile(dirname + "/" + name);
+    }
+  }
+  *result = new FileSecondaryCache(env, dirname, capacity);
+  return Status::OK();
+}
+
+}  // namespace leveldb
@@ -0,0 +1,163 @@
+// Copyright (c) 2011 The LevelDB Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file. See the AUTHORS file for names of contributors.
+
+#include "pebblesdb/cache.h"
+
+#include <vector>
+#include "pebblesdb/env.h"
+#include "util/coding.h"
+#include "util/testharness.h"
+
+namespace leveldb {
+
+static std::string Key(int i) {
+  char buf[sizeof(uint32_t)];
+  EncodeFixed32(buf, i);
+  return std::string(buf, sizeof(buf));
+}
+
+static std::string Value(int i, size_t len) {
+  return std::string(len, static_cast<char>('a' + i % 26));
+}
+
+class SecondaryCacheTest {
+ public:
+  Env* env_;
+  std::string dir_;
+  SecondaryCache* cache_;
+
+  SecondaryCacheTest() : env_(Env::Default()), dir_(), cache_(NULL) {
+    dir_ = test::TmpDir() + "/secondary_cache_test";
+  }
+
+  ~SecondaryCacheTest() {
+    delete cache_;
+    env_->DeleteDir(dir_);
+  }
+
+  void Open(size_t capacity) {
+    delete cache_;
+    cache_ = NULL;
+    ASSERT_OK(NewFileSecondaryCache(env_, dir_, capacity, &cache_));
+  }
+
+  int NumSegmentFiles() {
+    std::vector<std::string> children;
+    ASSERT_OK(env_->GetChildren(dir_, &children));
+    int count = 0;
+    for (size_t i = 0; i < children.size(); i++) {
+      if (children[i] != "." && children[i] != "..") {
+        count++;
+      }
+    }
+    return count;
+  }
+
+  // Segments are written out in the background, in order, so once the
+  // file of segment n+1 exists, segment n is read from its file
+  void WaitForSegmentFiles(int n) {
+    for (int i = 0; i < 10000 && NumSegmentFiles() < n; i++) {
+      env_->SleepForMicroseconds(1000);
+    }
+    ASSERT_GE(NumSegmentFiles(), n);
+  }
+
+  std::string Lookup(int i) {
+    std::string contents;
+    if (!cache_->Lookup(Key(i), &contents)) {
+      return "NOT_FOUND";
+    }
+    return contents;
+  }
+};
+
+TEST(SecondaryCacheTest, HitAndMiss) {
+  Open(1 << 20);
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+  cache_->Insert(Key(1), Value(1, 100));
+  cache_->Insert(Key(2), Value(2, 200));
+  ASSERT_EQ(Value(1, 100), Lookup(1));
+  ASSERT_EQ(Value(2, 200), Lookup(2));
+  ASSERT_EQ("NOT_FOUND", Lookup(3));
+  ASSERT_EQ(2u, cache_->Hits());
+  ASSERT_EQ(2u, cache_->Misses());
+
+  cache_->Insert(Key(1), Value(5, 50));
+  ASSERT_EQ(Value(5, 50), Lookup(1));
+}
+
+TEST(SecondaryCacheTest, ReadFromSegmentFiles) {
+  // 256KB segments, so these entries fill three sealed segments
+  Open(1 << 20);
+  const size_t len = 4096;
+  for (int i = 0; i < 200; i++) {
+    cache_->Insert(Key(i), Value(i, len));
+  }
+  WaitForSegmentFiles(3);
+  for (int i = 0; i < 200; i++) {
+    ASSERT_EQ(Value(i, len), Lookup(i)) << i;
+  }
+}
+
+TEST(SecondaryCacheTest, DamagedSegmentFile) {
+  // 256KB segments of 64 entries each
+  Open(1 << 20);
+  const size_t len = 4096;
+  for (int i = 0; i < 200; i++) {
+    cache_->Insert(Key(i), Value(i, len));
+  }
+  WaitForSegmentFiles(2);
+  ASSERT_OK(WriteStringToFile(env_, std::string(64 * len, 'x'),
+                              dir_ + "/000001.seg"));
+  ASSERT_EQ("NOT_FOUND", Lookup(0));
+  ASSERT_EQ("NOT_FOUND", Lookup(63));
+  ASSERT_EQ(Value(64, len), Lookup(64));
+  ASSERT_EQ(Value(199, len), Lookup(199));
+}
+
+TEST(SecondaryCacheTest, EvictOldestSegments) {
+  const size_t capacity = 256 << 10;
+  const size_t len = 4096;
+  const int n = 1000;
+  Open(capacity);
+  for (int i = 0; i < n; i++) {
+    cache_->Insert(Key(i), Value(i, len));
+  }
+  ASSERT_LE(NumSegmentFiles(), 4);
+
+  // Only about the newest "capacity" bytes of entries remain
+  int found = 0;
+  for (int i = 0; i < n; i++) {
+    std::string v = Lookup(i);
+    if (v != "NOT_FOUND") {
+      ASSERT_EQ(Value(i, len), v);
+      found++;
+    }
+  }
+  ASSERT_GT(found, 0);
+  ASSERT_LE(found, static_cast<int>(capacity / len));
+  ASSERT_EQ(Value(n - 1, len), Lookup(n - 1));
+  ASSERT_EQ("NOT_FOUND", Lookup(0));
+}
+
+TEST(SecondaryCacheTest, ReopenDiscardsSegments) {
+  Open(256 << 10);
+  for (int i = 0; i < 100; i++) {
+    cache_->Insert(Key(i), Value(i, 4096));
+  }
+  delete cache_;
+  cache_ = NULL;
+
+  // Leave a segment file behind as if the process had crashed
+  ASSERT_OK(WriteStringToFile(env_, "stale", dir_ + "/000001.seg"));
+  Open(256 << 10);
+  ASSERT_EQ(0, NumSegmentFiles());
+  ASSERT_EQ("NOT_FOUND", Lookup(1));
+}
+
+}  // namespace leveldb
+
+int main(int argc, char** argv) {
+  return leveldb::test::RunAllTests();
+}
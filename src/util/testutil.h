@@ -38,12 +38,18 @@ class ErrorEnv : public EnvWrapper {
 
   virtual Status NewWritableFile(const std::string& fname,
                                  WritableFile** result) {
+    return NewWritableFile(fname, FileOptions(), result);
+  }
+
+  virtual Status NewWritableFile(const std::string& fname,
+                                 const FileOptions& file_options,
+                                 WritableFile** result) {
     if (writable_file_error_) {
       ++num_writable_file_errors_;
       *result = NULL;
       return Status::IOError(fname, "fake error");
     }
-    return target()->NewWritableFile(fname, result);
+    return target()->NewWritableFile(fname, file_options, result);
   }
 };
 